@@ -149,11 +149,13 @@ class AnalogConfig : public AudioBaseInfo {
 
 
 /**
- * @brief A very fast ADC and DAC using the ESP32 I2S interface.
+ * @brief A very fast ADC and DAC using the ESP32 I2S interface. In TX_MODE the xrun statistics
+ * report the writes which arrived after the estimated fill level of the DMA buffers has dropped
+ * to 0 as late_writes.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class AnalogAudioStream  : public AudioStreamX {
+class AnalogAudioStream  : public AudioStreamX, public XRunSource {
   public:
     /// Default constructor
     AnalogAudioStream() {
@@ -281,6 +283,9 @@ class AnalogAudioStream  : public AudioStreamX {
           i2s_adc_enable(port_no); 
         } 
       }
+      int frame_size = adc_config.channels * adc_config.bits_per_sample / 8;
+      late_writes.begin(adc_config.mode == TX_MODE ? adc_config.sample_rate * frame_size : 0,
+                        adc_config.dma_buf_count * adc_config.dma_buf_len * frame_size);
       active = true;
       return true;
     }
@@ -300,6 +305,7 @@ class AnalogAudioStream  : public AudioStreamX {
         } else {
           i2s_stop(port_no);
         }
+        late_writes.end();
         active = false;   
     }
 
@@ -334,6 +340,7 @@ class AnalogAudioStream  : public AudioStreamX {
             stop();
         }
         LOGD("converted write size: %d",result);
+        if (late_writes.write(size_bytes)) xrun_stats.late_writes++;
       }
       return size_bytes;
     }   
@@ -367,6 +374,7 @@ class AnalogAudioStream  : public AudioStreamX {
     bool active = false;
     bool is_driver_installed = false;
     size_t result=0;
+    LateWriteDetector late_writes;
 
 
     // The internal DAC only supports 8 bit values - so we need to convert the data
@@ -4,6 +4,8 @@
 #include "AudioCodecs/CodecNOP.h"
 #include "AudioCodecs/CodecRAW.h"
 #include "AudioCodecs/Codec8Bit.h"
+#include "AudioCodecs/CodecSPDIF.h"
+#include "AudioCodecs/ContainerRTP.h"
 
 #if defined(USE_HELIX) || defined(USE_DECODERS)
 #include "AudioCodecs/CodecHelix.h"
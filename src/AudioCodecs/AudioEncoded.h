@@ -135,11 +135,12 @@ protected:
 
 /**
  * @brief A more natural Stream class to process encoded data (aac, wav,
- * mp3...).
+ * mp3...). Timestamps are forwarded unchanged: the latency of the decoder
+ * is not taken into account.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class EncodedAudioStream : public AudioPrint {
+class EncodedAudioStream : public AudioPrint, public TimestampForwarder {
 public:
   /// Constructor for AudioStream with automatic notification of audio changes
   EncodedAudioStream(AudioStream *outputStream, AudioDecoder *decoder) {
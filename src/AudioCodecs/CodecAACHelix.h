@@ -2,6 +2,7 @@
 
 #include "Stream.h"
 #include "AudioCodecs/AudioEncoded.h"
+#include "AudioMetaData/MetaDataFilter.h"
 #include "AACDecoderHelix.h"
 
 namespace audio_tools {
@@ -21,6 +22,7 @@ class AACDecoderHelix : public AudioDecoder  {
         AACDecoderHelix() {
             LOGD(LOG_METHOD);
             aac = new libhelix::AACDecoderHelix();
+            filter.setDecoder(aac);
             if (aac==nullptr){
                 LOGE("Not enough memory for libhelix");
             }
@@ -33,6 +35,7 @@ class AACDecoderHelix : public AudioDecoder  {
         AACDecoderHelix(Print &out_stream){
             LOGD(LOG_METHOD);
             aac = new libhelix::AACDecoderHelix(out_stream);
+            filter.setDecoder(aac);
             if (aac==nullptr){
                 LOGE("Not enough memory for libhelix");
             }
@@ -48,6 +51,7 @@ class AACDecoderHelix : public AudioDecoder  {
         AACDecoderHelix(Print &out_stream, AudioBaseInfoDependent &bi){
             LOGD(LOG_METHOD);
             aac = new libhelix::AACDecoderHelix(out_stream);
+            filter.setDecoder(aac);
             if (aac==nullptr){
                 LOGE("Not enough memory for libhelix");
             }
@@ -75,13 +79,17 @@ class AACDecoderHelix : public AudioDecoder  {
             if (aac!=nullptr) {
                 aac->setDelay(CODEC_DELAY_MS);
                 aac->begin();
+                filter.begin();
             }
         }
 
         /// Releases the reserved memory
         virtual void end(){
             LOGD(LOG_METHOD);
-            if (aac!=nullptr) aac->end();
+            if (aac!=nullptr) {
+                if (use_filter) filter.end();
+                aac->end();
+            }
         }
 
         virtual _AACFrameInfo audioInfoEx(){
@@ -99,7 +107,8 @@ class AACDecoderHelix : public AudioDecoder  {
 
         /// Write AAC data to decoder
         size_t write(const void* aac_data, size_t len) {
-            return aac==nullptr ? 0 : aac->write(aac_data, len);
+            if (aac==nullptr) return 0;
+            return use_filter ? filter.write((uint8_t*)aac_data, len) : aac->write(aac_data, len);
         }
 
         /// checks if the class is active 
@@ -129,8 +138,25 @@ class AACDecoderHelix : public AudioDecoder  {
                 audioChangeAACHelix->setAudioInfo(baseInfo);   
             }
         }
+        /// Activates a filter that makes sure that helix does not get any metadata segments
+        void setFilterMetaData(bool filter){
+            use_filter = filter;
+        }
+
+        /// Check if the metadata filter is active
+        bool isFilterMetaData() {
+            return use_filter;
+        }
+
+        /// Provides access to the metadata filter: e.g. to define the callback or the file size
+        MetaDataFilter<libhelix::AACDecoderHelix> &metaDataFilter() {
+            return filter;
+        }
+
     protected:
         libhelix::AACDecoderHelix *aac=nullptr;
+        MetaDataFilter<libhelix::AACDecoderHelix> filter;
+        bool use_filter = false;
 
 };
 
@@ -86,7 +86,10 @@ class MP3DecoderHelix : public AudioDecoder  {
         /// Releases the reserved memory
         void end(){
             LOGD(LOG_METHOD);
-            if (mp3!=nullptr) mp3->end();
+            if (mp3!=nullptr) {
+                if (use_filter) filter.end();
+                mp3->end();
+            }
         }
 
         MP3FrameInfo audioInfoEx(){
@@ -147,6 +150,11 @@ class MP3DecoderHelix : public AudioDecoder  {
             return use_filter;
         }
 
+        /// Provides access to the metadata filter: e.g. to define the callback or the file size
+        MetaDataFilter<libhelix::MP3DecoderHelix> &metaDataFilter() {
+            return filter;
+        }
+
 
     protected:
         libhelix::MP3DecoderHelix *mp3=nullptr;
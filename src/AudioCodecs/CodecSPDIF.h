@@ -0,0 +1,418 @@
+#pragma once
+
+#include "AudioCodecs/AudioEncoded.h"
+
+#ifndef SPDIF_BUFFER_FRAMES
+#define SPDIF_BUFFER_FRAMES 96  // half a block: double buffering on I2S
+#endif
+
+namespace audio_tools {
+
+/// Number of frames in a IEC 60958 block (channel status is repeated every block)
+#define SPDIF_BLOCK_FRAMES 192
+/// Number of 32 bit biphase words which represent one subframe
+#define SPDIF_WORDS_PER_SUBFRAME 2
+
+/**
+ * @brief IEC 60958 (S/PDIF) helper functions which are shared by the SPDIFEncoder
+ * and SPDIFDecoder. A subframe consists of 32 time slots: 0-3 preamble, 4-27 audio
+ * (LSB first), 28 validity, 29 user data, 30 channel status, 31 parity. Each time slot
+ * is represented by 2 biphase mark cells, so a subframe results in 64 cells = 2 words
+ * of 32 bits, where the first cell is in the most significant bit.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class SPDIFBase {
+ public:
+  /// Preamble cells (assuming that the previous cell was 0)
+  enum Preamble : uint8_t { PreambleB = 0xE8, PreambleM = 0xE2, PreambleW = 0xE4 };
+
+  /// Channel status bytes for the consumer format (24 bytes = 192 bits)
+  const uint8_t *channelStatus() { return channel_status; }
+
+ protected:
+  uint8_t channel_status[SPDIF_BLOCK_FRAMES / 8] = {0};
+
+  /// Biphase mark cells for 8 bits (bit 0 first in time = msb) when the line was low before
+  static const uint16_t *bmcTable() {
+    static uint16_t table[256];
+    static bool is_setup = false;
+    if (!is_setup) {
+      for (int value = 0; value < 256; value++) {
+        uint16_t cells = 0;
+        int level = 0;
+        for (int bit = 0; bit < 8; bit++) {
+          // every bit starts with a transition, a 1 has an additional one in the middle
+          level ^= 1;
+          cells = (cells << 1) | level;
+          if (value & (1 << bit)) level ^= 1;
+          cells = (cells << 1) | level;
+        }
+        table[value] = cells;
+      }
+      is_setup = true;
+    }
+    return table;
+  }
+
+  /// even parity over the time slots 4 - 30
+  static uint32_t parity(uint32_t value) {
+    value ^= value >> 16;
+    value ^= value >> 8;
+    value ^= value >> 4;
+    value ^= value >> 2;
+    value ^= value >> 1;
+    return value & 1;
+  }
+
+  /// Defines the consumer channel status for the indicated audio format
+  void setupChannelStatus(AudioBaseInfo info) {
+    memset(channel_status, 0, sizeof(channel_status));
+    // byte 0: consumer, linear PCM, copy permitted, no pre-emphasis
+    channel_status[0] = 0b00000100;
+    // byte 1: category general; byte 2: source and channel not indicated
+    // byte 3: sampling frequency (bits 24-27) and clock accuracy level II
+    channel_status[3] = sampleRateCode(info.sample_rate);
+    // byte 4: word length (bit 32: max 24 bits, bit 33-35: length)
+    switch (info.bits_per_sample) {
+      case 16:
+        channel_status[4] = 0b0010;
+        break;
+      case 20:
+        channel_status[4] = 0b1010;
+        break;
+      case 24:
+        channel_status[4] = 0b1011;
+        break;
+    }
+  }
+
+  /// Channel status bit for the indicated frame in the block
+  bool channelStatusBit(int frame) {
+    return (channel_status[frame >> 3] >> (frame & 7)) & 1;
+  }
+
+  static uint8_t sampleRateCode(int sample_rate) {
+    switch (sample_rate) {
+      case 22050:
+        return 0b0100;
+      case 24000:
+        return 0b0110;
+      case 32000:
+        return 0b0011;
+      case 44100:
+        return 0b0000;
+      case 48000:
+        return 0b0010;
+      case 88200:
+        return 0b1000;
+      case 96000:
+        return 0b1010;
+      case 176400:
+        return 0b1100;
+      case 192000:
+        return 0b1110;
+    }
+    // not indicated
+    return 0b0001;
+  }
+};
+
+/**
+ * @brief Encodes PCM data into the IEC 60958 (S/PDIF) biphase mark representation. Each
+ * subframe is written as 2 uint32_t words (64 cells), so a stereo frame results in 4
+ * words which are usually output via I2S with 32 bits and the double sample rate.
+ * 16 bit data is expected as int16_t, 20 and 24 bit data as right aligned int32_t.
+ * The output can be any Print object, so the encoding can be used and tested on all
+ * platforms.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class SPDIFEncoder : public AudioEncoder, public SPDIFBase {
+ public:
+  SPDIFEncoder() = default;
+
+  SPDIFEncoder(Print &out) { setOutputStream(out); }
+
+  ~SPDIFEncoder() { end(); }
+
+  /// Defines the output stream
+  void setOutputStream(Print &out) override { p_print = &out; }
+
+  /// Provides "audio/spdif"
+  const char *mime() override { return "audio/spdif"; }
+
+  /// Defines the audio format: 1 or 2 channels with 16, 20 or 24 bits
+  void setAudioInfo(AudioBaseInfo info) override {
+    LOGD(LOG_METHOD);
+    this->info = info;
+  }
+
+  AudioBaseInfo audioInfo() { return info; }
+
+  /// Starts the processing with the indicated audio format
+  bool begin(AudioBaseInfo info) {
+    setAudioInfo(info);
+    begin();
+    return is_active;
+  }
+
+  void begin() override {
+    LOGD(LOG_METHOD);
+    is_active = false;
+    if (!(info.channels == 1 || info.channels == 2)) {
+      LOGE("Unsupported number of channels: %d", info.channels);
+      return;
+    }
+    if (!(info.bits_per_sample == 16 || info.bits_per_sample == 20 ||
+          info.bits_per_sample == 24)) {
+      LOGE("Unsupported bits per sample: %d", info.bits_per_sample);
+      return;
+    }
+    setupChannelStatus(info);
+    buffer.resize(SPDIF_BUFFER_FRAMES * 2 * SPDIF_WORDS_PER_SUBFRAME);
+    buffer_pos = 0;
+    buffer_written = 0;
+    frame_pos = 0;
+    channel = 0;
+    partial_len = 0;
+    bmcTable();
+    is_active = true;
+  }
+
+  void end() override {
+    if (is_active && buffer_pos > 0) writeBuffer();
+    is_active = false;
+  }
+
+  operator bool() override { return is_active; }
+
+  /// Encodes the PCM data and writes the result to the output: if the output stalls the
+  /// encoded data is kept and we return the number of accepted bytes
+  size_t write(const void *in_ptr, size_t in_size) override {
+    if (!is_active || p_print == nullptr) return 0;
+    const uint8_t *data = (const uint8_t *)in_ptr;
+    size_t pos = 0;
+    size_t sample_size = info.bits_per_sample == 16 ? 2 : 4;
+    while (pos < in_size) {
+      // the buffer can only be refilled when the pending data has been written
+      if (buffer_pos >= buffer.size() && !writeBuffer()) break;
+      if (partial_len == 0 && in_size - pos >= sample_size) {
+        writeSample(readSample(data + pos));
+        pos += sample_size;
+      } else {
+        // collect a sample which is split over multiple writes
+        partial[partial_len++] = data[pos++];
+        if (partial_len == (int)sample_size) {
+          writeSample(readSample(partial));
+          partial_len = 0;
+        }
+      }
+    }
+    return pos;
+  }
+
+  /// Writes any buffered data
+  void flush() {
+    if (is_active && buffer_pos > 0) writeBuffer();
+  }
+
+ protected:
+  Print *p_print = nullptr;
+  AudioBaseInfo info;
+  Vector<uint32_t> buffer{0};
+  int buffer_pos = 0;
+  size_t buffer_written = 0;
+  int frame_pos = 0;
+  int channel = 0;
+  bool is_active = false;
+  uint8_t partial[4];
+  int partial_len = 0;
+
+  int32_t readSample(const uint8_t *data) {
+    if (info.bits_per_sample == 16) {
+      int16_t result;
+      memcpy(&result, data, 2);
+      return result;
+    }
+    int32_t result;
+    memcpy(&result, data, 4);
+    return result;
+  }
+
+  /// Encodes a single sample (and duplicates it if we have only 1 channel)
+  void writeSample(int32_t sample) {
+    // left align the audio data to 24 bits
+    uint32_t audio = (uint32_t)sample << (24 - info.bits_per_sample);
+    if (info.channels == 2) {
+      encodeSubframe(audio, channel);
+      channel ^= 1;
+    } else {
+      encodeSubframe(audio, 0);
+      encodeSubframe(audio, 1);
+    }
+  }
+
+  /// Encodes a subframe into 2 words: 28 data bits using 3.5 table lookups
+  void encodeSubframe(uint32_t audio, int ch) {
+    uint8_t preamble = ch == 1 ? PreambleW : (frame_pos == 0 ? PreambleB : PreambleM);
+    // time slots 4-31 (validity and user data are 0)
+    uint32_t data = audio & 0xFFFFFF;
+    if (channelStatusBit(frame_pos)) data |= 1 << 26;
+    data |= parity(data) << 27;
+
+    const uint16_t *table = bmcTable();
+    // the preamble ends low
+    uint32_t level = 0;
+    uint64_t cells = (uint64_t)preamble << 56;
+    for (int shift = 40; shift >= 8; shift -= 16) {
+      uint32_t enc = table[data & 0xFF] ^ (level ? 0xFFFF : 0);
+      level = enc & 1;
+      cells |= (uint64_t)enc << shift;
+      data >>= 8;
+    }
+    uint32_t enc = table[data & 0x0F] ^ (level ? 0xFFFF : 0);
+    cells |= enc >> 8;
+
+    buffer[buffer_pos++] = cells >> 32;
+    buffer[buffer_pos++] = (uint32_t)cells;
+
+    if (ch == 1) {
+      if (++frame_pos == SPDIF_BLOCK_FRAMES) frame_pos = 0;
+      if (buffer_pos >= buffer.size()) writeBuffer();
+    }
+  }
+
+  /// Writes the encoded data: returns false if the output did not accept all of it. The
+  /// unwritten tail is kept for the next call.
+  bool writeBuffer() {
+    size_t size = buffer_pos * sizeof(uint32_t);
+    uint8_t *data = (uint8_t *)buffer.data();
+    while (buffer_written < size) {
+      size_t written = p_print->write(data + buffer_written, size - buffer_written);
+      if (written == 0) {
+        LOGD("Output stalled: %d bytes pending", (int)(size - buffer_written));
+        return false;
+      }
+      buffer_written += written;
+    }
+    buffer_pos = 0;
+    buffer_written = 0;
+    return true;
+  }
+};
+
+/**
+ * @brief Decodes IEC 60958 (S/PDIF) biphase mark words (as produced by the
+ * SPDIFEncoder) back to PCM data. This is mainly used to verify the encoding.
+ * The result is provided as int16_t for 16 bits and as int32_t for 20 and 24
+ * bits.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class SPDIFDecoder : public AudioDecoder, public SPDIFBase {
+ public:
+  SPDIFDecoder() = default;
+
+  SPDIFDecoder(Print &out) { setOutputStream(out); }
+
+  void setOutputStream(Print &out) override { p_print = &out; }
+
+  void setNotifyAudioChange(AudioBaseInfoDependent &bi) override { p_notify = &bi; }
+
+  /// Defines the audio format of the result
+  void setAudioInfo(AudioBaseInfo info) override { this->info = info; }
+
+  AudioBaseInfo audioInfo() override { return info; }
+
+  void begin() override {
+    word_count = 0;
+    cs_pos = -1;
+    parity_errors = 0;
+    is_active = true;
+    if (p_notify != nullptr) p_notify->setAudioInfo(info);
+  }
+
+  void end() override { is_active = false; }
+
+  operator bool() override { return is_active; }
+
+  /// Number of subframes with invalid preamble, biphase cells or parity
+  size_t errors() { return parity_errors; }
+
+  size_t write(const void *in_ptr, size_t in_size) override {
+    if (!is_active) return 0;
+    const uint8_t *data = (const uint8_t *)in_ptr;
+    for (size_t j = 0; j < in_size; j++) {
+      ((uint8_t *)words)[word_count * 4 + byte_pos] = data[j];
+      if (++byte_pos == 4) {
+        byte_pos = 0;
+        if (++word_count == SPDIF_WORDS_PER_SUBFRAME) {
+          word_count = 0;
+          decodeSubframe();
+        }
+      }
+    }
+    return in_size;
+  }
+
+ protected:
+  Print *p_print = nullptr;
+  AudioBaseInfoDependent *p_notify = nullptr;
+  AudioBaseInfo info;
+  uint32_t words[SPDIF_WORDS_PER_SUBFRAME];
+  int word_count = 0;
+  int byte_pos = 0;
+  int cs_pos = -1;
+  size_t parity_errors = 0;
+  bool is_active = false;
+
+  void decodeSubframe() {
+    uint64_t cells = ((uint64_t)words[0] << 32) | words[1];
+    uint8_t preamble = cells >> 56;
+    if (preamble != PreambleB && preamble != PreambleM && preamble != PreambleW) {
+      // we are not aligned: skip one word
+      parity_errors++;
+      words[0] = words[1];
+      word_count = 1;
+      return;
+    }
+
+    // decode time slots 4-31: bit is 1 if the 2 cells differ
+    uint32_t data = 0;
+    for (int slot = 0; slot < 28; slot++) {
+      int shift = 54 - (slot * 2);
+      uint32_t pair = (cells >> shift) & 0b11;
+      if (pair == 0b01 || pair == 0b10) data |= 1 << slot;
+    }
+    if (parity(data) != 0) {
+      parity_errors++;
+      return;
+    }
+
+    // collect channel status
+    if (preamble == PreambleB) cs_pos = 0;
+    if (preamble != PreambleW && cs_pos >= 0) {
+      if (cs_pos < SPDIF_BLOCK_FRAMES) {
+        uint8_t mask = 1 << (cs_pos & 7);
+        if (data & (1 << 26))
+          channel_status[cs_pos >> 3] |= mask;
+        else
+          channel_status[cs_pos >> 3] &= ~mask;
+      }
+      cs_pos++;
+    }
+
+    if (p_print == nullptr) return;
+    int32_t audio = (int32_t)(data << 8) >> 8;  // sign extend 24 bits
+    if (info.bits_per_sample == 16) {
+      int16_t sample = audio >> 8;
+      p_print->write((uint8_t *)&sample, sizeof(sample));
+    } else {
+      int32_t sample = audio >> (24 - info.bits_per_sample);
+      p_print->write((uint8_t *)&sample, sizeof(sample));
+    }
+  }
+};
+
+}  // namespace audio_tools
@@ -0,0 +1,539 @@
+#pragma once
+#include "AudioCodecs/AudioEncoded.h"
+#include "AudioTools/JitterBufferStream.h"
+
+namespace audio_tools {
+
+/// Supported RTP payload formats
+enum RTPPayloadFormat { RTP_L16, RTP_PCMU, RTP_PCMA, RTP_OPUS, RTP_SBC };
+
+/**
+ * @brief Configuration for the RTPPacketizer and RTPDepacketizer
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct RTPConfig : public AudioBaseInfo {
+  RTPConfig() {
+    sample_rate = 44100;
+    channels = 2;
+    bits_per_sample = 16;
+  }
+  RTPPayloadFormat format = RTP_L16;
+  /// -1: we use the default for the format
+  int payload_type = -1;
+  /// max size of a RTP packet (incl header)
+  uint16_t mtu = 1400;
+  /// duration of a PCM (L16, G.711) packet
+  uint16_t packet_ms = 20;
+  /// synchronization source: 0 for a random value
+  uint32_t ssrc = 0;
+};
+
+/**
+ * @brief Statistics of the RTPDepacketizer
+ */
+struct RTPStats {
+  uint32_t packets = 0;
+  uint32_t lost = 0;
+  uint32_t late = 0;
+  uint32_t invalid = 0;
+};
+
+/**
+ * @brief Common functionality of the RTPPacketizer and RTPDepacketizer
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class RTPBase {
+ public:
+  RTPConfig defaultConfig() {
+    RTPConfig c;
+    return c;
+  }
+
+  /// Provides the payload type: the static types are defined in RFC 3551
+  int payloadType() {
+    if (cfg.payload_type >= 0) return cfg.payload_type;
+    switch (cfg.format) {
+      case RTP_PCMU:
+        return 0;
+      case RTP_PCMA:
+        return 8;
+      case RTP_L16:
+        if (cfg.sample_rate == 44100 && cfg.channels == 2) return 10;
+        if (cfg.sample_rate == 44100 && cfg.channels == 1) return 11;
+        return 96;
+      default:
+        return 96;
+    }
+  }
+
+  /// The RTP clock rate: Opus always uses 48000
+  int clockRate() { return cfg.format == RTP_OPUS ? 48000 : cfg.sample_rate; }
+
+  /// Determines the number of samples (at 48kHz) of an Opus packet from the TOC byte (RFC 6716)
+  static int opusSamples(const uint8_t *data, size_t len) {
+    if (len == 0) return 0;
+    int config = data[0] >> 3;
+    int frame_samples;
+    if (config < 12) {
+      const int silk[] = {480, 960, 1920, 2880};
+      frame_samples = silk[config & 3];
+    } else if (config < 16) {
+      frame_samples = (config & 1) ? 960 : 480;
+    } else {
+      const int celt[] = {120, 240, 480, 960};
+      frame_samples = celt[config & 3];
+    }
+    int frames;
+    switch (data[0] & 3) {
+      case 0:
+        frames = 1;
+        break;
+      case 3:
+        frames = len > 1 ? data[1] & 0x3F : 0;
+        break;
+      default:
+        frames = 2;
+    }
+    return frames * frame_samples;
+  }
+
+  /// Determines the length of a SBC frame from it's header (A2DP spec): returns 0 if this is not a valid header
+  static int sbcFrameLen(const uint8_t *header) {
+    if (header[0] != 0x9C) return 0;
+    int blocks = 4 * (((header[1] >> 4) & 3) + 1);
+    int mode = (header[1] >> 2) & 3;
+    int subbands = (header[1] & 1) ? 8 : 4;
+    int channels = mode == 0 ? 1 : 2;
+    int bitpool = header[2];
+    int bits = mode < 2 ? blocks * channels * bitpool : (mode == 3 ? subbands : 0) + blocks * bitpool;
+    return 4 + (4 * subbands * channels) / 8 + (bits + 7) / 8;
+  }
+
+  /// Number of samples of a SBC frame
+  static int sbcSamples(const uint8_t *header) {
+    int blocks = 4 * (((header[1] >> 4) & 3) + 1);
+    int subbands = (header[1] & 1) ? 8 : 4;
+    return blocks * subbands;
+  }
+
+ protected:
+  RTPConfig cfg;
+  static const int header_size = 12;
+};
+
+/**
+ * @brief Packetizes the audio data into RTP packets (RFC 3550): each packet is written with a single
+ * write to the output, so e.g. a UDPStream sends it as one datagram. The header is written in front
+ * of the payload in the packet buffer. PCM (L16 in network byte order, G.711 PCMU/PCMA) is split into
+ * packets of packet_ms which fit into the MTU. For Opus we expect one Opus packet per write (RFC 7587).
+ * SBC frames are combined into packets and fragmented if they do not fit (A2DP). The timestamp is
+ * derived from the number of samples and the marker bit is set on the first packet.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class RTPPacketizer : public AudioEncoder, public RTPBase {
+ public:
+  RTPPacketizer() = default;
+
+  RTPPacketizer(Print &out) { setOutputStream(out); }
+
+  void setOutputStream(Print &out) override { p_print = &out; }
+
+  void setAudioInfo(AudioBaseInfo info) override { cfg.setAudioInfo(info); }
+
+  /// Starts the processing: returns false if a packet can not hold at least one frame
+  bool begin(RTPConfig config) {
+    cfg = config;
+    begin();
+    return is_active;
+  }
+
+  void begin() override {
+    LOGD(LOG_METHOD);
+    is_active = false;
+    // we need room for the header and at least one byte of payload (+ the SBC header)
+    if (cfg.mtu <= header_size + 1) {
+      LOGE("mtu too small: %d", cfg.mtu);
+      return;
+    }
+    if (cfg.format != RTP_OPUS && cfg.format != RTP_SBC) {
+      int frame_size = cfg.channels * (cfg.format == RTP_L16 ? 2 : 1);
+      pcm_packet_len = (size_t)cfg.sample_rate * cfg.packet_ms / 1000 * frame_size;
+      if (pcm_packet_len > maxPayload()) pcm_packet_len = maxPayload();
+      pcm_packet_len = frame_size > 0 ? pcm_packet_len / frame_size * frame_size : 0;
+      if (pcm_packet_len == 0) {
+        LOGE("packet can not hold a frame: mtu %d, packet_ms %d", cfg.mtu, cfg.packet_ms);
+        return;
+      }
+    }
+    packet.resize(cfg.mtu);
+    if (cfg.format == RTP_SBC) sbc_frame.resize(512);
+    ssrc = cfg.ssrc != 0 ? cfg.ssrc : random(1, 0x7FFFFFFF);
+    // the initial sequence number and timestamp are random (RFC 3550 5.1)
+    seq = random(0, 0x10000);
+    ts = (uint32_t)random(0, 0x10000) << 16 | (uint32_t)random(0, 0x10000);
+    is_marker = true;
+    payload_len = 0;
+    sbc_frame_len = 0;
+    sbc_frame_count = 0;
+    samples = 0;
+    is_active = true;
+  }
+
+  void end() override {
+    flush();
+    is_active = false;
+  }
+
+  /// Sends the collected data
+  void flush() {
+    if (payload_len == 0 || cfg.format == RTP_OPUS) return;
+    if (cfg.format == RTP_SBC) {
+      sendSBCPacket();
+    } else {
+      sendPCMPacket();
+    }
+  }
+
+  const char *mime() override { return "application/rtp"; }
+
+  operator bool() override { return is_active; }
+
+  size_t write(const void *data, size_t len) override {
+    if (!is_active || p_print == nullptr) return 0;
+    const uint8_t *in = (const uint8_t *)data;
+    switch (cfg.format) {
+      case RTP_OPUS:
+        writeOpus(in, len);
+        break;
+      case RTP_SBC:
+        writeSBC(in, len);
+        break;
+      default:
+        writePCM(in, len);
+        break;
+    }
+    return len;
+  }
+
+  /// Sequence number of the next packet
+  uint16_t sequenceNumber() { return seq; }
+
+  /// Timestamp of the next packet
+  uint32_t timestamp() { return ts; }
+
+ protected:
+  Print *p_print = nullptr;
+  Vector<uint8_t> packet{0};
+  Vector<uint8_t> sbc_frame{0};
+  size_t payload_len = 0;
+  size_t pcm_packet_len = 0;
+  uint16_t seq = 0;
+  uint32_t ts = 0;
+  uint32_t ssrc = 0;
+  uint32_t samples = 0;
+  bool is_marker = true;
+  bool is_active = false;
+  int sbc_frame_len = 0;
+  int sbc_frame_count = 0;
+
+  uint8_t *payload() { return packet.data() + header_size; }
+
+  size_t maxPayload() { return cfg.mtu - header_size; }
+
+  /// Writes the header in front of the payload and sends the packet
+  void sendPacket() {
+    uint8_t *header = packet.data();
+    header[0] = 0x80;
+    header[1] = (is_marker ? 0x80 : 0) | (payloadType() & 0x7F);
+    header[2] = seq >> 8;
+    header[3] = seq & 0xFF;
+    header[4] = ts >> 24;
+    header[5] = ts >> 16;
+    header[6] = ts >> 8;
+    header[7] = ts & 0xFF;
+    header[8] = ssrc >> 24;
+    header[9] = ssrc >> 16;
+    header[10] = ssrc >> 8;
+    header[11] = ssrc & 0xFF;
+    p_print->write(packet.data(), header_size + payload_len);
+    is_marker = false;
+    seq++;
+    ts += samples;
+    samples = 0;
+    payload_len = 0;
+  }
+
+  /// PCM packets contain complete frames of packet_ms
+  void writePCM(const uint8_t *data, size_t len) {
+    while (len > 0) {
+      size_t n = min(len, pcm_packet_len - payload_len);
+      memcpy(payload() + payload_len, data, n);
+      payload_len += n;
+      data += n;
+      len -= n;
+      if (payload_len == pcm_packet_len) {
+        sendPCMPacket();
+      }
+    }
+  }
+
+  void sendPCMPacket() {
+    int bytes_per_sample = cfg.format == RTP_L16 ? 2 : 1;
+    samples = payload_len / (cfg.channels * bytes_per_sample);
+    if (cfg.format == RTP_L16) swapBytes(payload(), payload_len);
+    sendPacket();
+  }
+
+  /// L16 uses the network byte order
+  static void swapBytes(uint8_t *data, size_t len) {
+    for (size_t j = 0; j + 1 < len; j += 2) {
+      uint8_t tmp = data[j];
+      data[j] = data[j + 1];
+      data[j + 1] = tmp;
+    }
+  }
+
+  /// One Opus packet per RTP packet
+  void writeOpus(const uint8_t *data, size_t len) {
+    if (len > maxPayload()) {
+      LOGE("Opus packet too big for MTU: %u", (unsigned)len);
+      return;
+    }
+    memcpy(payload(), data, len);
+    payload_len = len;
+    samples = opusSamples(data, len);
+    sendPacket();
+  }
+
+  /// We collect the SBC frames
+  void writeSBC(const uint8_t *data, size_t len) {
+    for (size_t j = 0; j < len; j++) {
+      if (sbc_frame_len == 0 && data[j] != 0x9C) continue;  // search sync word
+      sbc_frame[sbc_frame_len++] = data[j];
+      if (sbc_frame_len >= 3) {
+        int frame_len = sbcFrameLen(sbc_frame.data());
+        if (frame_len == 0 || frame_len > (int)sbc_frame.size()) {
+          sbc_frame_len = 0;
+        } else if (sbc_frame_len == frame_len) {
+          addSBCFrame(sbc_frame.data(), frame_len);
+          sbc_frame_len = 0;
+        }
+      }
+    }
+  }
+
+  /// Adds a complete frame to the packet: the payload starts with the SBC header byte
+  void addSBCFrame(const uint8_t *frame, int len) {
+    if (payload_len > 0 && (payload_len + len > maxPayload() || sbc_frame_count == 15)) {
+      sendSBCPacket();
+    }
+    if (1 + len > (int)maxPayload()) {
+      sendSBCFragments(frame, len);
+      return;
+    }
+    if (payload_len == 0) payload_len = 1;
+    memcpy(payload() + payload_len, frame, len);
+    payload_len += len;
+    sbc_frame_count++;
+    samples += sbcSamples(frame);
+  }
+
+  void sendSBCPacket() {
+    payload()[0] = sbc_frame_count;
+    sbc_frame_count = 0;
+    sendPacket();
+  }
+
+  /// A frame which does not fit into a packet is split into fragments
+  void sendSBCFragments(const uint8_t *frame, int len) {
+    int fragment_size = maxPayload() - 1;
+    int fragments = (len + fragment_size - 1) / fragment_size;
+    int frame_samples = sbcSamples(frame);
+    for (int j = 0; j < fragments; j++) {
+      int n = min(fragment_size, len - j * fragment_size);
+      // F S L RFA number of remaining fragments
+      payload()[0] = 0x80 | (j == 0 ? 0x40 : 0) | (j == fragments - 1 ? 0x20 : 0) | (fragments - j);
+      memcpy(payload() + 1, frame + j * fragment_size, n);
+      payload_len = n + 1;
+      // all fragments share the timestamp of the frame
+      samples = j == fragments - 1 ? frame_samples : 0;
+      sendPacket();
+    }
+  }
+};
+
+/**
+ * @brief Extracts the payload from the received RTP packets: each write must contain a full packet
+ * (e.g. one UDP datagram). Lost and late packets are detected from the sequence number. L16 is
+ * converted to the little endian PCM data, G.711 and Opus payloads are passed on to the output
+ * (e.g. an EncodedAudioStream with the decoder) and fragmented SBC frames are reassembled. If a
+ * JitterBufferStream is defined, the payload is passed on with the sequence number so that it
+ * can be reordered.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class RTPDepacketizer : public AudioDecoder, public RTPBase {
+ public:
+  RTPDepacketizer() = default;
+
+  RTPDepacketizer(Print &out) { setOutputStream(out); }
+
+  void setOutputStream(Print &out) override { p_print = &out; }
+
+  void setNotifyAudioChange(AudioBaseInfoDependent &bi) override { p_notify = &bi; }
+
+  /// The payload is written with the sequence number to the jitter buffer instead of the output
+  void setJitterBuffer(JitterBufferStream *jitter) { p_jitter = jitter; }
+
+  void setAudioInfo(AudioBaseInfo info) override { cfg.setAudioInfo(info); }
+
+  AudioBaseInfo audioInfo() override { return cfg; }
+
+  void begin(RTPConfig config) {
+    cfg = config;
+    begin();
+  }
+
+  void begin() override {
+    LOGD(LOG_METHOD);
+    buffer.resize(cfg.mtu);
+    if (cfg.format == RTP_SBC) sbc_frame.resize(512);
+    stat = RTPStats();
+    is_first = true;
+    sbc_frame_len = 0;
+    is_active = true;
+    if (p_notify != nullptr) p_notify->setAudioInfo(cfg);
+  }
+
+  void end() override { is_active = false; }
+
+  operator bool() override { return is_active; }
+
+  /// Processes a full RTP packet
+  size_t write(const void *data, size_t len) override {
+    if (!is_active) return 0;
+    const uint8_t *packet = (const uint8_t *)data;
+    size_t header_len = len > 0 ? header_size + 4 * (packet[0] & 0x0F) : header_size;
+    if (len < header_len || (packet[0] >> 6) != 2 || (packet[1] & 0x7F) != payloadType()) {
+      LOGW("invalid RTP packet");
+      stat.invalid++;
+      return len;
+    }
+    if (packet[0] & 0x10) {
+      // skip extension header
+      if (len < header_len + 4) return len;
+      header_len += 4 + 4 * (packet[header_len + 2] << 8 | packet[header_len + 3]);
+    }
+    size_t payload_len = len > header_len ? len - header_len : 0;
+    if ((packet[0] & 0x20) && payload_len > 0) {
+      // remove padding
+      size_t padding = packet[len - 1];
+      payload_len = padding <= payload_len ? payload_len - padding : 0;
+    }
+    stat.packets++;
+    marker = packet[1] & 0x80;
+    seq = packet[2] << 8 | packet[3];
+    ts = (uint32_t)packet[4] << 24 | (uint32_t)packet[5] << 16 | packet[6] << 8 | packet[7];
+    if (!checkSequence(seq)) return len;
+    processPayload(packet + header_len, payload_len);
+    return len;
+  }
+
+  RTPStats &stats() { return stat; }
+
+  /// Sequence number of the last packet
+  uint16_t sequenceNumber() { return seq; }
+
+  /// Timestamp of the last packet
+  uint32_t timestamp() { return ts; }
+
+  /// Marker bit of the last packet
+  bool isMarker() { return marker; }
+
+ protected:
+  Print *p_print = nullptr;
+  AudioBaseInfoDependent *p_notify = nullptr;
+  JitterBufferStream *p_jitter = nullptr;
+  Vector<uint8_t> buffer{0};
+  Vector<uint8_t> sbc_frame{0};
+  int sbc_frame_len = 0;
+  RTPStats stat;
+  uint16_t seq = 0;
+  uint16_t expected_seq = 0;
+  uint32_t ts = 0;
+  bool marker = false;
+  bool is_first = true;
+  bool is_active = false;
+
+  /// Determines the lost and late packets: returns false if the packet should be ignored
+  bool checkSequence(uint16_t seq) {
+    if (!is_first) {
+      int16_t diff = seq - expected_seq;
+      if (diff < 0) {
+        stat.late++;
+        // the jitter buffer can still use it
+        return p_jitter != nullptr;
+      }
+      stat.lost += diff;
+    }
+    is_first = false;
+    expected_seq = seq + 1;
+    return true;
+  }
+
+  void processPayload(const uint8_t *data, size_t len) {
+    switch (cfg.format) {
+      case RTP_L16: {
+        // convert from network byte order
+        size_t n = min(len, (size_t)buffer.size());
+        for (size_t j = 0; j + 1 < n; j += 2) {
+          buffer[j] = data[j + 1];
+          buffer[j + 1] = data[j];
+        }
+        output(buffer.data(), n);
+      } break;
+      case RTP_SBC:
+        processSBC(data, len);
+        break;
+      default:
+        output(data, len);
+        break;
+    }
+  }
+
+  void processSBC(const uint8_t *data, size_t len) {
+    if (len < 1) return;
+    uint8_t header = data[0];
+    if ((header & 0x80) == 0) {
+      // complete frames
+      output(data + 1, len - 1);
+      return;
+    }
+    // fragment
+    if (header & 0x40) sbc_frame_len = 0;
+    if ((size_t)sbc_frame_len + len > (size_t)sbc_frame.size() + 1) {
+      LOGE("SBC frame too big");
+      sbc_frame_len = 0;
+      return;
+    }
+    memcpy(sbc_frame.data() + sbc_frame_len, data + 1, len - 1);
+    sbc_frame_len += len - 1;
+    if (header & 0x20) {
+      output(sbc_frame.data(), sbc_frame_len);
+      sbc_frame_len = 0;
+    }
+  }
+
+  void output(const uint8_t *data, size_t len) {
+    if (p_jitter != nullptr) {
+      p_jitter->writePacket(seq, data, len);
+    } else if (p_print != nullptr) {
+      p_print->write(data, len);
+    }
+  }
+};
+
+}  // namespace audio_tools
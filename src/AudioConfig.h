@@ -39,11 +39,84 @@
 #define LOG_STREAM Serial
 #endif
 
+// Log levels below LOG_MIN_LEVEL (0=Debug, 1=Info, 2=Warning, 3=Error) are removed at compile time
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// Set USE_AUDIO_LOGGING_DEFERRED to true to be able to record the log messages w/o formatting
+// them in the audio processing (see AudioLogger::setDeferred()). This needs <atomic>.
+#ifndef USE_AUDIO_LOGGING_DEFERRED
+#define USE_AUDIO_LOGGING_DEFERRED false
+#endif
+
+#ifndef LOG_DEFERRED_QUEUE_SIZE
+#define LOG_DEFERRED_QUEUE_SIZE 32
+#endif
+
+#ifndef LOG_DEFERRED_MAX_ARGS
+#define LOG_DEFERRED_MAX_ARGS 6
+#endif
+
+#ifndef LOG_DEFERRED_TEXT_SIZE
+#define LOG_DEFERRED_TEXT_SIZE 48
+#endif
+
 #define CHECK_MEMORY() 
 // #define CHECK_MEMORY() checkMemory(true)
 #define LOG_PRINTF_BUFFER_SIZE 256
 #define LOG_METHOD __PRETTY_FUNCTION__
 
+/**
+ * ------------------------------------------------------------------------- 
+ * @brief Profiling
+ * Set USE_AUDIO_PROFILER to true to measure the time which is spent in the stages that are
+ * wrapped with a ProfiledStream. When it is false the ProfiledStream just forwards the calls.
+ * When using cmake you can set -DUSE_AUDIO_PROFILER=true
+ */
+
+#ifndef USE_AUDIO_PROFILER
+#define USE_AUDIO_PROFILER false
+#endif
+
+#ifndef AUDIO_PROFILER_MAX_STAGES
+#define AUDIO_PROFILER_MAX_STAGES 16
+#endif
+
+/**
+ * ------------------------------------------------------------------------- 
+ * @brief XRun Accounting
+ * Max number of buffers and streams which can be registered in the XRunRegistry
+ */
+
+#ifndef XRUN_REGISTRY_MAX_SOURCES
+#define XRUN_REGISTRY_MAX_SOURCES 16
+#endif
+
+/**
+ * ------------------------------------------------------------------------- 
+ * @brief Deadline Monitor
+ * Max nesting of the stages and number of overruns which are kept by the DeadlineMonitor
+ */
+
+#ifndef DEADLINE_MONITOR_MAX_DEPTH
+#define DEADLINE_MONITOR_MAX_DEPTH 8
+#endif
+
+#ifndef DEADLINE_MONITOR_HISTORY
+#define DEADLINE_MONITOR_HISTORY 8
+#endif
+
+/**
+ * ------------------------------------------------------------------------- 
+ * @brief Audio Timestamps
+ * Max number of pending timestamps which are kept by a TimestampTrack (e.g. of a buffer)
+ */
+
+#ifndef AUDIO_TIMESTAMP_MARKS
+#define AUDIO_TIMESTAMP_MARKS 8
+#endif
+
 /**
  * ------------------------------------------------------------------------- 
  * @brief Common Default Settings that can usually be changed in the API
@@ -101,6 +174,38 @@
 #define MAX_HTTP_HEADER_LINE_LENGTH 240
 #endif
 
+#ifndef HTTP_HEADER_BUFFER_SIZE
+#define HTTP_HEADER_BUFFER_SIZE 1024
+#endif
+
+#ifndef HTTP_MAX_HEADER_LINES
+#define HTTP_MAX_HEADER_LINES 24
+#endif
+
+#ifndef HTTP_REQUEST_LINE_SIZE
+#define HTTP_REQUEST_LINE_SIZE 256
+#endif
+
+#ifndef HTTP_REQUEST_TIMEOUT
+#define HTTP_REQUEST_TIMEOUT 2000
+#endif
+
+#ifndef AUDIO_BROADCAST_BUFFER_SIZE
+#define AUDIO_BROADCAST_BUFFER_SIZE 16384
+#endif
+
+#ifndef AUDIO_BROADCAST_MAX_FRAMES
+#define AUDIO_BROADCAST_MAX_FRAMES 64
+#endif
+
+#ifndef AUDIO_BROADCAST_MAX_CLIENTS
+#define AUDIO_BROADCAST_MAX_CLIENTS 4
+#endif
+
+#ifndef AUDIO_BROADCAST_WRITE_LIMIT
+#define AUDIO_BROADCAST_WRITE_LIMIT 1460
+#endif
+
 /**
  * ------------------------------------------------------------------------- 
  * @brief PWM
@@ -1,6 +1,8 @@
 #pragma once
 #include "AudioHttp/URLStream.h"
 #include "AudioHttp/URLStreamESP32.h"
+#include "AudioHttp/HttpRequestParser.h"
+#include "AudioHttp/BroadcastOutput.h"
 #include "AudioHttp/AudioServer.h"
 #include "AudioHttp/ICYStream.h"
 #include "AudioHttp/ICYStreamESP32.h"
@@ -8,6 +8,8 @@
 #endif
 #include "AudioCodecs/CodecWAV.h"
 #include "AudioTools.h"
+#include "AudioHttp/BroadcastOutput.h"
+#include "AudioHttp/HttpRequestParser.h"
 
 namespace audio_tools {
 
@@ -94,13 +96,22 @@ class AudioServer {
          * @brief Add this method to your loop
          * Returns true while the client is connected.
          */
-        bool doLoop() {
+        virtual bool doLoop() {
             //LOGD("doLoop");
             bool active = true;
             if (!client_obj.connected()) {
                 client_obj = server.available(); // listen for incoming clients
+                if (client_obj) {
+                    LOGI("New Client.");
+                    request.begin();
+                }
+            }
+            // the request is processed without blocking
+            if (client_obj.connected() && !request.isComplete()) {
                 processClient();
-            } else {
+            }
+            // we start to stream as soon as the request is complete
+            if (client_obj.connected() && request.isComplete()) {
                 // We are connected: copy input from source to wav output
                 if (client_obj){
                     if (callback==nullptr) {
@@ -150,6 +161,7 @@ class AudioServer {
         Stream *in = nullptr;                    
         StreamCopy copier;
         BaseConverter<int16_t> *converter_ptr = nullptr;
+        HttpRequestParser request;
 
         void connectWiFi() {
              LOGD(LOG_METHOD);
@@ -168,15 +180,18 @@ class AudioServer {
 
         virtual void sendReplyHeader(){
              LOGD(LOG_METHOD);
+            writeReplyHeader(client_obj);
+        }
+
+        void writeReplyHeader(Print &out){
             // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
             // and a content-type so the client knows what's coming, then a blank line:
-            client_obj.println("HTTP/1.1 200 OK");
+            out.println("HTTP/1.1 200 OK");
             if (content_type!=nullptr){
-                client_obj.print("Content-type:");
-                client_obj.println(content_type);
+                out.print("Content-type:");
+                out.println(content_type);
             }
-            client_obj.println();
-
+            out.println();
         }
 
         virtual void sendReplyContent() {
@@ -193,34 +208,20 @@ class AudioServer {
             }
         }
 
-        // Handle an new client connection and return the data
+        // Processes the available request data and returns the reply when the request is complete
         void processClient() {
-            //LOGD("processClient");
-            if (client_obj)  { // if you get a client,
-                LOGI("New Client."); // print a message out the serial port
-                String currentLine = "";       // make a String to hold incoming data from the client
-                while (client_obj.connected()) { // loop while the client's connected
-                    if (client_obj.available()) { // if there's bytes to read from the client,
-                        char c = client_obj.read(); // read a byte, then
-                        if (c == '\n') { // if the byte is a newline character
-
-                            // if the current line is blank, you got two newline characters in a row.
-                            // that's the end of the client HTTP request, so send a response:
-                            if (currentLine.length() == 0){
-                                sendReplyHeader();
-                                sendReplyContent();
-                                // break out of the while loop:
-                                break;
-                            } else { // if you got a newline, then clear currentLine:
-                                currentLine = "";
-                            }
-                        }
-                        else if (c != '\r') { // if you got anything else but a carriage return character,
-                            currentLine += c; // add it to the end of the currentLine
-                        }
-                    }
-                }
-            }  
+            if (request.poll(client_obj)) {
+                sendReplyHeader();
+                sendReplyContent();
+            } else if (request.isError()) {
+                sendErrorReply(client_obj);
+            }
+        }
+
+        void sendErrorReply(Client &client) {
+            client.println("HTTP/1.1 400 Bad Request");
+            client.println();
+            client.stop();
         }
 };
 
@@ -346,6 +347,97 @@ class AudioEncoderServer  : public AudioServer {
 
 };
 
+/**
+ * @brief Webserver which streams the encoded audio to multiple clients: the audio is encoded only once
+ * into a shared BroadcastOutput and each client gets its own read position. New clients start on a 
+ * frame boundary and clients which can not keep up are skipped ahead (or dropped) without blocking 
+ * the others. 
+ * 
+ * in -copy> encoded_stream -> broadcast -> clients
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class AudioEncoderBroadcastServer : public AudioEncoderServer {
+    public:
+        AudioEncoderBroadcastServer(AudioEncoder *encoder) : AudioEncoderServer(encoder) {}
+
+        AudioEncoderBroadcastServer(AudioEncoder *encoder, const char* network, const char *password) 
+        : AudioEncoderServer(encoder, network, password) {}
+
+        /// Start the server. You need to be connected to WiFI before calling this method
+        void begin(Stream &in, AudioBaseInfo info) {
+            LOGD(LOG_METHOD);
+            this->audio_info = info;
+            encoder->setAudioInfo(audio_info);
+            broadcast.begin();
+            encoded_stream.begin(&broadcast, encoder);
+            copier.begin(encoded_stream, in);
+            AudioServer::begin(in, encoder->mime());
+        }
+
+        /// Start the server. You need to be connected to WiFI before calling this method
+        void begin(Stream &in, int sample_rate, int channels, int bits_per_sample=16) {
+            AudioBaseInfo info;
+            info.sample_rate = sample_rate;
+            info.channels = channels;
+            info.bits_per_sample = bits_per_sample;
+            begin(in, info);
+        }
+
+        /// Accepts new clients, encodes the next data and sends it to the clients. Returns true if we have clients 
+        bool doLoop() override {
+            WiFiClient new_client = server.available();
+            if (new_client) {
+                addClient(new_client);
+            }
+            processRequests();
+            // we only encode when somebody is listening
+            if (broadcast.clientCount()>0){
+                copier.copy();
+            }
+            return broadcast.update() > 0;
+        }
+
+        /// Provides access to the shared output: e.g. to define the header size or the late policy
+        BroadcastOutput &broadcastOutput() {
+            return broadcast;
+        }
+
+    protected:
+        BroadcastOutput broadcast;
+        WiFiClient clients[AUDIO_BROADCAST_MAX_CLIENTS];
+        HttpRequestParser requests[AUDIO_BROADCAST_MAX_CLIENTS];
+
+        /// Reserves a slot for the new client: it is added to the broadcast when its request is complete
+        void addClient(WiFiClient &client) {
+            for (int j=0; j<AUDIO_BROADCAST_MAX_CLIENTS; j++){
+                if (!clients[j].connected()){
+                    broadcast.removeClient(clients[j]);
+                    clients[j] = client;
+                    requests[j].begin();
+                    LOGI("New Client: %d", j);
+                    return;
+                }
+            }
+            LOGW("Too many clients");
+            client.stop();
+        }
+
+        /// Processes the pending requests without blocking
+        void processRequests() {
+            for (int j=0; j<AUDIO_BROADCAST_MAX_CLIENTS; j++){
+                if (!clients[j].connected() || requests[j].isComplete()) continue;
+                if (requests[j].poll(clients[j])) {
+                    writeReplyHeader(clients[j]);
+                    broadcast.addClient(clients[j]);
+                    LOGI("Broadcast clients: %d", broadcast.clientCount());
+                } else if (requests[j].isError()) {
+                    sendErrorReply(clients[j]);
+                }
+            }
+        }
+};
+
 /**
  * @brief A simple Arduino Webserver which streams the audio as WAV data. 
  * This class is based on the AudioEncodedServer class. All you need to do is to provide the data 
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioBasic/Collections.h"
+#include "Client.h"
+
+namespace audio_tools {
+
+/// What happens with a client which can not keep up with the data
+enum BroadcastLatePolicy { BroadcastSkip, BroadcastDrop };
+
+/**
+ * @brief Position of a client in the shared data of a BroadcastOutput
+ */
+struct BroadcastCursor {
+    Client *p_client = nullptr;
+    uint64_t pos = 0;
+    size_t header_pos = 0;
+};
+
+/**
+ * @brief Output which distributes the written (e.g. encoded) data to multiple clients: the data is
+ * stored only once in a shared ring buffer and each client has its own read position. Each write()
+ * is considered to be a frame (the encoders provide complete frames), so new clients start on a frame
+ * boundary. If a header size is defined, the first bytes are kept and sent to each new client first
+ * (e.g. 44 for WAV). Clients which fall behind by more then the max lag (by default half of the
+ * buffer) are skipped ahead on the next frame boundary or dropped, so they never block the others. Call update() regularly
+ * to send the data to the clients: we never write more then the clients can accept.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class BroadcastOutput : public Print {
+    public:
+        BroadcastOutput(size_t bufferSize=AUDIO_BROADCAST_BUFFER_SIZE) {
+            buffer_size = bufferSize;
+        }
+
+        /// (Re)starts the processing: all clients are removed
+        bool begin() {
+            LOGD(LOG_METHOD);
+            buffer.resize(buffer_size);
+            frames.resize(AUDIO_BROADCAST_MAX_FRAMES);
+            header.resize(header_size);
+            total = 0;
+            frame_count = 0;
+            header_len = 0;
+            client_count = 0;
+            return true;
+        }
+
+        /// Removes all clients
+        void end() {
+            client_count = 0;
+        }
+
+        /// The indicated number of bytes at the beginning is sent to each client first: e.g. 44 for WAV
+        void setHeaderSize(size_t size) {
+            header_size = size;
+        }
+
+        /// Defines if clients which can not keep up are skipped ahead (default) or dropped
+        void setLatePolicy(BroadcastLatePolicy policy) {
+            late_policy = policy;
+        }
+
+        /// Defines the number of bytes a client can be behind before the late policy is applied: the default is half of the buffer
+        void setMaxLag(size_t bytes) {
+            max_lag = bytes;
+        }
+
+        /// Adds a client: returns false if the max number of clients has been reached
+        bool addClient(Client &client) {
+            if (client_count >= AUDIO_BROADCAST_MAX_CLIENTS) {
+                LOGW("Too many clients: increase AUDIO_BROADCAST_MAX_CLIENTS");
+                return false;
+            }
+            BroadcastCursor &cursor = clients[client_count++];
+            cursor.p_client = &client;
+            cursor.header_pos = 0;
+            // we start with the last frame
+            cursor.pos = frame_count > 0 && isValid(frame(frame_count-1)) ? frame(frame_count-1) : total;
+            LOGI("client added at %lu", (unsigned long) cursor.pos);
+            return true;
+        }
+
+        /// Removes the client
+        void removeClient(Client &client) {
+            for (int j = 0; j < client_count; j++) {
+                if (clients[j].p_client == &client) {
+                    removeClientIdx(j);
+                    return;
+                }
+            }
+        }
+
+        /// Number of registered clients
+        int clientCount() {
+            return client_count;
+        }
+
+        /// Total number of (non header) bytes which have been written
+        uint64_t totalWritten() {
+            return total;
+        }
+
+        /// Stores the data as a new frame: the oldest data is overwritten
+        size_t write(const uint8_t *data, size_t len) override {
+            if (buffer.size() == 0) begin();
+            size_t result = len;
+            // collect the header
+            if (header_len < header_size) {
+                size_t n = min(len, header_size - header_len);
+                memcpy(header.data() + header_len, data, n);
+                header_len += n;
+                data += n;
+                len -= n;
+            }
+            if (len == 0) return result;
+            // if the frame does not fit we keep only the end
+            if (len > buffer_size) {
+                total += len - buffer_size;
+                data += len - buffer_size;
+                len = buffer_size;
+            }
+            frames[frame_count % AUDIO_BROADCAST_MAX_FRAMES] = total;
+            frame_count++;
+            size_t idx = total % buffer_size;
+            size_t n = min(len, buffer_size - idx);
+            memcpy(buffer.data() + idx, data, n);
+            memcpy(buffer.data(), data + n, len - n);
+            total += len;
+            return result;
+        }
+
+        size_t write(uint8_t ch) override {
+            return write(&ch, 1);
+        }
+
+        int availableForWrite() override {
+            return buffer_size;
+        }
+
+        /// Sends the data to the clients: disconnected clients are removed. Returns the number of active clients
+        int update() {
+            for (int j = client_count - 1; j >= 0; j--) {
+                if (!updateClient(clients[j])) {
+                    removeClientIdx(j);
+                }
+            }
+            return client_count;
+        }
+
+    protected:
+        Vector<uint8_t> buffer{0};
+        Vector<uint8_t> header{0};
+        Vector<uint64_t> frames{0};
+        BroadcastCursor clients[AUDIO_BROADCAST_MAX_CLIENTS];
+        int client_count = 0;
+        size_t buffer_size;
+        size_t header_size = 0;
+        size_t header_len = 0;
+        uint64_t total = 0;
+        uint64_t frame_count = 0;
+        size_t max_lag = 0;
+        BroadcastLatePolicy late_policy = BroadcastSkip;
+
+        /// start position of the indicated frame
+        uint64_t frame(uint64_t idx) {
+            return frames[idx % AUDIO_BROADCAST_MAX_FRAMES];
+        }
+
+        /// returns true if the data at the position is still in the buffer
+        bool isValid(uint64_t pos) {
+            return pos + buffer_size >= total;
+        }
+
+        size_t maxLag() {
+            return max_lag > 0 && max_lag < buffer_size ? max_lag : buffer_size / 2;
+        }
+
+        uint64_t firstFrameIdx() {
+            return frame_count > AUDIO_BROADCAST_MAX_FRAMES ? frame_count - AUDIO_BROADCAST_MAX_FRAMES : 0;
+        }
+
+        /// determines the oldest frame which is within the max lag
+        uint64_t recentFrame() {
+            for (uint64_t j = firstFrameIdx(); j < frame_count; j++) {
+                if (frame(j) + maxLag() >= total) return frame(j);
+            }
+            return total;
+        }
+
+        /// returns true if a frame starts at the indicated position
+        bool isFrameStart(uint64_t pos) {
+            for (uint64_t j = firstFrameIdx(); j < frame_count; j++) {
+                if (frame(j) == pos) return true;
+            }
+            return false;
+        }
+
+        /// determines the start of the frame after the indicated position
+        uint64_t nextFrameStart(uint64_t pos) {
+            for (uint64_t j = firstFrameIdx(); j < frame_count; j++) {
+                if (frame(j) > pos) return frame(j);
+            }
+            return total;
+        }
+
+        /// max number of bytes which we can write to the client w/o blocking
+        size_t writeLimit(Client &client) {
+            int limit = client.availableForWrite();
+            if (limit <= 0 || limit > AUDIO_BROADCAST_WRITE_LIMIT) limit = AUDIO_BROADCAST_WRITE_LIMIT;
+            return limit;
+        }
+
+        /// sends the available data to the client: returns false if the client needs to be removed
+        bool updateClient(BroadcastCursor &cursor) {
+            Client &client = *cursor.p_client;
+            if (!client.connected()) {
+                LOGI("client disconnected");
+                return false;
+            }
+            size_t limit = writeLimit(client);
+            // send the header first
+            if (cursor.header_pos < header_len) {
+                size_t n = client.write(header.data() + cursor.header_pos, min(limit, header_len - cursor.header_pos));
+                cursor.header_pos += n;
+                if (cursor.header_pos < header_len) return true;
+                limit -= n;
+            }
+            // check if the client is too slow: we skip only on frame boundaries unless the data is lost
+            uint64_t end = total;
+            if (total - cursor.pos > maxLag()) {
+                if (late_policy == BroadcastDrop) {
+                    LOGW("dropping slow client");
+                    client.stop();
+                    return false;
+                }
+                bool is_lost = !isValid(cursor.pos);
+                if (is_lost || isFrameStart(cursor.pos)) {
+                    uint64_t pos = recentFrame();
+                    LOGW("client skipped %lu bytes%s", (unsigned long)(pos - cursor.pos), is_lost ? " - frame was cut" : "");
+                    cursor.pos = pos;
+                } else {
+                    // we stop at the end of the current frame, so that we can skip
+                    end = nextFrameStart(cursor.pos);
+                }
+            }
+            // send the data in up to 2 contiguous blocks
+            while (limit > 0 && cursor.pos < end) {
+                size_t idx = cursor.pos % buffer_size;
+                size_t len = min((size_t)(end - cursor.pos), buffer_size - idx);
+                len = min(len, limit);
+                size_t n = client.write(buffer.data() + idx, len);
+                cursor.pos += n;
+                limit -= n;
+                if (n < len) break;
+            }
+            return true;
+        }
+
+        void removeClientIdx(int idx) {
+            for (int j = idx; j < client_count - 1; j++) {
+                clients[j] = clients[j + 1];
+            }
+            client_count--;
+        }
+};
+
+}
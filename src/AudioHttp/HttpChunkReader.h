@@ -9,6 +9,8 @@ namespace audio_tools {
 /**
  * @brief Http might reply with chunks. So we need to dechunk the data.
  * see https://en.wikipedia.org/wiki/Chunked_transfer_encoding
+ * The data is read in bulk via the window of the HttpLineReader: readSlice() provides
+ * the payload without copying it.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
@@ -30,6 +32,7 @@ class HttpChunkReader : public HttpLineReader {
         void open(Client &client){
             LOGD("HttpChunkReader: %s", "open");
             has_ended = false;
+            is_crlf_pending = false;
             readChunkLen(client);
 
         }
@@ -37,94 +40,102 @@ class HttpChunkReader : public HttpLineReader {
         // reads a block of data from the chunks
         virtual int read(Client &client, uint8_t* str, int len) {
             LOGD("HttpChunkReader: %s", "read");
-            if (has_ended && open_chunk_len==0) return 0;
+            if (!nextChunk(client)) return 0;
 
             // read the chunk data - but not more then available
             int read_max = len < open_chunk_len ? len : open_chunk_len;
-            int len_processed = client.read(str, read_max);
-            // update current unprocessed chunk
-            open_chunk_len -= len_processed;
-
-            // remove traling CR LF from data
-            if (open_chunk_len<=0){
-                removeCRLF(client);
-                readChunkLen(client);
-            } 
+            int len_processed = readBytes(client, str, read_max);
+            processed(len_processed);
+            return len_processed;
+        }
 
+        /// Provides a pointer to the next payload bytes of the current chunk without copying them: returns the number of bytes
+        virtual int readSlice(Client &client, const uint8_t* &data, int len) {
+            if (!nextChunk(client)) return 0;
+            int read_max = len < open_chunk_len ? len : open_chunk_len;
+            int len_processed = HttpLineReader::readSlice(client, data, read_max);
+            processed(len_processed);
             return len_processed;
         }
 
         // reads a single line from the chunks
         virtual int readln(Client &client, uint8_t* str, int len, bool incl_nl=true){
             LOGD("HttpChunkReader: %s", "readln");
-            if (has_ended && open_chunk_len==0) return 0;
+            if (!nextChunk(client)) return 0;
 
             int read_max = len < open_chunk_len ? len : open_chunk_len;
             int len_processed = readlnInternal(client, str, read_max, incl_nl);
-            open_chunk_len -= len_processed;
-
-            // the chunks are terminated by a final CRLF
-            if (open_chunk_len<=0){
-                removeCRLF(client);
-                readChunkLen(client);
-            }
-
+            processed(len_processed);
             return len_processed;
 
         }
 
+        using HttpLineReader::available;
+
         int available() {
             int result = has_ended ? 0 : open_chunk_len;
-            char msg[50];
-            sprintf(msg,"available=>%d",result);
-            LOGD("HttpChunkReader: %s",msg);
-
+            LOGD("HttpChunkReader: available=>%d", result);
             return result;
         }
 
+        /// returns true when the last chunk has been received
+        bool isEnded() {
+            return has_ended && open_chunk_len<=0;
+        }
+
+        /// Makes sure that we are positioned on the data of a chunk: returns false if there is no data
+        bool nextChunk(Client &client) {
+            if (has_ended && open_chunk_len<=0) return false;
+            if (is_crlf_pending){
+                // the trailing CR LF and the next length are processed as soon as they are available
+                if (available(client) < 3) return false;
+                removeCRLF(client);
+                readChunkLen(client);
+                if (has_ended) return false;
+            }
+            return open_chunk_len > 0;
+        }
 
     protected:
         int open_chunk_len;
         bool has_ended=false;
-        HttpReplyHeader *http_heaer_ptr; 
+        bool is_crlf_pending = false;
+        HttpReplyHeader *http_heaer_ptr = nullptr; 
 
+        void processed(int len) {
+            if (len <= 0) return;
+            // update current unprocessed chunk
+            open_chunk_len -= len;
+            if (open_chunk_len<=0){
+                is_crlf_pending = true;
+            }
+        }
 
+        // remove traling CR LF from data
         void removeCRLF(Client &client){
             LOGD("HttpChunkReader: %s", "removeCRLF");
-            // remove traling CR LF from data
-            if (client.peek()=='\r'){
-                LOGD("HttpChunkReader: %s", "removeCR");
-                client.read();
-            }
-            if (client.peek()=='\n'){
-                LOGD("HttpChunkReader: %s", "removeLF");
-                client.read();
-            }
+            uint8_t crlf[3];
+            readlnInternal(client, crlf, sizeof(crlf), false);
+            is_crlf_pending = false;
         }
 
-
         // we read the chunk length which is indicated as hex value
         virtual void readChunkLen(Client &client) {
             LOGD("HttpChunkReader::readChunkLen");
             uint8_t len_str[51];
             readlnInternal(client, len_str, 50, false);
-            LOGD("HttpChunkReader::readChunkLen %s", (const char*)len_str);
             open_chunk_len = strtol((char*)len_str, nullptr, 16);
-
-            char msg[40];
-            sprintf(msg, "chunk_len: %d",open_chunk_len);
-            LOGD("HttpChunkReader::readChunkLen->%s", msg);
+            LOGD("HttpChunkReader::readChunkLen->chunk_len: %d", open_chunk_len);
 
             if (open_chunk_len==0){
                 has_ended = true;
                 LOGD("HttpChunkReader::readChunkLen %s", "last chunk received");
                 // processing of additinal final headers after the chunk end
                 if (http_heaer_ptr!=nullptr){
-                     http_heaer_ptr->readExt(client);
+                     http_heaer_ptr->readExt(client, *this);
                 }
             }
         }
 };   
 
 }
-
@@ -29,25 +29,34 @@ const char* HOST_C = "Host";
 const char* ACCEPT_ENCODING = "Accept-Encoding";
 const char* IDENTITY = "identity";
 const char* LOCATION = "Location";
+const char* RANGE = "Range";
+const char* CONTENT_RANGE = "Content-Range";
+const char* ACCEPT_RANGES = "Accept-Ranges";
+const char* ICY_METAINT = "icy-metaint";
 
 
 // Http methods
 const char* methods[] = {"?","GET","HEAD","POST","PUT","DELETE","TRACE","OPTIONS","CONNECT","PATCH",nullptr};
 
 /**
- * @brief A individual key - value header line 
- * 
+ * @brief A individual key - value header line: the key and value are not owned by the line
+ * but point into the buffer of the HttpHeader
  */
 struct HttpHeaderLine {
-    StrExt key;
-    StrExt value;
-    bool active;
+    const char* key = nullptr;
+    const char* value = nullptr;
+    uint16_t key_len = 0;
+    uint16_t value_capacity = 0;
+    bool active = false;
 };
 
 /**
  * @brief In a http request and reply we need to process header information. With this API
- * we can define and query the header information. The individual header lines are stored
- * in a vector. This is the common functionality for the HttpRequest and HttpReplyHeader
+ * we can define and query the header information. The keys and values are stored in a 
+ * fixed buffer (HTTP_HEADER_BUFFER_SIZE) and the lines are just views into this buffer, so 
+ * no heap allocations are needed for processing the headers. The frequently used headers 
+ * (Content-Length, Transfer-Encoding, Location, icy-metaint, Content-Type...) are found via
+ * precomputed slots. This is the common functionality for the HttpRequest and HttpReplyHeader
  * subclasses
  * @author Phil Schatzmann
  * @copyright GPLv3
@@ -61,34 +70,25 @@ class HttpHeader {
             protocol_str = "HTTP/1.1";
             url_path = "/";
             status_msg = "";
+            clearLines();
         }
         ~HttpHeader(){
             LOGI("~HttpHeader");
-            clear(true);
         }
 
-        /// clears the data - usually we do not delete but we just set the active flag
+        /// clears the data: the flag is only relevant for compatibility reasons because we just reset the buffer
         HttpHeader& clear(bool activeFlag=true) {
             is_written = false;
             is_chunked = false;
             url_path = "/";
-            for (auto it = lines.begin() ; it != lines.end(); ++it){
-                if (activeFlag){
-                    (*it)->active = false;
-                } else {
-                    delete *it;
-                }
-            }
-            if (!activeFlag){
-                lines.clear();
-            }
+            clearLines();
             return *this;
         }
 
         HttpHeader& put(const char* key, const char* value){
             if (value!=nullptr && strlen(value)>0){
                 LOGD("HttpHeader::put %s %s", key, value);
-                HttpHeaderLine *hl = headerLine(key);
+                HttpHeaderLine *hl = headerLine(key, key!=nullptr ? strlen(key) : 0);
                 if (hl==nullptr){
                     LOGE("HttpHeader::put - did not add HttpHeaderLine for %s", key);
                     return *this;
@@ -96,14 +96,7 @@ class HttpHeader {
 
                 // log entry
                 LOGD("HttpHeader::put -> '%s' : '%s'", key, value);
-
-                hl->value = value;
-                hl->active = true;
-
-                if (Str(key) == TRANSFER_ENCODING &&  Str(value) == CHUNKED){
-                    LOGD("HttpHeader::put -> is_chunked!!!");
-                    this->is_chunked = true;
-                }
+                setValue(hl, value, strlen(value));
             } else {
                 LOGD("HttpHeader::put - value ignored because it is null for %s", key);
             }
@@ -113,51 +106,43 @@ class HttpHeader {
         /// adds a new line to the header - e.g. for content size
         HttpHeader& put(const char* key, int value){
             LOGD("HttpHeader::put %s %d", key, value);
-            HttpHeaderLine *hl = headerLine(key);
-
-            if (value>1000){
-                LOGW("value is > 1000");
-            }
-
-            // add value
-            hl->value = value;
-            hl->active = true;
-            LOGI("%s %s", key, hl->value.c_str());
-            return *this;
+            char value_str[12];
+            snprintf(value_str, sizeof(value_str), "%d", value);
+            return put(key, value_str);
         }
 
         /// adds a  received new line to the header
         HttpHeader& put(const char* line){
             LOGD("HttpHeader::put -> %s", (const char*) line);
-            Str keyStr(line);
-            int pos = keyStr.indexOf(":");
-            char *key = (char*)line;
-            key[pos] = 0;
+            const char* colon = strchr(line, ':');
+            if (colon==nullptr){
+                LOGW("HttpHeader::put - invalid line: %s", line);
+                return *this;
+            }
+            int key_len = colon - line;
+            while (key_len > 0 && line[key_len-1]==' ') key_len--;
 
             // usually there is a leading space - but unfurtunately not always
-            const char *value = line+pos+1;
-            if (value[0]==' '){
-                value = line+pos+2;
+            const char *value = colon+1;
+            while (*value==' ') value++;
+            if (*value==0) return *this;
+
+            HttpHeaderLine *hl = headerLine(line, key_len);
+            if (hl!=nullptr){
+                setValue(hl, value, strlen(value));
             }
-            return put((const char*)key, value);
+            return *this;
         }
 
         // determines a header value with the key
         const char* get(const char* key){
-            for (auto it = lines.begin() ; it != lines.end(); ++it){
-                HttpHeaderLine *line = *it;
-                line->key.trim();
-                if (line->key.equalsIgnoreCase(key)){
-                    const char* result = line->value.c_str();
-                    return line->active ? result : nullptr;
-                }
-            }
-            return nullptr;
+            HttpHeaderLine *line = findLine(key, key!=nullptr ? strlen(key) : 0);
+            return line!=nullptr && line->active ? line->value : nullptr;
         }
 
         // reads a single header line 
         void readLine(Client &in, char* str, int len){
-            reader.readlnInternal(in, (uint8_t*) str, len, false);
+            p_reader->readlnInternal(in, (uint8_t*) str, len, false);
             LOGI("HttpHeader::readLine -> %s",str);
         }
 
@@ -167,21 +152,21 @@ class HttpHeader {
                 LOGI("HttpHeader::writeHeaderLine: the value must not be null");
                 return;
             }
-            LOGD("HttpHeader::writeHeaderLine: %s",header->key.c_str());
+            LOGD("HttpHeader::writeHeaderLine: %s",header->key);
             if (!header->active){
                 LOGI("HttpHeader::writeHeaderLine - not active");
                 return;
             }
-            if (header->value.c_str() == nullptr){
+            if (header->value == nullptr){
                 LOGI("HttpHeader::writeHeaderLine - ignored because value is null");
                 return;
             }
 
             char msg[200];
             Str msg_str(msg,200);
-            msg_str = header->key.c_str();
+            msg_str = header->key;
             msg_str += ": ";
-            msg_str += header->value.c_str();
+            msg_str += header->value;
             msg_str += CRLF;
             out.print(msg);
 
@@ -221,21 +206,28 @@ class HttpHeader {
 
         /// reads the full header from the request (stream)
         void read(Client &in) {
+            read(in, reader);
+        }
+
+        /// reads the full header with the indicated reader: the reader buffers the data which follows the header
+        void read(Client &in, HttpLineReader &lineReader) {
             LOGI("HttpHeader::read");
+            p_reader = &lineReader;
             // remove all existing value
             clear();
+            status_code = UNDEFINED;
 
             char line[MAX_HTTP_HEADER_LINE_LENGTH];   
             if (in.connected()){
-                if (in.available()==0) {
+                if (p_reader->available(in)==0) {
                     LOGW("Waiting for data...");
-                    while(in.available()==0){
+                    while(p_reader->available(in)==0){
                         delay(500);
                     }
                 }
                 readLine(in, line, MAX_HTTP_HEADER_LINE_LENGTH);
                 parse1stLine(line);
-                while (in.available()){
+                while (p_reader->available(in)){
                     readLine(in, line, MAX_HTTP_HEADER_LINE_LENGTH);
                     if (isValidStatus() || isRedirectStatus()){
                         Str lineStr(line);
@@ -253,8 +245,8 @@ class HttpHeader {
         void write(Client &out){
             LOGI("HttpHeader::write");
             write1stLine(out);
-            for (auto it = lines.begin() ; it != lines.end(); ++it){
-                writeHeaderLine(out, *it);
+            for (int j=0; j<line_count; j++){
+                writeHeaderLine(out, &lines[j]);
             }
             // print empty line
             crlf(out);
@@ -262,7 +254,7 @@ class HttpHeader {
             is_written = true;
         }
 
-        /// automatically create new lines
+        /// automatically create new lines: if this is false we only keep the known header lines
         void setAutoCreateLines(bool is_auto_line){
             create_new_lines = is_auto_line;
         }
@@ -276,19 +268,40 @@ class HttpHeader {
             return status_code >= 300 && status_code < 400;
         }
 
+        /// Number of header lines
+        int lineCount() {
+            return line_count;
+        }
+
+        /// Number of bytes which are used in the header buffer
+        int bufferUsed() {
+            return buffer_used;
+        }
+
     protected:
+        /// Headers which can be found w/o search
+        enum KnownHeader {ContentLengthSlot, TransferEncodingSlot, LocationSlot, IcyMetaintSlot, ContentTypeSlot, 
+                          ConnectionSlot, ContentRangeSlot, KnownHeaderCount};
+        const char* known_headers[KnownHeaderCount] = {CONTENT_LENGTH, TRANSFER_ENCODING, LOCATION, ICY_METAINT,
+                          CONTENT_TYPE, CONNECTION, CONTENT_RANGE};
         int status_code = UNDEFINED;
         bool is_written = false;
         bool is_chunked = false;
         bool create_new_lines = true;
         MethodID method_id;
-        // we store the values on the heap. this is acceptable because we just have one instance for the
-        // requests and one for the replys: which needs about 2*100 bytes 
+        // the first line is stored on the heap. this is acceptable because the size is allocated only once: 
+        // which needs about 100 bytes 
         StrExt protocol_str = StrExt(10);
         StrExt url_path = StrExt(70);
         StrExt status_msg = StrExt(20);
-        Vector<HttpHeaderLine*> lines;
+        // the keys and values are stored in a fixed buffer
+        char buffer[HTTP_HEADER_BUFFER_SIZE];
+        int buffer_used = 0;
+        HttpHeaderLine lines[HTTP_MAX_HEADER_LINES];
+        int line_count = 0;
+        int8_t slots[KnownHeaderCount];
         HttpLineReader reader;
+        HttpLineReader *p_reader = &reader;
         const char* CRLF = "\r\n";
 
         // the headers need to delimited with CR LF
@@ -297,32 +310,159 @@ class HttpHeader {
             LOGI(" -> %s ", "<CR LF>");
         }
 
+        void clearLines() {
+            buffer_used = 0;
+            line_count = 0;
+            memset(slots, -1, sizeof(slots));
+        }
+
+        /// determines the slot of a known header: we first check the pointer so that the constants are found fast
+        int knownSlot(const char* key, int len) {
+            for (int j=0; j<KnownHeaderCount; j++){
+                if (key==known_headers[j]) return j;
+            }
+            for (int j=0; j<KnownHeaderCount; j++){
+                if (equalsIgnoreCase(known_headers[j], strlen(known_headers[j]), key, len)) return j;
+            }
+            return -1;
+        }
+
+        static bool equalsIgnoreCase(const char* str1, int len1, const char* str2, int len2) {
+            if (len1!=len2) return false;
+            for (int j=0;j<len1;j++){
+                if (tolower(str1[j]) != tolower(str2[j]))
+                    return false;
+            }
+            return true;
+        }
+
+        /// finds a header line by key 
+        HttpHeaderLine *findLine(const char* key, int len) {
+            if (key==nullptr) return nullptr;
+            int slot = knownSlot(key, len);
+            if (slot>=0){
+                return slots[slot]>=0 ? &lines[slots[slot]] : nullptr;
+            }
+            for (int j=0; j<line_count; j++){
+                if (equalsIgnoreCase(lines[j].key, lines[j].key_len, key, len)){
+                    return &lines[j];
+                }
+            }
+            return nullptr;
+        }
+
         // gets or creates a header line by key
-        HttpHeaderLine *headerLine(const char* key) {
+        HttpHeaderLine *headerLine(const char* key, int len) {
             if (key!=nullptr){
-                for (auto it = lines.begin() ; it != lines.end(); ++it){
-                    HttpHeaderLine *pt = (*it);
-                    if (pt!=nullptr && pt->key.c_str()!=nullptr){
-                        if (pt->key.equalsIgnoreCase(key)){
-                            pt->active = true;
-                            return pt;
-                        }
-                    }
+                HttpHeaderLine *result = findLine(key, len);
+                if (result!=nullptr){
+                    result->active = true;
+                    return result;
+                }
+                int slot = knownSlot(key, len);
+                if (!create_new_lines && slot<0){
+                    return nullptr;
                 }
-                if (create_new_lines){
-                    HttpHeaderLine *newLine = new HttpHeaderLine();
-                    LOGD("HttpHeader::headerLine - new line created for %s", key);
-                    newLine->active = true;
-                    newLine->key = key;
-                    lines.push_back(newLine);
-                    return newLine;
+                if (line_count>=HTTP_MAX_HEADER_LINES){
+                    LOGE("HttpHeader::headerLine - too many lines: increase HTTP_MAX_HEADER_LINES");
+                    return nullptr;
                 }
+                char* key_str = store(key, len);
+                if (key_str==nullptr){
+                    return nullptr;
+                }
+                LOGD("HttpHeader::headerLine - new line created for %s", key_str);
+                result = &lines[line_count];
+                *result = HttpHeaderLine();
+                result->key = key_str;
+                result->key_len = len;
+                result->active = true;
+                if (slot>=0) slots[slot] = line_count;
+                line_count++;
+                return result;
             } else {
                 LOGI("HttpHeader::headerLine %s", "The key must not be null");
             }
             return nullptr;            
         }
 
+        /// copies the string with a terminating 0 into the buffer
+        char* store(const char* str, int len) {
+            if (buffer_used + len + 1 > HTTP_HEADER_BUFFER_SIZE){
+                compact();
+                if (buffer_used + len + 1 > HTTP_HEADER_BUFFER_SIZE){
+                    LOGE("HttpHeader - buffer full: increase HTTP_HEADER_BUFFER_SIZE");
+                    return nullptr;
+                }
+            }
+            char* result = buffer + buffer_used;
+            memmove(result, str, len);
+            result[len] = 0;
+            buffer_used += len + 1;
+            return result;
+        }
+
+        /// updates the value: we overwrite the old value if the new one fits
+        void setValue(HttpHeaderLine *hl, const char* value, int len) {
+            if (hl->value==value) {
+                hl->active = true;
+                return;
+            }
+            if (hl->value!=nullptr && len < hl->value_capacity){
+                char* value_str = (char*) hl->value;
+                memmove(value_str, value, len);
+                value_str[len] = 0;
+            } else {
+                // compacting the buffer would move a value which is located in the buffer
+                bool is_internal = value >= buffer && value < buffer + HTTP_HEADER_BUFFER_SIZE;
+                if (is_internal && buffer_used + len + 1 > HTTP_HEADER_BUFFER_SIZE){
+                    LOGE("HttpHeader - buffer full: increase HTTP_HEADER_BUFFER_SIZE");
+                    return;
+                }
+                hl->value = nullptr;
+                const char* value_str = store(value, len);
+                if (value_str==nullptr) return;
+                hl->value = value_str;
+                hl->value_capacity = len + 1;
+            }
+            hl->active = true;
+            int chunked_idx = slots[TransferEncodingSlot];
+            if (chunked_idx>=0 && hl==&lines[chunked_idx] && Str(hl->value).equalsIgnoreCase(CHUNKED)){
+                LOGD("HttpHeader::put -> is_chunked!!!");
+                this->is_chunked = true;
+            }
+        }
+
+        /// removes the unused space from the buffer: the strings are moved down in the sequence of their position
+        void compact() {
+            LOGI("HttpHeader::compact");
+            int pos = 0;
+            const char* last = nullptr;
+            while (true) {
+                // find the next string after the last one
+                const char** next = nullptr;
+                for (int j=0; j<line_count; j++){
+                    const char** candidates[2] = {&lines[j].key, &lines[j].value};
+                    for (const char** candidate : candidates){
+                        if (*candidate!=nullptr && *candidate > last && (next==nullptr || *candidate < *next)){
+                            next = candidate;
+                        }
+                    }
+                }
+                if (next==nullptr) break;
+                int len = strlen(*next) + 1;
+                memmove(buffer + pos, *next, len);
+                *next = buffer + pos;
+                last = *next;
+                pos += len;
+            }
+            buffer_used = pos;
+            // the space of the values is now limited to the actual length
+            for (int j=0; j<line_count; j++){
+                if (lines[j].value!=nullptr) lines[j].value_capacity = strlen(lines[j].value) + 1;
+            }
+        }
+
         MethodID getMethod(const char* line){
             // set action
             for (int j=0; methods[j]!=nullptr;j++){
@@ -419,8 +559,9 @@ class HttpReplyHeader : public HttpHeader  {
         }
 
         // reads the final chunked reply headers 
-        void readExt(Client &in) {
+        void readExt(Client &in, HttpLineReader &lineReader) {
             LOGI("HttpReplyHeader::readExt");
+            p_reader = &lineReader;
             char line[MAX_HTTP_HEADER_LINE_LENGTH];   
             readLine(in, line, MAX_HTTP_HEADER_LINE_LENGTH);
             while(strlen(line)!=0){
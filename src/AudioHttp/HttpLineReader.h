@@ -1,12 +1,26 @@
 #pragma once
 
+#include "AudioConfig.h"
 #include "AudioTools/AudioLogger.h"
+#include "AudioBasic/Collections.h"
+#include "Client.h"
+
+#ifndef HTTP_READER_BUFFER_SIZE
+#define HTTP_READER_BUFFER_SIZE 512
+#endif
+
+#ifndef HTTP_READER_TIMEOUT
+#define HTTP_READER_TIMEOUT 2000
+#endif
 
 namespace audio_tools {
 
 /**
 * @brief We read a single line. A terminating 0 is added to the string to make it
-* compliant for c string functions.
+* compliant for c string functions. The data is read in bulk into a local window
+* and the line end is determined with memchr. Because the window might contain
+* more data then the line, all subsequent reads from the same stream need to go
+* via this reader (see readBytes()).
 * @author Phil Schatzmann
 * @copyright GPLv3
 */
@@ -14,65 +28,128 @@ namespace audio_tools {
 class HttpLineReader {
    public:
        HttpLineReader(){}
+
        // reads up the the next CR LF - but never more then the indicated len. returns the number of characters read including crlf
-       virtual int readlnInternal(Stream &client, uint8_t* str, int len, bool incl_nl=true){
-           int result = 0;
+       virtual int readlnInternal(Client &client, uint8_t* str, int len, bool incl_nl=true){
            LOGD( "HttpLineReader %s","readlnInternal");
-           // wait for first character
-           for (int w=0;w<20 && client.available()==0; w++){
-               delay(100);
+           setClient(client);
+           uint8_t *nl = nullptr;
+           unsigned long timeout = millis() + HTTP_READER_TIMEOUT;
+           // make sure that we have a full line in the window
+           while ((nl = findNewLine()) == nullptr && buffered() < (int)buffer.size()){
+               if (fill() == 0){
+                   if (millis() > timeout) break;
+                   delay(5);
+               }
            }
            // if we do not have any data we stop
-           if (client.available()==0) {
+           if (buffered()==0) {
                LOGW( "HttpLineReader %s","readlnInternal->no Data");
                str[0]=0;
                return 0;
            }
 
-           // process characters until we find a new line
-           bool is_buffer_owerflow = false;
-           int j=0;
-           while (true){
-               int c = client.read();
-               if (c==-1){
-                   break;
-               }
+           // we return the line incl the new line or the available data
+           int line_len = nl != nullptr ? nl - (buffer.data() + read_pos) + 1 : buffered();
+           int result = line_len < len ? line_len : len;
+           int copy_len = result;
+           if (nl != nullptr && !incl_nl) {
+               // remove cr lf
+               copy_len = line_len - 1;
+               if (copy_len > 0 && buffer[read_pos + copy_len - 1] == '\r') copy_len--;
+           }
+           if (copy_len > len - 1) copy_len = len - 1;
+           memcpy(str, buffer.data() + read_pos, copy_len);
+           str[copy_len] = 0;
+           read_pos += line_len;
+           if (line_len > len){
+               LOGE("Line cut off: %s", str);
+           }
+           return result;
+       }
 
-               if (j<len){
-                   result++;
-               } else {
-                   is_buffer_owerflow = true;
-               }
+       /// reads the data: we provide the buffered data first and then read directly from the stream
+       virtual int readBytes(Client &client, uint8_t* data, int len){
+           setClient(client);
+           int result = buffered();
+           if (result > 0){
+               if (result > len) result = len;
+               memcpy(data, buffer.data() + read_pos, result);
+               read_pos += result;
+               return result;
+           }
+           // bulk read of the available data without blocking
+           int avail = client.available();
+           if (len > avail) len = avail;
+           int read = len > 0 ? client.read(data, len) : 0;
+           return read > 0 ? read : 0;
+       }
 
-               if (c=='\n'){
-                   if (incl_nl){
-                       str[j]=c;
-                       break;
-                   } else {
-                       // remove cr lf
-                       if (j>=1){
-                           if (str[j-1]=='\r'){
-                               // remove cr
-                               str[j-1]=0;
-                               break;;
-                           } else {
-                               // remove nl
-                               str[j]=0;
-                               break;
-                           }
-                       }
-                   }
-               }
-               if (!is_buffer_owerflow){
-                   str[j] = c;
-               }
-               j++;
+       /// Provides a pointer to up to len buffered bytes without copying them: returns the number of bytes
+       virtual int readSlice(Client &client, const uint8_t* &data, int len){
+           setClient(client);
+           if (buffered()==0) fill();
+           int result = buffered() < len ? buffered() : len;
+           data = buffer.data() + read_pos;
+           read_pos += result;
+           return result;
+       }
+
+       /// Number of bytes which are available in the window and the stream
+       virtual int available(Client &client) {
+           if (p_client != &client) return client.available();
+           return buffered() + client.available();
+       }
+
+       /// Number of unprocessed bytes in the window
+       int buffered() {
+           return write_pos - read_pos;
+       }
+
+       /// Removes the buffered data: e.g. when a new connection is opened
+       void clear() {
+           read_pos = 0;
+           write_pos = 0;
+       }
+
+   protected:
+       Vector<uint8_t> buffer{0};
+       Client *p_client = nullptr;
+       int read_pos = 0;
+       int write_pos = 0;
+
+       /// The buffered data belongs to a specific client
+       void setClient(Client &client) {
+           if (p_client != &client){
+               p_client = &client;
+               clear();
            }
-           str[result-1]=0;
-           if (is_buffer_owerflow){
-               LOGE("Line cut off: %s", str);
+           if (buffer.size()==0){
+               buffer.resize(HTTP_READER_BUFFER_SIZE);
            }
+       }
 
+       uint8_t* findNewLine() {
+           return (uint8_t*) memchr(buffer.data() + read_pos, '\n', buffered());
+       }
+
+       /// reads the available data in bulk into the window: returns the number of new bytes
+       int fill() {
+           if (read_pos > 0 && read_pos == write_pos){
+               clear();
+           } else if (read_pos > 0 && write_pos == (int)buffer.size()){
+               // move the unprocessed data to the start
+               memmove(buffer.data(), buffer.data() + read_pos, buffered());
+               write_pos -= read_pos;
+               read_pos = 0;
+           }
+           int len = p_client->available();
+           int space = buffer.size() - write_pos;
+           if (len > space) len = space;
+           if (len <= 0) return 0;
+           int result = p_client->read(buffer.data() + write_pos, len);
+           if (result < 0) return 0;
+           write_pos += result;
            return result;
        }
 };
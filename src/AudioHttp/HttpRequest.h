@@ -41,10 +41,28 @@ class HttpRequest {
         }
 
         void setClient(Client &client){
+            if (this->client_ptr != &client){
+                // we do not know to which host the new client is connected
+                connected_host = "";
+                connected_port = -1;
+                is_own_connection = false;
+            }
             this->client_ptr = &client;
             this->client_ptr->setTimeout(clientTimeout);
         }
 
+        /// Defines a client which is already connected to the host of the url (e.g. from a connection pool)
+        /// and which can be reused for the next request
+        void setConnectedClient(Client &client, Url &url){
+            setClient(client);
+            connected_host = url.host();
+            connected_port = url.port();
+            reply_header.clear();
+            content_remaining = 0;
+            is_ready = true;
+            is_own_connection = true;
+        }
+
         // the requests usually need a host. This needs to be set if we did not provide a URL
         void setHost(const char* host){
             LOGI("setHost %s", host);
@@ -60,10 +78,14 @@ class HttpRequest {
         } 
 
         virtual int available() {
+            if (client_ptr == nullptr) return 0;
             if (reply_header.isChunked()){
+                chunk_reader.nextChunk(*client_ptr);
                 return chunk_reader.available();
             }
-            return client_ptr != nullptr ? client_ptr->available() : 0;
+            int result = chunk_reader.available(*client_ptr);
+            // on a persistent connection we must not read into the next reply
+            return content_remaining >= 0 && result > content_remaining ? content_remaining : result;
         }
 
         virtual void stop(){
@@ -71,6 +93,10 @@ class HttpRequest {
                 LOGI("stop");
                 client_ptr->stop();
             }
+            connected_host = "";
+            connected_port = -1;
+            is_own_connection = false;
+            chunk_reader.clear();
         }
 
         virtual int post(Url &url, const char* mime, const char *data, int len=-1){
@@ -105,10 +131,26 @@ class HttpRequest {
             if (reply_header.isChunked()){
                 return chunk_reader.read(*client_ptr, str, len);
             } else {
-                return client_ptr->read(str, len);
+                if (content_remaining >= 0 && len > content_remaining) len = content_remaining;
+                if (len <= 0) return 0;
+                int result = chunk_reader.readBytes(*client_ptr, str, len);
+                if (content_remaining > 0 && result > 0) content_remaining -= result;
+                return result;
             }
         }
 
+        /// Provides a pointer to the next received bytes without copying them: returns the number of bytes
+        virtual int readSlice(const uint8_t* &data, int len){
+            if (reply_header.isChunked()){
+                return chunk_reader.readSlice(*client_ptr, data, len);
+            }
+            if (content_remaining >= 0 && len > content_remaining) len = content_remaining;
+            if (len <= 0) return 0;
+            int result = chunk_reader.HttpLineReader::readSlice(*client_ptr, data, len);
+            if (content_remaining > 0 && result > 0) content_remaining -= result;
+            return result;
+        }
+
         // read the reply data up to the next new line. For Chunked data we provide 
         // the full chunk!
         virtual int readln(uint8_t* str, int len, bool incl_nl=true){
@@ -159,51 +201,107 @@ class HttpRequest {
         bool isReady() {
             return is_ready;
         }
+
+        /// Requests only the indicated byte range with the next request: end is inclusive, -1 requests the data up to the end
+        virtual void setRange(long start, long end=-1){
+            range_start = start;
+            range_end = end;
+        }
+
+        /// Position of the first byte of the received data: 0 if we did not get a 206 Partial Content reply
+        long rangeStart() {
+            return reply_range_start;
+        }
+
+        /// Total size of the resource (from Content-Range or Content-Length): -1 if it is not known
+        long totalSize() {
+            return total_size;
+        }
+
+        /// returns true if the server replied with 206 Partial Content
+        bool isPartialContent() {
+            return reply_header.statusCode() == 206;
+        }
+
+        /// returns true if the connection can be used for the next request: the reply must have been 
+        /// fully consumed and both sides need to agree on keep-alive
+        bool isReusable() {
+            if (!connected() || !is_ready || connection == nullptr || !Str(connection).equalsIgnoreCase(CON_KEEP_ALIVE)) return false;
+            const char* reply_con = reply_header.get(CONNECTION);
+            if (reply_con != nullptr && Str(reply_con).equalsIgnoreCase(CON_CLOSE)) return false;
+            return reply_header.isChunked() ? chunk_reader.isEnded() : content_remaining == 0;
+        }
    
     protected:
-        Client *client_ptr;
+        Client *client_ptr = nullptr;
         Url url;
         HttpRequestHeader request_header;
         HttpReplyHeader reply_header;
-        HttpChunkReader chunk_reader = HttpChunkReader(reply_header);
+        // the chunk reader is also used to read the reply header and unchunked data, so that they share the same window
+        HttpChunkReader chunk_reader{reply_header};
         const char *agent = nullptr;
         const char *host_name=nullptr;
         const char *connection = CON_CLOSE;
         const char *accept = ACCEPT_ALL;
         const char *accept_encoding = nullptr;
         bool is_ready = false;
+        // the connection has been opened by us and not by the caller
+        bool is_own_connection = false;
         int32_t clientTimeout = URL_CLIENT_TIMEOUT; // 60000;
+        StrExt connected_host = StrExt(20);
+        int connected_port = -1;
+        long content_remaining = -1;
+        long range_start = -1;
+        long range_end = -1;
+        long reply_range_start = 0;
+        long total_size = -1;
 
         // opens a connection to the indicated host
         virtual int connect(const char *ip, uint16_t port, int32_t timeout) {
             client_ptr->setTimeout(timeout);
+            chunk_reader.clear();
             int is_connected = this->client_ptr->connect(ip, port);
             LOGI("connected %d timeout %d", is_connected, timeout);
+            if (is_connected==1){
+                connected_host = ip;
+                connected_port = port;
+                is_own_connection = true;
+            }
             return is_connected;
         }
 
-        // sends request and reads the reply_header from the server
-        virtual int process(MethodID action, Url &url, const char* mime, const char *data, int len=-1){
-            is_ready = false;
-            if (client_ptr==nullptr){
-                LOGE("The client has not been defined");
-                return -1;
-            }
-            if (!this->connected()){
-                LOGI("process connecting to host %s port %d", url.host(), url.port());
-                int is_connected = connect(url.host(), url.port(), clientTimeout);
-                if (is_connected!=1){
-                    LOGE("Connect failed");
-                    return -1;
-                }
+        // returns true if the open connection can be used for the indicated url
+        bool isReusable(Url &url) {
+            return isReusable() && connected_port == url.port() && connected_host.equals(url.host());
+        }
+
+        // determines the size information from the reply
+        void processReplySizes(MethodID action) {
+            int status = reply_header.statusCode();
+            const char* len_str = reply_header.get(CONTENT_LENGTH);
+            if (action == HEAD || status == 204 || status == 304) {
+                content_remaining = 0;
+            } else if (len_str != nullptr) {
+                content_remaining = atol(len_str);
             } else {
-                LOGI("process is already connected");
+                // we need to read until the connection is closed
+                content_remaining = -1;
             }
+            reply_range_start = 0;
+            total_size = len_str != nullptr ? atol(len_str) : -1;
+            // Content-Range: bytes 100-999/1000
+            const char* range = reply_header.get(CONTENT_RANGE);
+            if (status == 206 && range != nullptr) {
+                const char* start = strchr(range, ' ');
+                const char* total = strchr(range, '/');
+                if (start != nullptr) reply_range_start = atol(start + 1);
+                total_size = total != nullptr && total[1] != '*' ? atol(total + 1) : -1;
+                LOGI("Content-Range: %ld of %ld", reply_range_start, total_size);
+            }
+        }
 
-#ifdef ESP32
-            LOGI("Free heap: %u", ESP.getFreeHeap());
-#endif
-
+        // defines the header lines of the request
+        void setupRequestHeader(MethodID action, Url &url, const char* mime, const char *data, int &len) {
             host_name = url.host();                
             request_header.setValues(action, url.path());
             if (len>0 && data!=nullptr){
@@ -216,8 +314,26 @@ class HttpRequest {
             request_header.put(ACCEPT_ENCODING, accept_encoding);
             request_header.put(ACCEPT, accept);
             request_header.put(CONTENT_TYPE, mime);
-            request_header.write(*client_ptr);
+            if (range_start >= 0){
+                // "bytes=" + 2 numbers with up to 20 digits + "-"
+                char range[6 + 20 + 1 + 20 + 1];
+                int range_len;
+                if (range_end >= 0){
+                    range_len = snprintf(range, sizeof(range), "bytes=%ld-%ld", range_start, range_end);
+                } else {
+                    range_len = snprintf(range, sizeof(range), "bytes=%ld-", range_start);
+                }
+                if (range_len > 0 && range_len < (int)sizeof(range)){
+                    request_header.put(RANGE, range);
+                } else {
+                    LOGE("Invalid range: %ld-%ld", range_start, range_end);
+                }
+            }
+        }
 
+        // sends the request header and data and reads the reply header
+        void sendRequest(const char *data, int len) {
+            request_header.write(*client_ptr);
             if (len>0){
                 LOGI("Writing data: %d bytes", len);
                 client_ptr->write((const uint8_t*)data,len);
@@ -226,7 +342,60 @@ class HttpRequest {
             
             LOGI("Request written ... waiting for reply")
             client_ptr->flush();
-            reply_header.read(*client_ptr);
+            reply_header.read(*client_ptr, chunk_reader);
+        }
+
+        // sends request and reads the reply_header from the server
+        virtual int process(MethodID action, Url &url, const char* mime, const char *data, int len=-1){
+            if (client_ptr==nullptr){
+                LOGE("The client has not been defined");
+                return -1;
+            }
+            bool is_reused = false;
+            if (this->connected()){
+                if (!is_own_connection){
+                    // we use the connection which has been opened by the caller
+                    LOGI("process is already connected");
+                    is_reused = true;
+                } else if (isReusable(url)){
+                    LOGI("process is reusing the connection to %s", url.host());
+                    is_reused = true;
+                } else {
+                    LOGI("process is closing the connection");
+                    stop();
+                }
+            }
+            is_ready = false;
+            if (!is_reused){
+                LOGI("process connecting to host %s port %d", url.host(), url.port());
+                int is_connected = connect(url.host(), url.port(), clientTimeout);
+                if (is_connected!=1){
+                    LOGE("Connect failed");
+                    return -1;
+                }
+            }
+
+#ifdef ESP32
+            LOGI("Free heap: %u", ESP.getFreeHeap());
+#endif
+
+            setupRequestHeader(action, url, mime, data, len);
+            sendRequest(data, len);
+
+            // the server might have closed the persistent connection in the meantime: we retry once
+            if (is_reused && is_own_connection && reply_header.statusCode() == UNDEFINED){
+                LOGW("Persistent connection was closed - reconnecting");
+                stop();
+                if (connect(url.host(), url.port(), clientTimeout)!=1){
+                    LOGE("Connect failed");
+                    return -1;
+                }
+                setupRequestHeader(action, url, mime, data, len);
+                sendRequest(data, len);
+            }
+            // the range is only used for a single request
+            range_start = -1;
+            processReplySizes(action);
 
             // if we use chunked tranfer we need to read the first chunked length
             if (reply_header.isChunked()){
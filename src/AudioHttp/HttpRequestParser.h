@@ -0,0 +1,140 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "Client.h"
+
+namespace audio_tools {
+
+/// Processing state of the HttpRequestParser
+enum HttpRequestState { HttpRequestLine, HttpRequestHeaders, HttpRequestComplete, HttpRequestError };
+
+/**
+ * @brief Incremental parser for a HTTP request which can be polled without blocking: we
+ * process the data which is available and keep the state between the calls. The request
+ * line is stored in a fixed buffer and split into the method, path and version. The headers
+ * are only scanned for the empty line which terminates the request. Since an audio server
+ * expects GET requests, data which is received after the headers is ignored.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class HttpRequestParser {
+ public:
+  HttpRequestParser() = default;
+
+  /// Starts the processing of a new request
+  void begin() {
+    state = HttpRequestLine;
+    line_len = 0;
+    start_ms = millis();
+    request_line[0] = 0;
+    p_method = request_line;
+    p_path = request_line;
+    p_version = request_line;
+  }
+
+  /// Processes the available data of the client: returns true when the request is complete
+  bool poll(Client &client) {
+    uint8_t chunk[64];
+    while (state == HttpRequestLine || state == HttpRequestHeaders) {
+      int len = client.available();
+      if (len <= 0) break;
+      if (len > (int)sizeof(chunk)) len = sizeof(chunk);
+      len = client.read(chunk, len);
+      if (len <= 0) break;
+      write(chunk, len);
+    }
+    if (!isDone() && millis() - start_ms > HTTP_REQUEST_TIMEOUT) {
+      LOGW("HTTP request timeout");
+      state = HttpRequestError;
+    }
+    return state == HttpRequestComplete;
+  }
+
+  /// Processes the indicated data: returns the number of bytes which were used by the request
+  size_t write(const uint8_t *data, size_t len) {
+    size_t j = 0;
+    while (j < len && !isDone()) {
+      parse(data[j++]);
+    }
+    if (j < len) {
+      LOGD("ignoring %u bytes after the request", (unsigned)(len - j));
+    }
+    return j;
+  }
+
+  HttpRequestState requestState() { return state; }
+
+  /// Returns true when the request has been received completely
+  bool isComplete() { return state == HttpRequestComplete; }
+
+  /// Returns true if the request is invalid or if it was not received in time
+  bool isError() { return state == HttpRequestError; }
+
+  /// e.g. GET
+  const char *method() { return p_method; }
+
+  /// e.g. /index.html
+  const char *path() { return p_path; }
+
+  /// e.g. HTTP/1.1
+  const char *version() { return p_version; }
+
+ protected:
+  HttpRequestState state = HttpRequestLine;
+  char request_line[HTTP_REQUEST_LINE_SIZE];
+  int line_len = 0;
+  unsigned long start_ms = 0;
+  const char *p_method = "";
+  const char *p_path = "";
+  const char *p_version = "";
+
+  bool isDone() { return state == HttpRequestComplete || state == HttpRequestError; }
+
+  void parse(char c) {
+    if (c == '\r') return;
+    if (state == HttpRequestLine) {
+      if (c == '\n') {
+        // empty lines before the request are ignored
+        if (line_len > 0) endRequestLine();
+      } else if (line_len < HTTP_REQUEST_LINE_SIZE - 1) {
+        request_line[line_len++] = c;
+      } else {
+        LOGE("HTTP request line too long");
+        state = HttpRequestError;
+      }
+    } else if (c == '\n') {
+      // an empty line terminates the headers
+      if (line_len == 0) state = HttpRequestComplete;
+      line_len = 0;
+    } else {
+      line_len++;
+    }
+  }
+
+  /// Splits the request line into method, path and version
+  void endRequestLine() {
+    request_line[line_len] = 0;
+    line_len = 0;
+    p_method = request_line;
+    char *path = strchr(request_line, ' ');
+    if (path == nullptr) {
+      LOGE("Invalid HTTP request: %s", request_line);
+      state = HttpRequestError;
+      return;
+    }
+    *path++ = 0;
+    p_path = path;
+    char *version = strchr(path, ' ');
+    if (version != nullptr) {
+      *version++ = 0;
+      p_version = version;
+    } else {
+      p_version = "";
+    }
+    LOGI("HTTP request: %s %s", p_method, p_path);
+    state = HttpRequestHeaders;
+  }
+};
+
+}  // namespace audio_tools
@@ -94,15 +94,8 @@ class ICYStreamDefault : public AbstractURLStream {
             if (icy.hasMetaData()){
                 // get data
                 int read = url->readBytes(buffer, len);
-                // remove metadata from data
-                int pos = 0;
-                for (int j=0; j<read; j++){
-                    icy.processChar(buffer[j]);
-                    if (icy.isData()){
-                        buffer[pos++] = buffer[j];
-                    }
-                }    
-                result = pos;            
+                // remove metadata from data: audio runs are moved in blocks
+                result = icy.removeMetaData(buffer, read);
             } else {
                 // fast access if there is no metadata
                 result = url->readBytes(buffer, len);
@@ -27,10 +27,30 @@ typedef WiFiClient WiFiClientSecure;
 #endif
 
 
+#ifndef URL_CLIENT_POOL_SIZE
+#define URL_CLIENT_POOL_SIZE 2
+#endif
+
 namespace audio_tools {
 
 /**
- * @brief Represents the content of a URL as Stream. We use the WiFi.h API
+ * @brief Persistent connection of the URLStream connection pool
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct URLPoolEntry {
+    Client *client = nullptr;
+    WiFiClientSecure *client_secure = nullptr;
+    StrExt host = StrExt(20);
+    int port = -1;
+    unsigned long last_used = 0;
+};
+
+/**
+ * @brief Represents the content of a URL as Stream. We use the WiFi.h API.
+ * The connections are kept open (keep-alive) in a small pool, so that subsequent requests to the same
+ * host (e.g. the next track of a playlist) do not need a new TCP/TLS handshake. If the server supports
+ * Range requests we can also seek in the content.
  * @author Phil Schatzmann
  * @copyright GPLv3
  * 
@@ -40,37 +60,37 @@ class URLStreamDefault : public AbstractURLStream {
 
         URLStreamDefault(int readBufferSize=DEFAULT_BUFFER_SIZE){
             LOGI(LOG_METHOD);
-            read_buffer = new uint8_t[readBufferSize];
+            setupBuffer(readBufferSize);
         }
 
         URLStreamDefault(Client &clientPar, int readBufferSize=DEFAULT_BUFFER_SIZE){
             LOGI(LOG_METHOD);
-            read_buffer = new uint8_t[readBufferSize];
+            setupBuffer(readBufferSize);
             client = &clientPar;
         }
 
         URLStreamDefault(const char* network, const char *password, int readBufferSize=DEFAULT_BUFFER_SIZE) {
             LOGI(LOG_METHOD);
-            read_buffer = new uint8_t[readBufferSize];
+            setupBuffer(readBufferSize);
             this->network = (char*)network;
             this->password = (char*)password;            
         }
 
         ~URLStreamDefault(){
             LOGI(LOG_METHOD);
+            end();
+            request.stop();
             if (read_buffer!=nullptr){
                 delete[] read_buffer;
                 read_buffer = nullptr;
             }
-            if (clientSecure!=nullptr){
-                delete clientSecure;
-                clientSecure = nullptr;
-            }
-            if (clientInsecure!=nullptr){
-                delete clientInsecure;
-                clientInsecure = nullptr;
+            for (int j=0; j<URL_CLIENT_POOL_SIZE; j++){
+                if (pool[j].client!=nullptr){
+                    pool[j].client->stop();
+                    delete pool[j].client;
+                    pool[j].client = nullptr;
+                }
             }
-            end();
         }
 
 
@@ -88,40 +108,77 @@ class URLStreamDefault : public AbstractURLStream {
                 request.setAcceptMime(acceptMime);
             }
             result = process(action, url, reqMime, reqData);
-            if (result>0){
-                size = request.getReceivedContentLength();
-                LOGI("size: %d", (int)size);
-                if (size>=0){
-                    waitForData();
-                }
-            }
-            active = result == 200;
-            return active;
+            return processResult(result);
         }
 
         virtual void end() override {
             active = false;
-            request.stop();
+            // keep the connection open if it can be used for the next request
+            if (!request.isReusable()){
+                request.stop();
+            }
+        }
+
+        /// Seeks to the indicated byte position with the help of a Range request on the (persistent) connection.
+        /// If the server does not support Range requests we need to skip the data.
+        bool seek(size_t pos) {
+            if (url.host()==nullptr || strlen(url.host())==0) return false;
+            LOGI("seek: %u", (unsigned) pos);
+            request.setRange(pos);
+            int result = process(GET, url, "", "");
+            if (!processResult(result)) return false;
+            if (result == 200 && pos > 0){
+                LOGW("Range not supported by server: skipping %u bytes", (unsigned) pos);
+                while (position() < pos){
+                    size_t len = min((size_t)read_buffer_size, pos - position());
+                    if (readBytes(read_buffer, len)==0) {
+                        if (!request.connected()) return false;
+                        delay(10);
+                    }
+                }
+            }
+            return position() == pos;
+        }
+
+        /// Total size of the content: -1 if not known
+        long size() {
+            return request.totalSize();
+        }
+
+        /// Current read position in the content
+        size_t position() {
+            return request.rangeStart() + total_read - (read_size - read_pos);
+        }
+
+        /// Activates or deactivates persistent (keep-alive) connections: By default this is active
+        void setKeepAlive(bool active){
+            request.setConnection(active ? CON_KEEP_ALIVE : CON_CLOSE);
         }
 
         virtual int available() override {
             if (!active || !request) return 0;
-            return request.available();
+            return (read_size - read_pos) + request.available();
         }
 
         virtual size_t readBytes(uint8_t *buffer, size_t length) override {
             if (!active || !request) return 0;
-
-            size_t read = request.read((uint8_t*)buffer, length);
+            size_t result = 0;
+            // provide the buffered data first
+            if (!isEOS()){
+                result = min(length, (size_t)(read_size - read_pos));
+                memcpy(buffer, read_buffer + read_pos, result);
+                read_pos += result;
+                if (result == length) return result;
+            }
+            size_t read = request.read((uint8_t*)buffer + result, length - result);
             total_read+=read;
-            return read;
+            return result + read;
         }
 
         virtual int read() override {
             if (!active) return -1;
 
             fillBuffer();
-            total_read++;
             return isEOS() ? -1 :read_buffer[read_pos++];
         }
 
@@ -168,43 +225,56 @@ class URLStreamDefault : public AbstractURLStream {
     protected:
         HttpRequest request;
         Url url;
-        long size;
-        long total_read;
+        long total_read = 0;
         // buffered read
         uint8_t *read_buffer=nullptr;
-        uint16_t read_buffer_size;
-        uint16_t read_pos;
-        uint16_t read_size;
+        uint16_t read_buffer_size = 0;
+        uint16_t read_pos = 0;
+        uint16_t read_size = 0;
         bool active = false;
         // optional 
         char* network=nullptr;
         char* password=nullptr;
         Client *client=nullptr;
-        WiFiClient *clientInsecure=nullptr;
-        WiFiClientSecure *clientSecure=nullptr;
+        // persistent connections
+        URLPoolEntry pool[URL_CLIENT_POOL_SIZE];
+        unsigned long use_count = 0;
         int clientTimeout = URL_CLIENT_TIMEOUT; // 60000;
         unsigned long handshakeTimeout = URL_HANDSHAKE_TIMEOUT; //120000
         bool is_power_save = false;
 
-        void setTimeouts() {
+        void setupBuffer(int readBufferSize) {
+            read_buffer = new uint8_t[readBufferSize];
+            read_buffer_size = readBufferSize;
+            request.setConnection(CON_KEEP_ALIVE);
+        }
+
+        void setTimeouts(Client &client) {
             // set regular timeout
-            getClient(url.isSecure()).setTimeout(clientTimeout/1000); // this is in seconds
+            client.setTimeout(clientTimeout/1000); // this is in seconds
+        }
+
+        /// Evaluates the status code of the reply
+        bool processResult(int result) {
+            total_read = 0;
+            read_pos = 0;
+            read_size = 0;
+            active = result == 200 || result == 206;
+            LOGI("size: %ld", size());
+            // wait for the data unless the reply is empty
+            if (active && (request.reply().isChunked() || request.content_remaining != 0)){
+                waitForData();
+            }
+            return active;
         }
 
         /// Process the Http request and handle redirects
         int process(MethodID action, Url &url, const char* reqMime, const char *reqData, int len=-1) {
-            request.setClient(getClient(url.isSecure()));
+            selectClient(url);
             // keep icy across redirect requests ?
             const char* icy = request.header().get("Icy-MetaData");
 
-            // set timeout
-            setTimeouts();
 #ifdef ESP32
-            // There is a bug in IDF 4!
-            if (clientSecure!=nullptr){
-                clientSecure->setHandshakeTimeout(handshakeTimeout);
-            }
-
             // Performance optimization for ESP32
             if (!is_power_save){
                 esp_wifi_set_ps(WIFI_PS_NONE);
@@ -218,9 +288,7 @@ class URLStreamDefault : public AbstractURLStream {
                 if (redirect_url!=nullptr) {
                     LOGW("Redirected to: %s", redirect_url);
                     url.setUrl(redirect_url);
-                    Client* p_client =  &getClient(url.isSecure()); 
-                    p_client->stop();
-                    request.setClient(*p_client);
+                    selectClient(url);
                     if (icy){
                         request.header().put("Icy-MetaData", icy);
                     }
@@ -233,33 +301,90 @@ class URLStreamDefault : public AbstractURLStream {
             return status_code;
         }
 
-        /// Determines the client 
-        Client &getClient(bool isSecure){
+        /// Assigns the client for the url to the request
+        void selectClient(Url &url) {
+            URLPoolEntry *entry = nullptr;
+            Client &new_client = getClient(url, entry);
+            if (&new_client != request.client_ptr){
+                // close the current connection unless we can reuse it later
+                if (!request.isReusable()) request.stop();
+                if (new_client.connected()){
+                    LOGI("Using pooled connection to %s", url.host());
+                    request.setConnectedClient(new_client, url);
+                } else {
+                    request.setClient(new_client);
+                }
+            }
+            setTimeouts(new_client);
+#ifdef ESP32
+            // There is a bug in IDF 4!
+            if (entry!=nullptr && entry->client_secure!=nullptr){
+                entry->client_secure->setHandshakeTimeout(handshakeTimeout);
+            }
+#endif
+        }
+
+        /// Determines the client: we prefer an open connection to the same host
+        Client &getClient(Url &url, URLPoolEntry *&entry){
             if (client!=nullptr) return *client;
+            bool is_secure = url.isSecure();
+            for (int j=0; j<URL_CLIENT_POOL_SIZE; j++){
+                URLPoolEntry &e = pool[j];
+                if (e.client!=nullptr && (e.client_secure!=nullptr)==is_secure && e.port==url.port() 
+                && e.host.equals(url.host()) && e.client->connected()){
+                    entry = &e;
+                }
+            }
+            if (entry==nullptr){
+                // use an empty or the least recently used entry
+                entry = &pool[0];
+                for (int j=0; j<URL_CLIENT_POOL_SIZE; j++){
+                    if (pool[j].client==nullptr || pool[j].last_used < entry->last_used){
+                        entry = &pool[j];
+                        if (pool[j].client==nullptr) break;
+                    }
+                }
+                if (entry->client!=nullptr){
+                    entry->client->stop();
+                    if ((entry->client_secure!=nullptr)!=is_secure){
+                        if (entry->client==request.client_ptr) request.client_ptr = nullptr;
+                        delete entry->client;
+                        entry->client = nullptr;
+                        entry->client_secure = nullptr;
+                    }
+                }
+                if (entry->client==nullptr){
+                    entry->client = newClient(is_secure, entry->client_secure);
+                }
+                entry->host = url.host();
+                entry->port = url.port();
+            }
+            entry->last_used = ++use_count;
+            return *entry->client;
+        }
+
+        /// Creates a new client
+        virtual Client *newClient(bool isSecure, WiFiClientSecure *&clientSecure){
             if (isSecure){
-                if (clientSecure==nullptr){
 #ifndef IS_DESKTOP
-                    clientSecure = new WiFiClientSecure();
-                    clientSecure->setInsecure();
+                clientSecure = new WiFiClientSecure();
+                clientSecure->setInsecure();
 #else
-                    clientSecure = new WiFiClient();
+                clientSecure = new WiFiClient();
 #endif
-                } 
                 LOGI("WiFiClientSecure");
-                return *clientSecure;
-            }
-            if (clientInsecure==nullptr){
-                clientInsecure = new WiFiClient();
-                LOGI("WiFiClient");
+                return clientSecure;
             }
-            return *clientInsecure;
+            LOGI("WiFiClient");
+            return new WiFiClient();
         }
 
         inline void fillBuffer() {
             if (isEOS()){
                 // if we consumed all bytes we refill the buffer
-                read_size = readBytes(read_buffer,read_buffer_size);
                 read_pos = 0;
+                read_size = 0;
+                read_size = readBytes(read_buffer,read_buffer_size);
             }
         }
 
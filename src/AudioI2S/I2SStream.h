@@ -60,13 +60,15 @@ class I2S : public I2SBase {
 /**
  * @brief We support the Stream interface for the I2S access. In addition we allow a separate mute pin which might also be used
  * to drive a LED... 
+ * Since the DMA does not report underruns, the xrun statistics report the writes which arrived after the estimated
+ * fill level of the DMA buffers has dropped to 0 as late_writes.
  * 
  * @tparam T 
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
 
-class I2SStream : public AudioStream {
+class I2SStream : public AudioStream, public XRunSource {
 
     public:
         I2SStream(int mute_pin=PIN_I2S_MUTE) {
@@ -84,13 +86,16 @@ class I2SStream : public AudioStream {
         }
 
         bool begin() {
-            return i2s.begin();
+            bool result = i2s.begin();
+            beginLateWrites();
+            return result;
         }
 
         /// Starts the I2S interface
         void begin(I2SConfig cfg) {
             LOGD(LOG_METHOD);
             i2s.begin(cfg);
+            beginLateWrites();
             // unmute
             mute(false);
         }
@@ -100,6 +105,7 @@ class I2SStream : public AudioStream {
             LOGD(LOG_METHOD);
             mute(true);
             i2s.end();
+            late_writes.end();
         }
 
         /// updates the sample rate dynamically 
@@ -124,13 +130,17 @@ class I2SStream : public AudioStream {
 	                i2s.end();
 	                i2s.begin(cfg);
 	            }       
+                beginLateWrites();
             }
         }
 
         /// Writes the audio data to I2S
         virtual size_t write(const uint8_t *buffer, size_t size) {
             LOGD(LOG_METHOD);
-            return i2s.writeBytes(buffer, size);
+            size_t result = i2s.writeBytes(buffer, size);
+            if (late_writes.write(result)) xrun_stats.late_writes++;
+            if (result < size) xrun_stats.overflows++;
+            return result;
         }
 
         /// Reads the audio data
@@ -168,6 +178,19 @@ class I2SStream : public AudioStream {
     protected:
         I2SBase i2s;
         int mute_pin;
+        LateWriteDetector late_writes;
+
+        /// (re)starts the estimate of the fill level of the DMA buffers
+        void beginLateWrites() {
+            I2SConfig cfg = i2s.config();
+            int frame_size = cfg.channels * cfg.bits_per_sample / 8;
+#ifdef ESP32
+            uint32_t capacity = cfg.buffer_count * cfg.buffer_size * frame_size;
+#else
+            uint32_t capacity = I2S_BUFFER_COUNT * I2S_BUFFER_SIZE * frame_size;
+#endif
+            late_writes.begin(cfg.rx_tx_mode == RX_MODE ? 0 : cfg.sample_rate * frame_size, capacity);
+        }
 
         /// set mute pin on or off
         void mute(bool is_mute){
@@ -5,6 +5,9 @@
 
 #include "AudioTools/AudioStreams.h"
 #include "AudioTools/Buffers.h"
+#include "AudioTools/AudioSync.h"
+#include "AudioTools/Throttle.h"
+#include "AudioTools/PacketSendQueue.h"
 
 #ifdef FAST_ESP_NOW_HACK
 #include "esp_private/wifi.h"
@@ -49,11 +52,13 @@ struct ESPNowStreamConfig {
   const char *ssid = nullptr;
   const char *password = nullptr;
   bool use_send_ack = true;  // we wait for
-  uint16_t delay_after_write_ms = 2;
-  uint16_t delay_after_failed_write_ms = 2000;
+  uint16_t delay_after_write_ms = 2; // poll interval used by flush()
+  uint16_t delay_after_failed_write_ms = 2000; // a failed packet is resent after this time
   uint16_t buffer_size = ESP_NOW_MAX_DATA_LEN;
   uint16_t buffer_count = 400;
   int write_retry_count = -1; // -1 endless
+  uint16_t send_queue_count = 16; // number of packets which can be queued for sending
+  PacketQueueFullPolicy send_queue_policy = PacketQueueReject;
   void (*recveive_cb)(const uint8_t *mac_addr, const uint8_t *data,
                       int data_len) = nullptr;
   // to encrypt set primary_master_key and local_master_key to 16 byte strings
@@ -66,11 +71,12 @@ struct ESPNowStreamConfig {
 };
 
 /**
- * @brief ESPNow as Arduino Stream
+ * @brief ESPNow as Arduino Stream: the xrun statistics combine the send queue, the
+ * receive buffer and the received data which could not be stored.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class ESPNowStream : public AudioStreamX {
+class ESPNowStream : public AudioStreamX, public XRunSource {
  public:
   ESPNowStream() { ESPNowStreamSelf = this; };
 
@@ -86,7 +92,7 @@ class ESPNowStream : public AudioStreamX {
   /// Returns the mac address of the current ESP32
   const char *macAddress() { return WiFi.macAddress().c_str(); }
 
-  /// Defines an alternative send callback
+  /// Defines an alternative send callback: it needs to call sendComplete() to send the next packet
   void setSendCallback(esp_now_send_cb_t cb) { send = cb; }
 
   /// Defines the Receive Callback - Deactivates the readBytes and available()
@@ -197,50 +203,42 @@ class ESPNowStream : public AudioStreamX {
     return addPeer(peer);
   }
 
-  /// Writes the data - sends it to all the peers
+  /// Writes the data - sends it to all the peers: the data is queued and we do not wait for the
+  /// transmission. Only the data which fits into the queue is accepted.
   size_t write(const uint8_t *data, size_t len) override {
-    int open = len;
-    size_t result = 0;
-    int retry_count = 0;
-    while (open > 0) {
-      if (available_to_write > 0) {
-        resetAvailableToWrite();
-        size_t send_len = min(open, ESP_NOW_MAX_DATA_LEN);
-        esp_err_t rc = esp_now_send(nullptr, data + result, send_len);
-        // wait for confirmation
-        if (cfg.use_send_ack) {
-          while (available_to_write == 0) {
-            delay(1);
-          }
-        } else {
-          is_write_ok = true;
-        }
-        // check status
-        if (rc == ESP_OK && is_write_ok) {
-          open -= send_len;
-          result += send_len;
-        } else {
-          LOGW("Write failed - retrying again");
-          retry_count++;
-          if (cfg.write_retry_count>0 && retry_count>=cfg.write_retry_count){
-            LOGE("Write error after %d retries", cfg.write_retry_count);
-            // break loop
-            return 0;
-          }
-        }
-        // if we do have no partner to write we stall and retry later
-      } else {
-        delay(cfg.delay_after_write_ms);
-      }
+    Lock lock(send_lock);
+    return send_queue.write(data, len);
+  }
 
-      // Wait some time before we retry
-      if (!is_write_ok) {
-        delay(cfg.delay_after_failed_write_ms);
-      }
+  /// Waits until all queued data has been sent
+  void flush() override {
+    while (!isSendQueueEmpty()) {
+      delay(cfg.delay_after_write_ms);
     }
+  }
+
+  /// Confirms the last sent packet: to be called by an alternative send callback
+  void sendComplete(bool ok) {
+    Lock lock(send_lock);
+    send_queue.sendComplete(ok);
+  }
+
+  /// Provides the statistics of the send queue
+  PacketSendQueueStats &sendStats() { return send_queue.stats(); }
+
+  XRunStats xrunStats() override {
+    XRunStats result = xrun_stats;
+    result += send_queue.xrunStats();
+    if (p_buffer != nullptr) result += p_buffer->xrunStats();
     return result;
   }
 
+  void resetXRunStats() override {
+    xrun_stats.reset();
+    send_queue.resetXRunStats();
+    if (p_buffer != nullptr) p_buffer->resetXRunStats();
+  }
+
   /// Reeds the data from the peers
   size_t readBytes(uint8_t *data, size_t len) override {
     if (p_buffer == nullptr) return 0;
@@ -253,7 +251,10 @@ class ESPNowStream : public AudioStreamX {
   }
 
   int availableForWrite() override {
-    return cfg.use_send_ack ? available_to_write : cfg.buffer_size;
+    Lock lock(send_lock);
+    // retry failed packets
+    send_queue.update();
+    return send_queue.availableForWrite();
   }
 
  protected:
@@ -261,10 +262,10 @@ class ESPNowStream : public AudioStreamX {
   BaseBuffer<uint8_t> *p_buffer = nullptr;
   esp_now_recv_cb_t receive = default_recv_cb;
   esp_now_send_cb_t send = default_send_cb;
-  volatile size_t available_to_write;
+  PacketSendQueue send_queue;
   bool is_init = false;
-  bool is_write_ok = false;
   _lock_t write_lock;
+  _lock_t send_lock;
 
   inline void setupReceiveBuffer(){
     // setup receive buffer
@@ -274,10 +275,18 @@ class ESPNowStream : public AudioStreamX {
     }
   }
 
-  inline void resetAvailableToWrite() {
-    if (cfg.use_send_ack) {
-      available_to_write = 0;
+  bool isSendQueueEmpty() {
+    Lock lock(send_lock);
+    send_queue.update();
+    return send_queue.isEmpty();
+  }
+
+  static bool send_packet(const uint8_t *data, size_t len, void *ref) {
+    esp_err_t rc = esp_now_send(nullptr, data, len);
+    if (rc != ESP_OK) {
+      LOGW("esp_now_send: %d", rc);
     }
+    return rc == ESP_OK;
   }
 
   bool isEncrypted() {
@@ -323,7 +332,15 @@ class ESPNowStream : public AudioStreamX {
     if (cfg.use_send_ack) {
       esp_now_register_send_cb(send);
     }
-    available_to_write = cfg.buffer_size;
+    PacketSendQueueConfig queue_cfg;
+    queue_cfg.packet_size = ESP_NOW_MAX_DATA_LEN;
+    queue_cfg.packet_count = cfg.send_queue_count;
+    queue_cfg.retry_count = cfg.write_retry_count;
+    queue_cfg.retry_delay_ms = cfg.delay_after_failed_write_ms;
+    queue_cfg.use_send_ack = cfg.use_send_ack;
+    queue_cfg.full_policy = cfg.send_queue_policy;
+    send_queue.setTransport(send_packet, this);
+    send_queue.begin(queue_cfg);
     is_init = result == ESP_OK;
     return is_init;
   }
@@ -360,6 +377,7 @@ class ESPNowStream : public AudioStreamX {
     size_t result = ESPNowStreamSelf->p_buffer->writeArray(data, data_len);
     if (result!=data_len){
       LOGE("writeArray %d -> %d", data_len, result);
+      ESPNowStreamSelf->xrun_stats.dropped_bytes += data_len - result;
     }
   }
 
@@ -376,12 +394,8 @@ class ESPNowStream : public AudioStreamX {
 
     // ignore others
     if (strncmp((char *)mac_addr, (char *)first_mac, ESP_NOW_KEY_LEN) == 0) {
-      ESPNowStreamSelf->available_to_write = ESPNowStreamSelf->cfg.buffer_size;
-      if (status == ESP_NOW_SEND_SUCCESS) {
-        ESPNowStreamSelf->is_write_ok = true;
-      } else {
-        ESPNowStreamSelf->is_write_ok = false;
-      }
+      // sends the next queued packet
+      ESPNowStreamSelf->sendComplete(status == ESP_NOW_SEND_SUCCESS);
     }
   }
 };
@@ -493,282 +507,4 @@ class UDPStream : public WiFiUDP {
   }
 };
 
-enum RecordType : uint8_t { Undefined, Begin, Send, Receive, End };
-enum AudioType : uint8_t { PCM, MP3, AAC, WAV };
-enum TransmitRole : uint8_t { Sender, Receiver };
-
-/// Common Header for all records
-struct AudioHeader {
-  AudioHeader() = default;
-  uint8_t app = 123;
-  RecordType rec = Undefined;
-  uint16_t seq = 0;
-  // record counter
-  void increment() {
-    static uint16_t static_count = 0;
-    seq = static_count++;
-  }
-};
-
-/// Protocal Record To Start
-struct AudioDataBegin : public AudioHeader {
-  AudioDataBegin() { rec = Begin; }
-  AudioBaseInfo info;
-  AudioType type = PCM;
-};
-
-/// Protocol Record for Data
-struct AudioSendData : public AudioHeader {
-  AudioSendData() {
-    rec = Send;
-    ;
-  }
-  uint16_t size = 0;
-};
-
-/// Protocol Record for Request
-struct AudioConfirmDataToReceive : public AudioHeader {
-  AudioConfirmDataToReceive() { rec = Receive; }
-  uint16_t size = 0;
-};
-
-/// Protocol Record for End
-struct AudioDataEnd : public AudioHeader {
-  AudioDataEnd() { rec = End; }
-};
-
-/**
- * @brief Audio Writer which is synchronizing the amount of data
- * that can be processed with the AudioReceiver
- * @author Phil Schatzmann
- * @copyright GPLv3
- */
-class AudioSyncWriter : public AudioPrint {
- public:
-  AudioSyncWriter(Stream &dest) { p_dest = &dest; }
-
-  bool begin(AudioBaseInfo &info, AudioType type) {
-    is_sync = true;
-    AudioDataBegin begin;
-    begin.info = info;
-    begin.type = type;
-    begin.increment();
-    int write_len = sizeof(begin);
-    int len = p_dest->write((const uint8_t *)&begin, write_len);
-    return len == write_len;
-  }
-
-  size_t write(const uint8_t *data, size_t len) override {
-    int written_len = 0;
-    int open_len = len;
-    AudioSendData send;
-    while (written_len < len) {
-      int available_to_write = waitForRequest();
-      size_t to_write_len = DEFAULT_BUFFER_SIZE;
-      to_write_len = min(open_len, available_to_write);
-      send.increment();
-      send.size = to_write_len;
-      p_dest->write((const uint8_t *)&send, sizeof(send));
-      int w = p_dest->write(data + written_len, to_write_len);
-      written_len += w;
-      open_len -= w;
-    }
-    return written_len;
-  }
-
-  int availableForWrite() override { return available_to_write; }
-
-  void end() {
-    AudioDataEnd end;
-    end.increment();
-    p_dest->write((const uint8_t *)&end, sizeof(end));
-  }
-
- protected:
-  Stream *p_dest;
-  int available_to_write = 1024;
-  bool is_sync;
-
-  /// Waits for the data to be available
-  void waitFor(int size) {
-    while (p_dest->available() < size) {
-      delay(10);
-    }
-  }
-
-  int waitForRequest() {
-    AudioConfirmDataToReceive rcv;
-    size_t rcv_len = sizeof(rcv);
-    waitFor(rcv_len);
-    p_dest->readBytes((uint8_t *)&rcv, rcv_len);
-    return rcv.size;
-  }
-};
-
-/**
- * @brief Receving Audio Data over the wire and requesting for more data when
- * done to synchronize the processing with the sender. The audio data is
- * processed by the EncodedAudioStream; If you have multiple readers, only one
- * receiver should be used as confirmer!
- * @author Phil Schatzmann
- * @copyright GPLv3
- */
-class AudioSyncReader : public AudioStreamX {
- public:
-  AudioSyncReader(Stream &in, EncodedAudioStream &out,
-                  bool isConfirmer = true) {
-    p_in = &in;
-    p_out = &out;
-    is_confirmer = isConfirmer;
-  }
-
-  size_t copy() {
-    int processed = 0;
-    int header_size = sizeof(header);
-    waitFor(header_size);
-    readBytes((uint8_t *)&header, header_size);
-
-    switch (header.rec) {
-      case Begin:
-        audioDataBegin();
-        break;
-      case End:
-        audioDataEnd();
-        break;
-      case Send:
-        processed = receiveData();
-        break;
-    }
-    return processed;
-  }
-
- protected:
-  Stream *p_in;
-  EncodedAudioStream *p_out;
-  AudioConfirmDataToReceive req;
-  AudioHeader header;
-  AudioDataBegin begin;
-  size_t available = 0;  // initial value
-  bool is_started = false;
-  bool is_confirmer;
-  int last_seq = 0;
-
-  /// Starts the processing
-  void audioDataBegin() {
-    readProtocol(&begin, sizeof(begin));
-    p_out->begin();
-    p_out->setAudioInfo(begin.info);
-    requestData();
-  }
-
-  /// Ends the processing
-  void audioDataEnd() {
-    AudioDataEnd end;
-    readProtocol(&end, sizeof(end));
-    p_out->end();
-  }
-
-  // Receives audio data
-  int receiveData() {
-    AudioSendData data;
-    readProtocol(&data, sizeof(data));
-    available = data.size;
-    // receive and process audio data
-    waitFor(available);
-    int max_gap = 10;
-    if (data.seq > last_seq ||
-        (data.seq < max_gap && last_seq >= (32767 - max_gap))) {
-      uint8_t buffer[available];
-      p_in->readBytes((uint8_t *)buffer, available);
-      p_out->write((const uint8_t *)buffer, available);
-      // only one reader should be used as confirmer
-      if (is_confirmer) {
-        requestData();
-      }
-      last_seq = data.seq;
-    }
-    return available;
-  }
-
-  /// Waits for the data to be available
-  void waitFor(int size) {
-    while (p_in->available() < size) {
-      delay(10);
-    }
-  }
-
-  /// Request new data from writer
-  void requestData() {
-    req.size = p_out->availableForWrite();
-    req.increment();
-    p_in->write((const uint8_t *)&req, sizeof(req));
-    p_in->flush();
-  }
-
-  /// Reads the protocol record
-  void readProtocol(AudioHeader *data, int len) {
-    const static int header_size = sizeof(header);
-    memcpy(data, &header, header_size);
-    int read_size = len - header_size;
-    waitFor(read_size);
-    readBytes((uint8_t *)data + header_size, read_size);
-  }
-};
-
-/**
- * @brief Configure Throttle setting
- * @author Phil Schatzmann
- * @copyright GPLv3
- */
-struct ThrottleConfig : public AudioBaseInfo {
-  ThrottleConfig() {
-    sample_rate = 44100;
-    bits_per_sample = 16;
-    channels = 2;
-  }
-  int correction_ms = 0;
-};
-
-/**
- * @brief Throttle the sending of the audio data to limit it to the indicated
- * sample rate.
- * @author Phil Schatzmann
- * @copyright GPLv3
- */
-class Throttle {
- public:
-  Throttle() = default;
-
-  ThrottleConfig defaultConfig() {
-    ThrottleConfig c;
-    return c;
-  }
-
-  void begin(ThrottleConfig info) {
-    this->info = info;
-    bytesPerSample = info.bits_per_sample / 8 * info.channels;
-  }
-
-  // starts the timing
-  void startDelay() { start_time = millis(); }
-
-  // delay
-  void delayBytes(size_t bytes) { delaySamples(bytes / bytesPerSample); }
-
-  // delay
-  void delaySamples(size_t samples) {
-    int durationMsEff = millis() - start_time;
-    int durationToBe = (samples * 1000) / info.sample_rate;
-    int waitMs = durationToBe - durationMsEff + info.correction_ms;
-    if (waitMs > 0) {
-      delay(waitMs);
-    }
-  }
-
- protected:
-  unsigned long start_time;
-  ThrottleConfig info;
-  int bytesPerSample;
-};
-
 }  // namespace audio_tools
@@ -0,0 +1,311 @@
+#pragma once
+/**
+ * @brief Memory mapped access to WAV and raw PCM files for POSIX desktop environments
+ *
+ */
+
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AudioTools.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Configuration for MMapFileStream: for raw files (is_wav = false) the audio format
+ * must be defined. For WAV files it is taken from the header when reading.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct MMapFileConfig : public AudioBaseInfo {
+  MMapFileConfig() {
+    sample_rate = 44100;
+    channels = 2;
+    bits_per_sample = 16;
+  }
+  RxTxMode mode = RX_MODE;
+  /// the file contains a WAV header
+  bool is_wav = true;
+  /// initial size of the mapping in bytes when writing: it is doubled when it is full
+  size_t reserve_size = 1024 * 1024;
+};
+
+/**
+ * @brief File stream which maps the file into memory: the PCM data (after the WAV header) is
+ * accessible without any copy with data() and readSpan() and supports random access by byte
+ * or frame. When writing (TX_MODE) the file and the mapping are extended as needed: the data
+ * can also be written directly into the mapping with writeSpan(). end() updates the WAV header
+ * and truncates the file to the written size. Only for POSIX environments!
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class MMapFileStream : public AudioStream {
+ public:
+  MMapFileStream() = default;
+
+  ~MMapFileStream() { end(); }
+
+  MMapFileConfig defaultConfig(RxTxMode mode = RX_MODE) {
+    MMapFileConfig c;
+    c.mode = mode;
+    return c;
+  }
+
+  /// Opens the file for reading (RX_MODE) or writing (TX_MODE)
+  bool begin(const char *path, MMapFileConfig config) {
+    end();
+    cfg = config;
+    read_pos = 0;
+    if (cfg.mode == TX_MODE) return beginWrite(path);
+    if (cfg.mode == RX_MODE) return beginRead(path);
+    LOGE("Unsupported mode: %d", cfg.mode);
+    return false;
+  }
+
+  /// Unmaps and closes the file: a written file is truncated to its size and the WAV header is updated
+  void end() override {
+    if (p_map != nullptr) {
+      if (is_write) {
+        if (cfg.is_wav) writeWAVHeader(p_map, data_size);
+        msync(p_map, map_size, MS_SYNC);
+      }
+      munmap(p_map, map_size);
+      p_map = nullptr;
+    }
+    if (fd >= 0) {
+      if (is_write && ftruncate(fd, data_offset + data_size) != 0) {
+        LOGE("ftruncate failed");
+      }
+      close(fd);
+      fd = -1;
+    }
+    map_size = 0;
+    data_size = 0;
+    is_write = false;
+  }
+
+  operator bool() { return p_map != nullptr; }
+
+  /// Start of the PCM data
+  uint8_t *data() { return p_map == nullptr ? nullptr : p_map + data_offset; }
+
+  /// Size of the PCM data in bytes
+  size_t size() { return data_size; }
+
+  /// Number of frames of the PCM data
+  size_t frames() { return data_size / frameSize(); }
+
+  /// Provides the address of the indicated frame or nullptr if it is not available
+  uint8_t *frame(size_t idx) {
+    size_t pos = idx * frameSize();
+    return pos < data_size ? data() + pos : nullptr;
+  }
+
+  /// Moves the read position to the indicated byte of the PCM data
+  bool seek(size_t pos) {
+    if (pos > data_size) return false;
+    read_pos = pos;
+    return true;
+  }
+
+  /// Moves the read position to the indicated frame
+  bool seekFrame(size_t idx) { return seek(idx * frameSize()); }
+
+  /// Actual read position in bytes of the PCM data
+  size_t position() { return read_pos; }
+
+  /// Provides the data at the read position without copying it and advances the read position
+  size_t readSpan(const uint8_t *&ptr, size_t len) {
+    size_t result = available();
+    if (result > len) result = len;
+    ptr = data() + read_pos;
+    read_pos += result;
+    return result;
+  }
+
+  /// Reserves len bytes at the end of the written data: the caller fills them directly
+  uint8_t *writeSpan(size_t len) {
+    if (!is_write || !reserve(data_size + len)) return nullptr;
+    uint8_t *result = data() + data_size;
+    data_size += len;
+    return result;
+  }
+
+  int available() override {
+    if (p_map == nullptr || is_write) return 0;
+    size_t result = data_size - read_pos;
+    return result > INT_MAX ? INT_MAX : result;
+  }
+
+  size_t readBytes(uint8_t *buffer, size_t length) override {
+    const uint8_t *ptr;
+    size_t result = readSpan(ptr, length);
+    memcpy(buffer, ptr, result);
+    return result;
+  }
+
+  int read() override {
+    if (available() == 0) return -1;
+    return data()[read_pos++];
+  }
+
+  int peek() override {
+    if (available() == 0) return -1;
+    return data()[read_pos];
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    uint8_t *ptr = writeSpan(size);
+    if (ptr == nullptr) return 0;
+    memcpy(ptr, buffer, size);
+    return size;
+  }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  int availableForWrite() override { return is_write ? DEFAULT_BUFFER_SIZE : 0; }
+
+ protected:
+  MMapFileConfig cfg;
+  int fd = -1;
+  uint8_t *p_map = nullptr;
+  size_t map_size = 0;
+  size_t data_offset = 0;
+  size_t data_size = 0;
+  size_t read_pos = 0;
+  bool is_write = false;
+  static const int WAV_HEADER_SIZE = 44;
+
+  int frameSize() {
+    int result = info.channels * info.bits_per_sample / 8;
+    return result > 0 ? result : 1;
+  }
+
+  bool beginRead(const char *path) {
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      LOGE("Could not open %s", path);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      LOGE("Empty file %s", path);
+      end();
+      return false;
+    }
+    map_size = st.st_size;
+    void *map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      LOGE("mmap failed for %s", path);
+      end();
+      return false;
+    }
+    p_map = (uint8_t *)map;
+    madvise(p_map, map_size, MADV_SEQUENTIAL);
+
+    data_offset = 0;
+    data_size = map_size;
+    if (cfg.is_wav && !parseWAVHeader()) {
+      LOGE("Invalid WAV file %s", path);
+      end();
+      return false;
+    }
+    setAudioInfo(cfg);
+    LOGI("%s: %lu bytes of PCM data", path, (unsigned long)data_size);
+    return true;
+  }
+
+  bool parseWAVHeader() {
+    WAVHeader header;
+    header.begin(p_map, map_size);
+    WAVAudioInfo &wav = header.audioInfo();
+    uint8_t *sound;
+    size_t len;
+    if (!wav.is_valid || wav.format != WAV_FORMAT_PCM || !header.soundData(sound, len)) {
+      return false;
+    }
+    cfg.sample_rate = wav.sample_rate;
+    cfg.channels = wav.channels;
+    cfg.bits_per_sample = wav.bits_per_sample;
+    data_offset = sound - p_map;
+    data_size = len;
+    // ignore the chunks after the data
+    if (!wav.is_streamed && wav.data_length > 0 && wav.data_length < data_size) {
+      data_size = wav.data_length;
+    }
+    return true;
+  }
+
+  bool beginWrite(const char *path) {
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      LOGE("Could not create %s", path);
+      return false;
+    }
+    is_write = true;
+    data_offset = cfg.is_wav ? WAV_HEADER_SIZE : 0;
+    data_size = 0;
+    setAudioInfo(cfg);
+    if (!remap(data_offset + cfg.reserve_size)) {
+      end();
+      return false;
+    }
+    return true;
+  }
+
+  /// Makes sure that the mapping can hold the indicated PCM data
+  bool reserve(size_t size) {
+    if (data_offset + size <= map_size) return true;
+    size_t new_size = map_size * 2;
+    if (new_size < data_offset + size) new_size = data_offset + size;
+    return remap(new_size);
+  }
+
+  /// Extends the file and maps it with the new size
+  bool remap(size_t size) {
+    if (ftruncate(fd, size) != 0) {
+      LOGE("ftruncate failed: %lu", (unsigned long)size);
+      return false;
+    }
+    if (p_map != nullptr) munmap(p_map, map_size);
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      LOGE("mmap failed: %lu", (unsigned long)size);
+      p_map = nullptr;
+      map_size = 0;
+      return false;
+    }
+    p_map = (uint8_t *)map;
+    map_size = size;
+    return true;
+  }
+
+  void writeWAVHeader(uint8_t *out, uint32_t dataSize) {
+    uint16_t block_align = info.channels * info.bits_per_sample / 8;
+    memcpy(out, "RIFF", 4);
+    write32(out + 4, dataSize + WAV_HEADER_SIZE - 8);
+    memcpy(out + 8, "WAVEfmt ", 8);
+    write32(out + 16, 16);
+    write16(out + 20, WAV_FORMAT_PCM);
+    write16(out + 22, info.channels);
+    write32(out + 24, info.sample_rate);
+    write32(out + 28, info.sample_rate * block_align);
+    write16(out + 32, block_align);
+    write16(out + 34, info.bits_per_sample);
+    memcpy(out + 36, "data", 4);
+    write32(out + 40, dataSize);
+  }
+
+  void write32(uint8_t *out, uint32_t value) {
+    for (int j = 0; j < 4; j++) out[j] = value >> (8 * j);
+  }
+
+  void write16(uint8_t *out, uint16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+  }
+};
+
+}  // namespace audio_tools
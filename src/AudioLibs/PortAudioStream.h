@@ -6,6 +6,7 @@
 
 
 #include "AudioTools.h"
+#include "AudioTools/LockFreeBuffer.h"
 #include "portaudio.h"
 
 namespace audio_tools {
@@ -30,13 +31,26 @@ class PortAudioConfig : public AudioBaseInfo {
 
         bool is_input = false;
         bool is_output = true;
+        /// exchange the data with the real time callback of PortAudio instead of blocking reads and writes
+        bool is_callback = false;
+        /// frames per buffer (or callback): 0 lets PortAudio decide
+        int frames_per_buffer = 0;
+        /// target latency of the device in ms: 0 uses the default latency of the device
+        int latency_ms = 0;
+        /// max buffered data in ms (callback mode): this defines the latency
+        int buffer_ms = 100;
+        /// the output starts to play (also after an underrun) when this many ms are buffered (callback mode)
+        int prefill_ms = 20;
 };
 
 /**
- * @brief Arduino Audio Stream using PortAudio
- * 
+ * @brief Arduino Audio Stream using PortAudio. By default the reads and writes are blocking 
+ * on the device. In callback mode the real time callback of PortAudio exchanges the data via 
+ * preallocated lock free ring buffers: a write blocks only while the output buffer is full, 
+ * which is similar to I2S on a microcontroller. In full duplex mode the input and output are 
+ * processed by the same callback, so they are synchronized. 
  */
-class PortAudioStream : public AudioStreamX {
+class PortAudioStream : public AudioStreamX, public XRunSource {
     public:
         PortAudioStream() {
             LOGD(LOG_METHOD);
@@ -95,6 +109,9 @@ class PortAudioStream : public AudioStreamX {
         // start with the indicated configuration
         bool begin(PortAudioConfig info) {
             LOGD(LOG_METHOD);
+            if (stream!=nullptr){
+                end();
+            }
             this->info = info;
 
             if (info.channels>0 && info.sample_rate && info.bits_per_sample>0){
@@ -107,22 +124,44 @@ class PortAudioStream : public AudioStreamX {
                 }
 
                 // calculate frames
-                int bytes = info.bits_per_sample / 8;
-                int buffer_frames = paFramesPerBufferUnspecified; //buffer_size / bytes / info.channels;
-
-                // Open an audio I/O stream. 
-                LOGD("Pa_OpenDefaultStream");
-                err = Pa_OpenDefaultStream( &stream,
-                    info.is_input ? info.channels : 0,    // no input channels 
-                    info.is_output ? info.channels : 0,   // no output 
-                    getFormat(info.bits_per_sample),      // format  
+                int buffer_frames = info.frames_per_buffer > 0 ? info.frames_per_buffer : paFramesPerBufferUnspecified;
+
+                // allocate the ring buffers, so that the callback does not need to allocate anything
+                if (info.is_callback){
+                    int bytes_per_second = info.sample_rate * frameSize();
+                    // the ring buffers are rounded up to a power of 2: we limit the fill level to buffer_ms
+                    buffer_bytes = bytes_per_second * info.buffer_ms / 1000;
+                    buffer_bytes -= buffer_bytes % frameSize();
+                    in_buffer.resize(info.is_input ? buffer_bytes : 0);
+                    out_buffer.resize(info.is_output ? buffer_bytes : 0);
+                    prefill_bytes = bytes_per_second * info.prefill_ms / 1000;
+                    prefill_bytes -= prefill_bytes % frameSize();
+                    if (prefill_bytes > out_buffer.size()) prefill_bytes = out_buffer.size();
+                    is_primed = false;
+                }
+
+                // Open an audio I/O stream on the default devices
+                PaStreamParameters input_parameters;
+                PaStreamParameters output_parameters;
+                if (info.is_input && !setupParameters(input_parameters, Pa_GetDefaultInputDevice(), true)){
+                    return false;
+                }
+                if (info.is_output && !setupParameters(output_parameters, Pa_GetDefaultOutputDevice(), false)){
+                    return false;
+                }
+                LOGD("Pa_OpenStream");
+                err = Pa_OpenStream( &stream,
+                    info.is_input ? &input_parameters : nullptr, 
+                    info.is_output ? &output_parameters : nullptr,
                     info.sample_rate,                     // sample rate
                     buffer_frames,                        // frames per buffer 
-                    nullptr,   
-                    nullptr ); 
-                LOGD("Pa_OpenDefaultStream - done");
+                    paNoFlag,
+                    info.is_callback ? paCallback : nullptr,   
+                    this ); 
+                LOGD("Pa_OpenStream - done");
                 if( err != paNoError && err!= paOutputUnderflow ) {
                     LOGE(  "PortAudio error: %s\n", Pa_GetErrorText( err ) );
+                    stream = nullptr;
                     return false;
                 }
             } else {
@@ -134,6 +173,7 @@ class PortAudioStream : public AudioStreamX {
 
         void end() override {
             LOGD(LOG_METHOD);
+            if (stream==nullptr) return;
             err = Pa_StopStream( stream );
             if( err != paNoError ) {
                 LOGE(  "PortAudio error: %s\n", Pa_GetErrorText( err ) );
@@ -143,7 +183,12 @@ class PortAudioStream : public AudioStreamX {
             if( err != paNoError ) {
                 LOGE(  "PortAudio error: %s\n", Pa_GetErrorText( err ) );
             }
+            stream = nullptr;
             stream_started = false;
+            // the callback is not active any more
+            in_buffer.reset();
+            out_buffer.reset();
+            is_primed = false;
         }
 
         operator bool() {
@@ -154,6 +199,9 @@ class PortAudioStream : public AudioStreamX {
             LOGD("write: %zu", len);
 
             startStream();
+            if (info.is_callback){
+                return writeBuffer(data, len);
+            }
 
             size_t result = 0;
             if (stream!=nullptr){
@@ -174,6 +222,10 @@ class PortAudioStream : public AudioStreamX {
 
         size_t readBytes( uint8_t *data, size_t len) override { 
             LOGD("readBytes: %zu", len);
+            startStream();
+            if (info.is_callback){
+                return readBuffer(data, len);
+            }
             size_t result = 0;
             if (stream!=nullptr){
                 int bytes = info.bits_per_sample / 8;
@@ -191,9 +243,45 @@ class PortAudioStream : public AudioStreamX {
         }
 
         int available() override {
+            if (info.is_callback) return in_buffer.available();
             return DEFAULT_BUFFER_SIZE;
         }
 
+        int availableForWrite() override {
+            if (info.is_callback) return freeBytes(out_buffer);
+            return DEFAULT_BUFFER_SIZE;
+        }
+
+        /// Underflows of the output, overflows of the input and the dropped input bytes 
+        XRunStats xrunStats() override {
+            XRunStats result;
+            result.underflows = underflow_count.load();
+            result.overflows = overflow_count.load();
+            result.dropped_bytes = dropped_bytes.load();
+            return result;
+        }
+
+        void resetXRunStats() override {
+            underflow_count.store(0);
+            overflow_count.store(0);
+            dropped_bytes.store(0);
+        }
+
+        /// Number of executed callbacks
+        uint32_t callbackCount() {
+            return callback_count.load();
+        }
+
+        /// Actual output latency in us: the latency of the device and the buffered data
+        uint32_t outputLatencyUs() {
+            return latencyUs(false, out_buffer.available());
+        }
+
+        /// Actual input latency in us: the latency of the device and the buffered data
+        uint32_t inputLatencyUs() {
+            return latencyUs(true, in_buffer.available());
+        }
+
 
     protected:
         PaStream *stream = nullptr;
@@ -201,6 +289,150 @@ class PortAudioStream : public AudioStreamX {
         PortAudioConfig info;
         bool stream_started = false;
         int buffer_size = 10*1024;
+        // callback mode: the application is the producer of the output and the consumer of the input
+        LockFreeRingBuffer<uint8_t> in_buffer;
+        LockFreeRingBuffer<uint8_t> out_buffer;
+        int buffer_bytes = 0;
+        int prefill_bytes = 0;
+        // only used by the callback while the stream is active
+        bool is_primed = false;
+        std::atomic<uint32_t> underflow_count{0};
+        std::atomic<uint32_t> overflow_count{0};
+        std::atomic<uint32_t> dropped_bytes{0};
+        std::atomic<uint32_t> callback_count{0};
+
+        int frameSize() {
+            return info.channels * info.bits_per_sample / 8;
+        }
+
+        bool setupParameters(PaStreamParameters &parameters, PaDeviceIndex device, bool isInput){
+            if (device == paNoDevice){
+                LOGE("No default %s device", isInput ? "input" : "output");
+                return false;
+            }
+            const PaDeviceInfo *device_info = Pa_GetDeviceInfo(device);
+            parameters.device = device;
+            parameters.channelCount = info.channels;
+            parameters.sampleFormat = getFormat(info.bits_per_sample);
+            if (info.latency_ms > 0){
+                parameters.suggestedLatency = info.latency_ms / 1000.0;
+            } else {
+                parameters.suggestedLatency = isInput ? device_info->defaultHighInputLatency : device_info->defaultHighOutputLatency;
+            }
+            parameters.hostApiSpecificStreamInfo = nullptr;
+            return true;
+        }
+
+        uint32_t latencyUs(bool isInput, int bufferedBytes){
+            uint32_t result = 0;
+            if (stream!=nullptr){
+                const PaStreamInfo *stream_info = Pa_GetStreamInfo(stream);
+                if (stream_info!=nullptr){
+                    result = (isInput ? stream_info->inputLatency : stream_info->outputLatency) * 1000000;
+                }
+            }
+            int bytes_per_second = info.sample_rate * frameSize();
+            if (bytes_per_second > 0){
+                result += (uint64_t)bufferedBytes * 1000000 / bytes_per_second;
+            }
+            return result;
+        }
+
+        /// free space of the ring buffer up to the configured buffer size
+        int freeBytes(LockFreeRingBuffer<uint8_t> &buffer) {
+            int result = buffer_bytes - buffer.available();
+            return result > 0 ? result : 0;
+        }
+
+        /// waits for the time which is needed by the callback to process the indicated bytes
+        void waitFor(int bytes) {
+            int bytes_per_ms = info.sample_rate * frameSize() / 1000;
+            int ms = bytes_per_ms > 0 ? bytes / bytes_per_ms : 1;
+            delay(ms > 0 ? ms : 1);
+        }
+
+        /// blocks until all data has been queued for the callback
+        size_t writeBuffer(const uint8_t* data, size_t len) {
+            size_t result = 0;
+            while (result < len && stream_started) {
+                int open = len - result;
+                int size = freeBytes(out_buffer);
+                if (size > open) size = open;
+                if (size > 0) {
+                    result += out_buffer.writeArray(data + result, size);
+                } else {
+                    // wait until there is room for the open data (max half of the buffer)
+                    waitFor(open < buffer_bytes / 2 ? open : buffer_bytes / 2);
+                }
+            }
+            return result;
+        }
+
+        /// blocks until the requested data has been received by the callback
+        size_t readBuffer(uint8_t* data, size_t len) {
+            size_t result = 0;
+            while (result < len && stream_started) {
+                int open = len - result;
+                int size = in_buffer.available();
+                if (size > open) size = open;
+                if (size > 0) {
+                    result += in_buffer.readArray(data + result, size);
+                } else {
+                    // wait until the open data has been recorded (max half of the buffer)
+                    waitFor(open < buffer_bytes / 2 ? open : buffer_bytes / 2);
+                }
+            }
+            return result;
+        }
+
+        static int paCallback(const void *input, void *output, unsigned long frames,
+                        const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags flags, void *userData) {
+            PortAudioStream *self = (PortAudioStream*)userData;
+            self->processCallback((const uint8_t*)input, (uint8_t*)output, frames, flags);
+            return paContinue;
+        }
+
+        /// Real time callback: it must not block or allocate memory
+        void processCallback(const uint8_t *input, uint8_t *output, unsigned long frames, PaStreamCallbackFlags flags) {
+            int frame_size = frameSize();
+            int bytes = frames * frame_size;
+            callback_count++;
+            if (flags & paOutputUnderflow) underflow_count++;
+            if (flags & paInputOverflow) overflow_count++;
+
+            // input and output of the same callback belong to the same point in time
+            if (input != nullptr){
+                // we only store complete frames
+                int size = freeBytes(in_buffer);
+                size -= size % frame_size;
+                if (size > bytes) size = bytes;
+                in_buffer.writeArray(input, size);
+                if (size < bytes){
+                    overflow_count++;
+                    dropped_bytes += bytes - size;
+                }
+            }
+
+            if (output != nullptr){
+                int size = 0;
+                if (!is_primed && out_buffer.available() >= prefill_bytes && out_buffer.available() > 0){
+                    is_primed = true;
+                }
+                if (is_primed){
+                    // we only play complete frames
+                    size = out_buffer.available();
+                    size -= size % frame_size;
+                    if (size > bytes) size = bytes;
+                    out_buffer.readArray(output, size);
+                    if (size < bytes) {
+                        underflow_count++;
+                        // we wait for the prefill again
+                        is_primed = false;
+                    }
+                }
+                memset(output + size, 0, bytes - size);
+            }
+        }
 
 
         PaSampleFormat getFormat(int bitLength){
@@ -5,6 +5,7 @@
 #include "AudioTools/AudioStreams.h"
 #include "AudioMetaData/MetaDataICY.h"
 #include "AudioMetaData/MetaDataID3.h"
+#include "AudioMetaData/MetaDataReplayGain.h"
 #include "AudioHttp/HttpRequest.h"
 
 namespace audio_tools {
@@ -0,0 +1,134 @@
+#pragma once
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "AudioTools/AudioLogger.h"
+#include "AudioMetaData/AbstractMetaData.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Streaming parser for the items of an APEv2 tag (the data between the 32 byte header and footer):
+ * The "Title", "Artist", "Album" and "Genre" text items are reported via the callback. All other items
+ * (e.g. binary cover art) are skipped by their declared size without buffering them.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class MetaDataAPE {
+  public:
+    MetaDataAPE() = default;
+
+    void setCallback(void (*fn)(MetaDataType info, const char* str, int len)) {
+        callback = fn;
+    }
+
+    /// (re)starts the processing of the items
+    void begin() {
+        state = ItemHeader;
+        header_pos = 0;
+    }
+
+    /// provide the (partial) item data
+    size_t write(const uint8_t* data, size_t len){
+        size_t pos = 0;
+        while (pos < len) {
+            switch (state) {
+                case ItemHeader: {
+                    size_t n = min(len - pos, (size_t)(8 - header_pos));
+                    memcpy(item_header + header_pos, data + pos, n);
+                    header_pos += n;
+                    pos += n;
+                    if (header_pos == 8) {
+                        value_size = readLE(item_header);
+                        item_flags = readLE(item_header + 4);
+                        key_len = 0;
+                        state = Key;
+                    }
+                } break;
+
+                case Key: {
+                    char ch = data[pos++];
+                    if (ch != 0) {
+                        if (key_len < (int)sizeof(key) - 1) key[key_len++] = ch;
+                        break;
+                    }
+                    key[key_len] = 0;
+                    item_type = itemType(key);
+                    // only UTF-8 text items are relevant
+                    if (item_type < 0 || (item_flags & 0x06) != 0) item_type = -1;
+                    value_len = 0;
+                    state = value_size > 0 ? Value : ItemHeader;
+                    header_pos = 0;
+                } break;
+
+                case Value: {
+                    size_t n = min(len - pos, value_size);
+                    if (item_type >= 0) {
+                        size_t copy = min(n, sizeof(value) - 1 - value_len);
+                        memcpy(value + value_len, data + pos, copy);
+                        value_len += copy;
+                    }
+                    value_size -= n;
+                    pos += n;
+                    if (value_size == 0) {
+                        if (item_type >= 0) processNotify();
+                        state = ItemHeader;
+                        header_pos = 0;
+                    }
+                } break;
+            }
+        }
+        return len;
+    }
+
+    /// Determines the size of the data which belongs to the tag from a 32 byte APEv2 header or footer
+    static size_t tagSize(const uint8_t* data, bool &hasHeader) {
+        if (memcmp(data, "APETAGEX", 8) != 0) return 0;
+        hasHeader = readLE(data + 20) & 0x80000000;
+        // the size includes the footer and the items, but not the header
+        return readLE(data + 12);
+    }
+
+    /// Returns true if the 32 bytes are a APEv2 header (and not a footer)
+    static bool isHeader(const uint8_t* data) {
+        return memcmp(data, "APETAGEX", 8) == 0 && (readLE(data + 20) & 0x20000000);
+    }
+
+    static uint32_t readLE(const uint8_t* data) {
+        return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    }
+
+  protected:
+    enum State { ItemHeader, Key, Value };
+    const char* keys[4] = {"Title", "Artist", "Album", "Genre"};
+    const MetaDataType types[4] = {Title, Artist, Album, Genre};
+    void (*callback)(MetaDataType info, const char* str, int len) = nullptr;
+    State state = ItemHeader;
+    uint8_t item_header[8];
+    int header_pos = 0;
+    size_t value_size = 0;
+    uint32_t item_flags = 0;
+    int item_type = -1;
+    char key[32];
+    int key_len = 0;
+    char value[256];
+    size_t value_len = 0;
+
+    int itemType(const char* str) {
+        for (int j = 0; j < 4; j++) {
+            if (strcasecmp(str, keys[j]) == 0) return j;
+        }
+        return -1;
+    }
+
+    void processNotify() {
+        if (callback == nullptr) return;
+        value[value_len] = 0;
+        // multiple values are separated by 0: we just use the first one
+        int len = strlen(value);
+        LOGD("APE %s: %.*s", key, LOG_PRINTF_BUFFER_SIZE / 2, value);
+        callback(types[item_type], value, len);
+    }
+};
+
+}
@@ -1,10 +1,18 @@
 #pragma once
 #include "AudioTools/AudioLogger.h"
+#include "AudioCodecs/AudioEncoded.h"
+#include "AudioMetaData/MetaDataID3.h"
+#include "AudioMetaData/MetaDataAPE.h"
 
 namespace audio_tools {
 
 /**
- * @brief Class which filters out ID3v1 and ID3v2 Metadata and provides only the audio data to the decoder
+ * @brief Class which filters out the metadata blocks and provides only the audio data to the decoder:
+ * Leading ID3v2 and APEv2 tags are skipped using their declared size, so we do not need to scan the data.
+ * If the total size is known (see setSize()) we also remove a trailing ID3v1 tag. For seekable files
+ * processTrailer() determines the end of the audio from the trailing ID3v1 and APEv2 tags.
+ * The audio data is passed on to the decoder without copying it. The Title, Artist, Album and Genre
+ * of the removed tags can be reported via a callback.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
@@ -24,104 +32,288 @@ class MetaDataFilter {
             p_decoder = decoder;
         }
 
+        /// Defines the callback which receives the metadata of the removed tags
+        void setCallback(void (*fn)(MetaDataType info, const char* str, int len)) {
+            callback = fn;
+            id3v1.setCallback(fn);
+            id3v2.setCallback(fn);
+            ape.setCallback(fn);
+        }
+
+        /// Defines the total size of the file: this is needed to remove the trailing ID3v1 tag
+        void setSize(size_t size){
+            total_size = size;
+        }
+
+        /// Determines the end of the audio data from the trailing ID3v1 and APEv2 tags of a seekable file (e.g. SD File).
+        /// The file position is restored. Call this before begin().
+        template <class File>
+        bool processTrailer(File &file) {
+            size_t size = file.size();
+            size_t file_pos = file.position();
+            size_t end = size;
+            uint8_t buffer[sizeof(ID3v1)];
+            // ID3v1
+            if (end >= sizeof(ID3v1) && file.seek(end - sizeof(ID3v1)) && file.read(buffer, sizeof(ID3v1)) == sizeof(ID3v1)
+                && memcmp(buffer, "TAG", 3) == 0) {
+                LOGI("ID3v1 tag at %u", (unsigned)(end - sizeof(ID3v1)));
+                if (callback != nullptr) id3v1.processTag(buffer, sizeof(ID3v1));
+                end -= sizeof(ID3v1);
+                // enhanced tag in front of ID3v1
+                if (end >= sizeof(ID3v1Enhanced) && file.seek(end - sizeof(ID3v1Enhanced)) && file.read(buffer, 4) == 4
+                    && memcmp(buffer, "TAG+", 4) == 0) {
+                    end -= sizeof(ID3v1Enhanced);
+                }
+            }
+            // APEv2 footer
+            bool has_header = false;
+            size_t ape_size = 0;
+            if (end >= 32 && file.seek(end - 32) && file.read(buffer, 32) == 32) {
+                ape_size = MetaDataAPE::tagSize(buffer, has_header);
+            }
+            if (ape_size >= 32 && ape_size + (has_header ? 32 : 0) <= end) {
+                LOGI("APEv2 tag with %u bytes", (unsigned)ape_size);
+                end -= ape_size;
+                if (callback != nullptr && file.seek(end)) {
+                    // parse the items which are in front of the footer
+                    ape.begin();
+                    for (size_t pos = 0; pos < ape_size - 32; ) {
+                        size_t n = file.read(buffer, min(sizeof(buffer), ape_size - 32 - pos));
+                        if (n == 0) break;
+                        ape.write(buffer, n);
+                        pos += n;
+                    }
+                }
+                if (has_header) end -= 32;
+            }
+            file.seek(file_pos);
+            total_size = size;
+            audio_end = end;
+            return end < size;
+        }
+
         /// (Re)starts the processing
         void begin() {
             LOGD(LOG_METHOD);
-            start = 0;
+            state = ReadHeader;
+            header_len = 0;
+            skip = 0;
+            parse_len = 0;
+            pos = 0;
+            tail_len = 0;
+        }
+
+        /// Writes the remaining buffered data
+        void end() {
+            if (state == ReadHeader && header_len > 0) {
+                writeAudio(header, header_len);
+            }
+            flushTail();
+            state = ReadHeader;
+            header_len = 0;
         }
 
-        /// Writes the data to the decoder 
+        /// Writes the data to the decoder
         size_t write(uint8_t* data, size_t len){
             LOGD(LOG_METHOD);
             if (p_decoder==nullptr) return 0;
-            int pos=0; int meta_len=0;
-            if (findTag(data, len, pos, meta_len)){
-                LOGD("pos: %d len: %d",pos, meta_len);
-                if (start<pos){
-                    p_decoder->write(data+start,pos);
-                }
+            size_t idx = 0;
+            while (idx < len) {
+                switch (state) {
+                    case ReadHeader: {
+                        size_t n = min(len - idx, headerSize() - header_len);
+                        memcpy(header + header_len, data + idx, n);
+                        header_len += n;
+                        idx += n;
+                        // the size might have changed after we got the first characters
+                        if (header_len < headerSize() && isHeaderPrefix()) break;
+                        if (!startTag()) {
+                            // the few collected bytes are audio
+                            writeAudio(header, header_len);
+                            state = Audio;
+                        }
+                        header_len = 0;
+                    } break;
 
-                int start_idx2 = pos+meta_len;
-                int len2 =  len-start_idx2;    
-                if (start_idx2<len){
-                    // we still have some audio to write
-                    p_decoder->write(data+start_idx2,len2);
-                } else {
-                    // ignore audio of next write
-                    start = meta_len - len2;
-                }
-            } else {
-                // ignore start number of characters
-                if (start>=len){
-                    start -= len;
-                } else {
-                    p_decoder->write(data+start,len-start);
-                    start = 0;
+                    case SkipTag: {
+                        size_t n = min(len - idx, skip);
+                        if (parse_len > 0) {
+                            size_t parse = min(n, parse_len);
+                            if (is_ape) ape.write(data + idx, parse); else id3v2.write(data + idx, parse);
+                            parse_len -= parse;
+                        }
+                        skip -= n;
+                        idx += n;
+                        pos += n;
+                        if (skip == 0) state = ReadHeader;
+                    } break;
+
+                    case Audio:
+                        writeAudio(data + idx, len - idx);
+                        idx = len;
+                        break;
                 }
             }
             return len;
         }
 
     protected:
+        enum State {ReadHeader, SkipTag, Audio};
         Decoder *p_decoder=nullptr;
-        enum MetaType {TAG, TAG_PLUS, ID3};
-        int start = 0;
-        /// ID3 verion 2 TAG Header (10 bytes)
-        struct ID3v2 {
-            uint8_t header[3]; // ID3
-            uint8_t version[2];
-            uint8_t flags;
-            uint8_t size[4];
-        } tagv2;
-
-        /// determines if the data conatins a ID3v1 or ID3v2 tag
-        bool findTag(uint8_t* data, size_t len, int &pos_tag, int &meta_len){
-            MetaType tag_type;
-            if (find((const char*)data, len, pos_tag, tag_type)){
-                switch(tag_type){
-                    case TAG:
-                        LOGD("TAG");
-                        meta_len = 128;
-                        break;
-                    case TAG_PLUS:
-                        LOGD("TAG+");
-                        meta_len = 227;
-                        break;
-                    case ID3:
-                        LOGD("ID3");
-                        memcpy(&tagv2, data+pos_tag, sizeof(ID3v2));   
-                        meta_len = calcSizeID3v2(tagv2.size);
-                        break;
+        void (*callback)(MetaDataType info, const char* str, int len) = nullptr;
+        MetaDataID3V1 id3v1;
+        MetaDataID3V2 id3v2;
+        MetaDataAPE ape;
+        State state = ReadHeader;
+        uint8_t header[32];
+        size_t header_len = 0;
+        size_t skip = 0;
+        size_t parse_len = 0;
+        bool is_ape = false;
+        size_t pos = 0;
+        size_t total_size = 0;
+        size_t audio_end = 0;
+        uint8_t tail[sizeof(ID3v1)];
+        size_t tail_len = 0;
+
+        /// ID3v2 needs 10 bytes, APEv2 32 bytes
+        size_t headerSize() {
+            return header_len >= 3 && memcmp(header, "APE", 3) == 0 ? 32 : 10;
+        }
+
+        /// Returns true if the collected data might be the start of a tag
+        bool isHeaderPrefix() {
+            return memcmp(header, "ID3", min(header_len, (size_t)3)) == 0
+                || memcmp(header, "APETAGEX", min(header_len, (size_t)8)) == 0;
+        }
 
+        /// Determines if the collected header is a tag: the tag data is skipped
+        bool startTag() {
+            size_t size = 0;
+            if (header_len == 10 && (size = MetaDataID3V2::tagSize(header)) > 0) {
+                LOGI("skipping ID3v2 tag with %u bytes", (unsigned)size);
+                is_ape = false;
+                if (callback != nullptr) {
+                    id3v2.begin();
+                    id3v2.write(header, header_len);
+                    parse_len = size - header_len;
                 }
-                return true;
-            }
-            return false;
-        }
-
-        // calculate the synch save size for ID3v2
-        uint32_t calcSizeID3v2(uint8_t chars[4]) {
-            uint32_t byte0 = chars[0];
-            uint32_t byte1 = chars[1];
-            uint32_t byte2 = chars[2];
-            uint32_t byte3 = chars[3];
-            return byte0 << 21 | byte1 << 14 | byte2 << 7 | byte3;
-        }
-
-        /// find the tag position in the string;
-        bool find(const char*str, size_t len, int &pos, MetaType &type){
-            if (str==nullptr || len<=0) return false;
-            for (size_t j=0;j<=len-3;j++){
-                if (str[j]=='T' && str[j+1]=='A' && str[j+2]=='G'){
-                    type = str[j+3]=='+' ? TAG_PLUS : TAG;
-                    return true;
-                } else if (str[j]=='I' && str[j+1]=='D' && str[j+2]=='3'){
-                    type = ID3;
-                    return true;
+            } else if (header_len == 32 && MetaDataAPE::isHeader(header)) {
+                bool has_header;
+                size = MetaDataAPE::tagSize(header, has_header) + 32;
+                if (size < 64) return false;
+                LOGI("skipping APEv2 tag with %u bytes", (unsigned)size);
+                is_ape = true;
+                if (callback != nullptr) {
+                    ape.begin();
+                    // we do not parse the footer
+                    parse_len = size - 64;
                 }
+            } else {
+                return false;
+            }
+            pos += header_len;
+            skip = size - header_len;
+            state = skip > 0 ? SkipTag : ReadHeader;
+            return true;
+        }
+
+        /// Writes the audio data to the decoder: if we know the size, the last 128 bytes are kept back to check
+        /// for a ID3v1 tag
+        void writeAudio(uint8_t* data, size_t len) {
+            size_t limit = audio_end;
+            if (limit == 0) limit = total_size > sizeof(tail) ? total_size - sizeof(tail) : 0;
+            size_t audio_len = len;
+            if (limit > 0) {
+                audio_len = pos >= limit ? 0 : min(len, limit - pos);
+            }
+            if (audio_len > 0) {
+                p_decoder->write(data, audio_len);
             }
-            return false;
+            if (audio_len < len && audio_end == 0) {
+                size_t n = min(len - audio_len, sizeof(tail) - tail_len);
+                memcpy(tail + tail_len, data + audio_len, n);
+                tail_len += n;
+                if (tail_len == sizeof(tail)) flushTail();
+            }
+            pos += len;
         }
+
+        /// Removes the ID3v1 tag or writes the data if it is audio
+        void flushTail() {
+            if (tail_len == 0) return;
+            if (tail_len == sizeof(tail) && memcmp(tail, "TAG", 3) == 0) {
+                LOGI("removing ID3v1 tag");
+                if (callback != nullptr) id3v1.processTag(tail, tail_len);
+            } else {
+                p_decoder->write(tail, tail_len);
+            }
+            tail_len = 0;
+        }
+};
+
+/**
+ * @brief Decoder which removes the metadata (ID3v2, APEv2 and ID3v1 tags) before the data is passed on to
+ * the indicated decoder: e.g. MetaDataFilterDecoder filter(aac);
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class MetaDataFilterDecoder : public AudioDecoder {
+    public:
+        MetaDataFilterDecoder(AudioDecoder &decoder) {
+            p_decoder = &decoder;
+            filter.setDecoder(p_decoder);
+        }
+
+        /// Defines the callback which receives the metadata of the removed tags
+        void setCallback(void (*fn)(MetaDataType info, const char* str, int len)) {
+            filter.setCallback(fn);
+        }
+
+        /// Defines the total size of the file: this is needed to remove the trailing ID3v1 tag
+        void setSize(size_t size){
+            filter.setSize(size);
+        }
+
+        /// Determines the end of the audio data from the trailing tags of a seekable file
+        template <class File>
+        bool processTrailer(File &file) {
+            return filter.processTrailer(file);
+        }
+
+        void setOutputStream(Print &out_stream) override {
+            p_decoder->setOutputStream(out_stream);
+        }
+
+        void setNotifyAudioChange(AudioBaseInfoDependent &bi) override {
+            p_decoder->setNotifyAudioChange(bi);
+        }
+
+        AudioBaseInfo audioInfo() override {
+            return p_decoder->audioInfo();
+        }
+
+        void begin() override {
+            p_decoder->begin();
+            filter.begin();
+        }
+
+        void end() override {
+            filter.end();
+            p_decoder->end();
+        }
+
+        size_t write(const void *data, size_t len) override {
+            return filter.write((uint8_t*)data, len);
+        }
+
+        operator bool() override {
+            return *p_decoder;
+        }
+
+    protected:
+        AudioDecoder *p_decoder = nullptr;
+        MetaDataFilter<AudioDecoder> filter;
 };
 
-}
\ No newline at end of file
+}
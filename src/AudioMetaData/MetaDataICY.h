@@ -41,12 +41,9 @@ class MetaDataICY : public AbstractMetaData {
             callback = fn;
         }
 
-        /// Defines the audio callback function
+        /// Defines the audio callback function: the audio is provided as slices of the written data (the bufferLen is not used any more)
         virtual void setAudioDataCallback(void (*fn)(const uint8_t* str, int len), int bufferLen=1024)  {
-            dataBuffer = new uint8_t[bufferLen];
             dataCallback = fn;
-            dataLen = 0;
-            dataPos = 0;
         }
 
         /// Resets all counters and restarts the prcessing
@@ -62,14 +59,58 @@ class MetaDataICY : public AbstractMetaData {
 
         /// Writes the data in order to retrieve the metadata and perform the corresponding callbacks 
         virtual size_t write(const uint8_t *buffer, size_t len) override {
-            if (callback!=nullptr){
-                for (size_t j=0;j<len;j++){
-                    processChar((char)buffer[j]);
-                }
+            if (callback!=nullptr || dataCallback!=nullptr){
+                demux(buffer, len, dataCallback==nullptr ? nullptr : audioDataCallback, this);
             }
             return len;
         }
 
+        /// Splits the data into audio runs and metadata blocks: Instead of processing each byte we jump to the next 
+        /// metadata boundary. The audio is reported as slices of the provided buffer (so it is not copied) and only 
+        /// the metadata blocks are parsed.
+        virtual void demux(const uint8_t *buffer, size_t len, void (*onAudio)(void* ref, const uint8_t* data, size_t len), void* ref=nullptr) {
+            size_t pos = 0;
+            while (pos<len){
+                if (nextStatus==ProcessData){
+                    size_t n = len - pos;
+                    if (mp3_blocksize>0){
+                        n = min(n, (size_t)(mp3_blocksize - totalData));
+                        totalData += n;
+                        if (totalData>=mp3_blocksize){
+                            LOGI("Data ended")
+                            totalData = 0;
+                            nextStatus = SetupSize;
+                        }   
+                    }
+                    currentStatus = ProcessData;
+                    if (onAudio!=nullptr) onAudio(ref, buffer+pos, n);
+                    pos += n;
+                } else if (nextStatus==ProcessMetaData){
+                    size_t n = min(len - pos, (size_t)(metaDataLen - metaDataPos));
+                    memcpy(metaData+metaDataPos, buffer+pos, n);
+                    metaDataPos += n;
+                    pos += n;
+                    currentStatus = ProcessMetaData;
+                    if (metaDataPos>=metaDataLen){
+                        processMetaData(metaData, metaDataLen);
+                        LOGI("Metadata ended")
+                        nextStatus = ProcessData;
+                    }
+                } else {
+                    // the size byte
+                    processChar(buffer[pos++]);
+                }
+            }
+        }
+
+        /// Removes the metadata from the buffer: the audio runs are moved to the front. Returns the resulting audio length
+        virtual size_t removeMetaData(uint8_t *buffer, size_t len) {
+            if (!hasMetaData()) return len;
+            Compact compact{buffer, 0};
+            demux(buffer, len, compactCallback, &compact);
+            return compact.len;
+        }
+
         /// Returns the actual status of the state engine for the current byte
         virtual Status status() {
             return currentStatus;
@@ -152,18 +193,30 @@ class MetaDataICY : public AbstractMetaData {
         int metaDataPos = 0;
         bool is_data; // indicates if the current byte is a data byte
         // data
-        uint8_t *dataBuffer=nullptr;
         void (*dataCallback)(const uint8_t* str, int len) = nullptr;    
-        int dataLen = 0;
-        int dataPos = 0;
+        struct Compact {
+            uint8_t* buffer;
+            size_t len;
+        };
 
         virtual void clear() {
             nextStatus = ProcessData;
             totalData = 0;
             metaDataLen = 0;
             metaDataPos = 0;
-            dataLen = 0;
-            dataPos = 0;
+        }
+
+        static void audioDataCallback(void* ref, const uint8_t* data, size_t len){
+            MetaDataICY *self = (MetaDataICY*)ref;
+            self->dataCallback(data, len);
+        }
+
+        static void compactCallback(void* ref, const uint8_t* data, size_t len){
+            Compact *compact = (Compact*)ref;
+            if (compact->buffer + compact->len != data){
+                memmove(compact->buffer + compact->len, data, len);
+            }
+            compact->len += len;
         }
 
         /// determines the meta data size from the size byte
@@ -227,15 +280,10 @@ class MetaDataICY : public AbstractMetaData {
             }
         }
 
-        /// Collects the data in a buffer and executes the callback when the buffer is full
+        /// Provides a single audio byte via the callback
         virtual void processData(char ch){
-            if (dataBuffer!=nullptr){
-                dataBuffer[dataPos++] = ch;
-                // output data via callback
-                if (dataPos>=dataLen){
-                    dataCallback(dataBuffer, dataLen);
-                    dataPos = 0;
-                }
+            if (dataCallback!=nullptr){
+                dataCallback((const uint8_t*)&ch, 1);
             }
         }
 };
@@ -253,7 +301,7 @@ class ICYUrlSetup {
         int setup(HttpRequest &http ) {
             LOGD(LOG_METHOD);
             p_http = &http;
-            const char* iceMetaintStr = http.reply().get("icy-metaint");
+            const char* iceMetaintStr = http.reply().get(ICY_METAINT);
             if (iceMetaintStr){
                 LOGI("icy-metaint: %s", iceMetaintStr);
             } else {
@@ -14,20 +14,20 @@
 namespace audio_tools {
 
 /// String array with genres
-const char *genres[] = { "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise", "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Insdustiral", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native US", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock", "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival", "Celtic", "Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic","Humour", "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club", "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhytmic Soul", "Freestyle", "Duet", "Punk Rock", "Drum Solo", "Acapella", "Euro-House", "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror", "Indie", "BritPop", "Negerpunk", "Polsk Punk", "Beat", "Christian Gangsta", "Heavy Metal", "Black Metal", "Crossover", "Contemporary C", "Christian Rock", "Merengue", "Salsa", "Thrash Metal", "Anime", "JPop", "SynthPop" };
+const char *genres[] = { "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise", "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Insdustiral", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native US", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock", "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival", "Celtic", "Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic","Humour", "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club", "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhytmic Soul", "Freestyle", "Duet", "Punk Rock", "Drum Solo", "Acapella", "Euro-House", "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror", "Indie", "BritPop", "Negerpunk", "Polsk Punk", "Beat", "Christian Gangsta", "Heavy Metal", "Black Metal", "Crossover", "Contemporary C", "Christian Rock", "Merengue", "Salsa", "Thrash Metal", "Anime", "JPop", "SynthPop" };
 
 /// current status of the parsing
 enum ParseStatus { TagNotFound, PartialTagAtTail, TagFoundPartial, TagFoundComplete, TagProcessed};
 
 
-/// ID3 verion 1 TAG (130 bytes)
+/// ID3 verion 1.1 TAG (128 bytes)
 struct ID3v1 {
     char header[3]; // TAG
     char title[30];
     char artist[30];
     char album[30];
     char year[4];
-    char comment[30];
+    char comment[28];
     char zero_byte[1];    
     char track[1];    
     char genre;    
@@ -64,7 +64,7 @@ class MetaDataID3Base  {
     }
 
   protected:
-    void (*callback)(MetaDataType info, const char* title, int len);
+    void (*callback)(MetaDataType info, const char* title, int len) = nullptr;
     bool armed = false;
 
     /// find the tag position in the string - if not found we return -1;
@@ -101,8 +101,7 @@ class MetaDataID3V1  : public MetaDataID3Base {
     void begin() {
         end();
         status = TagNotFound;
-        use_bytes_of_next_write = 0;
-        memset(tag_str, 0, 5);
+        tail_len = 0;
     }
 
     /// Ends the processing and releases the memory
@@ -117,137 +116,75 @@ class MetaDataID3V1  : public MetaDataID3Base {
         }
     }
 
-    /// provide the (partial) data which might contain the meta data
+    /// provide the (partial) data which might contain the meta data: the tag is at the end of the file, so
+    /// we just keep the last bytes and check if they start with a tag - the audio data is not scanned
     size_t write(const uint8_t* data, size_t len){
-        if (armed){ 
-            switch(status){
-                case TagNotFound:
-                    processTagNotFound(data,len);
-                    break;
-                case PartialTagAtTail:
-                    processPartialTagAtTail(data,len);
-                    break;
-                case TagFoundPartial:
-                    processTagFoundPartial(data,len);
-                    break;
-                default:                
-                    // do nothing
-                    break;
+        if (armed && callback!=nullptr && status != TagProcessed){
+            updateTail(data, len);
+            const uint8_t* pt = tail + tail_len - sizeof(ID3v1);
+            if (tail_len >= sizeof(ID3v1) && memcmp(pt, "TAG", 3)==0 && pt[3]!='+'){
+                // optional enhanced tag in front of the ID3v1 tag
+                if (tail_len == sizeof(tail) && memcmp(tail, "TAG+", 4)==0){
+                    tag_ext = new ID3v1Enhanced();
+                    if (tag_ext!=nullptr) memcpy(tag_ext, tail, sizeof(ID3v1Enhanced));
+                }
+                processTag(pt, sizeof(ID3v1));
             }
         }
         return len;
     }
 
+    /// Parses a complete ID3v1 tag at a known position (e.g. the last 128 bytes of a file) without any scanning: 
+    /// returns false if the data does not start with a tag
+    bool processTag(const uint8_t* data, size_t len){
+        if (len < sizeof(ID3v1) || memcmp(data, "TAG", 3)!=0 || data[3]=='+') return false;
+        if (callback==nullptr) return true;
+        if (tag!=nullptr) delete tag;
+        tag = new ID3v1();
+        if (tag==nullptr) return false;
+        memcpy(tag, data, sizeof(ID3v1));
+        processNotify();
+        return true;
+    }
+
   protected:
-    int use_bytes_of_next_write = 0;
-    char tag_str[5] = "";
     ID3v1 *tag = nullptr;
     ID3v1Enhanced *tag_ext = nullptr;
     ParseStatus status = TagNotFound;
-
-
-    /// try to find the metatdata tag in the provided data
-    void processTagNotFound(const uint8_t* data, size_t len) {
-        // find tags
-        int pos = findTag("TAG+",(const char*) data, len);
-        if (pos>0){
-            tag_ext = new ID3v1Enhanced();
-            if (tag_ext!=nullptr){
-                if (len-pos>=sizeof(ID3v1Enhanced)){
-                    memcpy(tag,data+pos,sizeof(ID3v1Enhanced));
-                    processNotify();                    
-                } else {
-                    use_bytes_of_next_write = min(sizeof(ID3v1Enhanced), len-pos);
-                    memcpy(tag_ext, data+pos, use_bytes_of_next_write);
-                    status = TagFoundPartial;
-                }
-            }
-        } else {
-            pos = findTag("TAG", (const char*) data, len);
-            if (pos>0){
-                tag = new ID3v1();
-                if (tag!=nullptr){
-                    if (len-pos>=sizeof(ID3v1)){
-                        memcpy(tag,data+pos,sizeof(ID3v1));
-                        processNotify();                    
-                    } else {
-                        use_bytes_of_next_write = min(sizeof(ID3v1), len-pos);
-                        memcpy(tag,data+pos,use_bytes_of_next_write);
-                        status = TagFoundPartial;
-                        
-                    }
-                }
-            }
-        }
-
-        // we did not find a full tag we check if the end might start with a tag
-        if (pos==-1){
-            if (data[len-3] == 'T' && data[len-2] == 'A' && data[len-1] == 'G'){
-                strcpy(tag_str,"TAG");
-                status = TagFoundPartial;
-            } else if (data[len-2] == 'T' && data[len-1] == 'A' ){
-                strcpy(tag_str,"TA");
-                status = TagFoundPartial;                
-            } else if (data[len-1] == 'T'){            
-                strcpy(tag_str,"T");
-                status = TagFoundPartial;
-            }
+    // last bytes of the data: room for an enhanced tag followed by the ID3v1 tag
+    uint8_t tail[sizeof(ID3v1Enhanced) + sizeof(ID3v1)];
+    size_t tail_len = 0;
+
+    /// keeps the last bytes of the data
+    void updateTail(const uint8_t* data, size_t len) {
+        if (len >= sizeof(tail)){
+            memcpy(tail, data + len - sizeof(tail), sizeof(tail));
+            tail_len = sizeof(tail);
+            return;
         }
+        size_t keep = sizeof(tail) - len;
+        if (keep > tail_len) keep = tail_len;
+        memmove(tail, tail + tail_len - keep, keep);
+        memcpy(tail + keep, data, len);
+        tail_len = keep + len;
     }
 
-    /// We had part of the start tag at the end of the last write, now we get the full data
-    void processPartialTagAtTail(const uint8_t* data, size_t len) {
-        int tag_len = strlen(tag_str);
-        int missing = 5 - tag_len;
-        strncat((char*)tag_str, (char*)data, missing);
-        if (strncmp((char*)tag_str, "TAG+", 4)==0){
-            tag_ext = new ID3v1Enhanced();
-            memcpy(tag,tag_str, 4);
-            memcpy(tag,data+len,sizeof(ID3v1Enhanced));
-            processNotify();                    
-        } else if (strncmp((char*)tag_str,"TAG",3)==0){
-            tag = new ID3v1();
-            memcpy(tag,tag_str, 3);
-            memcpy(tag,data+len,sizeof(ID3v1));
-            processNotify();                    
-        }
+    /// reports the value of the enhanced tag: empty values do not replace the ID3v1 values
+    void notifyExt(MetaDataType type, const char* str, int max_len) {
+        int len = strnlen(str, max_len);
+        if (len > 0) callback(type, str, len);
     }
 
-    /// We have the beginning of the metadata and need to process the remainder
-    void processTagFoundPartial(const uint8_t* data, size_t len) {
-        if (tag!=nullptr){
-            int remainder = sizeof(ID3v1) - use_bytes_of_next_write;
-            memcpy(tag,data+use_bytes_of_next_write,remainder);
-            processNotify();                 
-            use_bytes_of_next_write = 0;   
-        } else if (tag_ext!=nullptr){
-            int remainder = sizeof(ID3v1Enhanced) - use_bytes_of_next_write;
-            memcpy(tag_ext,data+use_bytes_of_next_write,remainder);
-            processNotify();                 
-            use_bytes_of_next_write = 0;   
-        }
-    }
-
-    /// executes the callbacks
+    /// executes the callbacks: the longer values of the enhanced tag are reported last
     void processNotify() {
         if (callback==nullptr) return;
 
-        if (tag_ext!=nullptr){
-            callback(Title, tag_ext->title,strnlen(tag_ext->title,60));
-            callback(Artist, tag_ext->artist,strnlen(tag_ext->artist,60));
-            callback(Album, tag_ext->album,strnlen(tag_ext->album,60));
-            callback(Genre, tag_ext->genre,strnlen(tag_ext->genre,30));
-            delete tag_ext;
-            tag_ext = nullptr;
-            status = TagProcessed;
-        }
-
         if (tag!=nullptr){
             callback(Title, tag->title,strnlen(tag->title,30));
             callback(Artist, tag->artist,strnlen(tag->artist,30));
             callback(Album, tag->album,strnlen(tag->album,30));        
-            uint16_t genre = tag->genre;
-            if (genre < sizeof(genres)){
+            uint8_t genre = tag->genre;
+            if (genre < sizeof(genres)/sizeof(char*)){
                 const char* genre_str = genres[genre];
                 callback(Genre, genre_str,strlen(genre_str));
             }
@@ -255,18 +192,33 @@ class MetaDataID3V1  : public MetaDataID3Base {
             tag = nullptr;
             status = TagProcessed;
         }
+
+        if (tag_ext!=nullptr){
+            notifyExt(Title, tag_ext->title, 60);
+            notifyExt(Artist, tag_ext->artist, 60);
+            notifyExt(Album, tag_ext->album, 60);
+            notifyExt(Genre, tag_ext->genre, 30);
+            delete tag_ext;
+            tag_ext = nullptr;
+            status = TagProcessed;
+        }
     }
 
 };
 
 // -------------------------------------------------------------------------------------------------------------------------------------
 
-#define UnsynchronisationFlag 0x40
-#define ExtendedHeaderFlag 0x20
-#define ExperimentalIndicatorFlag 0x10
-        
-/// Relevant v2 Tags        
-const char* id3_v2_tags[] = {"TALB", "TOPE", "TIT2", "TCON"};
+#define UnsynchronisationFlag 0x80
+#define ExtendedHeaderFlag 0x40
+#define ExperimentalIndicatorFlag 0x20
+#define FooterPresentFlag 0x10
+
+/// Relevant v2 Tags (v2.3 and v2.4)
+const char* id3_v2_tags[] = {"TIT2", "TPE1", "TALB", "TCON"};
+/// Relevant v2 Tags (v2.2)
+const char* id3_v22_tags[] = {"TT2", "TP1", "TAL", "TCO"};
+/// Metadata types of the relevant v2 tags
+const MetaDataType id3_v2_types[] = {Title, Artist, Album, Genre};
 
 
 /// ID3 verion 2 TAG Header (10 bytes)
@@ -310,7 +262,10 @@ struct ID3v2FrameString {
 const int ID3FrameSize = 11;
 
 /**
- * @brief Simple ID3 Meta Data API which supports ID3 V2: We only support the "TALB", "TOPE", "TIT2", "TCON" tags
+ * @brief Streaming ID3 V2 parser which supports the versions 2.2, 2.3 and 2.4: We read the 10 byte header and then jump
+ * from frame to frame using the declared frame sizes. Only the "TIT2", "TPE1", "TALB", "TCON" (v2.2: "TT2", "TP1", "TAL", "TCO") 
+ * frames are collected: all other frames (e.g. APIC images) are skipped by length without buffering them. Unsynchronisation is 
+ * supported on tag (v2.2, v2.3) and on frame level (v2.4).
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
@@ -321,35 +276,38 @@ class MetaDataID3V2 : public MetaDataID3Base  {
     /// (re)starts the processing
     void begin() {
         status = TagNotFound;
-        use_bytes_of_next_write = 0;
-        actual_tag = nullptr;
-        tag_active = false;
+        state = ReadTagHeader;
+        header_pos = 0;
+        tag_remaining = 0;
+        tag_size = 0;
+        last_was_ff = false;
         tag_processed = false;
     }
     
 
     /// Ends the processing and releases the memory
     void end() {
-        status = TagNotFound;
-        use_bytes_of_next_write = 0;
-        actual_tag = nullptr;
-        tag_active = false;
-        tag_processed = false;
+        begin();
     }
 
     /// provide the (partial) data which might contain the meta data
     size_t write(const uint8_t* data, size_t len){
-        if (armed){ 
-            switch(status){
-                case TagNotFound:
-                    processTagNotFound(data,len);
-                    break;
-                case PartialTagAtTail:
-                    processPartialTagAtTail(data,len);
-                    break;
-                default:                
-                    // do nothing
-                    break;
+        size_t pos = 0;
+        if (state == ReadTagHeader){
+            pos = processTagHeader(data, len);
+        }
+        if (state != ReadTagHeader && tag_remaining > 0){
+            size_t n = min(len - pos, tag_remaining);
+            if (unsync_tag) {
+                processUnsynchronised(data + pos, n);
+            } else {
+                processBody(data + pos, n);
+            }
+            tag_remaining -= n;
+            if (tag_remaining == 0){
+                LOGI("ID3v2 tag processed");
+                status = TagProcessed;
+                tag_processed = true;
             }
         }
         return len;
@@ -370,20 +328,49 @@ class MetaDataID3V2 : public MetaDataID3Base  {
         return tag_processed;
     }
 
+    /// Total size of the tag including the header and footer (0 if there is no tag)
+    size_t tagSize() {
+        return tag_size;
+    }
+
+    /// Returns true if we still need to parse the initial data to decide if we have a tag
+    bool isHeaderPending() {
+        return state == ReadTagHeader;
+    }
+
+    /// determines the size of a ID3v2 tag (incl. header and footer) from the first 10 bytes: returns 0 if this is not a tag
+    static size_t tagSize(const uint8_t* data) {
+        if (memcmp(data, "ID3", 3)!=0 || data[3] < 2 || data[3] > 4 || data[4] == 0xFF) return 0;
+        if ((data[6] | data[7] | data[8] | data[9]) & 0x80) return 0;
+        size_t result = 10 + calcSize(data + 6);
+        if (data[3] == 4 && (data[5] & FooterPresentFlag)) result += 10;
+        return result;
+    }
+
   protected:
+    enum State { ReadTagHeader, ReadExtHeader, ReadFrameHeader, ReadFrameData, SkipData, SkipPadding, NoTag };
     ID3v2 tagv2;
-    bool tag_active = false;
     bool tag_processed = false;
     ParseStatus status = TagNotFound;
-    const char* actual_tag;
+    State state = ReadTagHeader;
     ID3v2FrameString frame_header;
-    int use_bytes_of_next_write = 0;
+    uint8_t header_buffer[10];
+    int header_pos = 0;
+    int header_len = 10;
+    size_t tag_size = 0;
+    size_t tag_remaining = 0;
+    size_t skip = 0;
+    int version = 0;
+    bool unsync_tag = false;
+    bool last_was_ff = false;
+    int frame_type = -1;
+    uint8_t frame_flags = 0;
+    size_t frame_size = 0;
     char result[256];
-    uint64_t total_len = 0;
-    uint64_t end_len = 0;
+    size_t result_len = 0;
 
     // calculate the synch save size
-    uint32_t calcSize(uint8_t chars[4]) {
+    static uint32_t calcSize(const uint8_t chars[4]) {
         uint32_t byte0 = chars[0];
         uint32_t byte1 = chars[1];
         uint32_t byte2 = chars[2];
@@ -391,94 +378,209 @@ class MetaDataID3V2 : public MetaDataID3Base  {
         return byte0 << 21 | byte1 << 14 | byte2 << 7 | byte3;
     }
 
-    /// try to find the metatdata tag in the provided data
-    void processTagNotFound(const uint8_t* data, size_t len) {
-
-        // activate tag processing when we have an ID3 Tag
-        if (!tag_active && !tag_processed){
-            int pos = findTag("ID3", (const char*) data, len);
-            if (pos>=0){
-                // fill v2 tag header
-                tag_active = true;  
-                // if we have enough data for the header we process it
-                if (len>=pos+sizeof(ID3v2)){
-                    memcpy(&tagv2, data+pos, sizeof(ID3v2));   
-                    end_len = total_len + calcSize(tagv2.size);
-                }
-            }
+    /// collects the 10 bytes of the tag header: returns the number of processed bytes
+    size_t processTagHeader(const uint8_t* data, size_t len) {
+        size_t n = min(len, (size_t)(10 - header_pos));
+        memcpy(header_buffer + header_pos, data, n);
+        header_pos += n;
+        if (header_pos < 10) {
+            // we can already reject the data if it does not start with ID3
+            if (memcmp(header_buffer, "ID3", min(header_pos, 3))!=0) state = NoTag;
+            return n;
+        }
+        tag_size = tagSize(header_buffer);
+        if (tag_size == 0) {
+            LOGD("No ID3v2 tag");
+            state = NoTag;
+            return n;
         }
+        memcpy(&tagv2, header_buffer, sizeof(ID3v2));
+        version = tagv2.version[0];
+        unsync_tag = version < 4 && (tagv2.flags & UnsynchronisationFlag);
+        tag_remaining = tag_size - 10;
+        LOGI("ID3v2.%d tag with %u bytes", version, (unsigned)tag_size);
+        if (version > 2 && (tagv2.flags & ExtendedHeaderFlag)){
+            state = ReadExtHeader;
+            header_pos = 0;
+            header_len = 4;
+        } else {
+            startFrameHeader();
+        }
+        status = TagFoundPartial;
+        return n;
+    }
 
-        // deactivate tag processing when we are out of range
-        if (end_len>0 && total_len>end_len){
-            tag_active = false;
-            tag_processed = false;
+    void startFrameHeader() {
+        state = ReadFrameHeader;
+        header_pos = 0;
+        header_len = version == 2 ? 6 : 10;
+    }
+
+    /// removes the unsynchronisation (0x00 after 0xFF) before parsing
+    void processUnsynchronised(const uint8_t* data, size_t len) {
+        uint8_t decoded[64];
+        size_t decoded_len = 0;
+        for (size_t j = 0; j < len; j++) {
+            uint8_t ch = data[j];
+            if (!(last_was_ff && ch == 0)) {
+                decoded[decoded_len++] = ch;
+            }
+            last_was_ff = ch == 0xFF;
+            if (decoded_len == sizeof(decoded)) {
+                processBody(decoded, decoded_len);
+                decoded_len = 0;
+            }
         }
+        processBody(decoded, decoded_len);
+    }
 
-        
-        if (tag_active){
-            // process all tags in current buffer
-            const char* partial_tag = nullptr;
-            for (const char* tag : id3_v2_tags){
-                actual_tag = tag;
-                int tag_pos = findTag(tag, (const char*)  data, len);
-
-                if (tag_pos>0 && tag_pos+sizeof(ID3v2Frame)<=len){
-                    // setup tag header
-                    memmove(&frame_header, data+tag_pos, sizeof(ID3v2FrameString));
-
-                    // get tag content
-                    if(calcSize(frame_header.size) <= len){
-                        int l = min(calcSize(frame_header.size)-1, (uint32_t) 256);
-                        memset(result,0,256);
-                        strncpy((char*)result, (char*) data+tag_pos+ID3FrameSize, l);
-                        int checkLen = min(l, 10);
-                        if (isAscii(checkLen)){
-                            processNotify();
+    /// Processes the data after the tag header using the declared sizes
+    void processBody(const uint8_t* data, size_t len) {
+        size_t pos = 0;
+        while (pos < len) {
+            switch (state) {
+                case ReadExtHeader:
+                case ReadFrameHeader: {
+                    size_t n = min(len - pos, (size_t)(header_len - header_pos));
+                    memcpy(header_buffer + header_pos, data + pos, n);
+                    header_pos += n;
+                    pos += n;
+                    if (header_pos == header_len) {
+                        if (state == ReadExtHeader) {
+                            // v2.3: the size excludes the size field, v2.4: the size is synch save and includes it
+                            uint32_t ext_size = version == 3 ? readInt(header_buffer, 4) + 4 : calcSize(header_buffer);
+                            skip = ext_size > 4 ? ext_size - 4 : 0;
+                            state = SkipData;
+                        } else {
+                            processFrameHeader();
                         }
-                    } else {
-                        partial_tag = tag;
                     }
-                }
-            }
-            
-            // save partial tag information so that we process the remainder with the next write
-            if (partial_tag!=nullptr){
-                int tag_pos = findTag(partial_tag, (const char*)  data, len);
-                memmove(&frame_header, data+tag_pos, sizeof(ID3v2FrameString));
-                int size = min(len - tag_pos, (size_t) calcSize(frame_header.size)-1); 
-                strncpy((char*)result, (char*)data+tag_pos+ID3FrameSize, size);
-                use_bytes_of_next_write = size;
-                status = PartialTagAtTail;
+                } break;
+
+                case ReadFrameData: {
+                    size_t n = min(len - pos, frame_size);
+                    size_t copy = min(n, sizeof(result) - 1 - result_len);
+                    memcpy(result + result_len, data + pos, copy);
+                    result_len += copy;
+                    frame_size -= n;
+                    pos += n;
+                    if (frame_size == 0) {
+                        processFrame();
+                        startFrameHeader();
+                    }
+                } break;
+
+                case SkipData: {
+                    size_t n = min(len - pos, skip);
+                    skip -= n;
+                    pos += n;
+                    if (skip == 0) startFrameHeader();
+                } break;
+
+                default:
+                    // padding or unsupported data: ignore the rest of the tag
+                    return;
             }
         }
-    
-        total_len += len;
+    }
 
+    uint32_t readInt(const uint8_t* data, int len) {
+        uint32_t result = 0;
+        for (int j = 0; j < len; j++) {
+            result = result << 8 | data[j];
+        }
+        return result;
     }
 
-    /// Make sure that the result is a valid ASCII string
-    bool isAscii(int l){
-        // check on first 10 characters
-        int m = l < 5 ? l : 10;
-        for (int j=0; j<m; j++){
-            if (!isascii(result[j])) return false;
+    /// Determines the frame size and decides if we need to collect or skip the data
+    void processFrameHeader() {
+        if (header_buffer[0] == 0) {
+            LOGD("ID3v2 padding");
+            state = SkipPadding;
+            return;
+        }
+        frame_flags = 0;
+        if (version == 2) {
+            frame_size = readInt(header_buffer + 3, 3);
+        } else {
+            frame_size = version == 4 ? calcSize(header_buffer + 4) : readInt(header_buffer + 4, 4);
+            frame_flags = header_buffer[9];
+        }
+        // provide the frame header
+        memset(&frame_header, 0, sizeof(frame_header));
+        memcpy(frame_header.id, header_buffer, version == 2 ? 3 : 4);
+        memcpy(frame_header.size, header_buffer + (version == 2 ? 3 : 4), version == 2 ? 3 : 4);
+
+        frame_type = frameType((const char*)header_buffer);
+        // we do not support compressed or encrypted frames
+        uint8_t unsupported = version == 4 ? 0x0C : 0xC0;
+        if (frame_type >= 0 && (frame_flags & unsupported) == 0 && frame_size > 1) {
+            LOGD("ID3v2 frame %.4s: %u bytes", frame_header.id, (unsigned)frame_size);
+            result_len = 0;
+            state = ReadFrameData;
+        } else {
+            LOGD("ID3v2 skipping frame %.4s: %u bytes", frame_header.id, (unsigned)frame_size);
+            skip = frame_size;
+            state = skip > 0 ? SkipData : ReadFrameHeader;
+            if (skip == 0) startFrameHeader();
         }
-        return true;
     }
 
-    /// We have the beginning of the metadata and need to process the remainder
-    void processPartialTagAtTail(const uint8_t* data, size_t len) {
-        int remainder = calcSize(frame_header.size) - use_bytes_of_next_write;
-        memcpy(result+use_bytes_of_next_write, data, remainder);
-        processNotify();    
+    /// Determines the index in id3_v2_tags: -1 if the frame is not relevant
+    int frameType(const char* id) {
+        for (int j = 0; j < 4; j++) {
+            if (version == 2 ? memcmp(id, id3_v22_tags[j], 3) == 0 : memcmp(id, id3_v2_tags[j], 4) == 0) {
+                return j;
+            }
+        }
+        return -1;
+    }
 
-        status = TagNotFound;
-        processTagNotFound(data+use_bytes_of_next_write, len-use_bytes_of_next_write);
+    /// removes the unsynchronisation of a v2.4 frame
+    void removeUnsynchronisation() {
+        size_t len = 0;
+        for (size_t j = 0; j < result_len; j++) {
+            if (j > 0 && (uint8_t)result[j - 1] == 0xFF && result[j] == 0) continue;
+            result[len++] = result[j];
+        }
+        result_len = len;
     }
 
-    /// For the time beeing we support only ASCII and UTF8
-    bool encodingIsSupported(){
-        return frame_header.encoding == 0 || frame_header.encoding == 3;
+    /// Converts the text frame to a zero terminated string and executes the callback
+    void processFrame() {
+        char* text = result;
+        if (version == 4) {
+            if (frame_flags & 0x02 || tagv2.flags & UnsynchronisationFlag) removeUnsynchronisation();
+            // skip grouping identity and data length indicator
+            if (frame_flags & 0x40) text++;
+            if (frame_flags & 0x01) text += 4;
+        }
+        int len = result_len - (text - result);
+        if (len <= 0) return;
+        frame_header.encoding = text[0];
+        len = toString(text + 1, len - 1);
+        if (len > 0) processNotify(id3_v2_types[frame_type], text + 1, len);
+    }
+
+    /// Converts the text to a zero terminated ISO-8859-1/UTF-8 string (UTF-16 is reduced to the 8 bit range)
+    int toString(char* str, int len) {
+        int result_len = 0;
+        if (frame_header.encoding == 1 || frame_header.encoding == 2) {
+            bool big_endian = frame_header.encoding == 2;
+            int start = 0;
+            if (len >= 2 && (uint8_t)str[0] == 0xFF && (uint8_t)str[1] == 0xFE) { big_endian = false; start = 2; }
+            else if (len >= 2 && (uint8_t)str[0] == 0xFE && (uint8_t)str[1] == 0xFF) { big_endian = true; start = 2; }
+            for (int j = start; j + 1 < len; j += 2) {
+                uint8_t high = big_endian ? str[j] : str[j + 1];
+                uint8_t low = big_endian ? str[j + 1] : str[j];
+                if (high == 0 && low == 0) break;
+                str[result_len++] = high == 0 ? low : '?';
+            }
+        } else {
+            while (result_len < len && str[result_len] != 0) result_len++;
+        }
+        str[result_len] = 0;
+        return result_len;
     }
 
     int strpos(char* str, const char* target) {
@@ -486,32 +588,23 @@ class MetaDataID3V2 : public MetaDataID3Base  {
         return (res == nullptr) ? -1 : res - str;
     }
 
-
     /// executes the callbacks
-    void processNotify() {
-        if (callback!=nullptr && actual_tag!=nullptr && encodingIsSupported()){
-            if (strncmp(actual_tag,"TALB",4)==0)
-                callback(Title, result,strnlen(result, 256));
-            else if (strncmp(actual_tag,"TOPE",4)==0)
-                callback(Artist, result,strnlen(result, 256));
-            else if (strncmp(actual_tag,"TIT2",4)==0)
-                callback(Album, result,strnlen(result, 256));
-            else if (strncmp(actual_tag,"TCON",4)==0) {
-                if (result[0]=='('){
-                    // convert genre id to string
-                    int end_pos = strpos((char*)result, ")");
-                    if (end_pos>0){
-                        // we just use the first entry
-                        result[end_pos]=0;
-                        int idx = atoi(result+1);
-                        if (idx>=0 && idx< (int)sizeof(genres)){
-                            strncpy((char*)result,genres[idx],256);
-                        }
-                    }
+    void processNotify(MetaDataType type, char* str, int len) {
+        if (callback==nullptr) return;
+        if (type == Genre && str[0]=='(') {
+            // convert genre id to string
+            int end_pos = strpos(str, ")");
+            if (end_pos>0){
+                // we just use the first entry
+                str[end_pos]=0;
+                int idx = atoi(str+1);
+                if (idx>=0 && idx< (int)(sizeof(genres)/sizeof(char*))){
+                    str = (char*) genres[idx];
+                    len = strlen(str);
                 }
-                callback(Genre, result,strnlen(result, 256));
             }
         }
+        callback(type, str, len);
     }
 
 };
@@ -563,6 +656,27 @@ class MetaDataID3 : public AbstractMetaData {
         return length;
     }
 
+    /// Reads the ID3v1 tag directly from the last 128 bytes of a seekable file (e.g. SD File) instead of scanning
+    /// the audio data. The file position is restored.
+    template <class File>
+    bool processID3v1(File &file) {
+        size_t size = file.size();
+        if (size < sizeof(ID3v1)) return false;
+        size_t pos = file.position();
+        uint8_t data[sizeof(ID3v1)];
+        bool result = false;
+        if (file.seek(size - sizeof(ID3v1)) && file.read(data, sizeof(ID3v1)) == sizeof(ID3v1)){
+            result = id3v1.processTag(data, sizeof(ID3v1));
+        }
+        file.seek(pos);
+        return result;
+    }
+
+    /// Size of the ID3v2 tag at the beginning of the data (0 if there is no tag)
+    size_t tagSize() {
+        return id3v2.tagSize();
+    }
+
   protected:
     MetaDataID3V1 id3v1;
     MetaDataID3V2 id3v2;
@@ -0,0 +1,233 @@
+#pragma once
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include "AudioTools/AudioLogger.h"
+
+#ifndef REPLAY_GAIN_SCAN_LIMIT
+#define REPLAY_GAIN_SCAN_LIMIT 16384
+#endif
+
+#ifndef REPLAY_GAIN_RAMP_MS
+#define REPLAY_GAIN_RAMP_MS 50
+#endif
+
+namespace audio_tools {
+
+/// Selects which ReplayGain value is applied
+enum ReplayGainMode { ReplayGainOff, ReplayGainTrack, ReplayGainAlbum };
+
+/**
+ * @brief ReplayGain information of a track: gains in dB relative to the ReplayGain
+ * reference level and the peaks as linear values (1.0 = full scale)
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ReplayGainInfo {
+    float track_gain = 0.0;
+    float album_gain = 0.0;
+    float track_peak = 0.0;
+    float album_peak = 0.0;
+    bool has_track_gain = false;
+    bool has_album_gain = false;
+
+    void clear() {
+        *this = ReplayGainInfo();
+    }
+
+    /// Determines the linear factor for the indicated mode. With clip prevention the factor is
+    /// limited so that the peak does not exceed full scale.
+    float factor(ReplayGainMode mode, float preampDb=0.0, bool clipPrevention=true) {
+        float gain_db, peak;
+        if (mode == ReplayGainAlbum && has_album_gain){
+            gain_db = album_gain;
+            peak = album_peak;
+        } else if (mode != ReplayGainOff && has_track_gain) {
+            gain_db = track_gain;
+            peak = track_peak;
+        } else {
+            return 1.0;
+        }
+        float result = pow(10.0f, (gain_db + preampDb) / 20.0f);
+        if (clipPrevention && peak > 0.0 && result * peak > 1.0){
+            result = 1.0 / peak;
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Extracts the ReplayGain (REPLAYGAIN_TRACK_GAIN, REPLAYGAIN_ALBUM_GAIN, REPLAYGAIN_TRACK_PEAK,
+ * REPLAYGAIN_ALBUM_PEAK) and EBU R128 (R128_TRACK_GAIN, R128_ALBUM_GAIN) values from the ID3v2 TXXX frames
+ * or the Vorbis comments (Ogg, FLAC) at the beginning of a file. Only ISO-8859-1 or UTF-8 encoded values are supported.
+ * The scanning is stopped at the end of the ID3v2 tag or after the defined limit, so the audio data is not
+ * affected.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class MetaDataReplayGain {
+  public:
+    MetaDataReplayGain() = default;
+
+    /// (Re)starts the parsing for a new file
+    void begin() {
+        info.clear();
+        total = 0;
+        limit = scan_limit;
+        token_len = 0;
+        value_len = 0;
+        key = NoKey;
+        is_active = true;
+    }
+
+    void end() {
+        is_active = false;
+    }
+
+    /// Defines the max number of bytes which are scanned if the file does not start with an ID3v2 tag
+    void setLimit(size_t limit){
+        scan_limit = limit;
+    }
+
+    /// Returns true while we are still scanning for values
+    bool isActive() {
+        return is_active;
+    }
+
+    /// Provides the values which have been found so far
+    ReplayGainInfo &replayGain() {
+        return info;
+    }
+
+    /// Parses the data: returns true if a new gain value was found
+    bool write(const uint8_t* data, size_t len){
+        if (!is_active) return false;
+        bool result = false;
+        for (size_t j = 0; j < len && total < limit; j++, total++){
+            // the header might be split over multiple writes
+            if (total < sizeof(header)){
+                header[total] = data[j];
+                if (total == sizeof(header) - 1 && memcmp(header, "ID3", 3) == 0){
+                    // only scan the ID3v2 tag
+                    limit = 10 + (header[6] << 21 | header[7] << 14 | header[8] << 7 | header[9]);
+                }
+            }
+            if (processChar(data[j])) result = true;
+        }
+        if (total >= limit){
+            LOGI("ReplayGain scanning ended after %u bytes", (unsigned) total);
+            is_active = false;
+        }
+        return result;
+    }
+
+  protected:
+    enum Key { NoKey, TrackGain, AlbumGain, TrackPeak, AlbumPeak, R128TrackGain, R128AlbumGain };
+    ReplayGainInfo info;
+    size_t scan_limit = REPLAY_GAIN_SCAN_LIMIT;
+    size_t limit = REPLAY_GAIN_SCAN_LIMIT;
+    size_t total = 0;
+    uint8_t header[10];
+    bool is_active = false;
+    Key key = NoKey;
+    char token[24];
+    int token_len = 0;
+    char value[16];
+    int value_len = 0;
+    int separator_count = 0;
+
+    /// We collect tokens of identifier characters and the following numeric value
+    bool processChar(uint8_t ch) {
+        if (key != NoKey){
+            return processValueChar(ch);
+        }
+        if (isalnum(ch) || ch == '_'){
+            if (token_len < (int)sizeof(token) - 1) {
+                token[token_len++] = toupper(ch);
+            } else {
+                // too long: this is not a relevant key
+                token_len = sizeof(token);
+            }
+            return false;
+        }
+        if (token_len > 0 && token_len < (int)sizeof(token)){
+            token[token_len] = 0;
+            key = toKey(token);
+            value_len = 0;
+            separator_count = 1;
+        }
+        token_len = 0;
+        return false;
+    }
+
+    /// After the key we expect some separators ('=', 0) followed by the value
+    bool processValueChar(uint8_t ch){
+        bool is_number = isdigit(ch) || ch == '-' || ch == '+' || ch == '.';
+        if (value_len == 0 && !is_number){
+            // skip separators
+            if (++separator_count > 4 || isalpha(ch)) key = NoKey;
+            return false;
+        }
+        if (is_number && value_len < (int)sizeof(value) - 1){
+            value[value_len++] = ch;
+            return false;
+        }
+        value[value_len] = 0;
+        bool result = setValue(key, value);
+        key = NoKey;
+        // the terminating character might start a new token
+        processChar(ch);
+        return result;
+    }
+
+    Key toKey(const char* str){
+        if (strcmp(str, "REPLAYGAIN_TRACK_GAIN")==0) return TrackGain;
+        if (strcmp(str, "REPLAYGAIN_ALBUM_GAIN")==0) return AlbumGain;
+        if (strcmp(str, "REPLAYGAIN_TRACK_PEAK")==0) return TrackPeak;
+        if (strcmp(str, "REPLAYGAIN_ALBUM_PEAK")==0) return AlbumPeak;
+        if (strcmp(str, "R128_TRACK_GAIN")==0) return R128TrackGain;
+        if (strcmp(str, "R128_ALBUM_GAIN")==0) return R128AlbumGain;
+        return NoKey;
+    }
+
+    bool setValue(Key key, const char* str){
+        float value = atof(str);
+        LOGI("ReplayGain %d: %s", key, str);
+        switch(key){
+            case TrackGain:
+                info.track_gain = value;
+                info.has_track_gain = true;
+                return true;
+            case AlbumGain:
+                info.album_gain = value;
+                info.has_album_gain = true;
+                return true;
+            case TrackPeak:
+                info.track_peak = value;
+                return true;
+            case AlbumPeak:
+                info.album_peak = value;
+                return true;
+            // R128 gains are Q7.8 values relative to -23 LUFS: ReplayGain uses -18 LUFS
+            case R128TrackGain:
+                if (!info.has_track_gain){
+                    info.track_gain = value / 256.0 + 5.0;
+                    info.has_track_gain = true;
+                    return true;
+                }
+                break;
+            case R128AlbumGain:
+                if (!info.has_album_gain){
+                    info.album_gain = value / 256.0 + 5.0;
+                    info.has_album_gain = true;
+                    return true;
+                }
+                break;
+            default:
+                break;
+        }
+        return false;
+    }
+};
+
+}
@@ -82,10 +82,11 @@ struct PWMConfig : public AudioBaseInfo {
 
 
 /**
- * @brief Common functionality for PWM output
+ * @brief Common functionality for PWM output: the xrun statistics report the frames
+ * which could not be played because the buffer was empty.
  * 
  */
-class PWMAudioStreamBase : public AudioPrint {
+class PWMAudioStreamBase : public AudioPrint, public XRunSource {
     public:
         ~PWMAudioStreamBase(){
             if (is_timer_started){
@@ -305,6 +306,7 @@ class PWMAudioStreamBase : public AudioPrint {
                     }
                 } else {
                     underflow_count++;
+                    xrun_stats.underflows++;
                 }
                 updateStatistics();
             } 
@@ -21,6 +21,12 @@
 #include "AudioTools/AudioLogger.h"
 #include "AudioTools/AudioStreams.h"
 #include "AudioTools/AudioStreamsConverter.h"
+#include "AudioTools/JitterBufferStream.h"
+#include "AudioTools/AudioClock.h"
+#include "AudioTools/Throttle.h"
+#include "AudioTools/PacketSendQueue.h"
+#include "AudioTools/AudioProfiler.h"
+#include "AudioTools/XRunStats.h"
 #include "AudioTools/AudioOutput.h"
 #include "AudioTools/Resample.h"
 #include "AudioTools/AudioCopy.h"
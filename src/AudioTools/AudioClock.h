@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Time source for the pacing of the library: delays, timeouts and deadlines. By default
+ * the real time of the platform is used. With setVirtual() the time only advances with the
+ * delays (or advanceUs()), which return immediately: so offline rendering (e.g. of a playlist
+ * or an effect chain) runs as fast as possible and gives deterministic results. Alternatively
+ * a custom time source can be defined with setTimeSource(). The virtual time is not thread
+ * safe. The measurement of the processing time (e.g. AudioProfiler, MeasuringStream,
+ * DeadlineMonitor) always uses the real time.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class AudioClock {
+ public:
+  static AudioClock &instance() {
+    static AudioClock clock;
+    return clock;
+  }
+
+  /// Activates or deactivates the virtual time which starts at the indicated time
+  void setVirtual(bool active, uint64_t startUs = 0) {
+    is_virtual = active;
+    virtual_us = startUs;
+  }
+
+  bool isVirtual() { return is_virtual; }
+
+  /// Defines a custom time source: use nullptr to restore the real time
+  void setTimeSource(uint64_t (*nowUs)(), void (*sleepUs)(uint64_t us)) {
+    p_now_us = nowUs;
+    p_sleep_us = sleepUs;
+  }
+
+  /// Monotonic time in us
+  uint64_t timeUs() {
+    if (is_virtual) return virtual_us;
+    if (p_now_us != nullptr) return p_now_us();
+    // handle the overflow of micros()
+    uint32_t us = ::micros();
+    real_us += (uint32_t)(us - last_micros);
+    last_micros = us;
+    return real_us;
+  }
+
+  /// Time in ms
+  uint64_t timeMs() { return timeUs() / 1000; }
+
+  /// Waits for the indicated time: the virtual time is just advanced
+  void sleepUs(uint64_t us) {
+    if (is_virtual) {
+      virtual_us += us;
+    } else if (p_sleep_us != nullptr) {
+      p_sleep_us(us);
+    } else {
+      if (us >= 1000) ::delay(us / 1000);
+      if (us % 1000 > 0) ::delayMicroseconds(us % 1000);
+    }
+  }
+
+  void sleepMs(uint32_t ms) { sleepUs((uint64_t)ms * 1000); }
+
+  /// Advances the virtual time (e.g. by the duration of the rendered audio)
+  void advanceUs(uint64_t us) {
+    if (is_virtual) virtual_us += us;
+  }
+
+ protected:
+  bool is_virtual = false;
+  uint64_t virtual_us = 0;
+  uint64_t real_us = 0;
+  uint32_t last_micros = 0;
+  uint64_t (*p_now_us)() = nullptr;
+  void (*p_sleep_us)(uint64_t us) = nullptr;
+
+  AudioClock() { last_micros = ::micros(); }
+};
+
+/// millis() of the AudioClock
+inline uint32_t audioMillis() { return AudioClock::instance().timeMs(); }
+
+/// micros() of the AudioClock
+inline uint32_t audioMicros() { return AudioClock::instance().timeUs(); }
+
+/// delay() of the AudioClock
+inline void audioDelay(uint32_t ms) { AudioClock::instance().sleepMs(ms); }
+
+/// delayMicroseconds() of the AudioClock
+inline void audioDelayMicroseconds(uint32_t us) { AudioClock::instance().sleepUs(us); }
+
+}  // namespace audio_tools
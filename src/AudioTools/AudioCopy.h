@@ -6,6 +6,7 @@
 #include "AudioTools/Buffers.h"
 #include "AudioTools/Converter.h"
 #include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
 #include "AudioTools/AudioStreams.h"
 
 namespace audio_tools {
@@ -95,7 +96,7 @@ class StreamCopyT {
             // If we try to write to a server we might not have any output destination yet
             int to_write = to->availableForWrite();
             if (to_write<=0){
-                delay(500);
+                audioDelay(500);
                 return 0;
             }
 
@@ -115,9 +116,12 @@ class StreamCopyT {
                     bytes_to_read = min((int)bytes_to_read, to_write);
                 }
 
+                if (p_deadline!=nullptr) p_deadline->beginCycle(bytes_to_read);
+
                 // get the data now
                 bytes_read = 0;
                 if (bytes_to_read>0){
+                    DeadlineStage stage(p_deadline, "read");
                     bytes_read = from->readBytes((uint8_t*)buffer, bytes_to_read);
                 }
 
@@ -126,7 +130,11 @@ class StreamCopyT {
                 is_first = false;
 
                 // write data
-                result = write(bytes_read, delayCount);
+                {
+                    DeadlineStage stage(p_deadline, "write");
+                    result = write(bytes_read, delayCount);
+                }
+                if (p_deadline!=nullptr) p_deadline->endCycle(bytes_read);
 
                 // callback with unconverted data
                 if (onWrite!=nullptr) onWrite(onWriteObj, buffer, result);
@@ -138,7 +146,7 @@ class StreamCopyT {
                 CHECK_MEMORY();
             } else {
                 // give the processor some time 
-                delay(delay_on_no_data);
+                audioDelay(delay_on_no_data);
             }
             return result;
         }
@@ -177,7 +185,7 @@ class StreamCopyT {
                 #endif
                 CHECK_MEMORY();
             } else {
-                delay(delay_on_no_data);
+                audioDelay(delay_on_no_data);
             }
             return result;
         }
@@ -209,7 +217,7 @@ class StreamCopyT {
                 if (count==0){
                     // wait for more data
                     retry++;
-                    delay(retryWaitMs);
+                    audioDelay(retryWaitMs);
                 } else {
                     retry = 0; // after we got new data we restart the counting
                 }
@@ -249,6 +257,12 @@ class StreamCopyT {
             return buffer_size;
         }
 
+        /// Checks that each copy() finishes within the playing time of the copied data: for outputs which 
+        /// block until they have room (e.g. I2S) use the cumulative mode of the DeadlineMonitor
+        void setDeadlineMonitor(DeadlineMonitor &monitor){
+            p_deadline = &monitor;
+        }
+
     protected:
         AudioStream *from = nullptr;
         Print *to = nullptr;
@@ -261,6 +275,7 @@ class StreamCopyT {
         const char* actual_mime = nullptr;
         int retryLimit = COPY_RETRY_LIMIT;
         int delay_on_no_data = COPY_DELAY_ON_NODATA;
+        DeadlineMonitor *p_deadline = nullptr;
 
         // blocking write - until everything is processed
         size_t write(size_t len, size_t &delayCount ){
@@ -280,7 +295,7 @@ class StreamCopyT {
                 }
                 
                 if (retry>1) {
-                    delay(5);
+                    audioDelay(5);
                     LOGI("try write - %d (open %ld bytes) ",retry, open);
                 }
 
@@ -354,7 +369,7 @@ class StreamCopy : public StreamCopyT<uint8_t> {
                 #endif
             } else {
                 // give the processor some time 
-                delay(delay_on_no_data);
+                audioDelay(delay_on_no_data);
             }
             return result;
         }
@@ -3,6 +3,11 @@
 #include "AudioConfig.h"
 #include "Stream.h"
 
+#if USE_AUDIO_LOGGING && USE_AUDIO_LOGGING_DEFERRED
+#include <atomic>
+#include <type_traits>
+#endif
+
 // Logging Implementation
 #if USE_AUDIO_LOGGING
 
@@ -14,8 +19,186 @@ namespace audio_tools {
 static portMUX_TYPE mutex_logger = portMUX_INITIALIZER_UNLOCKED;
 #endif
 
+#if USE_AUDIO_LOGGING_DEFERRED
+
+/// Type of a recorded log argument
+enum LogArgType : uint8_t { LogArgInt32, LogArgInt64, LogArgDouble, LogArgString, LogArgPointer };
+
+static_assert(LOG_DEFERRED_TEXT_SIZE > 0 && LOG_DEFERRED_TEXT_SIZE <= 0xFFFF,
+              "LOG_DEFERRED_TEXT_SIZE must be between 1 and 65535");
+
 /**
- * @brief A simple Logger that writes messages dependent on the log level
+ * @brief A log message which has not been formatted yet: we only keep the format pointer and
+ * the raw arguments. Strings are copied into the text area because they might not be valid
+ * any more when the message is formatted.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct LogRecord {
+  std::atomic<uint32_t> seq{0};
+  const char *fmt = nullptr;
+  const char *file = nullptr;
+  uint16_t line = 0;
+  uint8_t level = 0;
+  uint8_t argc = 0;
+  uint16_t text_len = 0;
+  LogArgType types[LOG_DEFERRED_MAX_ARGS];
+  int64_t args[LOG_DEFERRED_MAX_ARGS];
+  char text[LOG_DEFERRED_TEXT_SIZE];
+
+  void clear() {
+    argc = 0;
+    text_len = 0;
+  }
+
+  void add(const char *str) {
+    if (argc >= LOG_DEFERRED_MAX_ARGS) return;
+    if (str == nullptr) str = "(null)";
+    int len = strnlen(str, LOG_DEFERRED_TEXT_SIZE);
+    int space = LOG_DEFERRED_TEXT_SIZE - text_len - 1;
+    if (len > space) len = space < 0 ? 0 : space;
+    memcpy(text + text_len, str, len);
+    text[text_len + len] = 0;
+    types[argc] = LogArgString;
+    args[argc++] = text_len;
+    text_len += len + 1;
+    if (text_len > LOG_DEFERRED_TEXT_SIZE - 1) text_len = LOG_DEFERRED_TEXT_SIZE - 1;
+  }
+
+  void add(char *str) { add((const char *)str); }
+
+  void add(double value) {
+    if (argc >= LOG_DEFERRED_MAX_ARGS) return;
+    types[argc] = LogArgDouble;
+    memcpy(&args[argc++], &value, sizeof(double));
+  }
+
+  void add(float value) { add((double)value); }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type add(T value) {
+    if (argc >= LOG_DEFERRED_MAX_ARGS) return;
+    types[argc] = sizeof(T) > 4 ? LogArgInt64 : LogArgInt32;
+    args[argc++] = (int64_t)value;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_pointer<T>::value>::type add(T value) {
+    if (argc >= LOG_DEFERRED_MAX_ARGS) return;
+    types[argc] = LogArgPointer;
+    args[argc++] = (int64_t)(uintptr_t)value;
+  }
+
+  void addAll() {}
+
+  template <typename T, typename... Args>
+  void addAll(T value, Args... rest) {
+    add(value);
+    addAll(rest...);
+  }
+
+  /// Formats the message with the recorded arguments: returns the length
+  int format(char *out, int size) {
+    const char *f = fmt;
+    int pos = 0;
+    int arg = 0;
+    while (*f && pos < size - 1) {
+      if (*f != '%') {
+        out[pos++] = *f++;
+        continue;
+      }
+      if (f[1] == '%') {
+        out[pos++] = '%';
+        f += 2;
+        continue;
+      }
+      // copy flags, width and precision: the length modifiers are replaced
+      char spec[16];
+      int n = 0;
+      spec[n++] = *f++;
+      while (*f && strchr("-+ #0123456789.", *f) && n < 10) spec[n++] = *f++;
+      while (*f && strchr("hlLzjt", *f)) f++;
+      char conversion = *f;
+      if (conversion == 0) break;
+      f++;
+      int remaining = size - pos;
+      int len = 0;
+      if (arg >= argc) {
+        len = snprintf(out + pos, remaining, "?");
+      } else {
+        int64_t value = args[arg];
+        LogArgType type = types[arg++];
+        switch (conversion) {
+          case 'd':
+          case 'i': {
+            strcpy(spec + n, "lld");
+            long long v = type == LogArgInt32 ? (long long)(int32_t)value : (long long)value;
+            len = snprintf(out + pos, remaining, spec, v);
+          } break;
+          case 'u':
+          case 'x':
+          case 'X':
+          case 'o': {
+            spec[n] = 'l';
+            spec[n + 1] = 'l';
+            spec[n + 2] = conversion;
+            spec[n + 3] = 0;
+            unsigned long long v = type == LogArgInt32 ? (unsigned long long)(uint32_t)value : (unsigned long long)value;
+            len = snprintf(out + pos, remaining, spec, v);
+          } break;
+          case 'f':
+          case 'F':
+          case 'e':
+          case 'E':
+          case 'g':
+          case 'G': {
+            spec[n] = conversion;
+            spec[n + 1] = 0;
+            double v;
+            if (type == LogArgDouble) {
+              memcpy(&v, &value, sizeof(double));
+            } else {
+              v = value;
+            }
+            len = snprintf(out + pos, remaining, spec, v);
+          } break;
+          case 's': {
+            spec[n] = 's';
+            spec[n + 1] = 0;
+            const char *str = "?";
+            if (type == LogArgString) str = text + value;
+            if (type == LogArgPointer && value != 0) str = (const char *)(uintptr_t)value;
+            len = snprintf(out + pos, remaining, spec, str);
+          } break;
+          case 'c':
+            spec[n] = 'c';
+            spec[n + 1] = 0;
+            len = snprintf(out + pos, remaining, spec, (int)value);
+            break;
+          case 'p':
+            len = snprintf(out + pos, remaining, "%p", (void *)(uintptr_t)value);
+            break;
+          default:
+            len = 0;
+            break;
+        }
+      }
+      pos += len < remaining ? len : remaining - 1;
+    }
+    out[pos] = 0;
+    return pos;
+  }
+};
+
+#endif
+
+/**
+ * @brief A simple Logger that writes messages dependent on the log level. The log levels
+ * below LOG_MIN_LEVEL are removed at compile time. If USE_AUDIO_LOGGING_DEFERRED is active
+ * the messages can be recorded without formatting into a lock free queue (see setDeferred()),
+ * so that the logging does not disturb the timing of the audio processing. The recorded
+ * messages are formatted and printed by processDeferred() which should be called from a
+ * non audio context (e.g. the loop).
  * @author Phil Schatzmann
  * @copyright GPLv3
  * 
@@ -44,20 +227,29 @@ class AudioLogger {
             return log_stream_ptr!=nullptr && level >= log_level;
         }
 
+        /// formats the prefix into the print buffer
         AudioLogger &prefix(const char* file, int line, LogLevel current_level){
             lock();
-            printPrefix(file,line,current_level);
+            prefix_len = printPrefix(print_buffer, LOG_PRINTF_BUFFER_SIZE, file, line, current_level);
             return *this;
         }
 
+        /// prints the prefix and the message with one call
         void println(){
             log_stream_ptr->println(print_buffer);
             print_buffer[0]=0;
+            prefix_len = 0;
             unlock();
         }
 
+        /// buffer for the message after the prefix
         char* str() {
-            return print_buffer;
+            return print_buffer + prefix_len;
+        }
+
+        /// available size for the message
+        int strSize() {
+            return LOG_PRINTF_BUFFER_SIZE - prefix_len;
         }
 
         /// provides the singleton instance
@@ -73,15 +265,90 @@ class AudioLogger {
             return log_level;
         }
 
+#if USE_AUDIO_LOGGING_DEFERRED
+        /// If active the messages are only recorded and printed by processDeferred()
+        void setDeferred(bool active) {
+            is_deferred = active;
+        }
+
+        bool isDeferred() {
+            return is_deferred;
+        }
+
+        /// Records a message without formatting it: returns false if the queue is full
+        template <typename... Args>
+        bool record(LogLevel level, const char* file, int line, const char* fmt, Args... args) {
+            uint32_t pos = write_pos.load(std::memory_order_relaxed);
+            LogRecord *rec;
+            while (true) {
+                rec = &records[pos % LOG_DEFERRED_QUEUE_SIZE];
+                int32_t diff = (int32_t)(rec->seq.load(std::memory_order_acquire) - pos);
+                if (diff == 0) {
+                    if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    // the queue is full: we never block
+                    dropped_count.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    pos = write_pos.load(std::memory_order_relaxed);
+                }
+            }
+            setupRecord(*rec, level, file, line, fmt);
+            rec->addAll(args...);
+            rec->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Formats and prints the recorded messages (max the indicated number): returns the number of printed messages
+        int processDeferred(int max = -1) {
+            int result = 0;
+            while (max < 0 || result < max) {
+                LogRecord &rec = records[read_pos % LOG_DEFERRED_QUEUE_SIZE];
+                if (rec.seq.load(std::memory_order_acquire) != read_pos + 1) break;
+                print(rec);
+                rec.seq.store(read_pos + LOG_DEFERRED_QUEUE_SIZE, std::memory_order_release);
+                read_pos++;
+                result++;
+            }
+            uint32_t dropped = dropped_count.load(std::memory_order_relaxed);
+            if (dropped != reported_dropped && log_stream_ptr != nullptr) {
+                lock();
+                snprintf(print_buffer, LOG_PRINTF_BUFFER_SIZE, "[W] AudioLogger - %u messages dropped", (unsigned)(dropped - reported_dropped));
+                log_stream_ptr->println(print_buffer);
+                unlock();
+                reported_dropped = dropped;
+            }
+            return result;
+        }
 
+        /// Number of messages which were lost because the queue was full
+        uint32_t droppedCount() {
+            return dropped_count.load(std::memory_order_relaxed);
+        }
+#endif
 
     protected:
         Stream *log_stream_ptr = &LOG_STREAM;
         const char* TAG = "AudioTools";
         LogLevel log_level = LOG_LEVEL;
         char print_buffer[LOG_PRINTF_BUFFER_SIZE];
+        int prefix_len = 0;
+#if USE_AUDIO_LOGGING_DEFERRED
+        bool is_deferred = false;
+        LogRecord records[LOG_DEFERRED_QUEUE_SIZE];
+        std::atomic<uint32_t> write_pos{0};
+        std::atomic<uint32_t> dropped_count{0};
+        uint32_t read_pos = 0;
+        uint32_t reported_dropped = 0;
+#endif
 
-        AudioLogger() {}
+        AudioLogger() {
+#if USE_AUDIO_LOGGING_DEFERRED
+            for (uint32_t j = 0; j < LOG_DEFERRED_QUEUE_SIZE; j++) {
+                records[j].seq.store(j);
+            }
+#endif
+        }
 
         const char* levelName(LogLevel level) const {
             switch(level){
@@ -97,19 +364,29 @@ class AudioLogger {
             return "";
         }
 
-        int printPrefix(const char* file, int line, LogLevel current_level) const {
+        int printPrefix(char* out, int size, const char* file, int line, LogLevel current_level) const {
             const char* file_name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
-            const char* level_code = levelName(current_level);
-            int len = log_stream_ptr->print("[");
-            len += log_stream_ptr->print(level_code);
-            len += log_stream_ptr->print("] ");
-            len += log_stream_ptr->print(file_name);
-            len += log_stream_ptr->print(" : ");
-            len += log_stream_ptr->print(line);
-            len += log_stream_ptr->print(" - ");
-            return len;
+            int len = snprintf(out, size, "[%s] %s : %d - ", levelName(current_level), file_name, line);
+            return len < size ? len : size - 1;
         }
 
+#if USE_AUDIO_LOGGING_DEFERRED
+        void setupRecord(LogRecord &rec, LogLevel level, const char* file, int line, const char* fmt) {
+            rec.clear();
+            rec.level = level;
+            rec.file = file;
+            rec.line = line;
+            rec.fmt = fmt;
+        }
+
+        void print(LogRecord &rec) {
+            if (log_stream_ptr == nullptr) return;
+            prefix(rec.file, rec.line, (LogLevel)rec.level);
+            rec.format(str(), strSize());
+            println();
+        }
+#endif
+
         void lock(){
             #if defined(ESP32) && defined(SYNCHRONIZED_LOGGING)
                 portENTER_CRITICAL(&mutex_logger);
@@ -123,13 +400,35 @@ class AudioLogger {
         }
 };
 
+#if USE_AUDIO_LOGGING_DEFERRED
+#define LOG_OUT(level, ...) { AudioLogger &logger = AudioLogger::instance(); if (logger.isDeferred()) { logger.record(level, __FILE__, __LINE__, __VA_ARGS__); } else { logger.prefix(__FILE__,__LINE__, level); snprintf(logger.str(), logger.strSize(), __VA_ARGS__); logger.println(); } }
+#else
+#define LOG_OUT(level, ...) { AudioLogger &logger = AudioLogger::instance().prefix(__FILE__,__LINE__, level); snprintf(logger.str(), logger.strSize(), __VA_ARGS__); logger.println(); }
+#endif
 
-#define LOG_OUT(level, ...) snprintf(AudioLogger::instance().prefix(__FILE__,__LINE__, level).str(),LOG_PRINTF_BUFFER_SIZE,__VA_ARGS__); AudioLogger::instance().println();
-
+#if LOG_MIN_LEVEL <= 0
 #define LOGD(...) if (AudioLogger::instance().level()<=AudioLogger::Debug) { LOG_OUT(AudioLogger::Debug, __VA_ARGS__);}
+#else
+#define LOGD(...)
+#endif
+
+#if LOG_MIN_LEVEL <= 1
 #define LOGI(...) if (AudioLogger::instance().level()<=AudioLogger::Info) { LOG_OUT(AudioLogger::Info, __VA_ARGS__);}
+#else
+#define LOGI(...)
+#endif
+
+#if LOG_MIN_LEVEL <= 2
 #define LOGW(...) if (AudioLogger::instance().level()<=AudioLogger::Warning) { LOG_OUT(AudioLogger::Warning, __VA_ARGS__);}
+#else
+#define LOGW(...)
+#endif
+
+#if LOG_MIN_LEVEL <= 3
 #define LOGE(...) if (AudioLogger::instance().level()<=AudioLogger::Error) { LOG_OUT(AudioLogger::Error, __VA_ARGS__);}
+#else
+#define LOGE(...)
+#endif
 
 }
     
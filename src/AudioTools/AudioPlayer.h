@@ -7,10 +7,12 @@
 #include "AudioTools/Buffers.h"
 #include "AudioTools/Converter.h"
 #include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
 #include "AudioTools/AudioStreams.h"
 #include "AudioTools/AudioCopy.h"
 #include "AudioHttp/AudioHttp.h"
 #include "AudioTools/AudioSource.h"
+#include "AudioMetaData/MetaDataReplayGain.h"
 // support for legacy USE_SDFAT
 #ifdef USE_SDFAT
 #include "AudioLibs/AudioSourceSDFAT.h"
@@ -130,11 +132,12 @@ namespace audio_tools {
             if (index >= 0) {
                 p_input_stream = p_source->selectStream(index);
                 if (p_input_stream != nullptr) {
-                    if (meta_active) {
+                    if (meta_active || replay_gain_mode != ReplayGainOff) {
                         copier.setCallbackOnWrite(decodeMetaData, this);
                     }
+                    beginReplayGain();
                     copier.begin(*p_out_decoding, *p_input_stream);
-                    timeout = millis() + p_source->timeoutAutoNext();
+                    timeout = audioMillis() + p_source->timeoutAutoNext();
                     active = isActive;
                     result = true;
                 } else {
@@ -250,6 +253,7 @@ namespace audio_tools {
             if (p_input_stream != nullptr) {
                 LOGD("open selected stream");
                 meta_out.begin();
+                beginReplayGain();
                 copier.begin(*p_out_decoding, *p_input_stream);
             }
             return p_input_stream != nullptr;
@@ -294,16 +298,16 @@ namespace audio_tools {
                 LOGD(LOG_METHOD);
                 if (p_final_print!=nullptr && p_final_print->availableForWrite()==0){
                     // not ready to do anything - so we wait a bit
-                    delay(100);
+                    audioDelay(100);
                     return;
                 }
                 // handle sound
                 if (copier.copy() || timeout == 0) {
                     // reset timeout
-                    timeout = millis() + p_source->timeoutAutoNext();
+                    timeout = audioMillis() + p_source->timeoutAutoNext();
                 }
                 // move to next stream after timeout
-                if (p_input_stream == nullptr || millis() > timeout) {
+                if (p_input_stream == nullptr || audioMillis() > timeout) {
                     if (autonext) {
                         if (previous_stream == false) {
                             LOGW("-> timeout - moving to next stream");
@@ -321,7 +325,7 @@ namespace audio_tools {
                     } else {
                         active = false;
                     }
-                    timeout = millis() + p_source->timeoutAutoNext();
+                    timeout = audioMillis() + p_source->timeoutAutoNext();
                 }
             }
         }
@@ -347,12 +351,48 @@ namespace audio_tools {
             volume_out.setVolumeControl(vc);
         }
 
+        /// Activates the loudness normalization with the ReplayGain/R128 values from the metadata of each track. The gain 
+        /// is combined with the volume in the VolumeStream and changes are ramped over rampMs milliseconds.
+        virtual void setReplayGainMode(ReplayGainMode mode, float preampDb=0.0, int rampMs=REPLAY_GAIN_RAMP_MS) {
+            LOGI("setReplayGainMode: %d", mode);
+            replay_gain_mode = mode;
+            replay_gain_preamp = preampDb;
+            replay_gain_ramp_ms = rampMs;
+            if (mode != ReplayGainOff) {
+                copier.setCallbackOnWrite(decodeMetaData, this);
+            }
+            applyReplayGain();
+        }
+
+        /// Defines a callback which provides the ReplayGain of the selected stream e.g. from a precomputed index. 
+        /// If it returns false we use the values from the metadata.
+        virtual void setReplayGainCallback(bool (*callback)(Stream* stream, ReplayGainInfo &info)) {
+            replay_gain_callback = callback;
+        }
+
+        /// Defines the ReplayGain of the current track 
+        virtual void setReplayGain(ReplayGainInfo info) {
+            replay_gain.end();
+            replay_gain.replayGain() = info;
+            applyReplayGain();
+        }
+
+        /// Provides the ReplayGain information of the current track
+        virtual ReplayGainInfo& replayGain() {
+            return replay_gain.replayGain();
+        }
+
     protected:
         bool active = false;
         bool autonext = false;
         AudioSource* p_source = nullptr;
         VolumeStream volume_out; // Volume control
         MetaDataID3 meta_out; // Metadata parser
+        MetaDataReplayGain replay_gain; // ReplayGain parser
+        ReplayGainMode replay_gain_mode = ReplayGainOff;
+        float replay_gain_preamp = 0.0;
+        int replay_gain_ramp_ms = REPLAY_GAIN_RAMP_MS;
+        bool (*replay_gain_callback)(Stream* stream, ReplayGainInfo &info) = nullptr;
         EncodedAudioStream* p_out_decoding = nullptr; // Decoding stream
         AudioDecoder* p_decoder = nullptr;
         Stream* p_input_stream = nullptr;
@@ -377,6 +417,29 @@ namespace audio_tools {
             if (p->meta_active) {
                 p->meta_out.write((const uint8_t*)data, len);
             }
+            if (p->replay_gain_mode != ReplayGainOff && p->replay_gain.isActive()) {
+                if (p->replay_gain.write((const uint8_t*)data, len)) {
+                    p->applyReplayGain();
+                }
+            }
+        }
+
+        /// Determines the ReplayGain for a new stream: from the callback or from the metadata
+        void beginReplayGain() {
+            if (replay_gain_mode == ReplayGainOff) return;
+            replay_gain.begin();
+            if (replay_gain_callback != nullptr && replay_gain_callback(p_input_stream, replay_gain.replayGain())) {
+                replay_gain.end();
+            }
+            applyReplayGain();
+        }
+
+        /// Updates the gain of the VolumeStream
+        void applyReplayGain() {
+            float factor = replay_gain.replayGain().factor(replay_gain_mode, replay_gain_preamp);
+            if (factor != volume_out.gainFactor()) {
+                volume_out.setGain(factor, replay_gain_ramp_ms);
+            }
         }
 
     };
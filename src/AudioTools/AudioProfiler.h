@@ -0,0 +1,279 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioStreams.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Measured values of a single stage of the AudioProfiler. The times are wall clock
+ * times in us: inclusive contains the time of the called downstream (or upstream) stages
+ * which is excluded from exclusive.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ProfileStats {
+  const char *name = "";
+  uint32_t calls = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  uint64_t inclusive_us = 0;
+  uint64_t exclusive_us = 0;
+  uint32_t max_call_us = 0;
+  /// data rate of the audio which is processed by the stage: 0 if not known
+  uint32_t audio_bytes_per_second = 0;
+  uint64_t audio_bytes = 0;
+  /// time of the profiled stages which were called by the active call
+  uint64_t child_us = 0;
+
+  /// Processing time in us per second of audio
+  uint32_t usPerAudioSecond() {
+    if (audio_bytes == 0 || audio_bytes_per_second == 0) return 0;
+    return (double)exclusive_us * audio_bytes_per_second / audio_bytes;
+  }
+
+  void reset() {
+    calls = 0;
+    bytes_in = 0;
+    bytes_out = 0;
+    inclusive_us = 0;
+    exclusive_us = 0;
+    max_call_us = 0;
+    audio_bytes = 0;
+  }
+};
+
+/// State of an active call which is needed to attribute the time
+struct ProfileFrame {
+  ProfileStats *parent = nullptr;
+  uint64_t saved_child_us = 0;
+  uint32_t start_us = 0;
+};
+
+/**
+ * @brief Registry of the profiled stages: Tracks the active stage to attribute the time
+ * exclusively and exports the results as CSV or JSON.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class AudioProfiler {
+ public:
+  static AudioProfiler &instance() {
+    static AudioProfiler profiler;
+    return profiler;
+  }
+
+  /// Registers a stage
+  bool add(ProfileStats &stats) {
+    if (stage_count >= AUDIO_PROFILER_MAX_STAGES) {
+      LOGE("Too many profiler stages: %d", stage_count);
+      return false;
+    }
+    stages[stage_count++] = &stats;
+    return true;
+  }
+
+  /// Removes a stage
+  void remove(ProfileStats &stats) {
+    for (int j = 0; j < stage_count; j++) {
+      if (stages[j] == &stats) {
+        stages[j] = stages[--stage_count];
+        return;
+      }
+    }
+  }
+
+  /// Clears the measured values and restarts the time
+  void reset() {
+    for (int j = 0; j < stage_count; j++) stages[j]->reset();
+    start_us = micros();
+  }
+
+  int stageCount() { return stage_count; }
+
+  ProfileStats &stage(int idx) { return *stages[idx]; }
+
+  /// Time since the last reset in us
+  uint32_t elapsedUs() { return micros() - start_us; }
+
+  /// Prints a line for each stage with a header line
+  void printCSV(Print &out) {
+    out.println("stage,calls,bytes_in,bytes_out,inclusive_us,exclusive_us,max_call_us,cpu_percent,us_per_audio_s");
+    char msg[200];
+    for (int j = 0; j < stage_count; j++) {
+      ProfileStats &s = *stages[j];
+      snprintf(msg, sizeof(msg), "%s,%lu,%llu,%llu,%llu,%llu,%lu,%.2f,%lu", s.name, (unsigned long)s.calls,
+               (unsigned long long)s.bytes_in, (unsigned long long)s.bytes_out,
+               (unsigned long long)s.inclusive_us, (unsigned long long)s.exclusive_us,
+               (unsigned long)s.max_call_us, cpuPercent(s), (unsigned long)s.usPerAudioSecond());
+      out.println(msg);
+    }
+  }
+
+  /// Prints the stages as JSON array
+  void printJSON(Print &out) {
+    char msg[300];
+    out.print("[");
+    for (int j = 0; j < stage_count; j++) {
+      ProfileStats &s = *stages[j];
+      snprintf(msg, sizeof(msg),
+               "%s{\"stage\":\"%s\",\"calls\":%lu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"inclusive_us\":%llu,"
+               "\"exclusive_us\":%llu,\"max_call_us\":%lu,\"cpu_percent\":%.2f,\"us_per_audio_s\":%lu}",
+               j > 0 ? "," : "", s.name, (unsigned long)s.calls, (unsigned long long)s.bytes_in,
+               (unsigned long long)s.bytes_out, (unsigned long long)s.inclusive_us,
+               (unsigned long long)s.exclusive_us, (unsigned long)s.max_call_us, cpuPercent(s),
+               (unsigned long)s.usPerAudioSecond());
+      out.print(msg);
+    }
+    out.println("]");
+  }
+
+  /// Marks the start of a call of a stage
+  ProfileFrame enter(ProfileStats &stats) {
+    ProfileFrame frame;
+    frame.parent = p_active;
+    frame.saved_child_us = stats.child_us;
+    stats.child_us = 0;
+    p_active = &stats;
+    frame.start_us = micros();
+    return frame;
+  }
+
+  /// Marks the end of a call: the time and the bytes are also reported to the calling stage
+  void leave(ProfileStats &stats, ProfileFrame &frame, size_t bytes, bool isWrite) {
+    uint32_t duration = micros() - frame.start_us;
+    stats.calls++;
+    stats.inclusive_us += duration;
+    stats.exclusive_us += duration > stats.child_us ? duration - stats.child_us : 0;
+    if (duration > stats.max_call_us) stats.max_call_us = duration;
+    stats.audio_bytes += bytes;
+    stats.child_us = frame.saved_child_us;
+    p_active = frame.parent;
+    if (isWrite) {
+      stats.bytes_in += bytes;
+    } else {
+      stats.bytes_out += bytes;
+    }
+    // the calling stage produced (or consumes) the data
+    ProfileStats *parent = frame.parent;
+    if (parent != nullptr) {
+      parent->child_us += duration;
+      if (isWrite) {
+        parent->bytes_out += bytes;
+      } else {
+        parent->bytes_in += bytes;
+      }
+    }
+  }
+
+ protected:
+  ProfileStats *stages[AUDIO_PROFILER_MAX_STAGES];
+  int stage_count = 0;
+  ProfileStats *p_active = nullptr;
+  uint32_t start_us = micros();
+
+  AudioProfiler() = default;
+
+  float cpuPercent(ProfileStats &s) {
+    uint32_t elapsed = elapsedUs();
+    return elapsed == 0 ? 0.0f : 100.0f * s.exclusive_us / elapsed;
+  }
+};
+
+/**
+ * @brief Opt-in profiling wrapper for a stage of a pipeline: e.g. the VolumeStream output of
+ * a decoder. We measure the time of the write() and readBytes() calls and the processed bytes.
+ * The time of profiled stages which are called during the call is excluded, so each stage gets
+ * its own exclusive time, and the bytes which are passed to the next stage are reported as
+ * bytes_out (or bytes_in for readBytes()). If USE_AUDIO_PROFILER is false the calls are just
+ * forwarded.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class ProfiledStream : public AudioStreamX {
+ public:
+  ProfiledStream(Print &out, const char *name) {
+    p_print = &out;
+    setup(name);
+  }
+
+  ProfiledStream(Stream &io, const char *name) {
+    p_print = &io;
+    p_stream = &io;
+    setup(name);
+  }
+
+  ProfiledStream(AudioStream &io, const char *name) {
+    p_print = &io;
+    p_stream = &io;
+    p_audio = &io;
+    setup(name);
+  }
+
+  ~ProfiledStream() {
+#if USE_AUDIO_PROFILER
+    AudioProfiler::instance().remove(stats);
+#endif
+  }
+
+  bool begin() override { return p_audio != nullptr ? p_audio->begin() : true; }
+
+  void end() override {
+    if (p_audio != nullptr) p_audio->end();
+  }
+
+  /// Defines the audio format which is used to report the time per second of audio
+  void setAudioInfo(AudioBaseInfo info) override {
+    AudioStreamX::setAudioInfo(info);
+    stats.audio_bytes_per_second = info.sample_rate * info.channels * info.bits_per_sample / 8;
+    if (p_audio != nullptr) p_audio->setAudioInfo(info);
+  }
+
+  size_t write(const uint8_t *data, size_t len) override {
+#if USE_AUDIO_PROFILER
+    ProfileFrame frame = AudioProfiler::instance().enter(stats);
+    size_t result = p_print->write(data, len);
+    AudioProfiler::instance().leave(stats, frame, result, true);
+    return result;
+#else
+    return p_print->write(data, len);
+#endif
+  }
+
+  size_t readBytes(uint8_t *data, size_t len) override {
+    if (p_stream == nullptr) return not_supported(0);
+#if USE_AUDIO_PROFILER
+    ProfileFrame frame = AudioProfiler::instance().enter(stats);
+    size_t result = p_stream->readBytes(data, len);
+    AudioProfiler::instance().leave(stats, frame, result, false);
+    return result;
+#else
+    return p_stream->readBytes(data, len);
+#endif
+  }
+
+  int available() override { return p_stream != nullptr ? p_stream->available() : 0; }
+
+  int availableForWrite() override { return p_print->availableForWrite(); }
+
+  void flush() override { p_print->flush(); }
+
+  /// Provides the measured values
+  ProfileStats &profileStats() { return stats; }
+
+ protected:
+  Print *p_print = nullptr;
+  Stream *p_stream = nullptr;
+  AudioStream *p_audio = nullptr;
+  ProfileStats stats;
+
+  void setup(const char *name) {
+    stats.name = name;
+#if USE_AUDIO_PROFILER
+    AudioProfiler::instance().add(stats);
+#endif
+  }
+};
+
+}  // namespace audio_tools
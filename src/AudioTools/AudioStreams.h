@@ -4,6 +4,9 @@
 #include "AudioTools/AudioTypes.h"
 #include "AudioTools/Buffers.h"
 #include "AudioTools/AudioLogger.h"
+#include "AudioTools/Histogram.h"
+#include "AudioTools/DeadlineMonitor.h"
+#include "AudioTools/AudioTimestamp.h"
 #include "AudioEffects/SoundGenerator.h"
 #include "AudioTools/VolumeControl.h"
 
@@ -196,7 +199,7 @@ class MemoryStream : public AudioStream {
       if (!write(buffer[j])) {
         break;
       }
-      result = j;
+      result = j + 1;
     }
     return result;
   }
@@ -742,11 +745,12 @@ class NullStream : public BufferedStream {
 
 /**
  * @brief A Stream backed by a Ringbuffer. We can write to the end and read from
- * the beginning of the stream
+ * the beginning of the stream. The timestamps which are set before a write are
+ * kept with the data and passed on to the TimestampSink when the data is read.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class RingBufferStream : public AudioStream {
+class RingBufferStream : public AudioStream, public TimestampForwarder {
  public:
   RingBufferStream(int size = DEFAULT_BUFFER_SIZE) {
     buffer = new RingBuffer<uint8_t>(size);
@@ -758,6 +762,11 @@ class RingBufferStream : public AudioStream {
     }
   }
 
+  virtual void setAudioInfo(AudioBaseInfo info) override {
+    AudioStream::setAudioInfo(info);
+    timestamps.setAudioInfo(info);
+  }
+
   virtual int available() override {
     // LOGD("RingBufferStream::available: %zu",buffer->available());
     return buffer->available();
@@ -765,21 +774,45 @@ class RingBufferStream : public AudioStream {
 
   virtual void flush() override {}
   virtual int peek() override { return buffer->peek(); }
-  virtual int read() override { return buffer->read(); }
+  virtual int read() override { 
+    if (buffer->isEmpty()) return -1;
+    read_pos++;
+    return buffer->read();
+  }
 
   virtual size_t readBytes(uint8_t *data, size_t length) override {
-    return buffer->readArray(data, length);
+    forwardTimestamp(readTimestamp());
+    size_t result = buffer->readArray(data, length);
+    read_pos += result;
+    return result;
   }
 
   virtual size_t write(const uint8_t *data, size_t len) override {
     // LOGD("RingBufferStream::write: %zu",len);
-    return buffer->writeArray(data, len);
+    size_t result = buffer->writeArray(data, len);
+    write_pos += result;
+    return result;
+  }
+
+  virtual size_t write(uint8_t c) override { 
+    size_t result = buffer->write(c); 
+    write_pos += result;
+    return result;
+  }
+
+  /// Defines the timestamp of the next written frame
+  virtual void setTimestamp(AudioTimestamp ts) override {
+    timestamps.mark(write_pos, ts);
   }
 
-  virtual size_t write(uint8_t c) override { return buffer->write(c); }
+  /// Provides the timestamp of the next frame which will be read
+  AudioTimestamp readTimestamp() { return timestamps.at(read_pos); }
 
  protected:
   RingBuffer<uint8_t> *buffer = nullptr;
+  TimestampTrack timestamps;
+  uint64_t write_pos = 0;
+  uint64_t read_pos = 0;
 };
 
 /**
@@ -1103,7 +1136,10 @@ class VolumeStream : public AudioStreamX {
               float volume_value = volumeValue(vol);
               LOGI("setVolume: %f", volume_value);
               float factor = volumeControl().getVolumeFactor(volume_value);
-              factor_for_channel[channel]=factor;
+              volume_values[channel]=vol;
+              factor_for_channel[channel]=factor * gain;
+              target_factor[channel]=factor * gain;
+              ramp_frames = 0;
             } else {
               LOGE("Invalid channel %d - max: %d", channel, info.channels-1);
             }
@@ -1111,12 +1147,38 @@ class VolumeStream : public AudioStreamX {
 
         /// Provides the current volume setting
         float volume() {
-            return volume_values[0];
+            return volume_values==nullptr ? info.volume : volume_values[0];
         }
 
         /// Provides the current volume setting for the indicated channel
         float volume(int channel) {
-            return channel>=info.channels? 0 : volume_values[channel];
+            return channel>=info.channels || volume_values==nullptr ? 0 : volume_values[channel];
+        }
+
+        /// Defines an additional linear gain factor (e.g. ReplayGain) which is combined with the volume factor, 
+        /// so that we still need only one multiplication per sample. The change is ramped linearly over the indicated
+        /// time to avoid clicks.
+        void setGain(float factor, int rampMs=0){
+            LOGI("setGain: %f", factor);
+            gain = factor;
+            if (factor_for_channel==nullptr || info.channels==0) return;
+            is_active = true;
+            for (int j=0;j<info.channels;j++){
+              target_factor[j] = volumeControl().getVolumeFactor(volumeValue(volume_values[j])) * gain;
+            }
+            ramp_frames = info.sample_rate * rampMs / 1000;
+            for (int j=0;j<info.channels;j++){
+              if (ramp_frames>0){
+                ramp_step[j] = (target_factor[j] - factor_for_channel[j]) / ramp_frames;
+              } else {
+                factor_for_channel[j] = target_factor[j];
+              }
+            }
+        }
+
+        /// Provides the actual gain factor
+        float gainFactor() {
+            return gain;
         }
 
     protected:
@@ -1128,17 +1190,23 @@ class VolumeStream : public AudioStreamX {
         CachedVolumeControl cached_volume{pot_vc};
         float *volume_values = nullptr;
         float *factor_for_channel = nullptr;
+        float *target_factor = nullptr;
+        float *ramp_step = nullptr;
+        float gain = 1.0;
+        int ramp_frames = 0;
         bool is_active = false;
         float max_value = 32767; // max value for clipping
         int max_channels=0;
 
         void setup(float vol) {
-            is_active = vol!=1.0;
+            is_active = vol!=1.0 || gain!=1.0;
             if (info.channels>max_channels){
               cleanup();
             }
             if (factor_for_channel==nullptr){
               factor_for_channel = new float[info.channels];
+              target_factor = new float[info.channels];
+              ramp_step = new float[info.channels];
             }
             if (volume_values==nullptr){
               volume_values = new float[info.channels];
@@ -1148,7 +1216,11 @@ class VolumeStream : public AudioStreamX {
         void cleanup() {
           if (factor_for_channel!=nullptr) {
             delete []factor_for_channel;
+            delete []target_factor;
+            delete []ramp_step;
             factor_for_channel = nullptr;
+            target_factor = nullptr;
+            ramp_step = nullptr;
           } 
           if (volume_values!=nullptr) {
             delete []volume_values;
@@ -1190,8 +1262,29 @@ class VolumeStream : public AudioStreamX {
             }
         }
 
+        /// Processes the frames while a gain change is ramped: returns the number of processed samples
+        template <typename T>
+        size_t applyRamp(T* data, size_t size){
+            size_t j = 0;
+            while (ramp_frames>0 && j+info.channels<=size){
+                for (int ch=0;ch<info.channels;ch++){
+                    factor_for_channel[ch] += ramp_step[ch];
+                    float result = factor_for_channel[ch] * data[j];
+                    if (!info.allow_boost){
+                        if (result>max_value) result = max_value;
+                        if (result<-max_value) result = -max_value;
+                    } 
+                    data[j++] = static_cast<T>(static_cast<int32_t>(result));
+                }
+                if (--ramp_frames==0){
+                    memcpy(factor_for_channel, target_factor, info.channels*sizeof(float));
+                }
+            }
+            return j;
+        }
+
         void applyVolume16(int16_t* data, size_t size){
-            for (size_t j=0;j<size;j++){
+            for (size_t j=applyRamp(data, size);j<size;j++){
                 float result = factorForChannel(j%info.channels) * data[j];
                 if (!info.allow_boost){
                     if (result>max_value) result = max_value;
@@ -1202,7 +1295,7 @@ class VolumeStream : public AudioStreamX {
         }
 
         void applyVolume24(int24_t* data, size_t size) {
-            for (size_t j=0;j<size;j++){
+            for (size_t j=applyRamp(data, size);j<size;j++){
                 float result = factorForChannel(j%info.channels) * data[j];
                 if (!info.allow_boost){
                     if (result>max_value) result = max_value;
@@ -1214,7 +1307,7 @@ class VolumeStream : public AudioStreamX {
         }
 
         void applyVolume32(int32_t* data, size_t size) {
-            for (size_t j=0;j<size;j++){
+            for (size_t j=applyRamp(data, size);j<size;j++){
                 float result = factorForChannel(j%info.channels) * data[j];
                 if (!info.allow_boost){
                     if (result>max_value) result = max_value;
@@ -1226,7 +1319,9 @@ class VolumeStream : public AudioStreamX {
 };
 
 /**
- * @brief Class which measures the truput
+ * @brief Class which measures the truput. In addition we collect histograms (in us) for the
+ * duration of the read and write calls, the interval between the calls and the call sizes (in
+ * bytes) to identify stalls and jitter.
  * @author Phil Schatzmann
  * @copyright GPLv3
  * 
@@ -1261,7 +1356,8 @@ class MeasuringStream : public AudioStreamX {
 
         /// Provides the data from all streams mixed together 
     size_t readBytes(uint8_t* data, size_t len) override {
-      return measure(p_stream->readBytes(data, len));
+      uint32_t start = micros();
+      return measure(p_stream->readBytes(data, len), start);
     }
 
     int available()  override {
@@ -1270,7 +1366,8 @@ class MeasuringStream : public AudioStreamX {
 
     /// Writes raw PCM audio data, which will be the input for the volume control 
     virtual size_t write(const uint8_t *buffer, size_t size) override {
-      return measure(p_print->write(buffer, size));
+      uint32_t start = micros();
+      return measure(p_print->write(buffer, size), start);
     }
 
     /// Provides the nubmer of bytes we can write
@@ -1288,6 +1385,49 @@ class MeasuringStream : public AudioStreamX {
       return start_time;
     }
 
+    /// Duration of the read and write calls in us
+    Histogram &callTimeUs() {
+      return call_time_us;
+    }
+
+    /// Time between the start of two subsequent calls in us
+    Histogram &intervalUs() {
+      return interval_us;
+    }
+
+    /// Number of bytes which were processed by the calls
+    Histogram &callSize() {
+      return call_size;
+    }
+
+    /// Number of calls which took longer then the stall limit or which were called too late
+    uint32_t stalls() {
+      return stall_count;
+    }
+
+    /// Defines the duration in us which is considered as stall (default 10ms)
+    void setStallLimitUs(uint32_t limit) {
+      stall_limit_us = limit;
+    }
+
+    /// Clears the histograms and the stall counter
+    void resetHistograms() {
+      call_time_us.reset();
+      interval_us.reset();
+      call_size.reset();
+      stall_count = 0;
+      has_last_call = false;
+    }
+
+    /// Prints the percentiles of the histograms
+    void printHistograms(Print &out) {
+      call_time_us.printTo(out, "call us");
+      interval_us.printTo(out, "interval us");
+      call_size.printTo(out, "call bytes");
+      out.print("stalls: ");
+      out.println(stall_count);
+    }
+
   protected:
     int max_count=0;
     int count=0;
@@ -1298,8 +1438,31 @@ class MeasuringStream : public AudioStreamX {
     int bytes_per_second = 0;
     NullStream null;
     Print *p_logout=nullptr;
+    Histogram call_time_us;
+    Histogram interval_us;
+    Histogram call_size;
+    uint32_t stall_limit_us = 10000;
+    uint32_t stall_count = 0;
+    uint32_t last_call_start = 0;
+    uint32_t last_call_end = 0;
+    bool has_last_call = false;
+
+    size_t measure(size_t len, uint32_t start) {
+      uint32_t end = micros();
+      uint32_t duration = end - start;
+      call_time_us.add(duration);
+      call_size.add(len);
+      // a stall is a slow call or a long gap since the end of the last call
+      bool is_stall = duration > stall_limit_us;
+      if (has_last_call) {
+        interval_us.add(start - last_call_start);
+        if (start - last_call_end > stall_limit_us) is_stall = true;
+      }
+      if (is_stall) stall_count++;
+      last_call_start = start;
+      last_call_end = end;
+      has_last_call = true;
 
-    size_t measure(size_t len) {
       count--;
       total_bytes+=len;
 
@@ -1329,6 +1492,171 @@ class MeasuringStream : public AudioStreamX {
 
 };
 
+/**
+ * @brief Reports the write() and readBytes() calls of the wrapped stream (e.g. a decoder or
+ * the output) as stage of a DeadlineMonitor, so that an overrun can be attributed to it.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class DeadlineStageStream : public AudioStreamX {
+  public:
+    DeadlineStageStream(Print &print, DeadlineMonitor &monitor, const char *name) {
+      p_print = &print;
+      p_monitor = &monitor;
+      stage_name = name;
+    }
+
+    DeadlineStageStream(Stream &stream, DeadlineMonitor &monitor, const char *name) {
+      p_print = &stream;
+      p_stream = &stream;
+      p_monitor = &monitor;
+      stage_name = name;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+      DeadlineStage stage(p_monitor, stage_name);
+      return p_print->write(buffer, size);
+    }
+
+    size_t readBytes(uint8_t *data, size_t len) override {
+      if (p_stream == nullptr) return not_supported(0);
+      DeadlineStage stage(p_monitor, stage_name);
+      return p_stream->readBytes(data, len);
+    }
+
+    int available() override { return p_stream != nullptr ? p_stream->available() : 0; }
+
+    int availableForWrite() override { return p_print->availableForWrite(); }
+
+  protected:
+    Print *p_print = nullptr;
+    Stream *p_stream = nullptr;
+    DeadlineMonitor *p_monitor = nullptr;
+    const char *stage_name = "";
+};
+
+/**
+ * @brief Configuration for TimestampedStream
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct TimestampedStreamConfig : public AudioBaseInfo {
+  TimestampedStreamConfig() {
+    sample_rate = 44100;
+    channels = 2;
+    bits_per_sample = 16;
+  }
+  /// latency of the device in us: e.g. the size of the DMA buffers
+  uint32_t latency_us = 0;
+};
+
+/**
+ * @brief Timestamps at the end of a pipeline: as output it keeps the timestamps of the
+ * written data and reports the timestamp of the frame which is currently played (taking
+ * the latency of the output into account). As input it stamps the data with the capture
+ * time and forwards the timestamp to the TimestampSink.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class TimestampedStream : public AudioStreamX, public TimestampForwarder {
+  public:
+    TimestampedStream(Print &print) { p_print = &print; }
+
+    TimestampedStream(Stream &stream) {
+      p_print = &stream;
+      p_stream = &stream;
+    }
+
+    TimestampedStreamConfig defaultConfig() {
+      TimestampedStreamConfig c;
+      return c;
+    }
+
+    bool begin(TimestampedStreamConfig config) {
+      cfg = config;
+      setAudioInfo(cfg);
+      timestamps.clear();
+      write_pos = 0;
+      read_pos = 0;
+      played_pos = 0;
+      return bytesPerSecond() > 0;
+    }
+
+    void setAudioInfo(AudioBaseInfo info) override {
+      AudioStreamX::setAudioInfo(info);
+      cfg.sample_rate = info.sample_rate;
+      cfg.channels = info.channels;
+      cfg.bits_per_sample = info.bits_per_sample;
+      timestamps.setAudioInfo(info);
+    }
+
+    /// Defines the timestamp of the next written frame
+    void setTimestamp(AudioTimestamp ts) override { timestamps.mark(write_pos, ts); }
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+      size_t result = p_print->write(buffer, size);
+      write_pos += result;
+      last_write_us = audioClockUs();
+      return result;
+    }
+
+    /// Reads the data and forwards the capture timestamp
+    size_t readBytes(uint8_t *data, size_t len) override {
+      if (p_stream == nullptr) return not_supported(0);
+      size_t result = p_stream->readBytes(data, len);
+      if (result > 0 && bytesPerSecond() > 0) {
+        // the first frame was captured before the last one became available
+        int64_t duration_us = (int64_t)result * 1000000 / bytesPerSecond();
+        read_timestamp = AudioTimestamp(read_pos / frameSize(), audioClockUs() - duration_us - cfg.latency_us);
+        read_pos += result;
+        forwardTimestamp(read_timestamp);
+      }
+      return result;
+    }
+
+    /// Capture timestamp of the data of the last read
+    AudioTimestamp readTimestamp() { return read_timestamp; }
+
+    /// Timestamp of the frame which is currently played: invalid if nothing is playing
+    AudioTimestamp playingTimestamp() {
+      if (write_pos == 0) return AudioTimestamp();
+      uint64_t bytes_per_second = bytesPerSecond();
+      uint64_t latency_bytes = (uint64_t)cfg.latency_us * bytes_per_second / 1000000;
+      uint64_t elapsed_bytes = (uint64_t)(audioClockUs() - last_write_us) * bytes_per_second / 1000000;
+      if (write_pos + elapsed_bytes < latency_bytes) return AudioTimestamp();
+      uint64_t pos = write_pos + elapsed_bytes - latency_bytes;
+      // the output can not play more than what was written
+      if (pos > write_pos) pos = write_pos;
+      pos -= pos % frameSize();
+      // the positions of the TimestampTrack must not decrease
+      if (pos < played_pos) pos = played_pos;
+      played_pos = pos;
+      return timestamps.at(pos);
+    }
+
+    int available() override { return p_stream != nullptr ? p_stream->available() : 0; }
+
+    int availableForWrite() override { return p_print->availableForWrite(); }
+
+  protected:
+    Print *p_print = nullptr;
+    Stream *p_stream = nullptr;
+    TimestampedStreamConfig cfg;
+    TimestampTrack timestamps;
+    AudioTimestamp read_timestamp;
+    uint64_t write_pos = 0;
+    uint64_t read_pos = 0;
+    uint64_t played_pos = 0;
+    int64_t last_write_us = 0;
+
+    uint32_t bytesPerSecond() { return cfg.sample_rate * frameSize(); }
+
+    int frameSize() {
+      int result = cfg.channels * cfg.bits_per_sample / 8;
+      return result > 0 ? result : 1;
+    }
+};
+
 /**
  * @brief MixerStream is mixing the input from Multiple Input Streams.
  * All streams must have the same audo format (sample rate, channels, bits per sample) 
@@ -1493,12 +1821,14 @@ struct TimerCallbackAudioStreamInfo : public AudioBaseInfo {
 /**
  * @brief Callback driven Audio Source (rx_tx_mode==RX_MODE) or Audio Sink
  * (rx_tx_mode==TX_MODE). This class allows to to integrate external libraries
- * in order to consume or generate a data stream which is based on a timer
+ * in order to consume or generate a data stream which is based on a timer.
+ * The xrun statistics report the frames which were overwritten in RX_MODE and the
+ * frames which could not be filled completely in TX_MODE.
  * @author Phil Schatzmann
  * @copyright GPLv3
  *
  */
-class TimerCallbackAudioStream : public BufferedStream {
+class TimerCallbackAudioStream : public BufferedStream, public XRunSource {
   friend void IRAM_ATTR timerCallback(void *obj);
 
  public:
@@ -1582,8 +1912,15 @@ class TimerCallbackAudioStream : public BufferedStream {
   /// Provides the effective sample rate
   uint16_t currentSampleRate() { return currentRateValue; }
 
+  /// Checks that each timer callback finishes within the duration of a frame
+  void setDeadlineMonitor(DeadlineMonitor &monitor) {
+    p_deadline = &monitor;
+    monitor.setAudioInfo(cfg);
+  }
+
  protected:
   TimerCallbackAudioStreamInfo cfg;
+  DeadlineMonitor *p_deadline = nullptr;
   AudioBaseInfoDependent *notifyTarget = nullptr;
   bool active = false;
   uint16_t (*frameCallback)(uint8_t *data, uint16_t len);
@@ -1668,17 +2005,24 @@ class TimerCallbackAudioStream : public BufferedStream {
 void TimerCallbackAudioStream::timerCallback(void *obj) {
   TimerCallbackAudioStream *src = (TimerCallbackAudioStream *)obj;
   if (src != nullptr) {
+    if (src->p_deadline != nullptr) src->p_deadline->beginCycle(src->frameSize);
     // LOGD("%s:  %s", LOG_METHOD, src->cfg.rx_tx_mode==RX_MODE ?
     // "RX_MODE":"TX_MODE");
     if (src->cfg.rx_tx_mode == RX_MODE) {
       // input
-      uint16_t available_bytes = src->frameCallback(src->frame, src->frameSize);
+      uint16_t available_bytes;
+      {
+        DeadlineStage stage(src->p_deadline, "frameCallback");
+        available_bytes = src->frameCallback(src->frame, src->frameSize);
+      }
       uint16_t buffer_available = src->buffer->availableForWrite();
       if (buffer_available < available_bytes) {
         // if buffer is full make space
         uint16_t to_clear = available_bytes - buffer_available;
         uint8_t tmp[to_clear];
         src->buffer->readArray(tmp, to_clear);
+        src->xrun_stats.overflows++;
+        src->xrun_stats.dropped_bytes += to_clear;
       }
       if (src->buffer->writeArray(src->frame, available_bytes) !=
           available_bytes) {
@@ -1691,6 +2035,10 @@ void TimerCallbackAudioStream::timerCallback(void *obj) {
           src->frameSize > 0) {
         uint16_t available_bytes =
             src->buffer->readArray(src->frame, src->frameSize);
+        if (available_bytes < src->frameSize) {
+          src->xrun_stats.underflows++;
+        }
+        DeadlineStage stage(src->p_deadline, "frameCallback");
         if (available_bytes !=
             src->frameCallback(src->frame, available_bytes)) {
           LOGE(UNDERFLOW_MSG);
@@ -1698,6 +2046,7 @@ void TimerCallbackAudioStream::timerCallback(void *obj) {
       }
     }
     src->measureSampleRate();
+    if (src->p_deadline != nullptr) src->p_deadline->endCycle();
   }
 }
 
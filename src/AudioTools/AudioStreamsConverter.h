@@ -10,7 +10,7 @@ namespace audio_tools {
  * @copyright GPLv3
  */
 template<typename T>
-class ChannelFormatConverterStreamT : public AudioStreamX {
+class ChannelFormatConverterStreamT : public AudioStreamX, public TimestampForwarder {
   public:
         ChannelFormatConverterStreamT(Stream &stream){
           p_stream = &stream;
@@ -96,7 +96,7 @@ class ChannelFormatConverterStreamT : public AudioStreamX {
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class ChannelFormatConverterStream : public AudioStreamX {
+class ChannelFormatConverterStream : public AudioStreamX, public TimestampForwarder {
   public:
         ChannelFormatConverterStream() = default;
 
@@ -261,7 +261,7 @@ class ChannelFormatConverterStream : public AudioStreamX {
  */
 
 template<typename T, typename TArg >
-class NumberFormatConverterStreamT : public AudioStreamX {
+class NumberFormatConverterStreamT : public AudioStreamX, public TimestampForwarder {
   public:
         NumberFormatConverterStreamT() = default;
 
@@ -327,7 +327,7 @@ class NumberFormatConverterStreamT : public AudioStreamX {
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
-class NumberFormatConverterStream :  public AudioStreamX {
+class NumberFormatConverterStream :  public AudioStreamX, public TimestampForwarder {
   public:
         NumberFormatConverterStream() = default;
 
@@ -507,7 +507,7 @@ class NumberFormatConverterStream :  public AudioStreamX {
  * @copyright GPLv3
  */
 
-class FormatConverterStream : public AudioStreamX {
+class FormatConverterStream : public AudioStreamX, public TimestampForwarder {
   public:
         FormatConverterStream() = default;
 
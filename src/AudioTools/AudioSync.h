@@ -0,0 +1,290 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
+#include "AudioTools/AudioStreams.h"
+#include "AudioCodecs/AudioEncoded.h"
+#include "AudioBasic/Collections.h"
+
+namespace audio_tools {
+
+enum RecordType : uint8_t { Undefined, Begin, Send, Receive, End };
+enum AudioType : uint8_t { PCM, MP3, AAC, WAV };
+enum TransmitRole : uint8_t { Sender, Receiver };
+
+/// Common Header for all records
+struct AudioHeader {
+  AudioHeader() = default;
+  uint8_t app = 123;
+  RecordType rec = Undefined;
+  uint16_t seq = 0;
+  // record counter
+  void increment() {
+    static uint16_t static_count = 0;
+    seq = static_count++;
+  }
+};
+
+/// Protocal Record To Start
+struct AudioDataBegin : public AudioHeader {
+  AudioDataBegin() { rec = Begin; }
+  AudioBaseInfo info;
+  AudioType type = PCM;
+};
+
+/// Protocol Record for Data
+struct AudioSendData : public AudioHeader {
+  AudioSendData() {
+    rec = Send;
+    ;
+  }
+  uint16_t size = 0;
+};
+
+/// Protocol Record for the credit: the writer may send data up to the total number of bytes
+/// indicated by limit. Because the limit is cumulative, later records replace earlier ones
+struct AudioConfirmDataToReceive : public AudioHeader {
+  AudioConfirmDataToReceive() { rec = Receive; }
+  uint32_t limit = 0;
+};
+
+/// Protocol Record for End
+struct AudioDataEnd : public AudioHeader {
+  AudioDataEnd() { rec = End; }
+};
+
+/**
+ * @brief Audio Writer which is synchronizing the amount of data
+ * that can be processed with the AudioSyncReader: We use a credit based
+ * sliding window, so multiple blocks can be in flight. The credits are
+ * received without blocking whenever we send data and we only wait if
+ * the credit has been used up.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class AudioSyncWriter : public AudioPrint {
+ public:
+  AudioSyncWriter(Stream &dest) { p_dest = &dest; }
+
+  /// Defines the max size of the data records
+  void setBlockSize(uint16_t size) { block_size = size; }
+
+  /// If false, write() only sends the data for which we have credit and never waits
+  void setBlocking(bool flag) { is_blocking = flag; }
+
+  bool begin(AudioBaseInfo &info, AudioType type) {
+    is_sync = true;
+    // the credits of the previous session are not valid any more
+    discardCredits();
+    sent_total = 0;
+    credit_limit = 0;
+    AudioDataBegin begin;
+    begin.info = info;
+    begin.type = type;
+    begin.increment();
+    int write_len = sizeof(begin);
+    int len = p_dest->write((const uint8_t *)&begin, write_len);
+    return len == write_len;
+  }
+
+  size_t write(const uint8_t *data, size_t len) override {
+    size_t written_len = 0;
+    AudioSendData send;
+    while (written_len < len) {
+      int credit = availableForWrite();
+      if (credit <= 0) {
+        if (!is_blocking) break;
+        waitForCredit();
+        continue;
+      }
+      size_t to_write_len = min(len - written_len, (size_t)min(credit, (int)block_size));
+      send.increment();
+      send.size = to_write_len;
+      p_dest->write((const uint8_t *)&send, sizeof(send));
+      size_t w = p_dest->write(data + written_len, to_write_len);
+      written_len += w;
+      sent_total += w;
+    }
+    return written_len;
+  }
+
+  /// Provides the open credit
+  int availableForWrite() override {
+    processCredits();
+    return (int32_t)(credit_limit - sent_total);
+  }
+
+  void end() {
+    AudioDataEnd end;
+    end.increment();
+    p_dest->write((const uint8_t *)&end, sizeof(end));
+  }
+
+ protected:
+  Stream *p_dest;
+  uint16_t block_size = DEFAULT_BUFFER_SIZE;
+  uint32_t sent_total = 0;
+  uint32_t credit_limit = 0;
+  bool is_sync;
+  bool is_blocking = true;
+
+  /// Processes all received credit records without blocking
+  void processCredits() {
+    AudioConfirmDataToReceive rcv;
+    while (p_dest->available() >= (int)sizeof(rcv)) {
+      p_dest->readBytes((uint8_t *)&rcv, sizeof(rcv));
+      if (rcv.rec == Receive && (int32_t)(rcv.limit - credit_limit) > 0) {
+        credit_limit = rcv.limit;
+      }
+    }
+  }
+
+  /// Removes the received credit records
+  void discardCredits() {
+    AudioConfirmDataToReceive rcv;
+    while (p_dest->available() >= (int)sizeof(rcv)) {
+      p_dest->readBytes((uint8_t *)&rcv, sizeof(rcv));
+    }
+  }
+
+  void waitForCredit() {
+    while (availableForWrite() <= 0) {
+      audioDelay(1);
+    }
+  }
+};
+
+/**
+ * @brief Receving Audio Data over the wire and granting credits when
+ * done to synchronize the processing with the sender. The audio data is
+ * processed by the EncodedAudioStream; If you have multiple readers, only one
+ * receiver should be used as confirmer! The writer can send up to the window
+ * size of data in advance and we report the processed data after each
+ * half window, so that the writer never needs to wait for a round trip.
+ * The data is processed with a fixed buffer. copy() only processes the
+ * available data and does not block.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class AudioSyncReader : public AudioStreamX {
+ public:
+  AudioSyncReader(Stream &in, EncodedAudioStream &out,
+                  bool isConfirmer = true) {
+    p_in = &in;
+    p_out = &out;
+    is_confirmer = isConfirmer;
+    buffer.resize(buffer_size);
+  }
+
+  /// Defines the number of bytes the writer can send in advance
+  void setWindowSize(uint32_t size) { window_size = size; }
+
+  /// Defines the size of the buffer which is used to copy the data
+  void setBufferSize(uint16_t size) {
+    buffer_size = size;
+    buffer.resize(size);
+  }
+
+  /// Processes the available data: returns the number of audio bytes
+  size_t copy() {
+    if (open_len == 0) {
+      if (p_in->available() < (int)sizeof(header)) return 0;
+      p_in->readBytes((uint8_t *)&header, sizeof(header));
+      switch (header.rec) {
+        case Begin:
+          audioDataBegin();
+          break;
+        case End:
+          audioDataEnd();
+          break;
+        case Send:
+          readProtocol(&data_header, sizeof(data_header));
+          open_len = data_header.size;
+          break;
+        default:
+          LOGW("Unexpected record: %d", header.rec);
+          break;
+      }
+    }
+    return receiveData();
+  }
+
+ protected:
+  Stream *p_in;
+  EncodedAudioStream *p_out;
+  AudioConfirmDataToReceive req;
+  AudioHeader header;
+  AudioSendData data_header;
+  AudioDataBegin begin;
+  Vector<uint8_t> buffer{0};
+  uint16_t buffer_size = DEFAULT_BUFFER_SIZE;
+  uint32_t window_size = 4 * DEFAULT_BUFFER_SIZE;
+  size_t open_len = 0;
+  uint32_t received_total = 0;
+  uint32_t confirmed_total = 0;
+  bool is_confirmer;
+
+  /// Starts the processing
+  void audioDataBegin() {
+    readProtocol(&begin, sizeof(begin));
+    received_total = 0;
+    open_len = 0;
+    p_out->begin();
+    p_out->setAudioInfo(begin.info);
+    requestData();
+  }
+
+  /// Ends the processing
+  void audioDataEnd() {
+    AudioDataEnd end;
+    readProtocol(&end, sizeof(end));
+    p_out->end();
+  }
+
+  // Receives the available audio data of the actual record
+  int receiveData() {
+    int result = 0;
+    while (open_len > 0) {
+      size_t len = min(open_len, (size_t)min(p_in->available(), (int)buffer.size()));
+      if (len == 0) break;
+      len = p_in->readBytes(buffer.data(), len);
+      p_out->write(buffer.data(), len);
+      open_len -= len;
+      received_total += len;
+      result += len;
+    }
+    // only one reader should be used as confirmer: we confirm after half of the window
+    if (is_confirmer && received_total - confirmed_total >= window_size / 2) {
+      requestData();
+    }
+    return result;
+  }
+
+  /// Waits for the data to be available
+  void waitFor(int size) {
+    while (p_in->available() < size) {
+      audioDelay(1);
+    }
+  }
+
+  /// Grants the credit for the next window
+  void requestData() {
+    req.limit = received_total + window_size;
+    req.increment();
+    confirmed_total = received_total;
+    p_in->write((const uint8_t *)&req, sizeof(req));
+    p_in->flush();
+  }
+
+  /// Reads the protocol record
+  void readProtocol(AudioHeader *data, int len) {
+    const static int header_size = sizeof(header);
+    memcpy(data, &header, header_size);
+    int read_size = len - header_size;
+    waitFor(read_size);
+    p_in->readBytes((uint8_t *)data + header_size, read_size);
+  }
+};
+
+}  // namespace audio_tools
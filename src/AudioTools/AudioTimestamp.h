@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "AudioTools/AudioTypes.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Presentation (or capture) timestamp of an audio frame: the position of the frame
+ * in the timeline of the stream and the time of the frame on the reference clock.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct AudioTimestamp {
+  /// position in frames in the timeline of the stream
+  uint64_t frame = 0;
+  /// time in us of the frame on the reference clock
+  int64_t clock_us = 0;
+  bool valid = false;
+
+  AudioTimestamp() = default;
+  AudioTimestamp(uint64_t frame, int64_t clockUs) {
+    this->frame = frame;
+    this->clock_us = clockUs;
+    valid = true;
+  }
+
+  /// Timestamp of the frame which follows the indicated number of frames later
+  AudioTimestamp advance(int64_t frames, int sampleRate) const {
+    AudioTimestamp result = *this;
+    if (!valid) return result;
+    result.frame += frames;
+    if (sampleRate > 0) result.clock_us += frames * 1000000 / sampleRate;
+    return result;
+  }
+};
+
+/// Default reference clock: monotonic 64 bit microseconds of the AudioClock
+inline int64_t audioClockUs() { return AudioClock::instance().timeUs(); }
+
+/**
+ * @brief Receiver of the optional timestamp side channel: the timestamp applies to the
+ * next frame which will be written.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class TimestampSink {
+ public:
+  virtual ~TimestampSink() = default;
+  virtual void setTimestamp(AudioTimestamp ts) = 0;
+};
+
+/**
+ * @brief Stage which passes the timestamps on to the next TimestampSink: by default the
+ * timestamps are forwarded unchanged because the stage does not change the number of frames.
+ * The sink needs to be defined explicitly since the data is passed on as Print.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class TimestampForwarder : public TimestampSink {
+ public:
+  /// Defines the stage which receives the timestamps
+  void setTimestampSink(TimestampSink &sink) { p_timestamp_sink = &sink; }
+
+  void setTimestamp(AudioTimestamp ts) override { forwardTimestamp(ts); }
+
+ protected:
+  TimestampSink *p_timestamp_sink = nullptr;
+
+  void forwardTimestamp(AudioTimestamp ts) {
+    if (p_timestamp_sink != nullptr && ts.valid) p_timestamp_sink->setTimestamp(ts);
+  }
+};
+
+/**
+ * @brief Timestamps which are attached to byte positions of a stream, so that they can be
+ * determined for any later position: e.g. when the data is read from a buffer.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class TimestampTrack {
+ public:
+  /// Defines the audio format which is used to convert the bytes to frames
+  void setAudioInfo(AudioBaseInfo info) {
+    sample_rate = info.sample_rate;
+    frame_size = info.channels * info.bits_per_sample / 8;
+    if (frame_size <= 0) frame_size = 1;
+  }
+
+  /// Removes all timestamps
+  void clear() { count = 0; }
+
+  bool isEmpty() { return count == 0; }
+
+  /// Defines the timestamp of the frame at the indicated byte position
+  void mark(uint64_t pos, AudioTimestamp ts) {
+    if (!ts.valid) return;
+    if (count == AUDIO_TIMESTAMP_MARKS) {
+      LOGW("too many timestamps: removing oldest");
+      first = next(first);
+      count--;
+    }
+    Mark &m = marks[(first + count) % AUDIO_TIMESTAMP_MARKS];
+    m.pos = pos;
+    m.ts = ts;
+    count++;
+  }
+
+  /// Determines the timestamp of the frame at the indicated byte position: the positions must not decrease
+  AudioTimestamp at(uint64_t pos) {
+    // remove the marks which are replaced by a later one
+    while (count > 1 && marks[next(first)].pos <= pos) {
+      first = next(first);
+      count--;
+    }
+    AudioTimestamp result;
+    if (count == 0 || marks[first].pos > pos) return result;
+    Mark &m = marks[first];
+    return m.ts.advance((pos - m.pos) / frame_size, sample_rate);
+  }
+
+ protected:
+  struct Mark {
+    uint64_t pos = 0;
+    AudioTimestamp ts;
+  } marks[AUDIO_TIMESTAMP_MARKS];
+  int first = 0;
+  int count = 0;
+  int sample_rate = 0;
+  int frame_size = 1;
+
+  int next(int idx) { return (idx + 1) % AUDIO_TIMESTAMP_MARKS; }
+};
+
+}  // namespace audio_tools
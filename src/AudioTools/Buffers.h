@@ -3,6 +3,7 @@
 
 #include "AudioBasic/Collections.h"
 #include "AudioTools/AudioLogger.h"
+#include "AudioTools/XRunStats.h"
 
 #undef MIN
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
@@ -14,12 +15,15 @@ template <typename T>
 class NBuffer;
 
 /**
- * @brief Shared functionality of all buffers
+ * @brief Shared functionality of all buffers: writeArray() reports an overflow if not all
+ * data fits into the buffer. Reading from an empty buffer is only reported as underflow
+ * after calling setUnderflowCounting(true), because polling consumers read from empty
+ * buffers all the time.
  * @author Phil Schatzmann
  * @copyright GPLv3
  */
 template <typename T>
-class BaseBuffer {
+class BaseBuffer : public XRunSource {
  public:
   virtual ~BaseBuffer() {}
 
@@ -29,6 +33,7 @@ class BaseBuffer {
   // reads multiple values
   int readArray(T data[], int len) {
     int lenResult = MIN(len, available());
+    if (len > 0 && lenResult == 0 && is_underflow_counting) this->xrun_stats.underflows++;
     for (int j = 0; j < lenResult; j++) {
       data[j] = read();
     }
@@ -46,6 +51,7 @@ class BaseBuffer {
       }
       result = j + 1;
     }
+    if (result < len) this->xrun_stats.overflows++;
     //CHECK_MEMORY();
     return result;
   }
@@ -100,7 +106,12 @@ class BaseBuffer {
   // returns the address of the start of the physical read buffer
   virtual T *address() = 0;
 
+  /// Reports reads from an empty buffer as underflow (default: false)
+  void setUnderflowCounting(bool active) { is_underflow_counting = active; }
+
  protected:
+  bool is_underflow_counting = false;
+
   void setWritePos(int pos){};
 
   friend NBuffer<T>;
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "AudioTools/AudioTypes.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/Histogram.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Configuration for the DeadlineMonitor: the deadline of a cycle is the playing time
+ * of the processed bytes. If a cycle does not report the bytes we use the buffer_size.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct DeadlineMonitorConfig : public AudioBaseInfo {
+  DeadlineMonitorConfig() {
+    sample_rate = 44100;
+    channels = 2;
+    bits_per_sample = 16;
+  }
+  /// bytes which are processed by a cycle which does not report them
+  int buffer_size = DEFAULT_BUFFER_SIZE;
+  /// fixed period in us (e.g. for encoded data): if 0 it is determined from the audio info
+  uint32_t period_us = 0;
+  /// part of the period in percent which can be used by a cycle
+  uint16_t budget_percent = 100;
+  /// The deadline is the end of the processed audio on a continuous timeline: the time a cycle
+  /// is ahead of it (e.g. after a blocking output has accepted the data early) is added to the
+  /// deadline of the next cycle. Use this for outputs which block until they have room (e.g. I2S).
+  bool cumulative = false;
+};
+
+/// Information about a cycle which has missed its deadline
+struct DeadlineOverrun {
+  uint32_t cycle = 0;
+  uint32_t duration_us = 0;
+  uint32_t deadline_us = 0;
+  /// stage which was executing when the deadline has passed
+  const char *stage = "";
+  uint32_t time_ms = 0;
+};
+
+/// Statistics of the DeadlineMonitor
+struct DeadlineStats {
+  uint32_t cycles = 0;
+  uint32_t overruns = 0;
+  uint32_t max_duration_us = 0;
+  /// max duration relative to the deadline
+  uint32_t max_load_percent = 0;
+};
+
+/**
+ * @brief Checks that each processing cycle (e.g. a StreamCopy::copy() or a timer callback)
+ * finishes within the playing time of the audio which it processes. The optional stages
+ * (e.g. a decoder write) which are executed by a cycle are tracked, so that an overrun
+ * reports the stage which was executing when the deadline has passed. The last overruns
+ * are kept and an optional callback is notified about each overrun. The cycle durations
+ * are collected in a Histogram.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class DeadlineMonitor : public AudioBaseInfoDependent {
+ public:
+  DeadlineMonitor() = default;
+
+  DeadlineMonitorConfig defaultConfig() {
+    DeadlineMonitorConfig c;
+    return c;
+  }
+
+  bool begin(DeadlineMonitorConfig config) {
+    cfg = config;
+    reset();
+    LOGI("deadline: %u us", (unsigned)deadlineUs());
+    return deadlineUs() > 0;
+  }
+
+  /// Updates the audio format which is used to determine the deadline
+  void setAudioInfo(AudioBaseInfo info) override {
+    cfg.sample_rate = info.sample_rate;
+    cfg.channels = info.channels;
+    cfg.bits_per_sample = info.bits_per_sample;
+  }
+
+  /// Defines a callback which is notified about each overrun
+  void setOverrunCallback(void (*callback)(DeadlineMonitor &monitor, DeadlineOverrun &overrun)) {
+    overrun_callback = callback;
+  }
+
+  /// Deadline in us for a cycle which processes the indicated bytes (0 = buffer_size)
+  uint32_t deadlineUs(size_t bytes = 0) {
+    uint32_t period = cfg.period_us;
+    if (period == 0) {
+      uint32_t bytes_per_second = cfg.sample_rate * cfg.channels * cfg.bits_per_sample / 8;
+      if (bytes == 0) bytes = cfg.buffer_size;
+      period = bytes_per_second == 0 ? 0 : (uint64_t)bytes * 1000000 / bytes_per_second;
+    }
+    return (uint64_t)period * cfg.budget_percent / 100;
+  }
+
+  /// Starts a cycle which processes the indicated bytes (0 = buffer_size)
+  void beginCycle(size_t bytes = 0) {
+    start_us = micros();
+    // in cumulative mode we can use the time we are ahead of the timeline
+    slack_us = 0;
+    if (cfg.cumulative && has_timeline && (int32_t)(timeline_us - start_us) > 0) {
+      slack_us = timeline_us - start_us;
+    }
+    deadline_us = slack_us + deadlineUs(bytes);
+    depth = 0;
+    late_stage = nullptr;
+    is_active = true;
+  }
+
+  /// Ends the cycle: the bytes (if > 0) replace the value of beginCycle(). Returns false for an overrun
+  bool endCycle(size_t bytes = 0) {
+    uint32_t duration = micros() - start_us;
+    if (!is_active) return true;
+    is_active = false;
+    if (bytes > 0) deadline_us = slack_us + deadlineUs(bytes);
+    if (cfg.cumulative) {
+      timeline_us = start_us + deadline_us;
+      has_timeline = true;
+    }
+    cycle_time_us.add(duration);
+    stat.cycles++;
+    if (duration > stat.max_duration_us) stat.max_duration_us = duration;
+    uint32_t load = deadline_us == 0 ? 0 : (uint64_t)duration * 100 / deadline_us;
+    if (load > stat.max_load_percent) stat.max_load_percent = load;
+    if (duration <= deadline_us) return true;
+
+    // record the overrun
+    stat.overruns++;
+    DeadlineOverrun &overrun = history[history_pos];
+    history_pos = (history_pos + 1) % DEADLINE_MONITOR_HISTORY;
+    if (history_count < DEADLINE_MONITOR_HISTORY) history_count++;
+    overrun.cycle = stat.cycles;
+    overrun.duration_us = duration;
+    overrun.deadline_us = deadline_us;
+    overrun.stage = late_stage != nullptr ? late_stage : currentStage();
+    overrun.time_ms = millis();
+    if (overrun_callback != nullptr) overrun_callback(*this, overrun);
+    return false;
+  }
+
+  /// Marks the start of a stage of the active cycle: stages can be nested
+  void enterStage(const char *name) {
+    if (!is_active) return;
+    // the deadline has passed before: we blame the enclosing stage
+    if (late_stage == nullptr && isLate()) late_stage = currentStage();
+    if (depth < DEADLINE_MONITOR_MAX_DEPTH) stages[depth] = name;
+    depth++;
+  }
+
+  /// Marks the end of the actual stage
+  void leaveStage() {
+    if (!is_active || depth == 0) return;
+    // the deadline has passed while this stage was executing
+    if (late_stage == nullptr && isLate()) late_stage = currentStage();
+    depth--;
+  }
+
+  /// Returns true if the active cycle has already passed its deadline
+  bool isLate() { return is_active && (uint32_t)(micros() - start_us) > deadline_us; }
+
+  /// Name of the innermost executing stage or "cycle" if no stage is executing
+  const char *currentStage() {
+    if (depth == 0) return "cycle";
+    return depth > DEADLINE_MONITOR_MAX_DEPTH ? stages[DEADLINE_MONITOR_MAX_DEPTH - 1] : stages[depth - 1];
+  }
+
+  DeadlineStats &stats() { return stat; }
+
+  /// Durations of the cycles in us
+  Histogram &cycleTimeUs() { return cycle_time_us; }
+
+  /// Number of recorded overruns (max DEADLINE_MONITOR_HISTORY)
+  int overrunCount() { return history_count; }
+
+  /// Provides the recorded overruns: 0 is the oldest
+  DeadlineOverrun &overrun(int idx) {
+    int pos = (history_pos - history_count + idx + DEADLINE_MONITOR_HISTORY) % DEADLINE_MONITOR_HISTORY;
+    return history[pos];
+  }
+
+  /// Clears the statistics and the recorded overruns
+  void reset() {
+    stat = DeadlineStats();
+    cycle_time_us.reset();
+    history_pos = 0;
+    history_count = 0;
+    is_active = false;
+    has_timeline = false;
+  }
+
+  /// Prints the statistics and the recorded overruns
+  void printTo(Print &out) {
+    char msg[120];
+    snprintf(msg, sizeof(msg), "deadline: %u us cycles=%u overruns=%u max=%u us max_load=%u%%",
+             (unsigned)deadlineUs(), (unsigned)stat.cycles, (unsigned)stat.overruns,
+             (unsigned)stat.max_duration_us, (unsigned)stat.max_load_percent);
+    out.println(msg);
+    cycle_time_us.printTo(out, "cycle us");
+    for (int j = 0; j < history_count; j++) {
+      DeadlineOverrun &o = overrun(j);
+      snprintf(msg, sizeof(msg), "overrun cycle=%u %u/%u us in %s at %u ms", (unsigned)o.cycle,
+               (unsigned)o.duration_us, (unsigned)o.deadline_us, o.stage, (unsigned)o.time_ms);
+      out.println(msg);
+    }
+  }
+
+ protected:
+  DeadlineMonitorConfig cfg;
+  DeadlineStats stat;
+  Histogram cycle_time_us;
+  DeadlineOverrun history[DEADLINE_MONITOR_HISTORY];
+  int history_pos = 0;
+  int history_count = 0;
+  const char *stages[DEADLINE_MONITOR_MAX_DEPTH];
+  int depth = 0;
+  const char *late_stage = nullptr;
+  uint32_t start_us = 0;
+  uint32_t deadline_us = 0;
+  uint32_t slack_us = 0;
+  // end of the processed audio in cumulative mode
+  uint32_t timeline_us = 0;
+  bool has_timeline = false;
+  bool is_active = false;
+  void (*overrun_callback)(DeadlineMonitor &monitor, DeadlineOverrun &overrun) = nullptr;
+};
+
+/**
+ * @brief Marks a stage of a DeadlineMonitor for the lifetime of the object. The monitor is
+ * optional: if it is null we do nothing.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class DeadlineStage {
+ public:
+  DeadlineStage(DeadlineMonitor *monitor, const char *name) {
+    p_monitor = monitor;
+    if (p_monitor != nullptr) p_monitor->enterStage(name);
+  }
+
+  ~DeadlineStage() {
+    if (p_monitor != nullptr) p_monitor->leaveStage();
+  }
+
+ protected:
+  DeadlineMonitor *p_monitor;
+};
+
+}  // namespace audio_tools
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Histogram with a fixed memory footprint: The values are counted in logarithmic
+ * buckets with 4 sub buckets per power of 2, so the reported percentiles have a max relative
+ * error of 25% over the full 32 bit range (e.g. microseconds). Adding a value is only a
+ * few integer operations, so it can be used in the hot path.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class Histogram {
+ public:
+  static const int BUCKETS = 124;
+
+  Histogram() { reset(); }
+
+  /// Removes all values
+  void reset() {
+    memset(buckets, 0, sizeof(buckets));
+    total = 0;
+    sum = 0;
+    min_value = 0xFFFFFFFF;
+    max_value = 0;
+  }
+
+  /// Adds a value
+  void add(uint32_t value) {
+    buckets[bucket(value)]++;
+    total++;
+    sum += value;
+    if (value < min_value) min_value = value;
+    if (value > max_value) max_value = value;
+  }
+
+  /// Number of values
+  uint32_t count() { return total; }
+
+  uint32_t minValue() { return total == 0 ? 0 : min_value; }
+
+  uint32_t maxValue() { return max_value; }
+
+  uint32_t mean() { return total == 0 ? 0 : sum / total; }
+
+  /// Provides the upper limit of the bucket which contains the indicated percentile (0-100)
+  uint32_t percentile(float pct) {
+    if (total == 0) return 0;
+    uint32_t limit = total * pct / 100.0f + 0.5f;
+    if (limit < 1) limit = 1;
+    uint32_t cumulative = 0;
+    for (int j = 0; j < BUCKETS; j++) {
+      cumulative += buckets[j];
+      if (cumulative >= limit) {
+        uint32_t result = bucketHigh(j);
+        return result > max_value ? max_value : result;
+      }
+    }
+    return max_value;
+  }
+
+  uint32_t p50() { return percentile(50); }
+  uint32_t p95() { return percentile(95); }
+  uint32_t p99() { return percentile(99); }
+
+  /// Number of values which are bigger then the indicated limit (with the resolution of a bucket)
+  uint32_t countAbove(uint32_t limit) {
+    uint32_t result = 0;
+    for (int j = bucket(limit) + 1; j < BUCKETS; j++) {
+      result += buckets[j];
+    }
+    return result;
+  }
+
+  /// Number of values in the indicated bucket
+  uint32_t bucketCount(int idx) { return buckets[idx]; }
+
+  /// Smallest value of the indicated bucket
+  static uint32_t bucketLow(int idx) {
+    if (idx < 4) return idx;
+    int msb = idx / 4 + 1;
+    return (uint32_t)(4 + idx % 4) << (msb - 2);
+  }
+
+  /// Biggest value of the indicated bucket
+  static uint32_t bucketHigh(int idx) {
+    if (idx < 4) return idx;
+    if (idx == BUCKETS - 1) return 0xFFFFFFFF;
+    return bucketLow(idx + 1) - 1;
+  }
+
+  /// Determines the bucket for a value
+  static int bucket(uint32_t value) {
+    if (value < 4) return value;
+    int msb = 31 - __builtin_clz(value);
+    return (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+  }
+
+  /// Prints the count, percentiles and max in one line
+  void printTo(Print &out, const char *title) {
+    char msg[120];
+    snprintf(msg, sizeof(msg), "%s: n=%u p50=%u p95=%u p99=%u max=%u", title, (unsigned)total,
+             (unsigned)p50(), (unsigned)p95(), (unsigned)p99(), (unsigned)max_value);
+    out.println(msg);
+  }
+
+ protected:
+  uint32_t buckets[BUCKETS];
+  uint32_t total;
+  uint64_t sum;
+  uint32_t min_value;
+  uint32_t max_value;
+};
+
+}  // namespace audio_tools
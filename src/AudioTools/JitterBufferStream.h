@@ -0,0 +1,331 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
+#include "AudioTools/AudioStreams.h"
+#include "AudioBasic/Collections.h"
+
+namespace audio_tools {
+
+/// How missing packets are replaced
+enum JitterConcealment { ConcealSilence, ConcealRepeatFade };
+
+/**
+ * @brief Configuration for the JitterBufferStream
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct JitterBufferConfig : public AudioBaseInfo {
+  JitterBufferConfig() {
+    sample_rate = 44100;
+    bits_per_sample = 16;
+    channels = 2;
+  }
+  /// max size of a packet in bytes
+  uint16_t packet_size = 256;
+  /// max number of packets which can be stored: rounded up to a power of 2
+  uint16_t max_packets = 32;
+  /// limits for the target depth in packets
+  uint16_t min_depth = 2;
+  uint16_t max_depth = 16;
+  /// the target depth covers the jitter multiplied by this factor
+  float jitter_factor = 3.0;
+  /// if we have more packets then target depth + this value we drop a packet to reduce the latency
+  uint16_t max_excess = 4;
+  /// duration of a packet: if 0 it is determined from the packet_size and the audio info
+  float packet_duration_ms = 0;
+  /// if true each written packet starts with a 16 bit big endian sequence number
+  bool sequence_header = false;
+  JitterConcealment concealment = ConcealRepeatFade;
+};
+
+/**
+ * @brief Statistics of the JitterBufferStream
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct JitterBufferStats {
+  uint32_t received = 0;
+  uint32_t played = 0;
+  uint32_t concealed = 0;
+  uint32_t late = 0;
+  uint32_t duplicates = 0;
+  uint32_t overflows = 0;
+  uint32_t underruns = 0;
+  uint32_t latency_drops = 0;
+  float jitter_ms = 0;
+  uint16_t target_depth = 0;
+  uint16_t depth = 0;
+};
+
+/**
+ * @brief Jitter buffer for packetized audio (e.g. received via UDP or ESPNow): The packets are
+ * reordered by their sequence number and the output is started only when we have buffered the
+ * target depth. The target depth adapts to the measured interarrival jitter (RFC 3550). Missing
+ * packets are replaced by a faded repetition of the last packet (16 bit PCM) or silence. The packets
+ * are written with writePacket() or with write() (with an automatic or a received sequence number)
+ * and the audio is read with readBytes(). The xrun statistics report the underruns, the overflows
+ * and the late packets together with the bytes of the discarded packets.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class JitterBufferStream : public AudioStreamX, public XRunSource {
+ public:
+  JitterBufferStream() = default;
+
+  JitterBufferConfig defaultConfig() {
+    JitterBufferConfig c;
+    return c;
+  }
+
+  bool begin() { return begin(cfg); }
+
+  bool begin(JitterBufferConfig config) {
+    LOGD(LOG_METHOD);
+    cfg = config;
+    // the slots must stay consistent when the 16 bit sequence number wraps around
+    uint32_t max_packets = 1;
+    while (max_packets < cfg.max_packets && max_packets < 0x8000) max_packets <<= 1;
+    if (max_packets != cfg.max_packets) {
+      LOGI("max_packets: %u -> %u", (unsigned)cfg.max_packets, (unsigned)max_packets);
+      cfg.max_packets = max_packets;
+    }
+    if (cfg.max_depth >= cfg.max_packets) cfg.max_depth = cfg.max_packets - 1;
+    if (cfg.min_depth > cfg.max_depth) cfg.min_depth = cfg.max_depth;
+    packet_ms = cfg.packet_duration_ms;
+    if (packet_ms <= 0) {
+      int bytes_per_ms = cfg.sample_rate * cfg.channels * cfg.bits_per_sample / 8 / 1000;
+      packet_ms = bytes_per_ms > 0 ? (float)cfg.packet_size / bytes_per_ms : 1.0;
+    }
+    data.resize(cfg.packet_size * cfg.max_packets);
+    slots.resize(cfg.max_packets);
+    current.resize(cfg.packet_size);
+    for (int j = 0; j < cfg.max_packets; j++) slots[j] = Slot();
+    stat = JitterBufferStats();
+    stat.target_depth = cfg.min_depth;
+    is_started = false;
+    is_playing = false;
+    current_len = 0;
+    current_pos = 0;
+    loss_count = 0;
+    write_seq = 0;
+    return true;
+  }
+
+  void end() {
+    is_started = false;
+    is_playing = false;
+  }
+
+  /// Adds a packet with the indicated sequence number: the arrival time is used to measure the jitter
+  bool writePacket(uint16_t seq, const uint8_t *packet, size_t len, uint32_t arrival_ms = audioMillis()) {
+    if (slots.size() == 0) begin();
+    if (len > cfg.packet_size) {
+      LOGE("packet too big: %u", (unsigned)len);
+      return false;
+    }
+    stat.received++;
+    updateJitter(seq, arrival_ms);
+    if (!is_started) {
+      is_started = true;
+      next_seq = seq;
+    }
+    int16_t offset = seq - next_seq;
+    if (offset < 0) {
+      LOGD("late packet %u", seq);
+      stat.late++;
+      xrun_stats.late_writes++;
+      xrun_stats.dropped_bytes += len;
+      return false;
+    }
+    if (offset >= cfg.max_packets) {
+      // we are too far behind: we continue with the oldest packet which fits
+      LOGW("jitter buffer overflow");
+      stat.overflows++;
+      xrun_stats.overflows++;
+      while ((int16_t)(seq - next_seq) >= cfg.max_packets) {
+        dropSlot(next_seq);
+        next_seq++;
+      }
+    }
+    Slot &s = slot(seq);
+    if (s.valid && s.seq == seq) {
+      stat.duplicates++;
+      return false;
+    }
+    s.seq = seq;
+    s.len = len;
+    s.valid = true;
+    memcpy(slotData(seq), packet, len);
+    updateDepth();
+    if (!is_playing && stat.depth >= stat.target_depth) {
+      LOGI("jitter buffer playing with %d packets", stat.depth);
+      is_playing = true;
+    }
+    return true;
+  }
+
+  /// Adds a packet: the sequence number is taken from the header or automatically assigned
+  size_t write(const uint8_t *packet, size_t len) override {
+    if (cfg.sequence_header) {
+      if (len < 2) return 0;
+      uint16_t seq = packet[0] << 8 | packet[1];
+      return writePacket(seq, packet + 2, len - 2) ? len : 0;
+    }
+    return writePacket(write_seq++, packet, len) ? len : 0;
+  }
+
+  /// Provides the audio data in the sequence of the packets
+  size_t readBytes(uint8_t *out, size_t len) override {
+    size_t result = 0;
+    while (result < len) {
+      if (current_pos >= current_len && !nextPacket()) break;
+      size_t n = min(len - result, (size_t)(current_len - current_pos));
+      memcpy(out + result, current.data() + current_pos, n);
+      current_pos += n;
+      result += n;
+    }
+    return result;
+  }
+
+  int available() override {
+    int result = current_len - current_pos;
+    if (is_playing && stat.depth > 0) result += cfg.packet_size;
+    return result;
+  }
+
+  int availableForWrite() override { return cfg.packet_size; }
+
+  /// Provides the statistics
+  JitterBufferStats &stats() { return stat; }
+
+  /// Current target depth in packets
+  int targetDepth() { return stat.target_depth; }
+
+  /// Number of buffered packets
+  int depth() { return stat.depth; }
+
+  /// Returns true if we provide data: false while we are buffering
+  bool isPlaying() { return is_playing; }
+
+ protected:
+  struct Slot {
+    uint16_t seq = 0;
+    uint16_t len = 0;
+    bool valid = false;
+  };
+  JitterBufferConfig cfg;
+  JitterBufferStats stat;
+  Vector<uint8_t> data{0};
+  Vector<Slot> slots{0};
+  Vector<uint8_t> current{0};
+  uint16_t current_len = 0;
+  uint16_t current_pos = 0;
+  uint16_t next_seq = 0;
+  uint16_t write_seq = 0;
+  bool is_started = false;
+  bool is_playing = false;
+  int loss_count = 0;
+  float packet_ms = 1.0;
+  // jitter measurement
+  bool has_last = false;
+  uint16_t last_seq = 0;
+  uint32_t last_arrival = 0;
+
+  Slot &slot(uint16_t seq) { return slots[seq % cfg.max_packets]; }
+
+  /// Invalidates the slot and reports the bytes of a valid packet as dropped
+  void dropSlot(uint16_t seq) {
+    Slot &s = slot(seq);
+    if (s.valid && s.seq == seq) xrun_stats.dropped_bytes += s.len;
+    s.valid = false;
+  }
+
+  uint8_t *slotData(uint16_t seq) { return data.data() + (seq % cfg.max_packets) * cfg.packet_size; }
+
+  /// interarrival jitter as defined in RFC 3550: the expected distance is derived from the sequence numbers
+  void updateJitter(uint16_t seq, uint32_t arrival_ms) {
+    if (has_last) {
+      int16_t seq_diff = seq - last_seq;
+      float d = (float)(int32_t)(arrival_ms - last_arrival) - seq_diff * packet_ms;
+      if (d < 0) d = -d;
+      stat.jitter_ms += (d - stat.jitter_ms) / 16.0f;
+      int target = (stat.jitter_ms * cfg.jitter_factor + packet_ms - 1) / packet_ms;
+      if (target < cfg.min_depth) target = cfg.min_depth;
+      if (target > cfg.max_depth) target = cfg.max_depth;
+      stat.target_depth = target;
+    }
+    if (!has_last || (int16_t)(seq - last_seq) > 0) {
+      has_last = true;
+      last_seq = seq;
+      last_arrival = arrival_ms;
+    }
+  }
+
+  /// number of packets from the next sequence number to the last received packet
+  void updateDepth() {
+    int result = 0;
+    for (int j = cfg.max_packets - 1; j >= 0; j--) {
+      uint16_t seq = next_seq + j;
+      Slot &s = slot(seq);
+      if (s.valid && s.seq == seq) {
+        result = j + 1;
+        break;
+      }
+    }
+    stat.depth = result;
+  }
+
+  /// Makes the next packet current: returns false if we are buffering
+  bool nextPacket() {
+    if (!is_playing) return false;
+    if (stat.depth == 0) {
+      LOGW("jitter buffer underrun");
+      stat.underruns++;
+      xrun_stats.underflows++;
+      is_playing = false;
+      return false;
+    }
+    // reduce the latency if we have too many packets
+    if (stat.depth > stat.target_depth + cfg.max_excess) {
+      dropSlot(next_seq);
+      next_seq++;
+      stat.latency_drops++;
+    }
+    Slot &s = slot(next_seq);
+    if (s.valid && s.seq == next_seq) {
+      current_len = s.len;
+      memcpy(current.data(), slotData(next_seq), s.len);
+      s.valid = false;
+      loss_count = 0;
+      stat.played++;
+    } else {
+      conceal();
+      stat.concealed++;
+    }
+    current_pos = 0;
+    next_seq++;
+    updateDepth();
+    return true;
+  }
+
+  /// Replaces a missing packet: we repeat the last packet with a decreasing volume
+  void conceal() {
+    loss_count++;
+    if (current_len == 0) current_len = cfg.packet_size;
+    if (cfg.concealment == ConcealRepeatFade && cfg.bits_per_sample == 16 && loss_count < 4) {
+      int16_t *samples = (int16_t *)current.data();
+      int sample_count = current_len / 2;
+      for (int j = 0; j < sample_count; j++) {
+        // fade out to half of the volume over the packet
+        float factor = 1.0f - 0.5f * j / sample_count;
+        samples[j] = samples[j] * factor;
+      }
+    } else {
+      memset(current.data(), 0, current_len);
+    }
+  }
+};
+
+}  // namespace audio_tools
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include "AudioTools/Buffers.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Lock free ring buffer for exactly one producer and one consumer thread (e.g. an
+ * application thread and a real time audio callback). The memory is allocated in the
+ * constructor or with resize(), so reading and writing never allocate or block. The size is
+ * rounded up to a power of 2. Please use readArray() and writeArray() of this class, which
+ * copy the data in at most 2 blocks.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+template <typename T>
+class LockFreeRingBuffer : public BaseBuffer<T> {
+ public:
+  LockFreeRingBuffer(int size = 0) { resize(size); }
+
+  ~LockFreeRingBuffer() {
+    if (p_data != nullptr) delete[] p_data;
+  }
+
+  /// Reallocates the buffer: this must not be called while the buffer is in use
+  void resize(int size) {
+    uint32_t new_capacity = 0;
+    if (size > 0) {
+      // the highest power of 2 of an int is the limit
+      new_capacity = 1;
+      while (new_capacity < (uint32_t)size && new_capacity < 0x40000000u) new_capacity <<= 1;
+    }
+    if (new_capacity != capacity) {
+      if (p_data != nullptr) delete[] p_data;
+      p_data = new_capacity > 0 ? new T[new_capacity] : nullptr;
+      capacity = new_capacity;
+    }
+    reset();
+  }
+
+  /// Number of entries which can be stored
+  int size() { return capacity; }
+
+  T read() override {
+    T result = 0;
+    readArray(&result, 1);
+    return result;
+  }
+
+  T peek() override {
+    if (available() == 0) return 0;
+    return p_data[read_pos.load(std::memory_order_relaxed) & (capacity - 1)];
+  }
+
+  bool write(T data) override { return writeArray(&data, 1) == 1; }
+
+  /// Reads multiple values: to be called by the consumer only
+  int readArray(T data[], int len) {
+    if (capacity == 0) return 0;
+    uint32_t read = read_pos.load(std::memory_order_relaxed);
+    uint32_t available = write_pos.load(std::memory_order_acquire) - read;
+    int result = len < (int)available ? len : available;
+    if (len > 0 && result == 0 && this->is_underflow_counting) this->xrun_stats.underflows++;
+    copy(data, read, result, true);
+    read_pos.store(read + result, std::memory_order_release);
+    return result;
+  }
+
+  /// Writes multiple values: to be called by the producer only
+  int writeArray(const T data[], int len) {
+    if (capacity == 0) return 0;
+    uint32_t write = write_pos.load(std::memory_order_relaxed);
+    uint32_t space = capacity - (write - read_pos.load(std::memory_order_acquire));
+    int result = len < (int)space ? len : space;
+    if (result < len) this->xrun_stats.overflows++;
+    copy((T *)data, write, result, false);
+    write_pos.store(write + result, std::memory_order_release);
+    return result;
+  }
+
+  bool isFull() override { return availableForWrite() == 0; }
+
+  /// Clears the buffer: this must not be called while the buffer is in use
+  void reset() override {
+    read_pos.store(0);
+    write_pos.store(0);
+  }
+
+  int available() override {
+    return write_pos.load(std::memory_order_acquire) - read_pos.load(std::memory_order_acquire);
+  }
+
+  int availableForWrite() override { return capacity - available(); }
+
+  T *address() override { return p_data; }
+
+ protected:
+  T *p_data = nullptr;
+  uint32_t capacity = 0;
+  // the positions are not wrapped: the difference is the number of entries
+  std::atomic<uint32_t> read_pos{0};
+  std::atomic<uint32_t> write_pos{0};
+
+  /// copies len entries from/to the indicated position in 1 or 2 blocks
+  void copy(T *data, uint32_t pos, int len, bool isRead) {
+    uint32_t start = pos & (capacity - 1);
+    int first = capacity - start;
+    if (first > len) first = len;
+    if (isRead) {
+      memcpy(data, p_data + start, first * sizeof(T));
+      memcpy(data + first, p_data, (len - first) * sizeof(T));
+    } else {
+      memcpy(p_data + start, data, first * sizeof(T));
+      memcpy(p_data, data + first, (len - first) * sizeof(T));
+    }
+  }
+};
+
+}  // namespace audio_tools
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
+#include "AudioTools/XRunStats.h"
+#include "AudioBasic/Collections.h"
+
+namespace audio_tools {
+
+/// What happens when we write to a full PacketSendQueue
+enum PacketQueueFullPolicy {
+  /// write() only accepts the data which fits: the caller needs to retry later
+  PacketQueueReject,
+  /// the oldest packets are dropped so that the new data can be queued
+  PacketQueueDropOldest
+};
+
+/**
+ * @brief Configuration for the PacketSendQueue
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct PacketSendQueueConfig {
+  /// max size of a packet
+  uint16_t packet_size = 250;
+  /// number of preallocated packets
+  uint16_t packet_count = 16;
+  /// number of retries for a failed packet before it is dropped: -1 endless
+  int retry_count = -1;
+  /// time to wait before a failed packet is sent again
+  uint16_t retry_delay_ms = 0;
+  /// if true we wait for sendComplete(), otherwise the result of the transport is final
+  bool use_send_ack = true;
+  PacketQueueFullPolicy full_policy = PacketQueueReject;
+};
+
+/**
+ * @brief Statistics of the PacketSendQueue
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct PacketSendQueueStats {
+  uint32_t sent = 0;
+  uint32_t failed = 0;
+  uint32_t dropped = 0;
+  uint32_t overflows = 0;
+};
+
+/**
+ * @brief Queue of preallocated packets which decouples the writing of data from an
+ * asynchronous transport (e.g. ESP-NOW): write() never waits. We send one packet
+ * at a time and the next packet is sent from sendComplete(), which is called by the
+ * send-complete callback of the transport. The available space is reported by
+ * availableForWrite(). Failed packets are retried or dropped according to the
+ * configuration. The queue is not thread safe: if sendComplete() is called from a
+ * different task, the caller needs to lock the access.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class PacketSendQueue : public XRunSource {
+ public:
+  /// Sends a packet: returns false if the packet could not be submitted
+  typedef bool (*SendCallback)(const uint8_t *data, size_t len, void *ref);
+
+  PacketSendQueue() = default;
+
+  PacketSendQueueConfig defaultConfig() {
+    PacketSendQueueConfig c;
+    return c;
+  }
+
+  /// Defines the transport
+  void setTransport(SendCallback cb, void *ref = nullptr) {
+    p_send = cb;
+    p_ref = ref;
+  }
+
+  bool begin(PacketSendQueueConfig config) {
+    cfg = config;
+    if (cfg.packet_size == 0 || cfg.packet_count == 0) {
+      LOGE("invalid packet size or count");
+      return false;
+    }
+    data.resize(cfg.packet_size * cfg.packet_count);
+    lens.resize(cfg.packet_count);
+    sending.resize(cfg.packet_size);
+    clear();
+    stat = PacketSendQueueStats();
+    return true;
+  }
+
+  /// Removes all queued packets
+  void clear() {
+    head = 0;
+    tail = 0;
+    count = 0;
+    retries = 0;
+    has_pending = false;
+    is_sending = false;
+  }
+
+  /// Splits the data into packets and adds them to the queue: returns the number of accepted bytes
+  size_t write(const uint8_t *in, size_t len) {
+    if (lens.size() == 0) return 0;
+    size_t result = 0;
+    while (result < len) {
+      // an idle transport takes over the oldest packet
+      if (count == cfg.packet_count) update();
+      if (count == cfg.packet_count) {
+        xrun_stats.overflows++;
+        if (cfg.full_policy != PacketQueueDropOldest) break;
+        xrun_stats.dropped_bytes += lens[tail];
+        tail = next(tail);
+        count--;
+        stat.overflows++;
+      }
+      size_t n = min(len - result, (size_t)cfg.packet_size);
+      memcpy(packet(head), in + result, n);
+      lens[head] = n;
+      head = next(head);
+      count++;
+      result += n;
+    }
+    update();
+    return result;
+  }
+
+  /// Number of bytes which can be written without loosing data
+  int availableForWrite() { return (cfg.packet_count - count) * cfg.packet_size; }
+
+  /// To be called by the send-complete callback of the transport
+  void sendComplete(bool ok) {
+    if (!is_sending) return;
+    result(ok);
+    if (ok || cfg.retry_delay_ms == 0) {
+      update();
+    }
+  }
+
+  /// Starts the sending of the next packet if we are idle: e.g. to retry after a failure
+  void update() {
+    while (!is_sending && p_send != nullptr) {
+      if (!has_pending) {
+        if (count == 0) return;
+        // the packet is copied so that the queue stays usable while it is in flight
+        sending_len = lens[tail];
+        memcpy(sending.data(), packet(tail), sending_len);
+        tail = next(tail);
+        count--;
+        has_pending = true;
+        retries = 0;
+      } else if ((int32_t)(audioMillis() - retry_time) < 0) {
+        return;
+      }
+      is_sending = true;
+      if (!p_send(sending.data(), sending_len, p_ref)) {
+        result(false);
+        return;
+      }
+      if (!cfg.use_send_ack) result(true);
+    }
+  }
+
+  /// Number of queued packets (w/o the packet in flight)
+  int queued() { return count; }
+
+  /// Returns true if all data has been sent
+  bool isEmpty() { return count == 0 && !has_pending; }
+
+  /// Returns true if we wait for the confirmation of a packet
+  bool isSending() { return is_sending; }
+
+  PacketSendQueueStats &stats() { return stat; }
+
+ protected:
+  PacketSendQueueConfig cfg;
+  PacketSendQueueStats stat;
+  SendCallback p_send = nullptr;
+  void *p_ref = nullptr;
+  Vector<uint8_t> data{0};
+  Vector<uint16_t> lens{0};
+  Vector<uint8_t> sending{0};
+  uint16_t sending_len = 0;
+  int head = 0;
+  int tail = 0;
+  int count = 0;
+  int retries = 0;
+  uint32_t retry_time = 0;
+  bool has_pending = false;
+  volatile bool is_sending = false;
+
+  int next(int pos) { return (pos + 1) % cfg.packet_count; }
+
+  uint8_t *packet(int pos) { return data.data() + pos * cfg.packet_size; }
+
+  /// Processes the result of the packet in flight
+  void result(bool ok) {
+    is_sending = false;
+    if (ok) {
+      stat.sent++;
+      has_pending = false;
+      return;
+    }
+    stat.failed++;
+    retry_time = audioMillis() + cfg.retry_delay_ms;
+    if (cfg.retry_count >= 0 && retries >= cfg.retry_count) {
+      LOGE("Write error after %d retries: packet dropped", retries);
+      stat.dropped++;
+      xrun_stats.dropped_bytes += sending_len;
+      has_pending = false;
+    } else {
+      LOGW("Write failed - retrying again");
+      retries++;
+    }
+  }
+};
+
+}  // namespace audio_tools
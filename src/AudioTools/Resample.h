@@ -455,7 +455,7 @@ struct ResampleConfig : public AudioBaseInfo {
  * @tparam T data type of audio data
  */
 template<typename T>
-class ResampleStream : public AudioStreamX {
+class ResampleStream : public AudioStreamX, public TimestampForwarder {
     public:
         /**
          * @brief Construct a new Resample Stream object which supports resampling
@@ -568,6 +568,12 @@ class ResampleStream : public AudioStreamX {
             return factor;
         }
 
+        /// Forwards the timestamp with the frame position converted to the target sample rate
+        void setTimestamp(AudioTimestamp ts) override {
+            ts.frame = ts.frame * timestampRatio();
+            forwardTimestamp(ts);
+        }
+
     protected:
         ResampleConfig cfg;
         ResampleParameterEstimator calc;
@@ -576,6 +582,14 @@ class ResampleStream : public AudioStreamX {
         ResamplePrecision precision;
         float factor;
 
+        /// Ratio of the output frames to the input frames
+        double timestampRatio() {
+            if (cfg.skip_every_nth!=0){
+                return static_cast<double>(cfg.skip_every_nth-1) / cfg.skip_every_nth;
+            }
+            return cfg.sample_rate_from>0 ? static_cast<double>(cfg.sample_rate) / cfg.sample_rate_from : 1.0;
+        }
+
 };
 
 /**
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+#include "AudioTools/AudioClock.h"
+#include "AudioTools/AudioTypes.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Configure Throttle setting
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct ThrottleConfig : public AudioBaseInfo {
+  ThrottleConfig() {
+    sample_rate = 44100;
+    bits_per_sample = 16;
+    channels = 2;
+  }
+  /// constant offset which is added to all deadlines
+  int correction_ms = 0;
+  /// if we are late by more then this we do not try to catch up but restart the timing
+  uint32_t max_late_us = 500000;
+};
+
+/**
+ * @brief Throttle the sending of the audio data to limit it to the indicated
+ * sample rate. We use a monotonic microsecond clock and calculate the deadline
+ * from the total number of samples since the start, so that the rounding errors
+ * do not accumulate. Waits which are shorter then a millisecond are done with
+ * delayMicroseconds(). The drift (how late we are after the wait) and the
+ * jitter are reported. The time is provided by the AudioClock: with the virtual
+ * time the throttle just advances the clock.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class Throttle {
+ public:
+  Throttle() = default;
+
+  ThrottleConfig defaultConfig() {
+    ThrottleConfig c;
+    return c;
+  }
+
+  void begin(ThrottleConfig info) {
+    this->info = info;
+    bytesPerSample = info.bits_per_sample / 8 * info.channels;
+    reset();
+  }
+
+  /// Restarts the timing with the next call of startDelay()
+  void reset() {
+    is_started = false;
+    total_samples = 0;
+    drift_us = 0;
+    jitter_us = 0;
+    max_drift_us = 0;
+  }
+
+  /// starts the timing: subsequent calls are ignored because we track the cumulative deadline
+  void startDelay() {
+    if (!is_started) {
+      last_micros = audioMicros();
+      now_us = 0;
+      start_us = 0;
+      total_samples = 0;
+      is_started = true;
+    }
+  }
+
+  // delay
+  void delayBytes(size_t bytes) { delaySamples(bytes / bytesPerSample); }
+
+  /// waits until the indicated number of additional samples is due
+  void delaySamples(size_t samples) {
+    startDelay();
+    total_samples += samples;
+    int64_t wait_us = deadline() - clock();
+    if (wait_us < -(int64_t)info.max_late_us) {
+      // we can not catch up: e.g. because the source stalled
+      LOGW("Throttle is late by %ld us: restarting", (long)-wait_us);
+      start_us = now_us;
+      total_samples = 0;
+      return;
+    }
+    if (wait_us > 0) {
+      sleep(wait_us);
+    }
+    updateStatistics(clock() - deadline());
+  }
+
+  /// Difference between the actual time and the deadline after the last wait in us (positive if we are late)
+  int32_t driftUs() { return drift_us; }
+
+  /// Smoothed absolute drift in us
+  float jitterUs() { return jitter_us; }
+
+  /// Max drift in us
+  int32_t maxDriftUs() { return max_drift_us; }
+
+  /// Number of samples since the start of the timing
+  uint64_t samples() { return total_samples; }
+
+ protected:
+  ThrottleConfig info;
+  int bytesPerSample = 4;
+  bool is_started = false;
+  uint32_t last_micros = 0;
+  int64_t now_us = 0;
+  int64_t start_us = 0;
+  uint64_t total_samples = 0;
+  int32_t drift_us = 0;
+  int32_t max_drift_us = 0;
+  float jitter_us = 0;
+
+  /// monotonic 64 bit microsecond clock: the overflow of audioMicros() is handled
+  int64_t clock() {
+    uint32_t us = audioMicros();
+    now_us += (uint32_t)(us - last_micros);
+    last_micros = us;
+    return now_us;
+  }
+
+  /// time when all samples should have been provided
+  int64_t deadline() {
+    return start_us + (int64_t)(total_samples * 1000000ull / info.sample_rate) + info.correction_ms * 1000ll;
+  }
+
+  void sleep(int64_t us) {
+    if (us >= 2000) {
+      audioDelay(us / 1000 - 1);
+      us = deadline() - clock();
+    }
+    if (us > 0) {
+      audioDelayMicroseconds(us);
+    }
+  }
+
+  void updateStatistics(int64_t late_us) {
+    drift_us = late_us;
+    if (drift_us > max_drift_us) max_drift_us = drift_us;
+    float abs_drift = drift_us < 0 ? -drift_us : drift_us;
+    jitter_us += (abs_drift - jitter_us) / 16.0f;
+  }
+};
+
+}  // namespace audio_tools
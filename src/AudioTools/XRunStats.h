@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "AudioTools/AudioLogger.h"
+
+namespace audio_tools {
+
+/**
+ * @brief Common xrun counters of buffers, sources and sinks:
+ * - underflows: the consumer requested data but nothing was available
+ * - overflows: the producer could not store (all) the data
+ * - dropped_bytes: bytes which were lost because they were discarded
+ * - late_writes: writes to an output which arrived after it had already run empty
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+struct XRunStats {
+  uint32_t underflows = 0;
+  uint32_t overflows = 0;
+  uint32_t dropped_bytes = 0;
+  uint32_t late_writes = 0;
+
+  /// Number of xrun events
+  uint32_t xruns() { return underflows + overflows + late_writes; }
+
+  void reset() {
+    underflows = 0;
+    overflows = 0;
+    dropped_bytes = 0;
+    late_writes = 0;
+  }
+
+  XRunStats &operator+=(const XRunStats &other) {
+    underflows += other.underflows;
+    overflows += other.overflows;
+    dropped_bytes += other.dropped_bytes;
+    late_writes += other.late_writes;
+    return *this;
+  }
+};
+
+/**
+ * @brief Interface of all classes which report xruns: by default the counters of
+ * xrun_stats are reported. Classes which already have their own statistics can
+ * override xrunStats() to map them.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class XRunSource {
+ public:
+  virtual ~XRunSource() = default;
+
+  /// Provides the xrun counters
+  virtual XRunStats xrunStats() { return xrun_stats; }
+
+  /// Clears the xrun counters
+  virtual void resetXRunStats() { xrun_stats.reset(); }
+
+ protected:
+  XRunStats xrun_stats;
+};
+
+/**
+ * @brief Estimates the fill level of an output (e.g. the DMA buffers of I2S) which is
+ * consumed with the sample rate, because the hardware does not report underruns: a write
+ * which arrives after the buffered data has been played is reported as late.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class LateWriteDetector {
+ public:
+  /// Defines the data rate and the size of the buffer of the output
+  void begin(uint32_t bytesPerSecond, uint32_t capacityBytes) {
+    bytes_per_second = bytesPerSecond;
+    capacity = capacityBytes;
+    level = 0;
+    is_active = false;
+  }
+
+  /// Stops the estimate: the next write starts a new one
+  void end() { is_active = false; }
+
+  /// Records the written bytes: returns true if the output has run empty since the last write
+  bool write(size_t bytes) {
+    if (bytes_per_second == 0 || bytes == 0) return false;
+    uint32_t now = micros();
+    bool result = false;
+    if (is_active) {
+      uint64_t consumed = (uint64_t)(now - last_us) * bytes_per_second / 1000000;
+      if (consumed > level) {
+        result = true;
+        level = 0;
+      } else {
+        level -= consumed;
+      }
+    }
+    level += bytes;
+    // a blocking write returns when the data fits into the buffer
+    if (capacity > 0 && level > capacity) level = capacity;
+    last_us = now;
+    is_active = true;
+    return result;
+  }
+
+  /// Estimated number of buffered bytes at the last write
+  uint32_t bufferedBytes() { return level; }
+
+ protected:
+  uint32_t bytes_per_second = 0;
+  uint32_t capacity = 0;
+  uint32_t level = 0;
+  uint32_t last_us = 0;
+  bool is_active = false;
+};
+
+/**
+ * @brief Registry of named xrun sources, so that the xruns of a whole pipeline can be
+ * checked and printed with one call: e.g. at the end of a soak test.
+ * @author Phil Schatzmann
+ * @copyright GPLv3
+ */
+class XRunRegistry {
+ public:
+  static XRunRegistry &instance() {
+    static XRunRegistry registry;
+    return registry;
+  }
+
+  /// Registers a source with a name which is used in the report
+  bool add(XRunSource &source, const char *name) {
+    if (source_count >= XRUN_REGISTRY_MAX_SOURCES) {
+      LOGE("Too many xrun sources: %d", source_count);
+      return false;
+    }
+    sources[source_count] = &source;
+    names[source_count] = name;
+    source_count++;
+    return true;
+  }
+
+  /// Removes a source
+  void remove(XRunSource &source) {
+    for (int j = 0; j < source_count; j++) {
+      if (sources[j] == &source) {
+        source_count--;
+        sources[j] = sources[source_count];
+        names[j] = names[source_count];
+        return;
+      }
+    }
+  }
+
+  /// Removes all sources
+  void clear() { source_count = 0; }
+
+  int sourceCount() { return source_count; }
+
+  XRunSource &source(int idx) { return *sources[idx]; }
+
+  const char *name(int idx) { return names[idx]; }
+
+  /// Sum of the counters of all sources
+  XRunStats total() {
+    XRunStats result;
+    for (int j = 0; j < source_count; j++) {
+      result += sources[j]->xrunStats();
+    }
+    return result;
+  }
+
+  /// Returns true if any source has reported an xrun
+  bool hasXRuns() { return total().xruns() > 0; }
+
+  /// Clears the counters of all sources
+  void reset() {
+    for (int j = 0; j < source_count; j++) {
+      sources[j]->resetXRunStats();
+    }
+  }
+
+  /// Prints a line per source and the total
+  void printTo(Print &out) {
+    for (int j = 0; j < source_count; j++) {
+      printLine(out, names[j], sources[j]->xrunStats());
+    }
+    printLine(out, "total", total());
+  }
+
+ protected:
+  XRunSource *sources[XRUN_REGISTRY_MAX_SOURCES];
+  const char *names[XRUN_REGISTRY_MAX_SOURCES];
+  int source_count = 0;
+
+  XRunRegistry() = default;
+
+  void printLine(Print &out, const char *name, XRunStats stats) {
+    char msg[120];
+    snprintf(msg, sizeof(msg), "%s: underflows=%lu overflows=%lu dropped_bytes=%lu late_writes=%lu", name,
+             (unsigned long)stats.underflows, (unsigned long)stats.overflows,
+             (unsigned long)stats.dropped_bytes, (unsigned long)stats.late_writes);
+    out.println(msg);
+  }
+};
+
+}  // namespace audio_tools
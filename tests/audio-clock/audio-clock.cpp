@@ -0,0 +1,85 @@
+// Tests the virtual time of the AudioClock: delays and throttled pipelines run without waiting
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+AudioClock &audio_clock = AudioClock::instance();
+uint64_t custom_us = 0;
+uint64_t customNow() { return custom_us; }
+void customSleep(uint64_t us) { custom_us += us * 2; }
+
+void testVirtual() {
+  audio_clock.setVirtual(true, 1000);
+  assert(audio_clock.isVirtual());
+  assert(audioMicros() == 1000);
+  unsigned long start = millis();
+  audioDelay(5000);
+  audioDelayMicroseconds(10);
+  assert(audio_clock.timeUs() == 5001010);
+  assert(audioMillis() == 5001);
+  audio_clock.advanceUs(990);
+  assert(audio_clock.timeMs() == 5002);
+  // no real waiting
+  assert(millis() - start < 100);
+}
+
+void testThrottle() {
+  // 60 seconds of audio are rendered without any real delay
+  audio_clock.setVirtual(true);
+  Throttle throttle;
+  auto cfg = throttle.defaultConfig();
+  throttle.begin(cfg);
+  unsigned long start = millis();
+  for (int j = 0; j < 44100 * 60 / 441; j++) {
+    throttle.startDelay();
+    throttle.delayBytes(441 * 4);
+  }
+  assert(millis() - start < 1000);
+  assert(audio_clock.timeUs() == 60000000);
+  // the result is deterministic
+  assert(throttle.driftUs() == 0);
+}
+
+// output which accepts everything
+class Sink : public AudioStreamX {
+ public:
+  size_t write(const uint8_t *data, size_t len) override { return len; }
+  int availableForWrite() override { return 1024; }
+};
+
+void testStreamCopy() {
+  // retry delays advance the virtual time
+  audio_clock.setVirtual(true);
+  RingBufferStream empty(100);
+  Sink out;
+  StreamCopy copier(out, empty);
+  copier.setDelayOnNoData(10);
+  for (int j = 0; j < 100; j++) copier.copy();
+  assert(audioMillis() == 1000);
+}
+
+void testTimeSource() {
+  audio_clock.setVirtual(false);
+  audio_clock.setTimeSource(customNow, customSleep);
+  assert(audioMicros() == 0);
+  audioDelay(1);
+  assert(audioMicros() == 2000);
+  audio_clock.setTimeSource(nullptr, nullptr);
+  // real time
+  uint64_t start = audio_clock.timeUs();
+  audioDelay(5);
+  assert(audio_clock.timeUs() - start >= 5000);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testVirtual();
+  testThrottle();
+  testStreamCopy();
+  testTimeSource();
+  Serial.println("AudioClock ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,160 @@
+// Tests the AudioSyncWriter and AudioSyncReader over a loopback connection with an artificial
+// latency: the sliding window must provide a much better throughput then stop and wait
+#include <deque>
+#include <string>
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioTools/AudioSync.h"
+#include "AudioCodecs/CodecCopy.h"
+
+using namespace audio_tools;
+
+uint32_t tick = 0;
+const uint32_t latency = 10;
+
+/// Data which becomes visible after the latency
+struct DelayPipe {
+  std::deque<std::pair<uint32_t, uint8_t>> data;
+  int available() {
+    int result = 0;
+    for (auto &entry : data) {
+      if (entry.first > tick) break;
+      result++;
+    }
+    return result;
+  }
+};
+
+/// One end of the loopback connection
+class LoopbackStream : public Stream {
+ public:
+  LoopbackStream(DelayPipe &in, DelayPipe &out) : in(in), out(out) {}
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t j = 0; j < len; j++) out.data.push_back({tick + latency, buf[j]});
+    return len;
+  }
+  int available() override { return in.available(); }
+  size_t readBytes(uint8_t *buf, size_t len) override {
+    size_t n = min(len, (size_t)available());
+    for (size_t j = 0; j < n; j++) {
+      buf[j] = in.data.front().second;
+      in.data.pop_front();
+    }
+    return n;
+  }
+  int read() override {
+    uint8_t ch;
+    return readBytes(&ch, 1) == 1 ? ch : -1;
+  }
+  int peek() override { return -1; }
+
+ protected:
+  DelayPipe &in;
+  DelayPipe &out;
+};
+
+/// Collects the received audio
+class MemoryOutput : public Print {
+ public:
+  std::string data;
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *buf, size_t len) override {
+    data.append((const char *)buf, len);
+    return len;
+  }
+};
+
+/// Transmits the data and returns the number of ticks
+uint32_t transmit(uint32_t window_size) {
+  DelayPipe to_reader, to_writer;
+  LoopbackStream writer_end(to_writer, to_reader);
+  LoopbackStream reader_end(to_reader, to_writer);
+  MemoryOutput out;
+  CopyDecoder copy;
+  EncodedAudioStream decoded(&out, &copy);
+
+  AudioSyncWriter writer(writer_end);
+  writer.setBlockSize(1024);
+  writer.setBlocking(false);
+  AudioSyncReader reader(reader_end, decoded);
+  reader.setWindowSize(window_size);
+
+  std::string audio;
+  for (int j = 0; j < 64 * 1024; j++) audio += (char)random(256);
+
+  tick = 0;
+  AudioBaseInfo info;
+  info.sample_rate = 44100;
+  info.channels = 2;
+  writer.begin(info, PCM);
+  size_t sent = 0;
+  while (out.data.size() < audio.size()) {
+    if (sent < audio.size()) {
+      sent += writer.write((const uint8_t *)audio.data() + sent, audio.size() - sent);
+    }
+    reader.copy();
+    tick++;
+    assert(tick < 100000);
+  }
+  writer.end();
+  assert(out.data == audio);
+  return tick;
+}
+
+void testSendBeforeBegin() {
+  // the reader missed the Begin record: the data is processed nevertheless
+  DelayPipe to_reader, to_writer;
+  LoopbackStream writer_end(to_writer, to_reader);
+  LoopbackStream reader_end(to_reader, to_writer);
+  MemoryOutput out;
+  CopyDecoder copy;
+  EncodedAudioStream decoded(&out, &copy);
+  decoded.begin();
+  AudioSyncReader reader(reader_end, decoded);
+  AudioSendData send;
+  send.size = 100;
+  uint8_t audio[100];
+  for (int j = 0; j < 100; j++) audio[j] = j;
+  tick = 0;
+  writer_end.write((const uint8_t *)&send, sizeof(send));
+  writer_end.write(audio, sizeof(audio));
+  for (; tick < 2 * latency; tick++) reader.copy();
+  assert(out.data == std::string((const char *)audio, sizeof(audio)));
+}
+
+void testStaleCredit() {
+  // a credit of the previous session is not used after begin()
+  DelayPipe to_reader, to_writer;
+  LoopbackStream writer_end(to_writer, to_reader);
+  LoopbackStream reader_end(to_reader, to_writer);
+  AudioSyncWriter writer(writer_end);
+  writer.setBlocking(false);
+  AudioConfirmDataToReceive credit;
+  credit.limit = 5000;
+  tick = 0;
+  reader_end.write((const uint8_t *)&credit, sizeof(credit));
+  tick = latency;
+  AudioBaseInfo info;
+  writer.begin(info, PCM);
+  assert(writer.availableForWrite() == 0);
+  assert(writer.write((const uint8_t *)"abc", 3) == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  // with a window of one block we need to wait for a round trip for each block
+  uint32_t stop_and_wait = transmit(1024);
+  uint32_t window = transmit(8 * 1024);
+  Serial.print("Ticks stop and wait: ");
+  Serial.print(stop_and_wait);
+  Serial.print(" window: ");
+  Serial.println(window);
+  assert(window * 4 < stop_and_wait);
+  testSendBeforeBegin();
+  testStaleCredit();
+  Serial.println("Audio sync ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,297 @@
+// Micro benchmarks of the core primitives: each case is warmed up and repeated and we report the min and
+// median time per sample. The results are written as CSV to BENCHMARK_OUTPUT (default benchmark.csv).
+// If BENCHMARK_BASELINE names the CSV of a previous run, the medians are compared and cases which are
+// slower than BENCHMARK_THRESHOLD percent (default 10) are reported as regression and the program
+// exits with 1. BENCHMARK_FILTER restricts the cases to the names which contain the indicated text.
+#include <algorithm>
+#include <stdarg.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioLibs/AudioRealFFT.h"
+
+using namespace audio_tools;
+
+const int WARMUP = 3;
+const int REPETITIONS = 15;
+// each repetition runs the case repeatedly for at least this time
+const uint32_t MIN_REPETITION_NS = 2000000;
+
+struct BenchmarkResult {
+  std::string name;
+  size_t samples = 0;
+  uint32_t iterations = 0;
+  double min_ns = 0;
+  double median_ns = 0;
+  double samplesPerSecond() { return median_ns > 0 ? 1.0e9 / median_ns : 0; }
+};
+
+std::vector<BenchmarkResult> results;
+const char *filter = getenv("BENCHMARK_FILTER");
+
+void report(const char *fmt, ...) {
+  char msg[160];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, args);
+  va_end(args);
+  Serial.print(msg);
+}
+
+uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t timeNs(std::function<void()> &fn, uint32_t iterations) {
+  uint64_t start = nowNs();
+  for (uint32_t j = 0; j < iterations; j++) fn();
+  return nowNs() - start;
+}
+
+/// Measures the case which processes the indicated number of samples per call
+void benchmark(const char *name, size_t samples, std::function<void()> fn) {
+  if (filter != nullptr && strstr(name, filter) == nullptr) return;
+  // determine the iterations per repetition (this also warms up the caches)
+  uint32_t iterations = 1;
+  while (timeNs(fn, iterations) < MIN_REPETITION_NS) iterations *= 2;
+  for (int j = 0; j < WARMUP; j++) timeNs(fn, iterations);
+
+  std::vector<double> ns_per_sample;
+  for (int j = 0; j < REPETITIONS; j++) {
+    ns_per_sample.push_back((double)timeNs(fn, iterations) / iterations / samples);
+  }
+  std::sort(ns_per_sample.begin(), ns_per_sample.end());
+
+  BenchmarkResult result;
+  result.name = name;
+  result.samples = samples;
+  result.iterations = iterations;
+  result.min_ns = ns_per_sample[0];
+  result.median_ns = ns_per_sample[REPETITIONS / 2];
+  results.push_back(result);
+  report("%-28s min %8.3f ns/sample  median %8.3f ns/sample  %9.2f Msamples/s\n", name, result.min_ns,
+                result.median_ns, result.samplesPerSecond() / 1.0e6);
+}
+
+void writeCSV(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    report("Could not write %s\n", path);
+    return;
+  }
+  fprintf(file, "name,samples,iterations,repetitions,min_ns_per_sample,median_ns_per_sample,samples_per_second\n");
+  for (auto &r : results) {
+    fprintf(file, "%s,%u,%u,%d,%.4f,%.4f,%.0f\n", r.name.c_str(), (unsigned)r.samples, (unsigned)r.iterations,
+            REPETITIONS, r.min_ns, r.median_ns, r.samplesPerSecond());
+  }
+  fclose(file);
+  report("Results written to %s\n", path);
+}
+
+/// Compares the medians with the baseline: returns the number of regressions
+int compare(const char *path, double threshold_percent) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    report("Could not read baseline %s\n", path);
+    return 0;
+  }
+  int regressions = 0;
+  char line[200];
+  // skip header
+  if (fgets(line, sizeof(line), file) == nullptr) line[0] = 0;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    char name[80];
+    unsigned samples, iterations;
+    int repetitions;
+    double min_ns, median_ns;
+    if (sscanf(line, "%79[^,],%u,%u,%d,%lf,%lf", name, &samples, &iterations, &repetitions, &min_ns, &median_ns) != 6)
+      continue;
+    for (auto &r : results) {
+      if (r.name != name || median_ns <= 0) continue;
+      double change = (r.median_ns - median_ns) * 100.0 / median_ns;
+      bool is_regression = change > threshold_percent;
+      if (is_regression) regressions++;
+      report("%-28s %8.3f -> %8.3f ns/sample %+7.1f%%%s\n", name, median_ns, r.median_ns, change,
+                    is_regression ? "  REGRESSION" : "");
+    }
+  }
+  fclose(file);
+  return regressions;
+}
+
+// test data: 1024 stereo frames
+const int FRAMES = 1024;
+const int SAMPLES = FRAMES * 2;
+int16_t pcm[SAMPLES];
+int16_t out[SAMPLES * 2];
+int32_t pcm32[SAMPLES];
+uint8_t pcm8[SAMPLES];
+float values[SAMPLES];
+volatile float sink;
+NullStream null_out;
+
+void benchmarkBuffers() {
+  RingBuffer<int16_t> ring(SAMPLES);
+  benchmark("RingBuffer", SAMPLES, [&]() {
+    ring.writeArray(pcm, SAMPLES);
+    ring.readArray(out, SAMPLES);
+  });
+
+  // readArray() provides the data of one buffer at a time
+  NBuffer<int16_t> nbuffer(256, 16);
+  benchmark("NBuffer", SAMPLES, [&]() {
+    nbuffer.writeArray(pcm, SAMPLES);
+    int len = 0;
+    while (len < SAMPLES) {
+      int n = nbuffer.readArray(out + len, SAMPLES - len);
+      if (n == 0) break;
+      len += n;
+    }
+  });
+}
+
+void benchmarkConverters() {
+  benchmark("NumberConverter 32->16", SAMPLES, [&]() {
+    for (int j = 0; j < SAMPLES; j++) out[j] = NumberConverter::convertFrom32To16(pcm32[j]);
+  });
+
+  ChannelConverter<int16_t> reduce(1, 2);
+  benchmark("ChannelConverter 2->1", SAMPLES,
+            [&]() { reduce.convert((uint8_t *)out, (uint8_t *)pcm, sizeof(pcm)); });
+
+  ChannelConverter<int16_t> enhance(2, 1);
+  benchmark("ChannelConverter 1->2", SAMPLES,
+            [&]() { enhance.convert((uint8_t *)out, (uint8_t *)pcm, sizeof(pcm)); });
+}
+
+void benchmarkStreams() {
+  AudioBaseInfo info;
+  info.sample_rate = 44100;
+  info.channels = 2;
+  info.bits_per_sample = 16;
+
+  VolumeStream volume(null_out);
+  volume.begin(info);
+  volume.setVolume(0.5);
+  benchmark("VolumeStream", SAMPLES, [&]() { volume.write((uint8_t *)pcm, sizeof(pcm)); });
+
+  Resample<int16_t> upsample;
+  upsample.begin(null_out, 2, 2, UPSAMPLE);
+  benchmark("Resample up x2", SAMPLES, [&]() { upsample.write((uint8_t *)pcm, sizeof(pcm)); });
+
+  Resample<int16_t> downsample;
+  downsample.begin(null_out, 2, 2, DOWNSAMPLE);
+  benchmark("Resample down x2", SAMPLES, [&]() { downsample.write((uint8_t *)pcm, sizeof(pcm)); });
+
+  OutputMixer<int16_t> mixer(null_out, 2);
+  mixer.begin(sizeof(pcm));
+  benchmark("OutputMixer 2 inputs", SAMPLES, [&]() {
+    mixer.write((uint8_t *)pcm, sizeof(pcm));
+    mixer.write((uint8_t *)pcm, sizeof(pcm));
+  });
+}
+
+void benchmarkFilters() {
+  const float fir_coeff[32] = {0.01f, 0.02f, 0.03f, 0.04f, 0.05f, 0.06f, 0.07f, 0.08f, 0.08f, 0.07f, 0.06f,
+                               0.05f, 0.04f, 0.03f, 0.02f, 0.01f, 0.01f, 0.02f, 0.03f, 0.04f, 0.05f, 0.06f,
+                               0.07f, 0.08f, 0.08f, 0.07f, 0.06f, 0.05f, 0.04f, 0.03f, 0.02f, 0.01f};
+  FIR<float> fir(fir_coeff);
+  benchmark("FIR float 32 taps", SAMPLES, [&]() {
+    float result = 0;
+    for (int j = 0; j < SAMPLES; j++) result += fir.process(values[j]);
+    sink = result;
+  });
+
+  const float b[3] = {0.0675f, 0.1349f, 0.0675f};
+  const float a[3] = {1.0f, -1.1430f, 0.4128f};
+  IIR<float> iir(b, a);
+  benchmark("IIR float 2nd order", SAMPLES, [&]() {
+    float result = 0;
+    for (int j = 0; j < SAMPLES; j++) result += iir.process(values[j]);
+    sink = result;
+  });
+
+  AudioRealFFT fft;
+  AudioFFTConfig cfg;
+  cfg.length = 1024;
+  fft.begin(cfg);
+  benchmark("AudioRealFFT 1024", SAMPLES, [&]() { fft.write((uint8_t *)pcm, sizeof(pcm)); });
+}
+
+// collects the WAV header
+struct HeaderPrint : public Print {
+  uint8_t data[100];
+  size_t len = 0;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *in, size_t size) override {
+    size = min(size, sizeof(data) - len);
+    memcpy(data + len, in, size);
+    len += size;
+    return size;
+  }
+};
+
+void benchmarkCodecs() {
+  WAVEncoder wav_encoder;
+  WAVAudioInfo wav_info = wav_encoder.defaultConfig();
+  wav_info.is_streamed = true;
+  wav_encoder.setOutputStream(null_out);
+  wav_encoder.begin(wav_info);
+  benchmark("WAVEncoder", SAMPLES, [&]() { wav_encoder.write(pcm, sizeof(pcm)); });
+
+  // the header is processed once: afterwards the decoder just forwards the data
+  HeaderPrint header;
+  wav_encoder.writeHeader(&header);
+  WAVDecoder wav_decoder(null_out);
+  wav_decoder.begin();
+  wav_decoder.write(header.data, header.len);
+  benchmark("WAVDecoder", SAMPLES, [&]() { wav_decoder.write(pcm, sizeof(pcm)); });
+
+  Encoder8Bit encoder8;
+  encoder8.begin(null_out);
+  benchmark("Encoder8Bit", SAMPLES, [&]() { encoder8.write(pcm, sizeof(pcm)); });
+
+  Decoder8Bit decoder8;
+  decoder8.setOutputStream(null_out);
+  AudioBaseInfo info;
+  info.channels = 2;
+  info.bits_per_sample = 16;
+  decoder8.begin(info);
+  benchmark("Decoder8Bit", SAMPLES, [&]() { decoder8.write(pcm8, sizeof(pcm8)); });
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  for (int j = 0; j < SAMPLES; j++) {
+    pcm[j] = sin(j * 0.05) * 16000;
+    pcm32[j] = (int32_t)pcm[j] << 16;
+    pcm8[j] = pcm[j] >> 8;
+    values[j] = pcm[j] / 32768.0f;
+  }
+
+  benchmarkBuffers();
+  benchmarkConverters();
+  benchmarkStreams();
+  benchmarkFilters();
+  benchmarkCodecs();
+
+  const char *output = getenv("BENCHMARK_OUTPUT");
+  writeCSV(output != nullptr ? output : "benchmark.csv");
+
+  const char *baseline = getenv("BENCHMARK_BASELINE");
+  if (baseline != nullptr) {
+    const char *threshold = getenv("BENCHMARK_THRESHOLD");
+    int regressions = compare(baseline, threshold != nullptr ? atof(threshold) : 10.0);
+    if (regressions > 0) {
+      report("%d regressions\n", regressions);
+      exit(1);
+    }
+  }
+  Serial.println("Benchmark ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,133 @@
+// Tests the BroadcastOutput with in memory clients: a fast client must get all frames, a slow client must
+// be skipped ahead to a frame boundary and late clients must start with the header and a full frame
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Mock Client which stores the received data and accepts only a limited number of bytes per update
+class MemoryClient : public Client {
+ public:
+  std::string rx;
+  int capacity = 100000;
+  bool is_connected = true;
+
+  int connect(IPAddress ip, uint16_t port) override { return 1; }
+  int connect(const char *host, uint16_t port) override { return 1; }
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *buf, size_t size) override {
+    size_t n = min(size, (size_t)capacity);
+    rx.append((const char *)buf, n);
+    capacity -= n;
+    return n;
+  }
+  int availableForWrite() override { return capacity; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t *buf, size_t size) override { return 0; }
+  int peek() override { return -1; }
+  void flush() override {}
+  void stop() override { is_connected = false; }
+  uint8_t connected() override { return is_connected; }
+  operator bool() override { return is_connected; }
+};
+
+const char *header = "HDR!";
+int frame_idx = 0;
+
+/// frame: 0xFF, index, length (2 bytes) followed by the payload
+void writeFrame(Print &out) {
+  uint8_t frame[300];
+  int len = random(10, 300);
+  frame[0] = 0xFF;
+  frame[1] = frame_idx & 0x7F;
+  frame[2] = len & 0xFF;
+  frame[3] = len >> 8;
+  memset(frame + 4, frame_idx & 0x7F, len - 4);
+  out.write(frame, len);
+  frame_idx++;
+}
+
+/// checks that the data consists of the header and complete frames: returns the number of frames
+int checkFrames(const std::string &data, bool contiguous) {
+  assert(data.compare(0, 4, header) == 0);
+  size_t pos = 4;
+  int count = 0;
+  int last = -1;
+  while (pos < data.size()) {
+    assert((uint8_t)data[pos] == 0xFF);
+    int idx = data[pos + 1];
+    int len = (uint8_t)data[pos + 2] | (uint8_t)data[pos + 3] << 8;
+    if (pos + len > data.size()) break;  // the last frame might still be incomplete
+    for (int j = 4; j < len; j++) assert(data[pos + j] == idx);
+    if (contiguous && last >= 0) assert(idx == ((last + 1) & 0x7F));
+    last = idx;
+    pos += len;
+    count++;
+  }
+  return count;
+}
+
+void testSkip() {
+  BroadcastOutput out(4000);
+  out.setHeaderSize(4);
+  // the slow client must be able to finish its frame before the data is overwritten
+  out.setMaxLag(1000);
+  out.begin();
+  out.write((const uint8_t *)header, 4);
+
+  MemoryClient fast, slow, late;
+  out.addClient(fast);
+  out.addClient(slow);
+  for (int j = 0; j < 500; j++) {
+    writeFrame(out);
+    if (j == 250) out.addClient(late);
+    fast.capacity = 100000;
+    slow.capacity = 37;
+    late.capacity = 100000;
+    out.update();
+  }
+  assert(out.clientCount() == 3);
+  assert(checkFrames(fast.rx, true) == 500);
+  assert(fast.rx.size() == out.totalWritten() + 4);
+  // the slow client got only some frames but all are complete
+  int slow_frames = checkFrames(slow.rx, false);
+  assert(slow_frames > 0 && slow_frames < 500);
+  assert(checkFrames(late.rx, true) == 250);
+
+  // disconnected clients are removed
+  late.stop();
+  out.update();
+  assert(out.clientCount() == 2);
+}
+
+void testDrop() {
+  BroadcastOutput out(4000);
+  out.setHeaderSize(4);
+  out.setLatePolicy(BroadcastDrop);
+  out.begin();
+  out.write((const uint8_t *)header, 4);
+
+  MemoryClient fast, slow;
+  out.addClient(fast);
+  out.addClient(slow);
+  for (int j = 0; j < 100; j++) {
+    writeFrame(out);
+    fast.capacity = 100000;
+    slow.capacity = 10;
+    out.update();
+  }
+  assert(out.clientCount() == 1);
+  assert(!slow.connected());
+  assert(checkFrames(fast.rx, true) == 100);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testSkip();
+  testDrop();
+  Serial.println("Broadcast ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,212 @@
+// Tests the DeadlineMonitor with deliberately slowed stages
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+int alerts = 0;
+const char *alert_stage = "";
+
+void onOverrun(DeadlineMonitor &monitor, DeadlineOverrun &overrun) {
+  alerts++;
+  alert_stage = overrun.stage;
+}
+
+// provides silence
+class ZeroStream : public AudioStreamX {
+ public:
+  size_t readBytes(uint8_t *data, size_t len) override {
+    memset(data, 0, len);
+    return len;
+  }
+  int available() override { return 10000; }
+};
+
+// output which is slow for the indicated number of writes
+class SlowOutput : public AudioStreamX {
+ public:
+  int slow_writes = 0;
+  size_t write(const uint8_t *data, size_t len) override {
+    if (slow_writes > 0) {
+      slow_writes--;
+      delay(15);
+    }
+    return len;
+  }
+  int availableForWrite() override { return 10000; }
+};
+
+// output which plays in real time and blocks while it has more than one block queued (like I2S)
+class PacedOutput : public AudioStreamX {
+ public:
+  uint32_t period_us = 10000;
+  size_t write(const uint8_t *data, size_t len) override {
+    if (queued_us == 0) start_us = micros();
+    while ((int64_t)queued_us - (int64_t)(micros() - start_us) > (int64_t)period_us) {
+      delayMicroseconds(100);
+    }
+    queued_us += period_us;
+    return len;
+  }
+  int availableForWrite() override { return 10000; }
+
+ protected:
+  uint64_t queued_us = 0;
+  unsigned long start_us = 0;
+};
+
+DeadlineMonitorConfig defaultConfig(DeadlineMonitor &monitor) {
+  auto cfg = monitor.defaultConfig();
+  cfg.sample_rate = 44100;
+  cfg.channels = 2;
+  cfg.bits_per_sample = 16;
+  // 10 ms
+  cfg.buffer_size = 1764;
+  return cfg;
+}
+
+// the deadline is the playing time of the processed bytes
+void testDeadline() {
+  DeadlineMonitor monitor;
+  auto cfg = defaultConfig(monitor);
+  assert(monitor.begin(cfg));
+  assert(monitor.deadlineUs() == 10000);
+  assert(monitor.deadlineUs(882) == 5000);
+  cfg.budget_percent = 50;
+  monitor.begin(cfg);
+  assert(monitor.deadlineUs() == 5000);
+  cfg.period_us = 2000;
+  monitor.begin(cfg);
+  assert(monitor.deadlineUs(882) == 1000);
+}
+
+// the overrun reports the stage which was executing when the deadline has passed
+void testStages() {
+  alerts = 0;
+  DeadlineMonitor monitor;
+  monitor.begin(defaultConfig(monitor));
+  monitor.setOverrunCallback(onOverrun);
+
+  // fast cycle
+  monitor.beginCycle();
+  monitor.enterStage("decoder");
+  monitor.leaveStage();
+  assert(monitor.endCycle());
+  assert(alerts == 0);
+
+  // slow nested stage
+  monitor.beginCycle();
+  monitor.enterStage("decoder");
+  monitor.enterStage("output");
+  delay(12);
+  monitor.leaveStage();
+  monitor.leaveStage();
+  assert(!monitor.endCycle());
+  assert(alerts == 1);
+  assert(strcmp(alert_stage, "output") == 0);
+
+  // the time between the stages is attributed to the cycle
+  monitor.beginCycle();
+  monitor.enterStage("decoder");
+  monitor.leaveStage();
+  delay(12);
+  monitor.enterStage("output");
+  monitor.leaveStage();
+  assert(!monitor.endCycle());
+  assert(strcmp(alert_stage, "cycle") == 0);
+
+  assert(monitor.stats().cycles == 3);
+  assert(monitor.stats().overruns == 2);
+  assert(monitor.stats().max_load_percent >= 120);
+  assert(monitor.overrunCount() == 2);
+  assert(monitor.overrun(0).cycle == 2);
+  assert(monitor.overrun(1).cycle == 3);
+  assert(monitor.cycleTimeUs().count() == 3);
+}
+
+// the history keeps the last overruns
+void testHistory() {
+  DeadlineMonitor monitor;
+  auto cfg = defaultConfig(monitor);
+  cfg.period_us = 100;
+  monitor.begin(cfg);
+  for (int j = 0; j < DEADLINE_MONITOR_HISTORY + 2; j++) {
+    monitor.beginCycle();
+    delay(1);
+    monitor.endCycle();
+  }
+  assert(monitor.stats().overruns == DEADLINE_MONITOR_HISTORY + 2);
+  assert(monitor.overrunCount() == DEADLINE_MONITOR_HISTORY);
+  assert(monitor.overrun(0).cycle == 3);
+  assert(monitor.overrun(DEADLINE_MONITOR_HISTORY - 1).cycle == DEADLINE_MONITOR_HISTORY + 2);
+  monitor.reset();
+  assert(monitor.overrunCount() == 0);
+}
+
+// StreamCopy reports the slow output stage
+void testStreamCopy() {
+  alerts = 0;
+  DeadlineMonitor monitor;
+  monitor.begin(defaultConfig(monitor));
+  monitor.setOverrunCallback(onOverrun);
+
+  ZeroStream in;
+  SlowOutput slow;
+  slow.slow_writes = 2;
+  DeadlineStageStream out(slow, monitor, "i2s");
+  StreamCopy copier(out, in, 1764);
+  copier.setDeadlineMonitor(monitor);
+  for (int j = 0; j < 5; j++) {
+    assert(copier.copy() == 1764);
+  }
+  assert(monitor.stats().cycles == 5);
+  assert(monitor.stats().overruns == 2);
+  assert(alerts == 2);
+  assert(strcmp(monitor.overrun(0).stage, "i2s") == 0);
+  monitor.printTo(Serial);
+}
+
+// a correctly paced blocking output does not cause any overruns in cumulative mode
+void testPacedOutput() {
+  for (int cumulative = 0; cumulative < 2; cumulative++) {
+    DeadlineMonitor monitor;
+    auto cfg = defaultConfig(monitor);
+    cfg.cumulative = cumulative;
+    monitor.begin(cfg);
+    ZeroStream in;
+    PacedOutput out;
+    StreamCopy copier(out, in, 1764);
+    copier.setDeadlineMonitor(monitor);
+    for (int j = 0; j < 30; j++) {
+      assert(copier.copy() == 1764);
+    }
+    assert(monitor.stats().cycles == 30);
+    if (cumulative) {
+      assert(monitor.stats().overruns == 0);
+    } else {
+      // each cycle waits for the output
+      assert(monitor.stats().max_load_percent >= 90);
+    }
+  }
+  // in cumulative mode a late cycle is still reported
+  DeadlineMonitor monitor;
+  auto cfg = defaultConfig(monitor);
+  cfg.cumulative = true;
+  monitor.begin(cfg);
+  monitor.beginCycle();
+  delay(12);
+  assert(!monitor.endCycle());
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testDeadline();
+  testStages();
+  testHistory();
+  testStreamCopy();
+  testPacedOutput();
+  Serial.println("DeadlineMonitor ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,87 @@
+// Tests the log bucketed Histogram and the histograms of the MeasuringStream with an output which stalls
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Output which needs 100us per call and stalls every 50 calls for 20ms
+class SlowPrint : public Print {
+ public:
+  int calls = 0;
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *data, size_t len) override {
+    delayMicroseconds(++calls % 50 == 0 ? 20000 : 100);
+    return len;
+  }
+};
+
+void testBuckets() {
+  // the buckets are contiguous and cover the full range
+  assert(Histogram::bucketLow(0) == 0);
+  for (int j = 1; j < Histogram::BUCKETS; j++) {
+    assert(Histogram::bucketLow(j) == Histogram::bucketHigh(j - 1) + 1);
+    assert(Histogram::bucket(Histogram::bucketLow(j)) == j);
+    assert(Histogram::bucket(Histogram::bucketHigh(j)) == j);
+  }
+  assert(Histogram::bucket(0xFFFFFFFF) == Histogram::BUCKETS - 1);
+  // the relative error is limited to 25%
+  for (uint32_t v = 4; v < 1000000; v = v * 3 / 2) {
+    int idx = Histogram::bucket(v);
+    assert(Histogram::bucketHigh(idx) - Histogram::bucketLow(idx) <= Histogram::bucketLow(idx) / 4);
+  }
+}
+
+void testPercentiles() {
+  Histogram h;
+  assert(h.p50() == 0);
+  for (uint32_t v = 1; v <= 1000; v++) h.add(v);
+  assert(h.count() == 1000);
+  assert(h.minValue() == 1);
+  assert(h.maxValue() == 1000);
+  assert(h.mean() == 500);
+  assert(h.p50() >= 500 && h.p50() <= 500 * 5 / 4);
+  assert(h.p95() >= 950 && h.p95() <= 1000);
+  assert(h.p99() >= 990 && h.p99() <= 1000);
+  assert(h.percentile(100) == 1000);
+  assert(h.countAbove(1023) == 0);
+  assert(h.countAbove(511) == 1000 - 511);
+  h.reset();
+  assert(h.count() == 0);
+  assert(h.maxValue() == 0);
+}
+
+void testMeasuringStream() {
+  SlowPrint slow;
+  MeasuringStream out(slow, 1000);
+  uint8_t data[512];
+  for (int j = 0; j < 200; j++) {
+    out.write(data, j % 2 == 0 ? 128 : 512);
+  }
+  assert(out.callTimeUs().count() == 200);
+  assert(out.intervalUs().count() == 199);
+  assert(out.stalls() == 4);
+  assert(out.callTimeUs().p50() >= 100 && out.callTimeUs().p50() < 1000);
+  assert(out.callTimeUs().maxValue() >= 20000);
+  assert(out.callTimeUs().p99() >= 20000);
+  // we report the upper limit of the bucket
+  assert(out.callSize().p50() >= 128 && out.callSize().p50() < 160);
+  assert(out.callSize().maxValue() == 512);
+  out.printHistograms(Serial);
+
+  out.resetHistograms();
+  assert(out.callTimeUs().count() == 0);
+  assert(out.stalls() == 0);
+  out.write(data, 10);
+  assert(out.intervalUs().count() == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testBuckets();
+  testPercentiles();
+  testMeasuringStream();
+  Serial.println("Histogram ok");
+}
+
+void loop() { stop(); }
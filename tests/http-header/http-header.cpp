@@ -0,0 +1,131 @@
+// Tests the parsing of the http header: we verify that reading the reply and looking up the values does
+// not allocate any memory on the heap
+#include <new>
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+int allocation_count = 0;
+
+void* operator new(size_t size) {
+  allocation_count++;
+  void* result = malloc(size);
+  if (result == nullptr) throw std::bad_alloc();
+  return result;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+/// Mock Client which provides a canned reply
+class ReplyClient : public Client {
+ public:
+  const char* rx = "";
+  size_t rx_len = 0;
+  size_t rx_pos = 0;
+
+  void setReply(const char* reply) {
+    rx = reply;
+    rx_len = strlen(reply);
+    rx_pos = 0;
+  }
+  int connect(IPAddress ip, uint16_t port) override { return 1; }
+  int connect(const char *host, uint16_t port) override { return 1; }
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *buf, size_t size) override { return size; }
+  int available() override { return rx_len - rx_pos; }
+  int read() override { return rx_pos < rx_len ? (uint8_t)rx[rx_pos++] : -1; }
+  int read(uint8_t *buf, size_t size) override {
+    size_t n = min(size, rx_len - rx_pos);
+    memcpy(buf, rx + rx_pos, n);
+    rx_pos += n;
+    return n;
+  }
+  int peek() override { return rx_pos < rx_len ? (uint8_t)rx[rx_pos] : -1; }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+};
+
+const char* reply_200 =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: audio/mpeg\r\n"
+    "Content-Length:12345\r\n"
+    "icy-metaint: 16000\r\n"
+    "icy-name: Test Radio\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+const char* reply_302 =
+    "HTTP/1.1 302 Found\r\n"
+    "Location: http://stream.example.com/live\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n";
+
+ReplyClient client;
+HttpReplyHeader reply;
+HttpRequestHeader request;
+
+void testReply() {
+  // the first read allocates the line buffer of the reader
+  client.setReply(reply_200);
+  reply.read(client);
+
+  for (int j = 0; j < 100; j++) {
+    allocation_count = 0;
+    client.setReply(j % 2 == 0 ? reply_302 : reply_200);
+    reply.read(client);
+    if (j % 2 == 0) {
+      assert(reply.statusCode() == 302);
+      assert(strcmp(reply.get(LOCATION), "http://stream.example.com/live") == 0);
+      assert(reply.isChunked());
+      assert(reply.get(CONTENT_LENGTH) == nullptr);
+    } else {
+      assert(reply.statusCode() == 200);
+      assert(strcmp(reply.get(CONTENT_TYPE), "audio/mpeg") == 0);
+      assert(atoi(reply.get(CONTENT_LENGTH)) == 12345);
+      assert(atoi(reply.get(ICY_METAINT)) == 16000);
+      assert(strcmp(reply.get("ICY-NAME"), "Test Radio") == 0);
+      assert(strcmp(reply.get("connection"), "keep-alive") == 0);
+      assert(!reply.isChunked());
+      assert(reply.get(LOCATION) == nullptr);
+    }
+    assert(allocation_count == 0);
+  }
+}
+
+void testRequest() {
+  char value[40];
+  for (int j = 0; j < 200; j++) {
+    allocation_count = 0;
+    // values with a changing length: the buffer must not run full
+    snprintf(value, sizeof(value), "bytes=%d-", j * 997);
+    request.setValues(GET, "/live");
+    request.put(HOST_C, j % 3 == 0 ? "stream.example.com" : "example.com");
+    request.put(CONNECTION, CON_KEEP_ALIVE);
+    request.put(CONTENT_LENGTH, j * 1000);
+    request.put(RANGE, value);
+    request.put("Icy-MetaData", "1");
+    assert(strcmp(request.get(RANGE), value) == 0);
+    assert(atoi(request.get(CONTENT_LENGTH)) == j * 1000);
+    assert(strcmp(request.get("icy-metadata"), "1") == 0);
+    assert(request.lineCount() == 5);
+    assert(request.bufferUsed() < HTTP_HEADER_BUFFER_SIZE);
+    client.setReply("");
+    request.write(client);
+    // the lines are deactivated after they have been written
+    assert(request.get(RANGE) == nullptr);
+    assert(allocation_count == 0);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  testReply();
+  testRequest();
+  Serial.println("Http header ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,134 @@
+// Tests the buffered line and chunk reading with a mock Client which provides the reply in
+// random small pieces, so that the lines and chunk sizes are split across reads
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Mock Client which only makes a few bytes available at a time
+class DribbleClient : public Client {
+ public:
+  std::string rx;
+  size_t rx_pos = 0;
+  size_t visible = 0;
+  int bulk_reads = 0;
+
+  void setReply(const std::string &reply) {
+    rx = reply;
+    rx_pos = 0;
+    visible = 0;
+  }
+  int connect(IPAddress ip, uint16_t port) override { return 1; }
+  int connect(const char *host, uint16_t port) override { return 1; }
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *buf, size_t size) override { return size; }
+  int available() override {
+    // reveal some more data with each call
+    if (visible < rx.size()) visible = min(rx.size(), visible + random(1, 40));
+    return visible - rx_pos;
+  }
+  int read() override { return rx_pos < visible ? (uint8_t)rx[rx_pos++] : -1; }
+  int read(uint8_t *buf, size_t size) override {
+    size_t n = min(size, visible - rx_pos);
+    memcpy(buf, rx.data() + rx_pos, n);
+    rx_pos += n;
+    bulk_reads++;
+    return n;
+  }
+  int peek() override { return rx_pos < visible ? (uint8_t)rx[rx_pos] : -1; }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+};
+
+std::string expected;
+
+std::string chunkedReply() {
+  std::string reply = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Type: audio/mpeg\r\n\r\n";
+  expected.clear();
+  for (int c = 0; c < 50; c++) {
+    int len = random(1, 700);
+    char len_str[20];
+    snprintf(len_str, sizeof(len_str), "%x\r\n", len);
+    reply += len_str;
+    for (int j = 0; j < len; j++) {
+      char ch = 'a' + random(26);
+      reply += ch;
+      expected += ch;
+    }
+    reply += "\r\n";
+  }
+  reply += "0\r\nX-Trailer: end\r\n\r\n";
+  return reply;
+}
+
+void testChunkedRead() {
+  DribbleClient client;
+  client.setReply(chunkedReply());
+  HttpRequest request(client);
+  Url url("http://host/stream");
+  assert(request.get(url) == 200);
+  assert(strcmp(request.reply().get(CONTENT_TYPE), "audio/mpeg") == 0);
+  std::string result;
+  uint8_t buffer[1024];
+  while (result.size() < expected.size()) {
+    int len = request.read(buffer, random(1, sizeof(buffer)));
+    result.append((const char *)buffer, len);
+  }
+  assert(result == expected);
+  // the trailer is processed after the last chunk
+  assert(request.read(buffer, sizeof(buffer)) == 0);
+  assert(request.available() == 0);
+  assert(strcmp(request.reply().get("X-Trailer"), "end") == 0);
+}
+
+void testChunkedSlices() {
+  DribbleClient client;
+  client.setReply(chunkedReply());
+  HttpRequest request(client);
+  Url url("http://host/stream");
+  assert(request.get(url) == 200);
+  std::string result;
+  while (result.size() < expected.size()) {
+    const uint8_t *data = nullptr;
+    int len = request.readSlice(data, random(1, 1024));
+    result.append((const char *)data, len);
+  }
+  assert(result == expected);
+  const uint8_t *data = nullptr;
+  assert(request.readSlice(data, 100) == 0);
+}
+
+void testLines() {
+  DribbleClient client;
+  std::string body;
+  for (int j = 0; j < 100; j++) {
+    body += "line " + std::to_string(j) + "\r\n";
+  }
+  client.setReply("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+  HttpRequest request(client);
+  Url url("http://host/list.m3u");
+  assert(request.get(url) == 200);
+  char line[40];
+  for (int j = 0; j < 100; j++) {
+    request.readln((uint8_t *)line, sizeof(line), false);
+    assert(strcmp(line, ("line " + std::to_string(j)).c_str()) == 0);
+  }
+  assert(request.available() == 0);
+  // we read in bulk and not per character
+  assert(client.bulk_reads < (int)body.size() / 4);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  for (int j = 0; j < 20; j++) {
+    testChunkedRead();
+    testChunkedSlices();
+    testLines();
+  }
+  Serial.println("Http reader ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,131 @@
+// Tests the incremental HttpRequestParser with mock clients which deliver the request byte by byte or
+// all at once: the parser must never block and must recognize the end of the request
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Mock Client which reveals the indicated number of bytes with each poll
+class RequestClient : public Client {
+ public:
+  std::string rx;
+  size_t rx_pos = 0;
+  size_t visible = 0;
+  size_t step = 1;
+
+  void setRequest(const std::string &request, size_t bytesPerPoll) {
+    rx = request;
+    rx_pos = 0;
+    visible = 0;
+    step = bytesPerPoll;
+  }
+  /// makes the next bytes available
+  void next() { visible = min(rx.size(), visible + step); }
+  int connect(IPAddress ip, uint16_t port) override { return 1; }
+  int connect(const char *host, uint16_t port) override { return 1; }
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *buf, size_t size) override { return size; }
+  int available() override { return visible - rx_pos; }
+  int read() override { return rx_pos < visible ? (uint8_t)rx[rx_pos++] : -1; }
+  int read(uint8_t *buf, size_t size) override {
+    size_t n = min(size, visible - rx_pos);
+    memcpy(buf, rx.data() + rx_pos, n);
+    rx_pos += n;
+    return n;
+  }
+  int peek() override { return rx_pos < visible ? (uint8_t)rx[rx_pos] : -1; }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+};
+
+const char *request =
+    "GET /stream.mp3 HTTP/1.1\r\n"
+    "Host: 192.168.1.10\r\n"
+    "User-Agent: VLC/3.0.16 LibVLC/3.0.16\r\n"
+    "Accept: */*\r\n"
+    "Icy-MetaData: 1\r\n"
+    "\r\n";
+
+/// returns the number of polls which were needed
+int parse(HttpRequestParser &parser, RequestClient &client, const std::string &req, size_t bytesPerPoll) {
+  client.setRequest(req, bytesPerPoll);
+  parser.begin();
+  int polls = 0;
+  while (!parser.poll(client) && !parser.isError()) {
+    // the parser must return when no data is available
+    assert(client.available() == 0);
+    assert(polls++ < 10000);
+    client.next();
+  }
+  return polls;
+}
+
+void testRequest(size_t bytesPerPoll) {
+  RequestClient client;
+  HttpRequestParser parser;
+  int polls = parse(parser, client, request, bytesPerPoll);
+  assert(parser.isComplete());
+  assert(strcmp(parser.method(), "GET") == 0);
+  assert(strcmp(parser.path(), "/stream.mp3") == 0);
+  assert(strcmp(parser.version(), "HTTP/1.1") == 0);
+  assert(client.rx_pos == strlen(request));
+  assert(polls == (int)((strlen(request) + bytesPerPoll - 1) / bytesPerPoll));
+}
+
+void testVariants() {
+  RequestClient client;
+  HttpRequestParser parser;
+
+  // new lines without carriage return and leading empty lines
+  parse(parser, client, "\r\nGET / HTTP/1.0\nHost: x\n\n", 1);
+  assert(parser.isComplete());
+  assert(strcmp(parser.path(), "/") == 0);
+
+  // HTTP/0.9 style request w/o version
+  parse(parser, client, "GET /a\r\n\r\n", 3);
+  assert(parser.isComplete());
+  assert(strcmp(parser.path(), "/a") == 0);
+  assert(strcmp(parser.version(), "") == 0);
+
+  // invalid request line
+  parse(parser, client, "garbage\r\n\r\n", 100);
+  assert(parser.isError());
+
+  // request line which does not fit into the buffer
+  std::string long_request = "GET /" + std::string(HTTP_REQUEST_LINE_SIZE, 'x') + " HTTP/1.1\r\n\r\n";
+  parse(parser, client, long_request, 1000);
+  assert(parser.isError());
+
+  // the parser can be reused: a header line which is longer then the request line buffer
+  std::string long_header = "GET / HTTP/1.1\r\nCookie: " + std::string(2000, 'c') + "\r\n\r\n";
+  parse(parser, client, long_header, 7);
+  assert(parser.isComplete());
+}
+
+void testTimeout() {
+  RequestClient client;
+  HttpRequestParser parser;
+  client.setRequest("GET / HTTP/1.1\r\n", 100);
+  parser.begin();
+  client.next();
+  assert(!parser.poll(client));
+  assert(!parser.isError());
+  delay(HTTP_REQUEST_TIMEOUT + 10);
+  assert(!parser.poll(client));
+  assert(parser.isError());
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testRequest(1);
+  testRequest(5);
+  testRequest(strlen(request));
+  testVariants();
+  testTimeout();
+  Serial.println("HttpRequestParser ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,114 @@
+// Splits a simulated ICY capture in random chunk sizes with the bulk demuxer and 
+// compares the result with the character based state engine 
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+const int metaint = 1000;
+const int blocks = 50;
+uint8_t capture[blocks * (metaint + 1 + 48)];
+size_t capture_len = 0;
+uint8_t expected_audio[blocks * metaint];
+uint8_t audio[blocks * metaint];
+size_t audio_len = 0;
+int title_count = 0;
+char last_title[80];
+
+void onTitle(MetaDataType type, const char* str, int len) {
+  title_count++;
+  strncpy(last_title, str, sizeof(last_title));
+}
+
+void onAudio(const uint8_t* data, int len) {
+  assert(audio_len + len <= sizeof(audio));
+  memcpy(audio + audio_len, data, len);
+  audio_len += len;
+}
+
+// builds the capture: audio blocks followed by size byte and metadata
+void setupCapture() {
+  for (int b = 0; b < blocks; b++) {
+    for (int j = 0; j < metaint; j++) {
+      uint8_t value = random(256);
+      expected_audio[b * metaint + j] = value;
+      capture[capture_len++] = value;
+    }
+    if (b % 3 == 0) {
+      // metadata padded to 16 bytes
+      char meta[48] = {0};
+      snprintf(meta, sizeof(meta), "StreamTitle='Title %d';", b);
+      int size = (strlen(meta) + 15) / 16;
+      capture[capture_len++] = size;
+      memcpy(capture + capture_len, meta, size * 16);
+      capture_len += size * 16;
+    } else {
+      capture[capture_len++] = 0;
+    }
+  }
+}
+
+void testCallback() {
+  MetaDataICY icy(metaint);
+  icy.setCallback(onTitle);
+  icy.setAudioDataCallback(onAudio);
+  icy.begin();
+  audio_len = 0;
+  title_count = 0;
+  size_t pos = 0;
+  while (pos < capture_len) {
+    size_t len = min((size_t)random(1, 700), capture_len - pos);
+    icy.write(capture + pos, len);
+    pos += len;
+  }
+  assert(audio_len == sizeof(expected_audio));
+  assert(memcmp(audio, expected_audio, audio_len) == 0);
+  assert(title_count == (blocks + 2) / 3);
+  assert(strcmp(last_title, "Title 48") == 0);
+}
+
+void testRemoveMetaData() {
+  MetaDataICY bulk(metaint);
+  MetaDataICY single(metaint);
+  bulk.setCallback(onTitle);
+  single.setCallback(onTitle);
+  bulk.begin();
+  single.begin();
+  uint8_t buffer[1024];
+  size_t result_len = 0;
+  size_t pos = 0;
+  while (pos < capture_len) {
+    size_t len = min((size_t)random(1, sizeof(buffer)), capture_len - pos);
+    // bulk processing in place
+    memcpy(buffer, capture + pos, len);
+    size_t audio_bytes = bulk.removeMetaData(buffer, len);
+    // character based processing
+    size_t count = 0;
+    for (size_t j = 0; j < len; j++) {
+      single.processChar(capture[pos + j]);
+      if (single.isData()) {
+        assert(buffer[count] == capture[pos + j]);
+        count++;
+      }
+    }
+    assert(count == audio_bytes);
+    memcpy(audio + result_len, buffer, audio_bytes);
+    result_len += audio_bytes;
+    pos += len;
+  }
+  assert(result_len == sizeof(expected_audio));
+  assert(memcmp(audio, expected_audio, result_len) == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  setupCapture();
+  for (int j = 0; j < 20; j++) {
+    testCallback();
+    testRemoveMetaData();
+  }
+  Serial.println("ICY ok");
+}
+
+void loop() { stop(); }
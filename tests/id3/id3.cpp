@@ -0,0 +1,357 @@
+// Builds synthetic ID3v2.2, v2.3, v2.4 and APEv2 tags with big cover art, splits them in random chunk sizes
+// and checks the reported metadata and the audio which is provided by the MetaDataFilter
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioMetaData/MetaDataFilter.h"
+
+using namespace audio_tools;
+
+uint8_t data[20000];
+size_t data_len = 0;
+size_t audio_start = 0;
+char title[80];
+char artist[80];
+char genre[80];
+int callback_count = 0;
+
+void onMetaData(MetaDataType type, const char* str, int len) {
+  callback_count++;
+  assert((int)strlen(str) == len);
+  if (type == Title) strncpy(title, str, sizeof(title));
+  if (type == Artist) strncpy(artist, str, sizeof(artist));
+  if (type == Genre) strncpy(genre, str, sizeof(genre));
+}
+
+void add(const void* str, size_t len) {
+  memcpy(data + data_len, str, len);
+  data_len += len;
+}
+
+void addSize(uint32_t size, bool syncsafe, int bytes = 4) {
+  for (int j = bytes - 1; j >= 0; j--) {
+    data[data_len++] = syncsafe ? (size >> (7 * j)) & 0x7F : (size >> (8 * j)) & 0xFF;
+  }
+}
+
+void addFrame(int version, const char* id, const uint8_t* content, size_t len, uint8_t flags = 0) {
+  add(id, version == 2 ? 3 : 4);
+  addSize(len, version == 4, version == 2 ? 3 : 4);
+  if (version > 2) {
+    data[data_len++] = 0;
+    data[data_len++] = flags;
+  }
+  add(content, len);
+}
+
+void addText(int version, const char* id, const char* str) {
+  uint8_t content[80];
+  content[0] = 0;
+  strcpy((char*)content + 1, str);
+  addFrame(version, id, content, strlen(str) + 1);
+}
+
+void addPicture(int version) {
+  static uint8_t picture[5000];
+  for (size_t j = 0; j < sizeof(picture); j++) picture[j] = random(256);
+  addFrame(version, version == 2 ? "PIC" : "APIC", picture, sizeof(picture));
+}
+
+// fills the header after all frames have been added
+void finishTag(int version, uint8_t flags) {
+  size_t end = data_len;
+  data_len = 0;
+  add("ID3", 3);
+  data[data_len++] = version;
+  data[data_len++] = 0;
+  data[data_len++] = flags;
+  addSize(end - 10, true);
+  data_len = end;
+  audio_start = end;
+}
+
+void addAudio() {
+  for (int j = 0; j < 3000; j++) {
+    // avoid any ID3 or TAG signatures in the audio
+    data[data_len++] = random(0, 64);
+  }
+}
+
+void buildV23() {
+  data_len = 10;
+  addPicture(3);
+  addText(3, "TIT2", "Title 2.3");
+  // UTF-16 with BOM
+  const uint8_t artist[] = {1, 0xFF, 0xFE, 'A', 0, 'r', 0, 't', 0, 0, 0};
+  addFrame(3, "TPE1", artist, sizeof(artist));
+  addText(3, "TCON", "(17)");
+  // padding
+  memset(data + data_len, 0, 100);
+  data_len += 100;
+  finishTag(3, 0);
+  addAudio();
+}
+
+void buildV22() {
+  data_len = 10;
+  addPicture(2);
+  addText(2, "TT2", "Title 2.2");
+  addText(2, "TP1", "Artist 2.2");
+  finishTag(2, 0);
+  addAudio();
+}
+
+void buildV24() {
+  data_len = 10;
+  // data length indicator and unsynchronised frame
+  const uint8_t text[] = {0, 0, 0, 8, 3, 'T', 0xFF, 0x00, 0xE0, 'x', 'y', 'z'};
+  addFrame(4, "TIT2", text, sizeof(text), 0x03);
+  addPicture(4);
+  // extended header flag is not set: just add an unknown frame
+  addText(4, "TXXX", "ignore");
+  addText(4, "TPE1", "Artist 2.4");
+  finishTag(4, 0);
+  addAudio();
+}
+
+void process(MetaDataID3 &id3) {
+  title[0] = artist[0] = genre[0] = 0;
+  callback_count = 0;
+  id3.begin();
+  size_t pos = 0;
+  while (pos < data_len) {
+    size_t len = min((size_t)random(1, 600), data_len - pos);
+    id3.write(data + pos, len);
+    pos += len;
+  }
+  id3.end();
+}
+
+void testParser() {
+  MetaDataID3 id3;
+  id3.setCallback(onMetaData);
+  id3.setFilter(SELECT_ID3V2);
+
+  buildV23();
+  process(id3);
+  assert(strcmp(title, "Title 2.3") == 0);
+  assert(strcmp(artist, "Art") == 0);
+  assert(strcmp(genre, "Rock") == 0);
+
+  buildV22();
+  process(id3);
+  assert(strcmp(title, "Title 2.2") == 0);
+  assert(strcmp(artist, "Artist 2.2") == 0);
+
+  buildV24();
+  process(id3);
+  assert(strcmp(title, "T\xFF\xE0xyz") == 0);
+  assert(strcmp(artist, "Artist 2.4") == 0);
+  assert(callback_count == 2);
+}
+
+// Mock decoder which collects the audio
+struct TestDecoder {
+  uint8_t result[sizeof(data)];
+  size_t len = 0;
+  int writes = 0;
+  size_t write(uint8_t* buffer, size_t size) {
+    memcpy(result + len, buffer, size);
+    len += size;
+    writes++;
+    return size;
+  }
+};
+
+void testFilter(bool withTrailer) {
+  buildV23();
+  size_t audio_end = data_len;
+  if (withTrailer) {
+    ID3v1 v1;
+    memset(&v1, 0, sizeof(v1));
+    memcpy(v1.header, "TAG", 3);
+    strcpy(v1.title, "Title v1");
+    add(&v1, sizeof(v1));
+  }
+  TestDecoder decoder;
+  MetaDataFilter<TestDecoder> filter(&decoder);
+  filter.setSize(data_len);
+  filter.begin();
+  size_t pos = 0;
+  while (pos < data_len) {
+    size_t len = min((size_t)random(1, 600), data_len - pos);
+    filter.write(data + pos, len);
+    pos += len;
+  }
+  filter.end();
+  assert(decoder.len == audio_end - audio_start);
+  assert(memcmp(decoder.result, data + audio_start, decoder.len) == 0);
+
+  // data without tag is passed on unchanged
+  TestDecoder decoder1;
+  MetaDataFilter<TestDecoder> filter1(&decoder1);
+  filter1.begin();
+  filter1.write(data + audio_start, 5);
+  filter1.write(data + audio_start + 5, 100);
+  filter1.end();
+  assert(decoder1.len == 105);
+  assert(memcmp(decoder1.result, data + audio_start, 105) == 0);
+}
+
+void addApeItem(const char* key, const void* value, uint32_t len, uint32_t flags = 0) {
+  uint8_t size[8] = {(uint8_t)len, (uint8_t)(len >> 8), (uint8_t)(len >> 16), (uint8_t)(len >> 24), (uint8_t)flags, 0, 0, 0};
+  add(size, 8);
+  add(key, strlen(key) + 1);
+  add(value, len);
+}
+
+void addApeHeader(uint32_t size, bool isHeader) {
+  uint32_t flags = 0x80000000 | (isHeader ? 0x20000000 : 0);
+  uint8_t header[32] = {'A', 'P', 'E', 'T', 'A', 'G', 'E', 'X', 0xD0, 0x07, 0, 0};
+  for (int j = 0; j < 4; j++) {
+    header[12 + j] = size >> (8 * j);
+    header[20 + j] = flags >> (8 * j);
+  }
+  add(header, 32);
+}
+
+// APEv2 items incl. binary cover art
+void addApeTag() {
+  size_t start = data_len;
+  data_len += 32;
+  static uint8_t picture[3000];
+  for (size_t j = 0; j < sizeof(picture); j++) picture[j] = random(256);
+  addApeItem("Cover Art (Front)", picture, sizeof(picture), 0x02);
+  addApeItem("TITLE", "Title APE", 9);
+  addApeItem("Artist", "Artist APE", 10);
+  uint32_t size = data_len - start - 32 + 32;
+  size_t end = data_len;
+  data_len = start;
+  addApeHeader(size, true);
+  data_len = end;
+  addApeHeader(size, false);
+}
+
+// Mock decoder which can be wrapped by the MetaDataFilterDecoder
+class TestAudioDecoder : public AudioDecoder {
+ public:
+  TestDecoder result;
+  AudioBaseInfo audioInfo() override { return AudioBaseInfo(); }
+  void setOutputStream(Print &out) override {}
+  void setNotifyAudioChange(AudioBaseInfoDependent &bi) override {}
+  void begin() override {}
+  void end() override {}
+  operator bool() override { return true; }
+  size_t write(const void *data, size_t len) override { return result.write((uint8_t *)data, len); }
+};
+
+// Mock seekable file
+struct TestFile {
+  size_t pos = 0;
+  size_t size() { return data_len; }
+  size_t position() { return pos; }
+  bool seek(size_t p) { pos = p; return p <= data_len; }
+  size_t read(uint8_t *buffer, size_t len) {
+    len = min(len, data_len - pos);
+    memcpy(buffer, data + pos, len);
+    pos += len;
+    return len;
+  }
+};
+
+void testAPE() {
+  // leading ID3v2 and APEv2 tags
+  buildV23();
+  data_len = audio_start;
+  addApeTag();
+  audio_start = data_len;
+  addAudio();
+  size_t audio_end = data_len;
+  // trailing APEv2 and ID3v1 tags
+  addApeTag();
+  ID3v1 v1;
+  memset(&v1, 0, sizeof(v1));
+  memcpy(v1.header, "TAG", 3);
+  strcpy(v1.album, "Album v1");
+  add(&v1, sizeof(v1));
+
+  TestAudioDecoder decoder;
+  MetaDataFilterDecoder filter(decoder);
+  filter.setCallback(onMetaData);
+  TestFile file;
+  assert(filter.processTrailer(file));
+  assert(file.pos == 0);
+  filter.begin();
+  title[0] = artist[0] = 0;
+  size_t pos = 0;
+  while (pos < data_len) {
+    size_t len = min((size_t)random(1, 600), data_len - pos);
+    filter.write(data + pos, len);
+    pos += len;
+  }
+  filter.end();
+  assert(decoder.result.len == audio_end - audio_start);
+  assert(memcmp(decoder.result.result, data + audio_start, decoder.result.len) == 0);
+  assert(strcmp(title, "Title APE") == 0);
+  assert(strcmp(artist, "Artist APE") == 0);
+}
+
+void testID3v1() {
+  ID3v1 v1;
+  memset(&v1, 0, sizeof(v1));
+  memcpy(v1.header, "TAG", 3);
+  strcpy(v1.title, "Title v1");
+  v1.genre = 17;
+  MetaDataID3V1 id3;
+  id3.setCallback(onMetaData);
+  id3.begin();
+  assert(id3.processTag((uint8_t*)&v1, sizeof(v1)));
+  assert(strcmp(title, "Title v1") == 0);
+  assert(strcmp(genre, "Rock") == 0);
+
+  // streaming: only the tail of the data is checked
+  MetaDataID3 stream;
+  stream.setCallback(onMetaData);
+  stream.setFilter(SELECT_ID3V1);
+  data_len = 0;
+  addAudio();
+  add(&v1, sizeof(v1));
+  strcpy(v1.title, "Other");
+  process(stream);
+  assert(strcmp(title, "Title v1") == 0);
+  assert(strcmp(genre, "Rock") == 0);
+  assert(callback_count == 4);
+
+  // enhanced tag in front of the ID3v1 tag: the longer title wins
+  ID3v1Enhanced ext;
+  memset(&ext, 0, sizeof(ext));
+  memcpy(ext.header, "TAG+", 4);
+  strcpy(ext.title, "Enhanced title which is longer than 30 chars");
+  data_len = 0;
+  addAudio();
+  add(&ext, sizeof(ext));
+  add(&v1, sizeof(v1));
+  process(stream);
+  assert(strcmp(title, ext.title) == 0);
+  assert(strcmp(genre, "Rock") == 0);
+
+  // no tag
+  data_len = 0;
+  addAudio();
+  process(stream);
+  assert(callback_count == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  for (int j = 0; j < 20; j++) {
+    testParser();
+    testFilter(false);
+    testFilter(true);
+    testAPE();
+  }
+  testID3v1();
+  Serial.println("ID3 ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,140 @@
+// Tests the JitterBufferStream with synthetic packet traces with delay, loss and reordering: the packets
+// contain the sequence number as sample values, so that we can check the sequence of the output
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+const int packet_size = 64;
+const int packet_ms = 10;
+
+struct Arrival {
+  uint32_t time;
+  uint16_t seq;
+  bool operator<(const Arrival &alt) const { return time < alt.time; }
+};
+
+/// Generates the arrival times: each packet is delayed by up to max_delay ms, some are lost
+std::vector<Arrival> trace(int count, int max_delay, int loss_percent) {
+  std::vector<Arrival> result;
+  for (int j = 0; j < count; j++) {
+    if (random(100) < loss_percent) continue;
+    result.push_back({(uint32_t)(j * packet_ms + random(0, max_delay + 1)), (uint16_t)j});
+  }
+  std::stable_sort(result.begin(), result.end());
+  return result;
+}
+
+struct Result {
+  int played = 0;
+  int concealed = 0;
+  bool is_ordered = true;
+};
+
+/// Delivers the packets at their arrival time and reads the audio with a constant rate
+Result simulate(JitterBufferStream &jitter, std::vector<Arrival> arrivals, int count, uint16_t first_seq = 0) {
+  Result result;
+  int16_t packet[packet_size / 2];
+  int16_t out[packet_size / 2];
+  size_t next = 0;
+  int last_seq = -1;
+  for (uint32_t t = 0; t < (uint32_t)(count * packet_ms + 200); t++) {
+    while (next < arrivals.size() && arrivals[next].time == t) {
+      uint16_t seq = arrivals[next].seq;
+      for (int j = 0; j < packet_size / 2; j++) packet[j] = seq + 1;
+      jitter.writePacket(first_seq + seq, (uint8_t *)packet, packet_size, t);
+      next++;
+    }
+    if (t % packet_ms == 0 && jitter.readBytes((uint8_t *)out, packet_size) == packet_size) {
+      // a played packet has constant values: the concealed packets are faded
+      if (out[0] == out[packet_size / 2 - 1] && out[0] > 0) {
+        if (out[0] <= last_seq) result.is_ordered = false;
+        last_seq = out[0];
+        result.played++;
+      } else {
+        result.concealed++;
+      }
+    }
+  }
+  return result;
+}
+
+JitterBufferConfig config() {
+  JitterBufferStream tmp;
+  auto cfg = tmp.defaultConfig();
+  cfg.packet_size = packet_size;
+  cfg.packet_duration_ms = packet_ms;
+  cfg.max_packets = 32;
+  return cfg;
+}
+
+void testReorder() {
+  JitterBufferStream jitter;
+  jitter.begin(config());
+  // delays of up to 2 packets: the packets arrive out of sequence but nothing is lost
+  Result result = simulate(jitter, trace(500, 2 * packet_ms, 0), 500);
+  assert(result.is_ordered);
+  assert(result.played == 500);
+  assert(jitter.stats().late == 0);
+  assert(jitter.stats().concealed == 0);
+  assert(jitter.stats().received == 500);
+}
+
+void testLoss() {
+  JitterBufferStream jitter;
+  jitter.begin(config());
+  std::vector<Arrival> arrivals = trace(500, packet_ms / 2, 5);
+  Result result = simulate(jitter, arrivals, 500);
+  assert(result.is_ordered);
+  assert(result.played == (int)arrivals.size());
+  // all lost packets (except at the end) have been concealed
+  int lost = 500 - arrivals.size();
+  assert(jitter.stats().concealed >= (uint32_t)lost - 2 && jitter.stats().concealed <= (uint32_t)lost);
+}
+
+void testAdaptive() {
+  // low jitter
+  JitterBufferStream low;
+  low.begin(config());
+  simulate(low, trace(500, 2, 0), 500);
+  // high jitter
+  JitterBufferStream high;
+  high.begin(config());
+  Result result = simulate(high, trace(500, 8 * packet_ms, 0), 500);
+  assert(high.stats().jitter_ms > low.stats().jitter_ms);
+  assert(high.targetDepth() > low.targetDepth());
+  assert(low.targetDepth() == config().min_depth);
+  assert(result.is_ordered);
+  // the adapted depth keeps the underruns and late packets low
+  assert(high.stats().late < 25);
+}
+
+void testWrapAround() {
+  // the sequence number wraps around with a max_packets which is not a power of 2
+  JitterBufferStream jitter;
+  auto cfg = config();
+  cfg.max_packets = 30;
+  // the window covers the colliding slots of the old implementation
+  cfg.min_depth = 17;
+  cfg.max_depth = 17;
+  jitter.begin(cfg);
+  Result result = simulate(jitter, trace(500, 2 * packet_ms, 0), 500, 65300);
+  assert(result.is_ordered);
+  assert(result.played >= 498);
+  assert(jitter.stats().duplicates == 0);
+  assert(jitter.stats().concealed == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testReorder();
+  testLoss();
+  testAdaptive();
+  testWrapAround();
+  Serial.println("Jitter buffer ok");
+}
+
+void loop() { stop(); }
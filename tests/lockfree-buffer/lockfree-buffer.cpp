@@ -0,0 +1,92 @@
+// Tests the LockFreeRingBuffer with one producer and one consumer thread
+#include <thread>
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioTools/LockFreeBuffer.h"
+
+using namespace audio_tools;
+
+const uint32_t COUNT = 1000000;
+
+void testBasic() {
+  // the size is rounded up to a power of 2
+  LockFreeRingBuffer<int16_t> buffer(100);
+  assert(buffer.size() == 128);
+  assert(buffer.isEmpty());
+
+  int16_t data[100];
+  int16_t result[100];
+  for (int j = 0; j < 100; j++) data[j] = j;
+  // wrap around the end of the buffer multiple times
+  for (int loop = 0; loop < 10; loop++) {
+    assert(buffer.writeArray(data, 100) == 100);
+    assert(buffer.available() == 100);
+    assert(buffer.availableForWrite() == 28);
+    assert(buffer.peek() == 0);
+    assert(buffer.readArray(result, 100) == 100);
+    assert(memcmp(data, result, sizeof(data)) == 0);
+  }
+
+  // overflow and underflow
+  assert(buffer.writeArray(data, 100) == 100);
+  assert(buffer.writeArray(data, 100) == 28);
+  assert(buffer.isFull());
+  assert(buffer.xrunStats().overflows == 1);
+  assert(buffer.readArray(result, 100) == 100);
+  assert(buffer.readArray(result, 100) == 28);
+  assert(buffer.readArray(result, 100) == 0);
+  assert(buffer.xrunStats().underflows == 0);
+  buffer.setUnderflowCounting(true);
+  assert(buffer.readArray(result, 100) == 0);
+  assert(buffer.xrunStats().underflows == 1);
+
+  // invalid sizes result in an empty buffer
+  buffer.resize(0);
+  assert(buffer.size() == 0);
+  buffer.resize(-5);
+  assert(buffer.size() == 0);
+  assert(buffer.writeArray(data, 100) == 0);
+}
+
+void testThreads() {
+  LockFreeRingBuffer<uint32_t> buffer(256);
+  std::thread producer([&]() {
+    uint32_t data[37];
+    uint32_t next = 0;
+    while (next < COUNT) {
+      int len = 0;
+      while (len < 37 && next + len < COUNT) {
+        data[len] = next + len;
+        len++;
+      }
+      int written = buffer.writeArray(data, len);
+      next += written;
+      if (written == 0) std::this_thread::yield();
+    }
+  });
+
+  // the consumer must receive all values in sequence
+  uint32_t data[53];
+  uint32_t expected = 0;
+  bool ok = true;
+  while (expected < COUNT) {
+    int len = buffer.readArray(data, 53);
+    for (int j = 0; j < len; j++) {
+      if (data[j] != expected++) ok = false;
+    }
+    if (len == 0) std::this_thread::yield();
+  }
+  producer.join();
+  assert(ok);
+  assert(buffer.isEmpty());
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testBasic();
+  testThreads();
+  Serial.println("LockFreeRingBuffer ok");
+}
+
+void loop() { stop(); }
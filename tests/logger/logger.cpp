@@ -0,0 +1,175 @@
+// Tests the AudioLogger: the debug level is removed at compile time (LOG_MIN_LEVEL=1) and the deferred
+// messages are only recorded by the producers and formatted later by processDeferred()
+// a text area of more than 255 bytes
+#define LOG_DEFERRED_TEXT_SIZE 400
+#include <string>
+#include <thread>
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Stream which collects the printed lines
+class LogCapture : public Stream {
+ public:
+  std::string text;
+  int lines = 0;
+  size_t write(uint8_t ch) override {
+    text += (char)ch;
+    if (ch == '\n') lines++;
+    return 1;
+  }
+  size_t write(const uint8_t *data, size_t len) override {
+    for (size_t j = 0; j < len; j++) write(data[j]);
+    return len;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+  void clear() {
+    text.clear();
+    lines = 0;
+  }
+} capture;
+
+/// the last line w/o prefix and new line
+std::string lastMessage() {
+  size_t end = capture.text.find_last_not_of("\r\n");
+  size_t start = capture.text.rfind(" - ", end);
+  return capture.text.substr(start + 3, end - start - 2);
+}
+
+int evaluated = 0;
+int count() { return ++evaluated; }
+
+void testCompileTimeLevel() {
+  AudioLogger::instance().begin(capture, AudioLogger::Debug);
+  capture.clear();
+  LOGD("removed %d", count());
+  assert(evaluated == 0);
+  assert(capture.lines == 0);
+  LOGI("kept %d", count());
+  assert(evaluated == 1);
+  assert(capture.lines == 1);
+  assert(capture.text.find("[I] logger.cpp : ") == 0);
+  assert(lastMessage() == "kept 1");
+}
+
+/// the formatting of the recorded arguments must give the same result as printf
+template <typename... Args>
+void checkFormat(const char *fmt, Args... args) {
+  char expected[200];
+  snprintf(expected, sizeof(expected), fmt, args...);
+  LOGW(fmt, args...);
+  assert(lastMessage() == expected);
+}
+
+void testFormat() {
+  capture.clear();
+  checkFormat("int %d %i %5d %-5d| %05d", -12, 34, 56, -7, 8);
+  checkFormat("unsigned %u %x %X %08x %o", 4000000000u, 255u, 255u, 0xabcu, 8u);
+  checkFormat("long %ld %lu %lld %llu %zu", -5l, 6ul, -7000000000ll, 8000000000ull, (size_t)9);
+  checkFormat("short %hd %hhu %c", (short)-3, (unsigned char)200, 'x');
+  checkFormat("float %f %.2f %e %g", 1.5f, 3.14159, 1e10, 0.25);
+  checkFormat("string %s %10s|%-4s| %%", "abc", "right", "l");
+  checkFormat("bool %d enum %d", true, AudioLogger::Error);
+  checkFormat("no arguments 100%%");
+}
+
+void testDeferred() {
+  AudioLogger &logger = AudioLogger::instance();
+  capture.clear();
+  logger.setDeferred(true);
+  char buffer[20];
+  strcpy(buffer, "first");
+  LOGI("deferred %s %d", buffer, 1);
+  // the string is copied when the message is recorded
+  strcpy(buffer, "changed");
+  LOGW("deferred %s %d", buffer, 2);
+  assert(capture.lines == 0);
+  assert(logger.processDeferred() == 2);
+  assert(capture.lines == 2);
+  assert(capture.text.find("deferred first 1") != std::string::npos);
+  assert(lastMessage() == "deferred changed 2");
+
+  // we never block when the queue is full
+  capture.clear();
+  for (int j = 0; j < LOG_DEFERRED_QUEUE_SIZE + 10; j++) {
+    LOGI("message %d", j);
+  }
+  assert(logger.droppedCount() == 10);
+  assert(logger.processDeferred(5) == 5);
+  assert(logger.processDeferred() == LOG_DEFERRED_QUEUE_SIZE - 5);
+  assert(capture.text.find("AudioLogger - 10 messages dropped") != std::string::npos);
+  assert(capture.text.find("message 31") != std::string::npos);
+  assert(capture.text.find("message 32") == std::string::npos);
+  logger.setDeferred(false);
+}
+
+/// multiple producers and one consumer: the messages of each producer keep their order
+void testThreads() {
+  AudioLogger &logger = AudioLogger::instance();
+  capture.clear();
+  logger.setDeferred(true);
+  uint32_t dropped_before = logger.droppedCount();
+  const int threads = 4;
+  const int messages = 2000;
+  std::thread producers[threads];
+  for (int t = 0; t < threads; t++) {
+    producers[t] = std::thread([t]() {
+      for (int j = 0; j < messages; j++) {
+        LOGI("thread %d msg %d", t, j);
+        if (j % 100 == 0) std::this_thread::yield();
+      }
+    });
+  }
+  int printed = 0;
+  for (int t = 0; t < threads; t++) producers[t].join();
+  printed += logger.processDeferred();
+  logger.setDeferred(false);
+
+  // producer runs can overtake the consumer: each message is either printed or counted as dropped
+  uint32_t dropped = logger.droppedCount() - dropped_before;
+  assert(printed + dropped == threads * messages);
+  int last[threads] = {-1, -1, -1, -1};
+  size_t pos = 0;
+  while ((pos = capture.text.find("thread ", pos)) != std::string::npos) {
+    int t, j;
+    assert(sscanf(capture.text.c_str() + pos, "thread %d msg %d", &t, &j) == 2);
+    assert(j > last[t]);
+    last[t] = j;
+    pos++;
+  }
+}
+
+// the strings are stored one after the other and truncated at the end of the text area
+void testTextArea() {
+  LogRecord record;
+  std::string part(100, 'x');
+  for (int j = 0; j < 5; j++) record.add(part.c_str());
+  assert(record.argc == 5);
+  int pos = 0;
+  for (int j = 0; j < record.argc; j++) {
+    int len = LOG_DEFERRED_TEXT_SIZE - 1 - pos;
+    if (len > 100) len = 100;
+    assert(record.types[j] == LogArgString);
+    assert(record.args[j] == pos);
+    assert(std::string(record.text + pos) == part.substr(0, len));
+    pos += len + 1;
+    if (pos > LOG_DEFERRED_TEXT_SIZE - 1) pos = LOG_DEFERRED_TEXT_SIZE - 1;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  testCompileTimeLevel();
+  testTextArea();
+  testFormat();
+  testDeferred();
+  testThreads();
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  Serial.println("AudioLogger ok");
+}
+
+void loop() { stop(); }
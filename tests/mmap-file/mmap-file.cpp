@@ -0,0 +1,90 @@
+// Tests the MMapFileStream: writing and reading of WAV and raw files
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioLibs/MMapFileStream.h"
+
+using namespace audio_tools;
+
+const char *WAV_FILE = "mmap-test.wav";
+const char *RAW_FILE = "mmap-test.raw";
+const int FRAMES = 10000;
+
+void write(const char *path, bool isWav) {
+  MMapFileStream out;
+  auto cfg = out.defaultConfig(TX_MODE);
+  cfg.is_wav = isWav;
+  cfg.sample_rate = 8000;
+  cfg.channels = 2;
+  // the mapping needs to be extended multiple times
+  cfg.reserve_size = 1000;
+  assert(out.begin(path, cfg));
+  int16_t frame[2];
+  for (int j = 0; j < FRAMES / 2; j++) {
+    frame[0] = j;
+    frame[1] = -j;
+    assert(out.write((uint8_t *)frame, sizeof(frame)) == sizeof(frame));
+  }
+  // zero copy
+  int16_t *data = (int16_t *)out.writeSpan(FRAMES / 2 * 4);
+  assert(data != nullptr);
+  for (int j = FRAMES / 2; j < FRAMES; j++) {
+    *data++ = j;
+    *data++ = -j;
+  }
+  assert(out.size() == FRAMES * 4);
+  out.end();
+}
+
+void read(const char *path, bool isWav) {
+  MMapFileStream in;
+  auto cfg = in.defaultConfig(RX_MODE);
+  cfg.is_wav = isWav;
+  cfg.sample_rate = 8000;
+  assert(in.begin(path, cfg));
+  assert(in.audioInfo().sample_rate == 8000);
+  assert(in.audioInfo().channels == 2);
+  assert(in.size() == FRAMES * 4);
+  assert(in.frames() == FRAMES);
+  assert(in.available() == FRAMES * 4);
+
+  // zero copy access
+  int16_t *data = (int16_t *)in.data();
+  for (int j = 0; j < FRAMES; j++) {
+    assert(data[j * 2] == j);
+    assert(data[j * 2 + 1] == -j);
+  }
+  const uint8_t *ptr;
+  assert(in.readSpan(ptr, 8) == 8);
+  assert(ptr == in.data());
+
+  // random access
+  assert(in.seekFrame(9000));
+  int16_t frame[2];
+  assert(in.readBytes((uint8_t *)frame, sizeof(frame)) == sizeof(frame));
+  assert(frame[0] == 9000 && frame[1] == -9000);
+  assert(in.position() == 9001 * 4);
+  assert(((int16_t *)in.frame(FRAMES - 1))[0] == FRAMES - 1);
+  assert(in.frame(FRAMES) == nullptr);
+  assert(!in.seek(FRAMES * 4 + 1));
+  assert(in.seekFrame(FRAMES));
+  assert(in.available() == 0);
+  assert(in.read() == -1);
+  in.end();
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  write(WAV_FILE, true);
+  read(WAV_FILE, true);
+  write(RAW_FILE, false);
+  read(RAW_FILE, false);
+  // a WAV header is required
+  MMapFileStream in;
+  assert(!in.begin(RAW_FILE, in.defaultConfig()));
+  remove(WAV_FILE);
+  remove(RAW_FILE);
+  Serial.println("MMapFileStream ok");
+}
+
+void loop() { stop(); }
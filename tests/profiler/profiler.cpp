@@ -0,0 +1,121 @@
+// Tests the AudioProfiler with a chain of stages which need a known processing time: each
+// stage must get its own exclusive time and the bytes which are passed between the stages
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// Stage which needs the indicated time per call and writes half of the data to the next stage
+class BusyStage : public AudioStreamX {
+ public:
+  BusyStage(Print &out, uint32_t us) : p_out(&out), busy_us(us) {}
+  size_t write(const uint8_t *data, size_t len) override {
+    uint32_t start = micros();
+    while ((uint32_t)(micros() - start) < busy_us);
+    p_out->write(data, len / 2);
+    return len;
+  }
+
+ protected:
+  Print *p_out;
+  uint32_t busy_us;
+};
+
+/// Source which needs the indicated time per call
+class BusySource : public AudioStreamX {
+ public:
+  BusySource(uint32_t us) : busy_us(us) {}
+  size_t readBytes(uint8_t *data, size_t len) override {
+    uint32_t start = micros();
+    while ((uint32_t)(micros() - start) < busy_us);
+    memset(data, 0, len);
+    return len;
+  }
+  int available() override { return DEFAULT_BUFFER_SIZE; }
+
+ protected:
+  uint32_t busy_us;
+};
+
+bool isNear(uint64_t value, uint64_t expected) { return value >= expected && value < expected * 13 / 10 + 500; }
+
+void testWriteChain() {
+  NullStream null;
+  BusyStage sink(null, 100);
+  ProfiledStream sink_p(sink, "sink");
+  BusyStage volume(sink_p, 200);
+  ProfiledStream volume_p(volume, "volume");
+  BusyStage decoder(volume_p, 300);
+  ProfiledStream decoder_p(decoder, "decoder");
+  AudioProfiler::instance().reset();
+
+  AudioBaseInfo info;
+  info.sample_rate = 8000;
+  info.channels = 1;
+  info.bits_per_sample = 16;
+  volume_p.setAudioInfo(info);
+
+  uint8_t data[400];
+  for (int j = 0; j < 100; j++) decoder_p.write(data, sizeof(data));
+
+  ProfileStats &d = decoder_p.profileStats();
+  ProfileStats &v = volume_p.profileStats();
+  ProfileStats &s = sink_p.profileStats();
+  assert(d.calls == 100 && v.calls == 100 && s.calls == 100);
+  assert(d.bytes_in == 40000 && d.bytes_out == 20000);
+  assert(v.bytes_in == 20000 && v.bytes_out == 10000);
+  assert(s.bytes_in == 10000 && s.bytes_out == 0);
+  // exclusive times do not contain the downstream stages
+  assert(isNear(d.exclusive_us, 30000));
+  assert(isNear(v.exclusive_us, 20000));
+  assert(isNear(s.exclusive_us, 10000));
+  assert(isNear(d.inclusive_us, 60000));
+  // 20000 bytes are 1.25 seconds of audio which needed 20ms
+  assert(v.usPerAudioSecond() >= 16000 && v.usPerAudioSecond() < 22000);
+
+  AudioProfiler::instance().printCSV(Serial);
+  AudioProfiler::instance().printJSON(Serial);
+  assert(AudioProfiler::instance().stageCount() == 3);
+
+  AudioProfiler::instance().reset();
+  assert(d.calls == 0 && d.exclusive_us == 0);
+}
+
+void testReadChain() {
+  BusySource source(200);
+  ProfiledStream source_p(source, "source");
+  // the reader of the source does some processing itself
+  class Reader : public AudioStreamX {
+   public:
+    Reader(Stream &in) : p_in(&in) {}
+    size_t readBytes(uint8_t *data, size_t len) override {
+      uint32_t start = micros();
+      while ((uint32_t)(micros() - start) < 100);
+      return p_in->readBytes(data, len);
+    }
+    Stream *p_in;
+  } reader(source_p);
+  ProfiledStream reader_p(reader, "reader");
+  assert(AudioProfiler::instance().stageCount() == 2);
+
+  uint8_t data[100];
+  for (int j = 0; j < 50; j++) reader_p.readBytes(data, sizeof(data));
+  ProfileStats &r = reader_p.profileStats();
+  ProfileStats &s = source_p.profileStats();
+  assert(r.bytes_in == 5000 && r.bytes_out == 5000);
+  assert(s.bytes_out == 5000 && s.bytes_in == 0);
+  assert(isNear(r.exclusive_us, 5000));
+  assert(isNear(s.exclusive_us, 10000));
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testWriteChain();
+  // the stages are removed when they are destroyed
+  assert(AudioProfiler::instance().stageCount() == 0);
+  testReadChain();
+  Serial.println("AudioProfiler ok");
+}
+
+void loop() { stop(); }
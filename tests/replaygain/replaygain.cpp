@@ -0,0 +1,188 @@
+// Tests the parsing of the ReplayGain values and the ramped gain of the VolumeStream
+#include "Arduino.h"
+#include "AudioTools.h"
+#include "AudioMetaData/MetaDataReplayGain.h"
+#include <vector>
+
+using namespace audio_tools;
+
+bool near(float value, float expected) { return fabs(value - expected) < 0.001; }
+
+/// Collects the written samples
+class SampleCollector : public Print {
+ public:
+  std::vector<int16_t> samples;
+  size_t write(const uint8_t *data, size_t len) override {
+    const int16_t *pt = (const int16_t *)data;
+    samples.insert(samples.end(), pt, pt + len / 2);
+    return len;
+  }
+  size_t write(uint8_t) override { return 0; }
+};
+
+/// Creates an ID3v2 tag with one TXXX frame: the size of the tag is defined explicitly
+std::vector<uint8_t> id3Tag(const char *key, const char *value, int tagSize) {
+  std::vector<uint8_t> frame;
+  frame.push_back(0);  // ISO-8859-1
+  frame.insert(frame.end(), key, key + strlen(key) + 1);
+  frame.insert(frame.end(), value, value + strlen(value) + 1);
+  std::vector<uint8_t> result = {'I', 'D', '3', 3, 0, 0};
+  for (int shift = 21; shift >= 0; shift -= 7) result.push_back((tagSize >> shift) & 0x7F);
+  result.insert(result.end(), {'T', 'X', 'X', 'X', 0, 0, 0, (uint8_t)frame.size(), 0, 0});
+  result.insert(result.end(), frame.begin(), frame.end());
+  return result;
+}
+
+/// Adds a Vorbis comment (little endian length followed by KEY=value)
+void addComment(std::vector<uint8_t> &data, const char *comment) {
+  uint32_t len = strlen(comment);
+  for (int j = 0; j < 4; j++) data.push_back(len >> (8 * j));
+  data.insert(data.end(), comment, comment + len);
+}
+
+void testTXXX() {
+  std::vector<uint8_t> data = id3Tag("REPLAYGAIN_TRACK_GAIN", "-6.50 dB", 200);
+  data.resize(210);
+  MetaDataReplayGain parser;
+  parser.begin();
+  assert(parser.write(data.data(), data.size()));
+  ReplayGainInfo &info = parser.replayGain();
+  assert(info.has_track_gain);
+  assert(!info.has_album_gain);
+  assert(near(info.track_gain, -6.5));
+  // the whole tag has been scanned
+  assert(!parser.isActive());
+}
+
+void testVorbisComments() {
+  std::vector<uint8_t> data = {'O', 'g', 'g', 'S'};
+  addComment(data, "TITLE=Test");
+  addComment(data, "REPLAYGAIN_ALBUM_GAIN=-3.20 dB");
+  addComment(data, "replaygain_album_peak=0.988");
+  // R128 Q7.8 value of 1 dB relative to -23 LUFS: +5 dB for the ReplayGain reference
+  addComment(data, "R128_TRACK_GAIN=256");
+  addComment(data, "ENCODER=x");
+  MetaDataReplayGain parser;
+  parser.begin();
+  assert(parser.write(data.data(), data.size()));
+  ReplayGainInfo &info = parser.replayGain();
+  assert(info.has_album_gain);
+  assert(near(info.album_gain, -3.2));
+  assert(near(info.album_peak, 0.988));
+  assert(info.has_track_gain);
+  assert(near(info.track_gain, 6.0));
+  // we are still scanning
+  assert(parser.isActive());
+}
+
+void testR128() {
+  // a ReplayGain value has priority over the R128 value
+  std::vector<uint8_t> data;
+  addComment(data, "REPLAYGAIN_TRACK_GAIN=-2.00 dB");
+  addComment(data, "R128_TRACK_GAIN=-1280");
+  addComment(data, "R128_ALBUM_GAIN=-1280");
+  data.push_back(0);
+  MetaDataReplayGain parser;
+  parser.begin();
+  parser.write(data.data(), data.size());
+  ReplayGainInfo &info = parser.replayGain();
+  assert(near(info.track_gain, -2.0));
+  assert(near(info.album_gain, 0.0));
+  assert(info.has_album_gain);
+}
+
+void testLimits() {
+  // the value after the scan limit is ignored
+  std::vector<uint8_t> data(100, ' ');
+  addComment(data, "REPLAYGAIN_TRACK_GAIN=-6.50 dB");
+  MetaDataReplayGain parser;
+  parser.setLimit(50);
+  parser.begin();
+  assert(!parser.write(data.data(), data.size()));
+  assert(!parser.replayGain().has_track_gain);
+  assert(!parser.isActive());
+  // inactive parsers ignore the data
+  assert(!parser.write(data.data() + 100, data.size() - 100));
+
+  // the value after the ID3v2 tag is ignored: the tag size is smaller than the TXXX frame
+  data = id3Tag("REPLAYGAIN_TRACK_GAIN", "-6.50 dB", 20);
+  parser.setLimit(REPLAY_GAIN_SCAN_LIMIT);
+  parser.begin();
+  // write in small blocks
+  for (size_t pos = 0; pos < data.size(); pos += 7) {
+    size_t len = data.size() - pos < 7 ? data.size() - pos : 7;
+    assert(!parser.write(data.data() + pos, len));
+  }
+  assert(!parser.replayGain().has_track_gain);
+  assert(!parser.isActive());
+}
+
+void testFactor() {
+  ReplayGainInfo info;
+  assert(info.factor(ReplayGainTrack) == 1.0);
+  info.track_gain = 6.0;
+  info.track_peak = 0.8;
+  info.has_track_gain = true;
+  assert(info.factor(ReplayGainOff) == 1.0);
+  // with clip prevention the peak is limited to full scale
+  assert(near(info.factor(ReplayGainTrack), 1.0 / 0.8));
+  assert(near(info.factor(ReplayGainTrack, 0.0, false), pow(10.0, 6.0 / 20.0)));
+  // the album mode falls back to the track gain
+  assert(near(info.factor(ReplayGainAlbum), 1.0 / 0.8));
+  info.album_gain = -6.0;
+  info.album_peak = 0.8;
+  info.has_album_gain = true;
+  assert(near(info.factor(ReplayGainAlbum), pow(10.0, -6.0 / 20.0)));
+  assert(near(info.factor(ReplayGainAlbum, 6.0), 1.0));
+  // no peak: no limit
+  info.track_peak = 0.0;
+  assert(near(info.factor(ReplayGainTrack), pow(10.0, 6.0 / 20.0)));
+}
+
+void testRamp() {
+  SampleCollector out;
+  VolumeStream volume(out);
+  auto cfg = volume.defaultConfig();
+  cfg.sample_rate = 1000;
+  cfg.channels = 2;
+  cfg.bits_per_sample = 16;
+  cfg.allow_boost = true;
+  cfg.volume = 1.0;
+  volume.begin(cfg);
+
+  int16_t data[40];
+  // the gain is ramped over 10 frames: 1000 * 10 / 1000
+  volume.setGain(0.5, 10);
+  for (int j = 0; j < 40; j++) data[j] = 10000;
+  volume.write((uint8_t *)data, sizeof(data));
+  assert(out.samples.size() == 40);
+  assert(out.samples[0] == 9500 && out.samples[1] == 9500);
+  assert(out.samples[16] > 5100);
+  assert(abs(out.samples[18] - 5000) <= 1);
+  for (int j = 20; j < 40; j++) assert(out.samples[j] == 5000);
+
+  // the gain is kept when the volume is changed
+  volume.setVolume(1.0);
+  assert(volume.gainFactor() == 0.5);
+  for (int j = 0; j < 40; j++) data[j] = 10000;
+  volume.write((uint8_t *)data, sizeof(data));
+  for (int j = 40; j < 80; j++) assert(out.samples[j] == 5000);
+  volume.setVolume(0.5);
+  for (int j = 0; j < 40; j++) data[j] = 10000;
+  volume.write((uint8_t *)data, sizeof(data));
+  for (int j = 80; j < 120; j++) assert(out.samples[j] == 2500);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  testTXXX();
+  testVorbisComments();
+  testR128();
+  testLimits();
+  testFactor();
+  testRamp();
+  Serial.println("ReplayGain ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,254 @@
+// Tests the RTP packetization with an in memory transport: the packets are collected in a vector
+// and then passed to the depacketizer, which must provide the original data
+#include <vector>
+#include <string>
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+/// In memory transport: each write is one packet
+class PacketTransport : public Print {
+ public:
+  std::vector<std::string> packets;
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *data, size_t len) override {
+    packets.push_back(std::string((const char *)data, len));
+    return len;
+  }
+};
+
+/// Collects the received data
+class MemoryOutput : public Print {
+ public:
+  std::string data;
+  std::vector<std::string> writes;
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *buf, size_t len) override {
+    data.append((const char *)buf, len);
+    writes.push_back(std::string((const char *)buf, len));
+    return len;
+  }
+};
+
+uint16_t seqOf(const std::string &p) { return (uint8_t)p[2] << 8 | (uint8_t)p[3]; }
+uint32_t tsOf(const std::string &p) {
+  return (uint32_t)(uint8_t)p[4] << 24 | (uint32_t)(uint8_t)p[5] << 16 | (uint8_t)p[6] << 8 | (uint8_t)p[7];
+}
+
+void roundTrip(PacketTransport &transport, RTPDepacketizer &depacketizer) {
+  for (auto &packet : transport.packets) depacketizer.write(packet.data(), packet.size());
+}
+
+void testL16() {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.ssrc = 1234;
+  packetizer.begin(cfg);
+
+  std::string pcm;
+  for (int j = 0; j < 10000; j++) {
+    int16_t sample = j * 7;
+    pcm.append((const char *)&sample, 2);
+  }
+  // write in odd pieces
+  for (size_t pos = 0; pos < pcm.size(); pos += 333) {
+    packetizer.write(pcm.data() + pos, min((size_t)333, pcm.size() - pos));
+  }
+  packetizer.end();
+
+  // 20ms at 44100 stereo are 3528 bytes which do not fit into the mtu: 1388 / 4 * 4 = 1388
+  assert(transport.packets.size() == (size_t)(pcm.size() + 1387) / 1388);
+  for (size_t j = 0; j < transport.packets.size(); j++) {
+    const std::string &p = transport.packets[j];
+    assert(p.size() <= 1400);
+    assert((uint8_t)p[0] == 0x80);
+    assert(((uint8_t)p[1] & 0x80) == (j == 0 ? 0x80 : 0));
+    assert(((uint8_t)p[1] & 0x7F) == 10);
+    assert(seqOf(p) == (uint16_t)(seqOf(transport.packets[0]) + j));
+    assert(tsOf(p) - tsOf(transport.packets[0]) == j * 347);
+  }
+  // network byte order
+  assert(transport.packets[0][12 + 3] == pcm[2] && transport.packets[0][12 + 2] == pcm[3]);
+
+  MemoryOutput out;
+  RTPDepacketizer depacketizer(out);
+  depacketizer.begin(cfg);
+  roundTrip(transport, depacketizer);
+  assert(out.data == pcm);
+  assert(depacketizer.stats().lost == 0);
+
+  // lost packet
+  MemoryOutput out1;
+  RTPDepacketizer lossy(out1);
+  lossy.begin(cfg);
+  transport.packets.erase(transport.packets.begin() + 3);
+  std::swap(transport.packets[5], transport.packets[6]);
+  roundTrip(transport, lossy);
+  assert(lossy.stats().lost == 2);
+  assert(lossy.stats().late == 1);
+}
+
+void testL16Jitter() {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.channels = 1;
+  cfg.sample_rate = 8000;
+  packetizer.begin(cfg);
+  for (int16_t j = 0; j < 1600; j++) packetizer.write(&j, 2);
+  packetizer.end();
+  assert(transport.packets.size() == 10);
+  std::swap(transport.packets[2], transport.packets[3]);
+
+  // the jitter buffer reorders the packets
+  JitterBufferStream jitter;
+  auto jcfg = jitter.defaultConfig();
+  jcfg.packet_size = 320;
+  jcfg.packet_duration_ms = 20;
+  // we deliver all packets at once
+  jcfg.max_excess = 16;
+  jitter.begin(jcfg);
+  RTPDepacketizer depacketizer;
+  depacketizer.setJitterBuffer(&jitter);
+  depacketizer.begin(cfg);
+  roundTrip(transport, depacketizer);
+  int16_t pcm[1600];
+  assert(jitter.readBytes((uint8_t *)pcm, sizeof(pcm)) == sizeof(pcm));
+  for (int16_t j = 0; j < 1600; j++) assert(pcm[j] == j);
+}
+
+void testG711() {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.format = RTP_PCMU;
+  cfg.sample_rate = 8000;
+  cfg.channels = 1;
+  packetizer.begin(cfg);
+  std::string data;
+  for (int j = 0; j < 1000; j++) data += (char)j;
+  packetizer.write(data.data(), data.size());
+  packetizer.end();
+  // 20ms are 160 bytes
+  assert(transport.packets.size() == 7);
+  assert(((uint8_t)transport.packets[0][1] & 0x7F) == 0);
+  assert(tsOf(transport.packets[6]) - tsOf(transport.packets[0]) == 6 * 160);
+  assert(transport.packets[6].size() == 12 + 40);
+
+  MemoryOutput out;
+  RTPDepacketizer depacketizer(out);
+  depacketizer.begin(cfg);
+  roundTrip(transport, depacketizer);
+  assert(out.data == data);
+}
+
+void testOpus() {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.format = RTP_OPUS;
+  packetizer.begin(cfg);
+  std::vector<std::string> frames;
+  for (int j = 0; j < 20; j++) {
+    // CELT 20ms (config 19) or SILK 60ms (config 3)
+    std::string frame(random(10, 200), (char)j);
+    frame[0] = j % 2 == 0 ? (19 << 3) : (3 << 3);
+    frames.push_back(frame);
+    packetizer.write(frame.data(), frame.size());
+  }
+  assert(transport.packets.size() == 20);
+  assert(tsOf(transport.packets[1]) - tsOf(transport.packets[0]) == 960);
+  assert(tsOf(transport.packets[2]) - tsOf(transport.packets[0]) == 960 + 2880);
+
+  // each packet is provided with a single write to the decoder
+  MemoryOutput out;
+  RTPDepacketizer depacketizer(out);
+  depacketizer.begin(cfg);
+  roundTrip(transport, depacketizer);
+  assert(out.writes == frames);
+}
+
+/// joint stereo, 16 blocks, 8 subbands, bitpool 35: 83 bytes
+std::string sbcFrame(int idx) {
+  std::string frame(83, (char)idx);
+  frame[0] = (char)0x9C;
+  frame[1] = (char)(2 << 6 | 3 << 4 | 3 << 2 | 1);
+  frame[2] = 35;
+  return frame;
+}
+
+void testSBC(int mtu) {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.format = RTP_SBC;
+  cfg.mtu = mtu;
+  packetizer.begin(cfg);
+  assert(RTPBase::sbcFrameLen((const uint8_t *)sbcFrame(0).data()) == 83);
+  std::string data;
+  for (int j = 0; j < 40; j++) data += sbcFrame(j);
+  // write in random pieces
+  for (size_t pos = 0; pos < data.size();) {
+    size_t n = min((size_t)random(1, 200), data.size() - pos);
+    packetizer.write(data.data() + pos, n);
+    pos += n;
+  }
+  packetizer.end();
+  for (auto &p : transport.packets) assert(p.size() <= (size_t)mtu);
+  if (mtu < 100) {
+    // each frame is split into 2 fragments with the same timestamp
+    assert(transport.packets.size() == 80);
+    assert((uint8_t)transport.packets[0][12] == (0x80 | 0x40 | 2));
+    assert((uint8_t)transport.packets[1][12] == (0x80 | 0x20 | 1));
+    assert(tsOf(transport.packets[1]) == tsOf(transport.packets[0]));
+    assert(tsOf(transport.packets[2]) - tsOf(transport.packets[0]) == 128);
+  } else {
+    // max 15 frames per packet
+    assert((uint8_t)transport.packets[0][12] == min(15, (mtu - 13) / 83));
+  }
+
+  MemoryOutput out;
+  RTPDepacketizer depacketizer(out);
+  depacketizer.begin(cfg);
+  roundTrip(transport, depacketizer);
+  assert(out.data == data);
+}
+
+void testInvalidConfig() {
+  PacketTransport transport;
+  RTPPacketizer packetizer(transport);
+  auto cfg = packetizer.defaultConfig();
+  cfg.packet_ms = 0;
+  assert(!packetizer.begin(cfg));
+  assert(!packetizer);
+  assert(packetizer.write("abcd", 4) == 0);
+  cfg.packet_ms = 20;
+  cfg.mtu = 12;
+  assert(!packetizer.begin(cfg));
+  // 1 ms of 8 kHz mono PCMU fits
+  cfg.mtu = 1400;
+  cfg.format = RTP_PCMU;
+  cfg.sample_rate = 8000;
+  cfg.channels = 1;
+  cfg.packet_ms = 1;
+  assert(packetizer.begin(cfg));
+  assert(packetizer.write("abcdefghij", 10) == 10);
+  assert(transport.packets.size() == 1 && transport.packets[0].size() == 12 + 8);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testL16();
+  testL16Jitter();
+  testG711();
+  testOpus();
+  testSBC(1400);
+  testSBC(60);
+  testInvalidConfig();
+  Serial.println("RTP ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,188 @@
+// Tests the PacketSendQueue with a simulated transport which is confirmed by the test
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+// simulated transport: we record the submitted packets
+struct Transport {
+  int submitted = 0;
+  int bytes = 0;
+  bool accept = true;
+  uint8_t last[250];
+  size_t last_len = 0;
+  int32_t values[32];
+} transport;
+
+bool sendPacket(const uint8_t *data, size_t len, void *ref) {
+  Transport *t = (Transport *)ref;
+  if (!t->accept) return false;
+  t->submitted++;
+  t->bytes += len;
+  memcpy(t->last, data, len);
+  if (t->submitted <= 32) memcpy(&t->values[t->submitted - 1], data, 4);
+  t->last_len = len;
+  return true;
+}
+
+void reset() { transport = Transport(); }
+
+uint8_t data[4000];
+
+// write does not wait and the queue is drained by the send-complete callback
+void testBackpressure() {
+  reset();
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.packet_count = 4;
+  queue.setTransport(sendPacket, &transport);
+  queue.begin(cfg);
+  assert(queue.availableForWrite() == 1000);
+
+  // one packet is in flight and 4 are queued: the rest is rejected
+  unsigned long start = millis();
+  size_t written = queue.write(data, sizeof(data));
+  assert(millis() - start < 2);
+  assert(written == 1250);
+  assert(transport.submitted == 1);
+  assert(queue.isSending());
+  assert(queue.availableForWrite() == 0);
+  assert(queue.write(data, 10) == 0);
+
+  // the confirmation sends the next packet
+  queue.sendComplete(true);
+  assert(transport.submitted == 2);
+  assert(queue.availableForWrite() == 250);
+  while (queue.isSending()) queue.sendComplete(true);
+  assert(queue.isEmpty());
+  assert(transport.bytes == 1250);
+  assert(queue.stats().sent == 5);
+
+  // partial packets are sent as is
+  assert(queue.write(data, 10) == 10);
+  assert(transport.last_len == 10);
+  queue.sendComplete(true);
+  assert(queue.isEmpty());
+}
+
+// the packets are sent in order
+void testOrder() {
+  reset();
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.packet_size = 4;
+  cfg.packet_count = 8;
+  queue.setTransport(sendPacket, &transport);
+  queue.begin(cfg);
+  for (int j = 0; j < 20; j++) {
+    int32_t value = j;
+    if (j % 3 == 2) {
+      // we use the callback to make space
+      while (queue.availableForWrite() < 4) queue.sendComplete(true);
+    }
+    while (queue.write((uint8_t *)&value, 4) == 0) queue.sendComplete(true);
+    assert(queue.isSending());
+  }
+  while (queue.isSending()) queue.sendComplete(true);
+  assert(transport.submitted == 20);
+  for (int j = 0; j < 20; j++) {
+    assert(transport.values[j] == j);
+  }
+}
+
+// a failed packet is retried and dropped after the retry count
+void testRetry() {
+  reset();
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.retry_count = 2;
+  queue.setTransport(sendPacket, &transport);
+  queue.begin(cfg);
+  queue.write(data, 500);
+  queue.sendComplete(false);
+  assert(transport.submitted == 2);
+  queue.sendComplete(false);
+  assert(transport.submitted == 3);
+  // third failure: we give up and continue with the next packet
+  queue.sendComplete(false);
+  assert(transport.submitted == 4);
+  assert(queue.stats().dropped == 1);
+  assert(queue.stats().failed == 3);
+  queue.sendComplete(true);
+  assert(queue.isEmpty());
+
+  // with a retry delay the failed packet is resent by update()
+  reset();
+  cfg.retry_count = -1;
+  cfg.retry_delay_ms = 20;
+  queue.begin(cfg);
+  queue.write(data, 100);
+  queue.sendComplete(false);
+  assert(!queue.isSending());
+  queue.update();
+  assert(transport.submitted == 1);
+  delay(25);
+  queue.update();
+  assert(transport.submitted == 2);
+  queue.sendComplete(true);
+  assert(queue.isEmpty());
+
+  // the transport refuses the packet: e.g. no peer
+  reset();
+  transport.accept = false;
+  assert(queue.write(data, 100) == 100);
+  assert(!queue.isEmpty());
+  assert(!queue.isSending());
+  transport.accept = true;
+  delay(25);
+  queue.update();
+  assert(transport.submitted == 1);
+}
+
+// live audio: we drop the oldest packets instead of rejecting the data
+void testDropOldest() {
+  reset();
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.packet_size = 4;
+  cfg.packet_count = 2;
+  cfg.full_policy = PacketQueueDropOldest;
+  queue.setTransport(sendPacket, &transport);
+  queue.begin(cfg);
+  for (int32_t j = 0; j < 10; j++) {
+    assert(queue.write((uint8_t *)&j, 4) == 4);
+  }
+  assert(queue.stats().overflows == 7);
+  assert(*(int32_t *)transport.last == 0);
+  queue.sendComplete(true);
+  assert(*(int32_t *)transport.last == 8);
+  queue.sendComplete(true);
+  assert(*(int32_t *)transport.last == 9);
+}
+
+// without acknowledgments the queue is drained immediately
+void testNoAck() {
+  reset();
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.use_send_ack = false;
+  queue.setTransport(sendPacket, &transport);
+  queue.begin(cfg);
+  assert(queue.write(data, sizeof(data)) == sizeof(data));
+  assert(transport.bytes == sizeof(data));
+  assert(queue.isEmpty());
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  for (int j = 0; j < (int)sizeof(data); j++) data[j] = j;
+  testBackpressure();
+  testOrder();
+  testRetry();
+  testDropOldest();
+  testNoAck();
+  Serial.println("PacketSendQueue ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,125 @@
+// Encodes PCM data to S/PDIF and decodes the result back to PCM
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+const int frames = 1000;
+
+/// Output which accepts only a limited number of bytes until more space is granted
+class StallingOutput : public Print {
+ public:
+  MemoryStream &out;
+  size_t space = 0;
+  StallingOutput(MemoryStream &out) : out(out) {}
+  size_t write(const uint8_t *data, size_t len) override {
+    if (len > space) len = space;
+    space -= len;
+    return out.write(data, len);
+  }
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+};
+
+// compare the decoded result with the original
+template <typename T>
+void test(int bits) {
+  AudioBaseInfo info;
+  info.sample_rate = 48000;
+  info.channels = 2;
+  info.bits_per_sample = bits;
+
+  // stereo test data: a ramp on the left and the inverted ramp on the right
+  T pcm[frames * 2];
+  int32_t max_value = (1 << (bits - 1)) - 1;
+  for (int j = 0; j < frames; j++) {
+    pcm[j * 2] = (T)(max_value - (j * 7919) % (2 * max_value));
+    pcm[j * 2 + 1] = -pcm[j * 2];
+  }
+
+  MemoryStream encoded(frames * 16);
+  MemoryStream decoded(sizeof(pcm) + 1);
+  encoded.begin();
+  decoded.begin();
+
+  SPDIFEncoder encoder(encoded);
+  encoder.begin(info);
+  // write in odd chunk sizes so that samples are split
+  const uint8_t *data = (const uint8_t *)pcm;
+  size_t pos = 0;
+  while (pos < sizeof(pcm)) {
+    size_t len = min((size_t)333, sizeof(pcm) - pos);
+    encoder.write(data + pos, len);
+    pos += len;
+  }
+  encoder.end();
+  assert(encoded.available() == frames * 16);
+
+  SPDIFDecoder decoder(decoded);
+  decoder.setAudioInfo(info);
+  decoder.begin();
+  decoder.write(encoded.data(), encoded.available());
+  assert(decoder.errors() == 0);
+  assert(decoded.available() == sizeof(pcm));
+  assert(memcmp(decoded.data(), pcm, sizeof(pcm)) == 0);
+  // channel status: sample rate and word length
+  assert(decoder.channelStatus()[3] == 0b0010);
+  assert(memcmp(decoder.channelStatus(), encoder.channelStatus(), 24) == 0);
+
+  Serial.print("SPDIF ok for bits: ");
+  Serial.println(bits);
+}
+
+// a stalled output must not lose any data: we report the accepted bytes
+void testStall() {
+  AudioBaseInfo info;
+  info.sample_rate = 48000;
+  info.channels = 2;
+  info.bits_per_sample = 16;
+  int16_t pcm[frames * 2];
+  for (int j = 0; j < frames * 2; j++) pcm[j] = j * 31;
+
+  MemoryStream encoded(frames * 16);
+  MemoryStream decoded(sizeof(pcm) + 1);
+  encoded.begin();
+  decoded.begin();
+  StallingOutput output(encoded);
+  SPDIFEncoder encoder(output);
+  encoder.begin(info);
+
+  const uint8_t *data = (const uint8_t *)pcm;
+  size_t pos = 0;
+  int stalls = 0;
+  while (pos < sizeof(pcm)) {
+    size_t len = min((size_t)333, sizeof(pcm) - pos);
+    size_t written = encoder.write(data + pos, len);
+    assert(written <= len);
+    if (written < len) stalls++;
+    pos += written;
+    // the output accepts only part of the encoded data
+    output.space += 700;
+  }
+  assert(stalls > 0);
+  output.space = frames * 16;
+  encoder.end();
+  assert(encoded.available() == frames * 16);
+
+  SPDIFDecoder decoder(decoded);
+  decoder.setAudioInfo(info);
+  decoder.begin();
+  decoder.write(encoded.data(), encoded.available());
+  assert(decoder.errors() == 0);
+  assert(decoded.available() == sizeof(pcm));
+  assert(memcmp(decoded.data(), pcm, sizeof(pcm)) == 0);
+  Serial.println("SPDIF ok for stalled output");
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  test<int16_t>(16);
+  test<int32_t>(20);
+  test<int32_t>(24);
+  testStall();
+}
+
+void loop() { stop(); }
@@ -0,0 +1,86 @@
+// Tests the Throttle: a long run with small blocks must stay within a sample accurate tolerance.
+// The time is provided by a simulated clock whose sleeps oversleep like a real scheduler, so the
+// result does not depend on the load of the machine running the test.
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+const uint64_t max_oversleep_us = 300;
+uint64_t test_now_us = 0;
+uint32_t random_state = 1;
+
+uint64_t testNowUs() { return test_now_us; }
+
+/// sleeps are late by up to max_oversleep_us
+void testSleepUs(uint64_t us) {
+  random_state = random_state * 1103515245 + 12345;
+  test_now_us += us + (random_state >> 16) % max_oversleep_us;
+}
+
+void testLongRun(int sample_rate, int frames_per_block, int duration_ms) {
+  Throttle throttle;
+  auto cfg = throttle.defaultConfig();
+  cfg.sample_rate = sample_rate;
+  cfg.channels = 2;
+  throttle.begin(cfg);
+
+  int bytes_per_block = frames_per_block * 4;
+  int blocks = (int64_t)sample_rate * duration_ms / 1000 / frames_per_block;
+  int64_t block_us = (int64_t)frames_per_block * 1000000 / sample_rate;
+  uint64_t start = test_now_us;
+  for (int j = 0; j < blocks; j++) {
+    throttle.startDelay();
+    throttle.delayBytes(bytes_per_block);
+    // we never run faster and the oversleeping is not accumulated
+    assert(throttle.driftUs() >= 0);
+    assert(throttle.driftUs() < (int32_t)max_oversleep_us);
+    // the processing of a block takes some time
+    test_now_us += block_us / 2;
+  }
+  int64_t elapsed = test_now_us - start;
+  int64_t expected = (int64_t)blocks * frames_per_block * 1000000 / sample_rate;
+  Serial.print("expected us: ");
+  Serial.print((long)expected);
+  Serial.print(" elapsed us: ");
+  Serial.print((long)elapsed);
+  Serial.print(" jitter us: ");
+  Serial.println(throttle.jitterUs());
+
+  // the error does not accumulate: the tolerance is below the duration of a block
+  assert(throttle.samples() == (uint64_t)blocks * frames_per_block);
+  assert(throttle.maxDriftUs() < (int32_t)max_oversleep_us);
+  assert(elapsed >= expected);
+  assert(elapsed - expected < block_us + (int64_t)max_oversleep_us);
+}
+
+void testRestart() {
+  Throttle throttle;
+  auto cfg = throttle.defaultConfig();
+  cfg.max_late_us = 10000;
+  throttle.begin(cfg);
+  throttle.startDelay();
+  throttle.delaySamples(441);
+  // the source stalls: we do not try to catch up
+  test_now_us += 50000;
+  throttle.delaySamples(441);
+  assert(throttle.samples() == 0);
+  uint64_t start = test_now_us;
+  throttle.delaySamples(441);
+  assert(test_now_us - start >= 10000);
+  assert(throttle.driftUs() >= 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  AudioClock::instance().setTimeSource(testNowUs, testSleepUs);
+  // blocks of 0.73 ms which can not be represented in ms
+  testLongRun(44100, 32, 2000);
+  testLongRun(96000, 100, 1000);
+  testRestart();
+  AudioClock::instance().setTimeSource(nullptr, nullptr);
+  Serial.println("Throttle ok");
+}
+
+void loop() { stop(); }
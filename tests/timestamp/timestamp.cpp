@@ -0,0 +1,129 @@
+// Tests the propagation of the timestamps through converter -> resampler -> buffer -> output
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+bool near(int64_t value, int64_t expected, int64_t tolerance) {
+  return value >= expected - tolerance && value <= expected + tolerance;
+}
+
+void testTrack() {
+  AudioBaseInfo info;
+  info.sample_rate = 44100;
+  info.channels = 2;
+  info.bits_per_sample = 16;
+  TimestampTrack track;
+  track.setAudioInfo(info);
+  assert(!track.at(0).valid);
+
+  track.mark(0, AudioTimestamp(0, 1000));
+  track.mark(400, AudioTimestamp(5000, 99999));
+  AudioTimestamp ts = track.at(40);
+  assert(ts.valid);
+  assert(ts.frame == 10);
+  assert(ts.clock_us == 1000 + 10 * 1000000 / 44100);
+  ts = track.at(404);
+  assert(ts.frame == 5001);
+  assert(ts.clock_us == 99999 + 1000000 / 44100);
+  // the first mark has been replaced
+  assert(!track.isEmpty());
+  track.clear();
+  assert(track.isEmpty());
+}
+
+void testEmptyRead() {
+  AudioBaseInfo info;
+  info.sample_rate = 44100;
+  info.channels = 2;
+  info.bits_per_sample = 16;
+  RingBufferStream ring(100);
+  ring.setAudioInfo(info);
+  ring.setTimestamp(AudioTimestamp(0, 1000));
+  // reading from an empty buffer must not advance the read position
+  assert(ring.read() == -1);
+  assert(ring.readTimestamp().frame == 0);
+  uint8_t data[8] = {0};
+  ring.write(data, sizeof(data));
+  assert(ring.read() == 0);
+  ring.read();
+  ring.read();
+  assert(ring.readTimestamp().frame == 0);
+  ring.read();
+  assert(ring.readTimestamp().frame == 1);
+}
+
+void testPipeline() {
+  int16_t mono[1000];
+  for (int j = 0; j < 1000; j++) mono[j] = j;
+  int16_t data[512];
+
+  NullStream null_out;
+  TimestampedStream out(null_out);
+  auto cfg = out.defaultConfig();
+  cfg.sample_rate = 22050;
+  cfg.latency_us = 10000;
+  assert(out.begin(cfg));
+  assert(!out.playingTimestamp().valid);
+
+  RingBufferStream ring(20000);
+  ring.setAudioInfo(cfg);
+  ring.setTimestampSink(out);
+  ResampleStream<int16_t> resample(ring);
+  resample.begin(2, 44100, 22050);
+  resample.setTimestampSink(ring);
+  ChannelFormatConverterStreamT<int16_t> converter(resample);
+  converter.begin(1, 2);
+  converter.setTimestampSink(resample);
+
+  // 2 blocks of 1000 frames at 44100: the second timestamp is in the timeline of the input
+  converter.setTimestamp(AudioTimestamp(0, 1000000));
+  converter.write((uint8_t *)mono, sizeof(mono));
+  converter.setTimestamp(AudioTimestamp(1000, 5000000));
+  converter.write((uint8_t *)mono, sizeof(mono));
+
+  // the buffer provides the timestamps in the timeline of the output
+  AudioTimestamp ts = ring.readTimestamp();
+  assert(ts.valid && ts.frame == 0 && ts.clock_us == 1000000);
+
+  size_t total = 0;
+  while (ring.available() > 0) {
+    size_t len = ring.readBytes((uint8_t *)data, sizeof(data));
+    total += out.write((uint8_t *)data, len);
+  }
+  int frames = total / 4;
+  assert(near(frames, 1000, 2));
+
+  // the latency of 10 ms is 220 frames at 22050
+  ts = out.playingTimestamp();
+  assert(ts.valid);
+  assert(near(ts.frame, frames - 220, 3));
+  assert(near(ts.clock_us, 5000000 + (int64_t)(ts.frame - 500) * 1000000 / 22050, 200));
+
+  // capture timestamps
+  RingBufferStream input(4000);
+  input.write((uint8_t *)mono, sizeof(mono));
+  TimestampedStream in(input);
+  cfg.latency_us = 0;
+  in.begin(cfg);
+  RingBufferStream captured(4000);
+  captured.setAudioInfo(cfg);
+  in.setTimestampSink(captured);
+  in.readBytes((uint8_t *)data, 400);
+  ts = in.readTimestamp();
+  assert(ts.valid && ts.frame == 0);
+  in.readBytes((uint8_t *)data, 400);
+  assert(in.readTimestamp().frame == 100);
+  assert(in.readTimestamp().clock_us >= ts.clock_us);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testTrack();
+  testEmptyRead();
+  testPipeline();
+  Serial.println("Timestamp ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,229 @@
+// Tests the persistent connections and the Range requests of the URLStream with a mock Client
+// which serves canned HTTP replies, so that no network is needed
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+const int content_size = 5000;
+int connect_count = 0;
+
+uint8_t contentByte(int pos) { return (pos * 7 + pos / 256) & 0xFF; }
+
+/// Mock Client: generates the reply when the request header is complete
+class MockClient : public Client {
+ public:
+  char host[80] = "";
+  Vector<uint8_t> rx;
+  size_t rx_pos = 0;
+  std::string request;
+  std::string last_request;
+  bool is_connected = false;
+
+  int connect(IPAddress ip, uint16_t port) override { return 0; }
+  int connect(const char *hostPar, uint16_t port) override {
+    strncpy(host, hostPar, sizeof(host));
+    is_connected = true;
+    connect_count++;
+    rx.resize(0);
+    rx_pos = 0;
+    return 1;
+  }
+  size_t write(uint8_t ch) override { return write(&ch, 1); }
+  size_t write(const uint8_t *buf, size_t size) override {
+    request.append((const char *)buf, size);
+    if (request.find("\r\n\r\n") != std::string::npos) {
+      last_request = request;
+      reply(request);
+      request.clear();
+    }
+    return size;
+  }
+  int available() override { return rx.size() - rx_pos; }
+  int read() override { return available() > 0 ? rx[rx_pos++] : -1; }
+  int read(uint8_t *buf, size_t size) override {
+    size_t n = min(size, (size_t)available());
+    memcpy(buf, rx.data() + rx_pos, n);
+    rx_pos += n;
+    return n;
+  }
+  int peek() override { return available() > 0 ? rx[rx_pos] : -1; }
+  void flush() override {}
+  void stop() override {
+    is_connected = false;
+    rx.resize(0);
+    rx_pos = 0;
+  }
+  uint8_t connected() override { return is_connected; }
+  operator bool() override { return true; }
+
+ protected:
+  void add(const char *str) { add((const uint8_t *)str, strlen(str)); }
+  void add(const uint8_t *data, size_t len) {
+    // compact the consumed data
+    if (rx_pos > 0) {
+      Vector<uint8_t> tmp;
+      for (int j = rx_pos; j < rx.size(); j++) tmp.push_back(rx[j]);
+      rx.resize(0);
+      for (int j = 0; j < tmp.size(); j++) rx.push_back(tmp[j]);
+      rx_pos = 0;
+    }
+    for (size_t j = 0; j < len; j++) rx.push_back(data[j]);
+  }
+
+  void reply(std::string &req) {
+    bool head = req.rfind("HEAD", 0) == 0;
+    bool chunked = req.find(" /chunked ") != std::string::npos;
+    bool no_range = req.find(" /norange ") != std::string::npos;
+    long start = 0;
+    size_t range_pos = req.find("Range: bytes=");
+    if (range_pos != std::string::npos && !no_range) start = atol(req.c_str() + range_pos + 13);
+    char header[300];
+    if (chunked) {
+      add("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n");
+      add("5\r\nHello\r\n6\r\n World\r\n0\r\n\r\n");
+      return;
+    }
+    if (start > 0) {
+      snprintf(header, sizeof(header),
+               "HTTP/1.1 206 Partial Content\r\nContent-Length: %ld\r\nContent-Range: bytes %ld-%d/%d\r\n\r\n",
+               content_size - start, start, content_size - 1, content_size);
+    } else {
+      snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nConnection: keep-alive\r\n\r\n",
+               content_size);
+    }
+    add(header);
+    if (head) return;
+    uint8_t body[content_size];
+    for (int j = start; j < content_size; j++) body[j - start] = contentByte(j);
+    add(body, content_size - start);
+  }
+};
+
+/// URLStream which uses mock clients for the connection pool
+class TestURLStream : public URLStream {
+ public:
+  Client *newClient(bool isSecure, WiFiClientSecure *&clientSecure) override { return new MockClient(); }
+};
+
+void readAll(URLStream &url, long start) {
+  uint8_t buffer[700];
+  long pos = start;
+  while (pos < content_size) {
+    size_t n = url.readBytes(buffer, random(1, sizeof(buffer)));
+    assert(n > 0);
+    for (size_t j = 0; j < n; j++) assert(buffer[j] == contentByte(pos + j));
+    pos += n;
+  }
+  assert(url.available() == 0);
+  assert(url.position() == (size_t)content_size);
+}
+
+void testKeepAlive() {
+  MockClient client;
+  URLStream url(client);
+  connect_count = 0;
+  // two requests to the same host share the connection
+  assert(url.begin("http://host1/file", "audio/mp3"));
+  assert(url.size() == content_size);
+  readAll(url, 0);
+  url.end();
+  assert(client.connected());
+  assert(url.begin("http://host1/file", "audio/mp3"));
+  readAll(url, 0);
+  url.end();
+  assert(connect_count == 1);
+  // chunked reply
+  assert(url.begin("http://host1/chunked"));
+  char hello[20] = {0};
+  size_t len = 0;
+  while (len < 11) len += url.readBytes((uint8_t *)hello + len, sizeof(hello) - len);
+  assert(strcmp(hello, "Hello World") == 0);
+  url.end();
+  assert(connect_count == 1);
+  // another host needs a new connection
+  assert(url.begin("http://host2/file"));
+  assert(connect_count == 2);
+  // an incomplete reply closes the connection
+  uint8_t buffer[100];
+  url.readBytes(buffer, sizeof(buffer));
+  url.end();
+  assert(!client.connected());
+  // without keep-alive we close the connection
+  url.setKeepAlive(false);
+  assert(url.begin("http://host2/file"));
+  readAll(url, 0);
+  url.end();
+  assert(!client.connected());
+}
+
+void testRange() {
+  MockClient client;
+  URLStream url(client);
+  assert(url.begin("http://host1/file"));
+  assert(url.read() == contentByte(0));
+  // seek with Range request
+  assert(url.seek(1234));
+  assert(url.httpRequest().isPartialContent());
+  assert(client.last_request.find("Range: bytes=1234-\r\n") != std::string::npos);
+  assert(url.size() == content_size);
+  assert(url.position() == 1234);
+  assert(url.read() == contentByte(1234));
+  assert(url.position() == 1235);
+  readAll(url, 1235);
+  // server which ignores the range: we skip the data
+  assert(url.begin("http://host1/norange"));
+  assert(url.seek(3000));
+  assert(!url.httpRequest().isPartialContent());
+  readAll(url, 3000);
+  url.end();
+}
+
+void testPool() {
+  TestURLStream url;
+  connect_count = 0;
+  assert(url.begin("http://host1/file"));
+  readAll(url, 0);
+  assert(url.begin("http://host2/file"));
+  readAll(url, 0);
+  // both connections are still open
+  assert(url.begin("http://host1/file"));
+  readAll(url, 0);
+  assert(url.begin("http://host2/file"));
+  readAll(url, 0);
+  assert(connect_count == 2);
+  // a third host replaces the least recently used connection (host1)
+  assert(url.begin("http://host3/file"));
+  readAll(url, 0);
+  assert(url.begin("http://host2/file"));
+  readAll(url, 0);
+  assert(connect_count == 3);
+  assert(url.begin("http://host1/file"));
+  readAll(url, 0);
+  assert(connect_count == 4);
+  url.end();
+}
+
+void testCallerConnection() {
+  // a connection which has been opened by the caller is used as is
+  MockClient client;
+  client.connect("host1", 80);
+  connect_count = 0;
+  HttpRequest request(client);
+  Url url("http://host1/file");
+  assert(request.get(url) == 200);
+  assert(connect_count == 0);
+  assert(client.connected());
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Warning);
+  testKeepAlive();
+  testRange();
+  testPool();
+  testCallerConnection();
+  Serial.println("URL pool ok");
+}
+
+void loop() { stop(); }
@@ -0,0 +1,125 @@
+// Tests the xrun accounting of the buffers, the send queue and the jitter buffer and the XRunRegistry
+#include "Arduino.h"
+#include "AudioTools.h"
+
+using namespace audio_tools;
+
+bool sendPacket(const uint8_t *data, size_t len, void *ref) { return true; }
+
+uint8_t data[1000];
+
+// reading from an empty buffer is an underflow if requested, a write which does not fit an overflow
+void testBuffer() {
+  RingBuffer<uint8_t> buffer(100);
+  // polling an empty buffer is not reported by default
+  assert(buffer.readArray(data, 10) == 0);
+  assert(buffer.xrunStats().underflows == 0);
+  buffer.setUnderflowCounting(true);
+  assert(buffer.readArray(data, 10) == 0);
+  assert(buffer.xrunStats().underflows == 1);
+  assert(buffer.readArray(data, 0) == 0);
+  assert(buffer.xrunStats().underflows == 1);
+
+  assert(buffer.writeArray(data, 80) == 80);
+  assert(buffer.xrunStats().overflows == 0);
+  assert(buffer.writeArray(data, 80) == 20);
+  assert(buffer.xrunStats().overflows == 1);
+  // a partial read is not an underflow
+  assert(buffer.readArray(data, 200) == 100);
+  assert(buffer.xrunStats().underflows == 1);
+
+  buffer.resetXRunStats();
+  assert(buffer.xrunStats().xruns() == 0);
+}
+
+// the oldest packets are dropped when the queue is full
+void testSendQueue() {
+  PacketSendQueue queue;
+  auto cfg = queue.defaultConfig();
+  cfg.packet_count = 2;
+  cfg.full_policy = PacketQueueDropOldest;
+  queue.setTransport(sendPacket, nullptr);
+  queue.begin(cfg);
+  // 1 packet in flight, 2 queued and 1 dropped
+  assert(queue.write(data, 1000) == 1000);
+  assert(queue.xrunStats().overflows == 1);
+  assert(queue.xrunStats().dropped_bytes == 250);
+}
+
+// late packets and packets which are removed by an overflow are dropped
+void testJitterBuffer() {
+  JitterBufferStream jitter;
+  auto cfg = jitter.defaultConfig();
+  cfg.packet_size = 100;
+  cfg.max_packets = 4;
+  jitter.begin(cfg);
+  assert(jitter.writePacket(10, data, 100));
+  assert(!jitter.writePacket(9, data, 50));
+  assert(jitter.xrunStats().late_writes == 1);
+  assert(jitter.xrunStats().dropped_bytes == 50);
+  // seq 10 is dropped to make space for seq 14
+  assert(jitter.writePacket(14, data, 100));
+  assert(jitter.xrunStats().overflows == 1);
+  assert(jitter.xrunStats().dropped_bytes == 150);
+}
+
+// a write after the output has played all buffered data is late
+void testLateWrites() {
+  LateWriteDetector detector;
+  // 1 byte per ms with a buffer of 100 bytes
+  detector.begin(1000, 100);
+  assert(!detector.write(200));
+  assert(detector.bufferedBytes() == 100);
+  delay(50);
+  assert(!detector.write(10));
+  assert(detector.bufferedBytes() >= 55 && detector.bufferedBytes() <= 65);
+  delay(100);
+  assert(detector.write(10));
+  assert(detector.bufferedBytes() == 10);
+  // after end() the next write starts a new estimate
+  detector.end();
+  delay(20);
+  assert(!detector.write(10));
+}
+
+void testRegistry() {
+  RingBuffer<uint8_t> in(100);
+  RingBuffer<uint8_t> out(100);
+  in.setUnderflowCounting(true);
+  XRunRegistry &registry = XRunRegistry::instance();
+  assert(registry.add(in, "in"));
+  assert(registry.add(out, "out"));
+  assert(registry.sourceCount() == 2);
+  assert(!registry.hasXRuns());
+
+  in.readArray(data, 10);
+  out.writeArray(data, 200);
+  out.writeArray(data, 10);
+  XRunStats total = registry.total();
+  assert(total.underflows == 1);
+  assert(total.overflows == 2);
+  assert(registry.hasXRuns());
+
+  registry.printTo(Serial);
+  registry.reset();
+  assert(!registry.hasXRuns());
+
+  registry.remove(in);
+  assert(registry.sourceCount() == 1);
+  assert(strcmp(registry.name(0), "out") == 0);
+  registry.clear();
+  assert(registry.sourceCount() == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  AudioLogger::instance().begin(Serial, AudioLogger::Error);
+  testBuffer();
+  testSendQueue();
+  testJitterBuffer();
+  testLateWrites();
+  testRegistry();
+  Serial.println("xrun ok");
+}
+
+void loop() { stop(); }